@@ -0,0 +1,759 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "admittance_controller/admittance_rule_impl.hpp"
+#include "admittance_controller/perf_counters.hpp"
+#include "admittance_joint_limits/admittance_joint_limits.hpp"
+#include "ik_adjoint/adjoint.hpp"
+#include "ik_eigen_interface/ik_eigen_interface.hpp"
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
+#include "ik_singularity/box_qp_solver.hpp"
+#include "mock_ik_plugin.hpp"
+#include "moveit_differential_ik_plugin/moveit_kinematics.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "rl_differential_ik_plugin/rl_kinematics.hpp"
+
+namespace
+{
+
+// Differential IK solver used by a benchmark, selected with its argument
+enum IkSolver : int64_t
+{
+  MOCK_IK = 0,
+  RL_IK = 1,
+  MOVEIT_IK = 2,
+};
+
+const char * ik_solver_label(int64_t solver)
+{
+  return solver == RL_IK ? "rl" : solver == MOVEIT_IK ? "moveit" : "mock";
+}
+
+const std::array<double, 6> JOINT_POSITIONS = {0.0, -1.57, 1.57, -1.57, -1.57, 0.0};
+
+std::shared_ptr<rclcpp_lifecycle::LifecycleNode> make_node()
+{
+  if (!rclcpp::ok()) {
+    rclcpp::init(0, nullptr);
+  }
+  std::ifstream urdf_file(ADMITTANCE_BENCHMARK_URDF);
+  std::stringstream urdf;
+  urdf << urdf_file.rdbuf();
+  std::ifstream srdf_file(ADMITTANCE_BENCHMARK_SRDF);
+  std::stringstream srdf;
+  srdf << srdf_file.rdbuf();
+  auto options = rclcpp::NodeOptions()
+    .automatically_declare_parameters_from_overrides(true)
+    .parameter_overrides({{"robot_description", urdf.str()}, {"robot_description_semantic", srdf.str()}});
+  return std::make_shared<rclcpp_lifecycle::LifecycleNode>("benchmark_admittance", options);
+}
+
+std::unique_ptr<ik_interface::IKBaseClass> make_ik(
+  int64_t solver, const std::shared_ptr<rclcpp_lifecycle::LifecycleNode> & node)
+{
+  std::unique_ptr<ik_interface::IKBaseClass> ik;
+  if (solver == RL_IK) {
+    ik = std::make_unique<rl_differential_ik_plugin::RLKinematics>();
+  } else if (solver == MOVEIT_IK) {
+    ik = std::make_unique<moveit_differential_ik_plugin::RLKinematics>();
+  } else {
+    ik = std::make_unique<admittance_controller_test::MockIKPlugin>();
+  }
+  if (!ik->initialize(node, "ur_manipulator")) {
+    return nullptr;
+  }
+  return ik;
+}
+
+trajectory_msgs::msg::JointTrajectoryPoint make_joint_state()
+{
+  trajectory_msgs::msg::JointTrajectoryPoint point;
+  point.positions.assign(JOINT_POSITIONS.begin(), JOINT_POSITIONS.end());
+  point.velocities.assign(6, 0.01);
+  point.accelerations.assign(6, 0.0);
+  point.effort.assign(6, 0.0);
+  return point;
+}
+
+geometry_msgs::msg::TransformStamped make_transform(
+  const std::string & parent, const std::string & child, const std::array<double, 6> & pose)
+{
+  geometry_msgs::msg::TransformStamped transform;
+  transform.header.frame_id = parent;
+  transform.child_frame_id = child;
+  convert_array_to_message(pose, transform);
+  return transform;
+}
+
+/**
+ * Adds hardware counters (cycles, instructions, cache and branch misses) per iteration to the results of
+ * a benchmark. Construct it right before the timing loop; nothing is reported if perf_event_open is not
+ * permitted.
+ */
+class PerfCounterReport
+{
+public:
+  explicit PerfCounterReport(benchmark::State & state)
+  : state_(state)
+  {
+    if (counters_.open()) {
+      counters_.read(begin_);
+    }
+  }
+
+  ~PerfCounterReport()
+  {
+    admittance_controller::PerfCounterSample end;
+    if (!counters_.read(end)) {
+      return;
+    }
+    report("cycles", end.cycles - begin_.cycles);
+    report("instructions", end.instructions - begin_.instructions);
+    report("cache_misses", end.cache_misses - begin_.cache_misses);
+    report("branch_misses", end.branch_misses - begin_.branch_misses);
+  }
+
+private:
+  void report(const char * name, uint64_t total)
+  {
+    state_.counters[name] = benchmark::Counter(static_cast<double>(total), benchmark::Counter::kAvgIterations);
+  }
+
+  benchmark::State & state_;
+  admittance_controller::PerfCounters counters_;
+  admittance_controller::PerfCounterSample begin_;
+};
+
+/// Gives the benchmarks access to the internals of the rule and sets it up without a running controller
+class BenchmarkAdmittanceRule : public admittance_controller::AdmittanceRule
+{
+public:
+  using AdmittanceRule::calculate_admittance_rule;
+  using AdmittanceRule::transform_relative_to_frame;
+
+  void set_parameters()
+  {
+    parameters_.ik_base_frame_ = "base_link";
+    parameters_.ik_group_name_ = "ur_manipulator";
+    parameters_.control_frame_ = "tool0";
+    parameters_.sensor_frame_ = "ft_sensor";
+    parameters_.open_loop_control_ = false;
+    parameters_.enable_parameter_update_without_reactivation_ = false;
+    parameters_.selected_axes_.fill(true);
+    parameters_.mass_ = {3.0, 3.0, 3.0, 0.05, 0.05, 0.05};
+    parameters_.stiffness_ = {50.0, 50.0, 50.0, 1.0, 1.0, 1.0};
+    parameters_.damping_ratio_.fill(1.0);
+    parameters_.convert_damping_ratio_to_damping();
+  }
+
+  // Static frames of a UR5e holding a force-torque sensor, instead of a running tf tree
+  void add_static_transforms()
+  {
+    tf_buffer_->setTransform(
+      make_transform("base_link", "tool0", {0.49, 0.13, 0.49, 3.14, 0.0, 0.0}), "benchmark", true);
+    tf_buffer_->setTransform(
+      make_transform("tool0", "ft_sensor", {0.0, 0.0, 0.02, 0.0, 0.0, 0.0}), "benchmark", true);
+  }
+};
+
+class AdmittanceRuleBenchmark : public benchmark::Fixture
+{
+public:
+  void SetUp(const benchmark::State & state) override
+  {
+    node_ = make_node();
+    rule_ = std::make_unique<BenchmarkAdmittanceRule>();
+    rule_->set_parameters();
+    if (rule_->configure(node_, make_ik(state.range(0), node_)) != controller_interface::return_type::OK) {
+      rule_.reset();
+      return;
+    }
+    rule_->add_static_transforms();
+    rule_->reset();
+
+    current_joint_state_ = make_joint_state();
+    reference_joint_state_ = make_joint_state();
+    desired_joint_state_ = make_joint_state();
+    measured_wrench_.force.x = 2.0;
+    measured_wrench_.force.z = -5.0;
+    measured_wrench_.torque.y = 0.1;
+    reference_pose_.header.frame_id = "base_link";
+    convert_array_to_message(std::array<double, 6>{0.5, 0.13, 0.5, 3.14, 0.0, 0.0}, reference_pose_);
+    reference_force_.header.frame_id = "base_link";
+    reference_joint_deltas_ = {0.001, 0.0, -0.001, 0.0, 0.002, 0.0};
+  }
+
+  void TearDown(const benchmark::State & /*state*/) override
+  {
+    rule_.reset();
+    node_.reset();
+  }
+
+protected:
+  bool check(benchmark::State & state)
+  {
+    if (!rule_) {
+      state.SkipWithError("Configuring the admittance rule failed");
+      return false;
+    }
+    state.SetLabel(ik_solver_label(state.range(0)));
+    return true;
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<BenchmarkAdmittanceRule> rule_;
+
+  trajectory_msgs::msg::JointTrajectoryPoint current_joint_state_;
+  trajectory_msgs::msg::JointTrajectoryPoint reference_joint_state_;
+  trajectory_msgs::msg::JointTrajectoryPoint desired_joint_state_;
+  geometry_msgs::msg::Wrench measured_wrench_;
+  geometry_msgs::msg::PoseStamped reference_pose_;
+  geometry_msgs::msg::WrenchStamped reference_force_;
+  std::array<double, 6> reference_joint_deltas_;
+  const rclcpp::Duration period_ = rclcpp::Duration::from_seconds(0.002);
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, update_reference_pose)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->update(current_joint_state_, measured_wrench_, reference_pose_, period_, desired_joint_state_);
+    benchmark::DoNotOptimize(desired_joint_state_.positions.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, update_reference_pose)
+->Arg(MOCK_IK)->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, update_reference_joint_deltas)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->update(current_joint_state_, measured_wrench_, reference_joint_deltas_, period_, desired_joint_state_);
+    benchmark::DoNotOptimize(desired_joint_state_.positions.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, update_reference_joint_deltas)
+->Arg(MOCK_IK)->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, update_reference_joint_state)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->update(current_joint_state_, measured_wrench_, reference_joint_state_, period_, desired_joint_state_);
+    benchmark::DoNotOptimize(desired_joint_state_.positions.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, update_reference_joint_state)
+->Arg(MOCK_IK)->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, update_reference_pose_and_force)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->update(
+      current_joint_state_, measured_wrench_, reference_pose_, reference_force_, period_, desired_joint_state_);
+    benchmark::DoNotOptimize(desired_joint_state_.positions.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, update_reference_pose_and_force)->Arg(MOCK_IK);
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, calculate_admittance_rule)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  const std::array<double, 6> wrench = {2.0, 0.0, -5.0, 0.0, 0.1, 0.0};
+  const std::array<double, 6> pose_error = {0.01, -0.002, 0.005, 0.0, 0.01, -0.01};
+  std::array<double, 6> desired_relative_pose;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->calculate_admittance_rule(wrench, pose_error, period_, desired_relative_pose);
+    benchmark::DoNotOptimize(desired_relative_pose.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, calculate_admittance_rule)->Arg(MOCK_IK);
+
+// Second argument is the axis mask: the specialized kernels for all axes, translation and z only, and the generic
+// kernel for x, z and ry
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, calculate_admittance_rule_axes)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  for (auto i = 0u; i < 6; ++i) {
+    rule_->parameters_.selected_axes_[i] = (state.range(1) >> i) & 1;
+  }
+  rule_->publish_parameters();
+  const std::array<double, 6> wrench = {2.0, 0.0, -5.0, 0.0, 0.1, 0.0};
+  const std::array<double, 6> pose_error = {0.01, -0.002, 0.005, 0.0, 0.01, -0.01};
+  std::array<double, 6> desired_relative_pose;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->calculate_admittance_rule(wrench, pose_error, period_, desired_relative_pose);
+    benchmark::DoNotOptimize(desired_relative_pose.data());
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, calculate_admittance_rule_axes)
+->Args({MOCK_IK, 0x3F})->Args({MOCK_IK, 0x07})->Args({MOCK_IK, 0x04})->Args({MOCK_IK, 0x15});
+
+BENCHMARK_DEFINE_F(AdmittanceRuleBenchmark, transform_relative_to_frame)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  auto relative_pose = make_transform("tool0", "tool0", {0.001, 0.002, -0.001, 0.01, 0.0, -0.02});
+  geometry_msgs::msg::TransformStamped relative_pose_base_frame;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    rule_->transform_relative_to_frame(relative_pose, relative_pose_base_frame, "base_link");
+    benchmark::DoNotOptimize(&relative_pose_base_frame);
+  }
+}
+BENCHMARK_REGISTER_F(AdmittanceRuleBenchmark, transform_relative_to_frame)->Arg(MOCK_IK);
+
+template<typename MsgType>
+void message_to_array(benchmark::State & state)
+{
+  MsgType message;
+  convert_array_to_message(std::array<double, 6>{0.5, 0.1, 0.4, 3.0, 0.1, -0.2}, message);
+  std::array<double, 6> array;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&message);
+    convert_message_to_array(message, array);
+    benchmark::DoNotOptimize(array.data());
+  }
+}
+BENCHMARK_TEMPLATE(message_to_array, geometry_msgs::msg::PoseStamped);
+BENCHMARK_TEMPLATE(message_to_array, geometry_msgs::msg::TransformStamped);
+
+void wrench_to_array(benchmark::State & state)
+{
+  geometry_msgs::msg::WrenchStamped message;
+  message.wrench.force.x = 2.0;
+  message.wrench.torque.z = 0.1;
+  std::array<double, 6> array;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(&message);
+    convert_message_to_array(message, array);
+    benchmark::DoNotOptimize(array.data());
+  }
+}
+BENCHMARK(wrench_to_array);
+
+template<typename MsgType>
+void array_to_message(benchmark::State & state)
+{
+  const std::array<double, 6> array = {0.5, 0.1, 0.4, 3.0, 0.1, -0.2};
+  MsgType message;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(array.data());
+    convert_array_to_message(array, message);
+    benchmark::DoNotOptimize(&message);
+  }
+}
+BENCHMARK_TEMPLATE(array_to_message, geometry_msgs::msg::PoseStamped);
+BENCHMARK_TEMPLATE(array_to_message, geometry_msgs::msg::TransformStamped);
+
+void enforce_joint_limits(benchmark::State & state)
+{
+  // Every joint inside its limits, so that all clamps are evaluated without changing the state
+  const auto joints = static_cast<size_t>(state.range(0));
+  admittance_joint_limits::AdmittanceJointLimits limits;
+  limits.configure(std::vector<double>(joints, -3.0), std::vector<double>(joints, 3.0),
+                   std::vector<double>(joints, 2.0), std::vector<double>(joints, 20.0));
+  limits.reset(std::vector<double>(joints, 0.1), std::vector<double>(joints, 0.5));
+  std::vector<double> positions(joints, 0.1);
+  std::vector<double> velocities(joints, 0.5);
+  std::vector<double> accelerations(joints, 1.0);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(positions.data());
+    limits.enforce(positions, velocities, accelerations, 0.001);
+    benchmark::DoNotOptimize(velocities.data());
+  }
+}
+BENCHMARK(enforce_joint_limits)->Arg(6)->Arg(7)->Arg(32);
+
+void solve_box_qp(benchmark::State & state)
+{
+  // Damped least-squares QP of a random Jacobian with tight joint bounds, so that about half of them are active;
+  // the second argument keeps the working set between solves like the IK does between cycles
+  const auto joints = state.range(0);
+  const bool warm_start = state.range(1) != 0;
+  std::srand(1);
+  const Eigen::MatrixXd jacobian = Eigen::MatrixXd::Random(6, joints);
+  const Eigen::MatrixXd hessian = jacobian.transpose() * jacobian + 1e-3 * Eigen::MatrixXd::Identity(joints, joints);
+  const Eigen::VectorXd gradient = -jacobian.transpose() * Eigen::VectorXd::Random(6);
+  const Eigen::VectorXd lower = Eigen::VectorXd::Constant(joints, -0.2);
+  const Eigen::VectorXd upper = Eigen::VectorXd::Constant(joints, 0.2);
+  ik_singularity::BoxQpSolver<8> solver;
+  solver.resize(joints);
+  ik_singularity::BoxQpSolver<8>::Vector solution;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    if (!warm_start) {
+      solver.reset();
+    }
+    solver.solve(hessian, gradient, lower, upper, solution);
+    benchmark::DoNotOptimize(solution.data());
+  }
+}
+BENCHMARK(solve_box_qp)->Args({6, 0})->Args({6, 1})->Args({7, 0})->Args({7, 1});
+
+void transform_twist(benchmark::State & state)
+{
+  // Argument 0: the identity the rule passes; 1: the same transform every call; 2: two transforms alternating in
+  // one cache, which recomputes the adjoint every call
+  geometry_msgs::msg::Transform transforms[2];
+  if (state.range(0) != 0) {
+    transforms[0].translation.x = 0.1;
+    transforms[0].rotation.z = std::sin(0.25);
+    transforms[0].rotation.w = std::cos(0.25);
+    transforms[1] = transforms[0];
+    transforms[1].translation.y = state.range(0) == 2 ? 0.2 : 0.0;
+  }
+  ik_adjoint::AdjointCache cache;
+  Eigen::VectorXd twist = Eigen::VectorXd::Constant(6, 0.01);
+  size_t i = 0;
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    cache.transform_twist(transforms[i++ & 1], twist);
+    benchmark::DoNotOptimize(twist.data());
+  }
+}
+BENCHMARK(transform_twist)->Arg(0)->Arg(1)->Arg(2);
+
+namespace
+{
+
+class RLKinematicsBenchmark : public benchmark::Fixture
+{
+public:
+  void SetUp(const benchmark::State & /*state*/) override
+  {
+    node_ = make_node();
+    ik_ = std::make_unique<rl_differential_ik_plugin::RLKinematics>();
+    if (!ik_->initialize(node_, "ur_manipulator")) {
+      ik_.reset();
+      return;
+    }
+    joint_state_ = make_joint_state();
+    ik_->update_robot_state(joint_state_);
+    identity_transform_.header.frame_id = "base_link";
+    identity_transform_.transform.rotation.w = 1.0;
+  }
+
+  void TearDown(const benchmark::State & /*state*/) override
+  {
+    ik_.reset();
+    node_.reset();
+  }
+
+protected:
+  bool check(benchmark::State & state)
+  {
+    if (!ik_) {
+      state.SkipWithError("Initializing the RL kinematics failed");
+      return false;
+    }
+    return true;
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<rl_differential_ik_plugin::RLKinematics> ik_;
+  trajectory_msgs::msg::JointTrajectoryPoint joint_state_;
+  geometry_msgs::msg::TransformStamped identity_transform_;
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(RLKinematicsBenchmark, update_robot_state)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->update_robot_state(joint_state_);
+  }
+}
+BENCHMARK_REGISTER_F(RLKinematicsBenchmark, update_robot_state);
+
+BENCHMARK_DEFINE_F(RLKinematicsBenchmark, calculate_end_effector_position)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  std::vector<double> end_effector_position(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->calculate_end_effector_position(end_effector_position);
+    benchmark::DoNotOptimize(end_effector_position.data());
+  }
+}
+BENCHMARK_REGISTER_F(RLKinematicsBenchmark, calculate_end_effector_position);
+
+BENCHMARK_DEFINE_F(RLKinematicsBenchmark, convert_cartesian_deltas_to_joint_deltas)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  std::vector<double> delta_x = {0.001, -0.002, 0.001, 0.0, 0.01, 0.0};
+  std::vector<double> delta_theta(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta);
+    benchmark::DoNotOptimize(delta_theta.data());
+  }
+}
+BENCHMARK_REGISTER_F(RLKinematicsBenchmark, convert_cartesian_deltas_to_joint_deltas);
+
+BENCHMARK_DEFINE_F(RLKinematicsBenchmark, convert_joint_deltas_to_cartesian_deltas)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  std::vector<double> delta_theta = {0.001, 0.0, -0.001, 0.0, 0.002, 0.0};
+  std::vector<double> delta_x(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x);
+    benchmark::DoNotOptimize(delta_x.data());
+  }
+}
+BENCHMARK_REGISTER_F(RLKinematicsBenchmark, convert_joint_deltas_to_cartesian_deltas);
+
+namespace
+{
+
+/**
+ * The differential IK backends, selected with the argument, on the same sequence of joint states: the UR5e pose of
+ * the other benchmarks followed by fixed random offsets of up to 0.5 rad, cycled through one state per iteration.
+ */
+class KinematicsBackendBenchmark : public benchmark::Fixture
+{
+public:
+  void SetUp(const benchmark::State & state) override
+  {
+    node_ = make_node();
+    ik_ = make_ik(state.range(0), node_);
+    std::srand(1);
+    joint_states_.assign(16, make_joint_state());
+    for (auto i = 1u; i < joint_states_.size(); ++i) {
+      for (auto & position : joint_states_[i].positions) {
+        position += 0.5 * (2.0 * std::rand() / RAND_MAX - 1.0);
+      }
+    }
+    identity_transform_.header.frame_id = "base_link";
+    identity_transform_.transform.rotation.w = 1.0;
+  }
+
+  void TearDown(const benchmark::State & /*state*/) override
+  {
+    ik_.reset();
+    node_.reset();
+  }
+
+protected:
+  bool check(benchmark::State & state)
+  {
+    if (!ik_) {
+      state.SkipWithError("Initializing the kinematics failed");
+      return false;
+    }
+    state.SetLabel(ik_solver_label(state.range(0)));
+    return true;
+  }
+
+  const trajectory_msgs::msg::JointTrajectoryPoint & next_joint_state()
+  {
+    next_ = (next_ + 1) % joint_states_.size();
+    return joint_states_[next_];
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<ik_interface::IKBaseClass> ik_;
+  std::vector<trajectory_msgs::msg::JointTrajectoryPoint> joint_states_;
+  size_t next_ = 0;
+  geometry_msgs::msg::TransformStamped identity_transform_;
+};
+
+}  // namespace
+
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, update_robot_state)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->update_robot_state(next_joint_state());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, update_robot_state)->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+// A control cycle of the rule: new state, then the conversion
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, update_and_convert_cartesian_deltas_to_joint_deltas)(
+  benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  std::vector<double> delta_x = {0.001, -0.002, 0.001, 0.0, 0.01, 0.0};
+  std::vector<double> delta_theta(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->update_robot_state(next_joint_state());
+    ik_->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta);
+    benchmark::DoNotOptimize(delta_theta.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, update_and_convert_cartesian_deltas_to_joint_deltas)
+->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, convert_cartesian_deltas_to_joint_deltas)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  ik_->update_robot_state(joint_states_[1]);
+  std::vector<double> delta_x = {0.001, -0.002, 0.001, 0.0, 0.01, 0.0};
+  std::vector<double> delta_theta(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta);
+    benchmark::DoNotOptimize(delta_theta.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, convert_cartesian_deltas_to_joint_deltas)
+->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, convert_joint_deltas_to_cartesian_deltas)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  ik_->update_robot_state(joint_states_[1]);
+  std::vector<double> delta_theta = {0.001, 0.0, -0.001, 0.0, 0.002, 0.0};
+  std::vector<double> delta_x(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    ik_->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x);
+    benchmark::DoNotOptimize(delta_x.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, convert_joint_deltas_to_cartesian_deltas)
+->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+// The same conversions on caller-owned Eigen buffers, without the std::vector copies
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, convert_cartesian_deltas_to_joint_deltas_eigen)(
+  benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  auto eigen_ik = ik_eigen_interface::get_eigen_interface(ik_.get());
+  ik_->update_robot_state(joint_states_[1]);
+  Eigen::VectorXd delta_x(6);
+  delta_x << 0.001, -0.002, 0.001, 0.0, 0.01, 0.0;
+  Eigen::VectorXd delta_theta(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    eigen_ik->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta);
+    benchmark::DoNotOptimize(delta_theta.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, convert_cartesian_deltas_to_joint_deltas_eigen)
+->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+// The kinematics of a joint-reference cycle of the rule: reference and current state in their own contexts. The
+// reference holds still, as between trajectory points, so only the current state is recomputed.
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, reference_and_current_contexts)(benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  using ik_kinematic_contexts::KinematicContext;
+  auto contexts = ik_kinematic_contexts::get_context_interface(ik_.get());
+  const auto reference = joint_states_[0];
+  std::vector<double> end_effector_position(6);
+  std::vector<double> delta_theta = {0.001, 0.0, -0.001, 0.0, 0.002, 0.0};
+  std::vector<double> delta_x = {0.001, -0.002, 0.001, 0.0, 0.01, 0.0};
+  std::vector<double> result(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    contexts->select_kinematic_context(KinematicContext::REFERENCE);
+    ik_->update_robot_state(reference);
+    ik_->calculate_end_effector_position(end_effector_position);
+    ik_->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, result);
+    contexts->select_kinematic_context(KinematicContext::CURRENT);
+    ik_->update_robot_state(next_joint_state());
+    ik_->calculate_end_effector_position(end_effector_position);
+    ik_->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, result);
+    benchmark::DoNotOptimize(result.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, reference_and_current_contexts)->Arg(RL_IK)->Arg(MOVEIT_IK);
+
+BENCHMARK_DEFINE_F(KinematicsBackendBenchmark, convert_joint_deltas_to_cartesian_deltas_eigen)(
+  benchmark::State & state)
+{
+  if (!check(state)) {
+    return;
+  }
+  auto eigen_ik = ik_eigen_interface::get_eigen_interface(ik_.get());
+  ik_->update_robot_state(joint_states_[1]);
+  Eigen::VectorXd delta_theta(6);
+  delta_theta << 0.001, 0.0, -0.001, 0.0, 0.002, 0.0;
+  Eigen::VectorXd delta_x(6);
+  PerfCounterReport report(state);
+  for (auto _ : state) {
+    eigen_ik->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x);
+    benchmark::DoNotOptimize(delta_x.data());
+  }
+}
+BENCHMARK_REGISTER_F(KinematicsBackendBenchmark, convert_joint_deltas_to_cartesian_deltas_eigen)
+->Arg(RL_IK)->Arg(MOVEIT_IK);
@@ -0,0 +1,117 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "closed_loop_sim.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace
+{
+
+void print_usage(const char * program)
+{
+  std::fprintf(
+    stderr,
+    "Usage: %s [options]\n"
+    "Runs the admittance controller against simulated joints and a scripted F/T sensor.\n\n"
+    "  --rate HZ               update rate, up to 10000 (default 1000)\n"
+    "  --duration S            simulated duration (default 10)\n"
+    "  --realtime              sleep until every cycle's deadline instead of running as fast as possible\n"
+    "  --plant-time-constant S first-order lag of the simulated joints (default 0.005)\n"
+    "  --wrench-script FILE    CSV with time,fx,fy,fz,tx,ty,tz keyframes (default: built-in push/pull script)\n"
+    "  --robot-description F   URDF of the robot (default: UR5e test model)\n"
+    "  --ik-plugin NAME        differential IK plugin (default rl_differential_ik_plugin/RLKinematics)\n"
+    "  --max-p999-us US        fail if the p99.9 update latency exceeds this value\n",
+    program);
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  admittance_controller_test::ClosedLoopSimOptions options;
+  std::string robot_description_path = ADMITTANCE_BENCHMARK_URDF;
+  double max_p999_us = 0.0;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--realtime") {
+      options.realtime = true;
+    } else if (arg == "--rate" && has_value) {
+      options.rate = std::atof(argv[++i]);
+    } else if (arg == "--duration" && has_value) {
+      options.duration = std::atof(argv[++i]);
+    } else if (arg == "--plant-time-constant" && has_value) {
+      options.plant_time_constant = std::atof(argv[++i]);
+    } else if (arg == "--wrench-script" && has_value) {
+      std::string error;
+      if (!admittance_controller_test::load_wrench_script(argv[++i], options.wrench_script, error)) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+      }
+    } else if (arg == "--robot-description" && has_value) {
+      robot_description_path = argv[++i];
+    } else if (arg == "--ik-plugin" && has_value) {
+      options.ik_plugin_name = argv[++i];
+    } else if (arg == "--max-p999-us" && has_value) {
+      max_p999_us = std::atof(argv[++i]);
+    } else {
+      print_usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+
+  std::ifstream urdf_file(robot_description_path);
+  if (!urdf_file) {
+    std::fprintf(stderr, "Could not open robot description '%s'\n", robot_description_path.c_str());
+    return 1;
+  }
+  std::stringstream urdf;
+  urdf << urdf_file.rdbuf();
+  options.robot_description = urdf.str();
+
+  int ret = 0;
+  {
+    admittance_controller_test::ClosedLoopSim sim(options);
+    std::string error;
+    if (!sim.setup(error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      ret = 1;
+    } else {
+      if (!sim.run()) {
+        ret = 1;
+      }
+      sim.print_report(std::cout);
+      const double p999_us = sim.update_latency().percentile(99.9) * 1e-3;
+      if (max_p999_us > 0.0 && p999_us > max_p999_us) {
+        std::fprintf(stderr, "p99.9 update latency %.2f us exceeds %.2f us\n", p999_us, max_p999_us);
+        ret = 1;
+      }
+    }
+  }
+  if (rclcpp::ok()) {
+    rclcpp::shutdown();
+  }
+  return ret;
+}
@@ -0,0 +1,333 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "closed_loop_sim.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "soak_monitor.hpp"
+
+// Heap allocations of the calling thread, so allocations of the update can be told apart from other threads
+namespace
+{
+thread_local uint64_t thread_allocations = 0;
+}  // namespace
+
+void * operator new(std::size_t size)
+{
+  ++thread_allocations;
+  if (void * ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+  return ::operator new(size);
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace
+{
+
+struct SoakOptions
+{
+  uint64_t cycles = 200000000;
+  uint64_t window_cycles = 1000000;
+  // A new random trajectory segment and contact are generated with this period, in simulated seconds
+  double segment_duration = 5.0;
+  // Largest deviation of random waypoints from the initial positions in rad
+  double amplitude = 0.3;
+  double max_force = 20.0;
+  double max_torque = 2.0;
+  unsigned int seed = 42;
+  std::string csv_path;
+};
+
+void print_usage(const char * program)
+{
+  std::fprintf(
+    stderr,
+    "Usage: %s [options]\n"
+    "Drives the admittance controller against simulated joints with randomized trajectories and wrenches and\n"
+    "fails if memory grows or the update latency drifts.\n\n"
+    "  --cycles N              number of update cycles (default 200000000)\n"
+    "  --window N              cycles per reported window (default 1000000)\n"
+    "  --rate HZ               update rate, up to 10000 (default 1000)\n"
+    "  --segment-duration S    simulated duration of each random trajectory and contact, >= 0.5 (default 5)\n"
+    "  --amplitude RAD         largest deviation of random waypoints from the initial positions (default 0.3)\n"
+    "  --max-force N           largest random force per axis (default 20)\n"
+    "  --max-torque NM         largest random torque per axis (default 2)\n"
+    "  --seed N                seed of the random scenario (default 42)\n"
+    "  --csv FILE              write the statistics of every window to a CSV file\n"
+    "  --robot-description F   URDF of the robot (default: UR5e test model)\n"
+    "  --ik-plugin NAME        differential IK plugin (default rl_differential_ik_plugin/RLKinematics)\n"
+    "  --warmup-windows N      windows ignored by the checks (default 2)\n"
+    "  --max-rss-growth-mb MB  allowed RSS growth after warm-up (default 8)\n"
+    "  --max-p999-drift F      allowed relative growth of the p99.9 update latency (default 0.5)\n"
+    "  --max-allocations-per-cycle N  fail if an update window allocates more often (default: off)\n"
+    "  --max-integrator X      fail if the integrators of the rule exceed this magnitude (default: off)\n",
+    program);
+}
+
+/// Random motion between waypoints around the initial positions, blended with a half cosine
+std::shared_ptr<trajectory_msgs::msg::JointTrajectory> random_trajectory(
+  const admittance_controller_test::ClosedLoopSimOptions & sim_options, double duration, double amplitude,
+  std::mt19937 & generator, std::vector<double> & waypoint)
+{
+  std::uniform_real_distribution<double> offset(-amplitude, amplitude);
+  const auto start = waypoint;
+  for (size_t i = 0; i < waypoint.size(); ++i) {
+    waypoint[i] = sim_options.initial_positions[i] + offset(generator);
+  }
+
+  auto trajectory = std::make_shared<trajectory_msgs::msg::JointTrajectory>();
+  trajectory->joint_names = sim_options.joint_names;
+  const double step = 0.05;
+  for (double t = step; t <= duration + 1e-9; t += step) {
+    const double s = 0.5 * (1.0 - std::cos(M_PI * t / duration));
+    const double ds = 0.5 * M_PI / duration * std::sin(M_PI * t / duration);
+    trajectory_msgs::msg::JointTrajectoryPoint point;
+    point.positions.resize(waypoint.size());
+    point.velocities.resize(waypoint.size());
+    for (size_t i = 0; i < waypoint.size(); ++i) {
+      point.positions[i] = start[i] + s * (waypoint[i] - start[i]);
+      point.velocities[i] = ds * (waypoint[i] - start[i]);
+    }
+    point.time_from_start = rclcpp::Duration::from_seconds(t);
+    trajectory->points.push_back(point);
+  }
+  return trajectory;
+}
+
+/// One contact of random direction, strength and length within [start, start + duration]
+std::vector<admittance_controller_test::WrenchKeyframe> random_contact(
+  double start, double duration, const SoakOptions & options, std::mt19937 & generator)
+{
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::uniform_real_distribution<double> force(-options.max_force, options.max_force);
+  std::uniform_real_distribution<double> torque(-options.max_torque, options.max_torque);
+
+  std::array<double, 6> wrench;
+  for (size_t i = 0; i < wrench.size(); ++i) {
+    wrench[i] = i < 3 ? force(generator) : torque(generator);
+  }
+  const double ramp = 0.05;
+  const double contact_start = start + ramp + unit(generator) * 0.5 * duration;
+  const double contact_end =
+    contact_start + 2.0 * ramp + unit(generator) * (start + duration - contact_start - 3.0 * ramp);
+  const std::array<double, 6> zero{};
+  return {
+    {start, zero},
+    {contact_start, zero},
+    {contact_start + ramp, wrench},
+    {contact_end - ramp, wrench},
+    {contact_end, zero},
+  };
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  admittance_controller_test::ClosedLoopSimOptions sim_options;
+  admittance_controller_test::SoakLimits limits;
+  SoakOptions options;
+  std::string robot_description_path = ADMITTANCE_BENCHMARK_URDF;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--cycles" && has_value) {
+      options.cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--window" && has_value) {
+      options.window_cycles = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--rate" && has_value) {
+      sim_options.rate = std::atof(argv[++i]);
+    } else if (arg == "--segment-duration" && has_value) {
+      options.segment_duration = std::atof(argv[++i]);
+    } else if (arg == "--amplitude" && has_value) {
+      options.amplitude = std::atof(argv[++i]);
+    } else if (arg == "--max-force" && has_value) {
+      options.max_force = std::atof(argv[++i]);
+    } else if (arg == "--max-torque" && has_value) {
+      options.max_torque = std::atof(argv[++i]);
+    } else if (arg == "--seed" && has_value) {
+      options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--csv" && has_value) {
+      options.csv_path = argv[++i];
+    } else if (arg == "--robot-description" && has_value) {
+      robot_description_path = argv[++i];
+    } else if (arg == "--ik-plugin" && has_value) {
+      sim_options.ik_plugin_name = argv[++i];
+    } else if (arg == "--warmup-windows" && has_value) {
+      limits.warmup_windows = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--max-rss-growth-mb" && has_value) {
+      limits.max_rss_growth_bytes = std::atof(argv[++i]) * 1024.0 * 1024.0;
+    } else if (arg == "--max-p999-drift" && has_value) {
+      limits.max_p999_drift = std::atof(argv[++i]);
+    } else if (arg == "--max-allocations-per-cycle" && has_value) {
+      limits.max_allocations_per_cycle = std::atof(argv[++i]);
+    } else if (arg == "--max-integrator" && has_value) {
+      limits.max_integrator = std::atof(argv[++i]);
+    } else {
+      print_usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (options.window_cycles == 0 || options.segment_duration < 0.5) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::ifstream urdf_file(robot_description_path);
+  if (!urdf_file) {
+    std::fprintf(stderr, "Could not open robot description '%s'\n", robot_description_path.c_str());
+    return 1;
+  }
+  std::stringstream urdf;
+  urdf << urdf_file.rdbuf();
+  sim_options.robot_description = urdf.str();
+  // The initial trajectory is replaced by the first random segment
+  sim_options.duration = options.segment_duration;
+  sim_options.wrench_script.clear();
+
+  std::ofstream csv;
+  if (!options.csv_path.empty()) {
+    csv.open(options.csv_path);
+    if (!csv) {
+      std::fprintf(stderr, "Could not open '%s' for writing\n", options.csv_path.c_str());
+      return 1;
+    }
+    admittance_controller_test::SoakMonitor::print_header(csv);
+  }
+
+  int ret = 0;
+  {
+    admittance_controller_test::ClosedLoopSim sim(sim_options);
+    std::string error;
+    if (!sim.setup(error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      ret = 1;
+    } else {
+      std::mt19937 generator(options.seed);
+      std::vector<double> waypoint = sim_options.initial_positions;
+      admittance_controller_test::SoakMonitor monitor(limits);
+      admittance_controller::LatencyHistogram window_latency;
+      admittance_controller_test::SoakWindow window;
+      uint64_t window_allocations = 0;
+      uint64_t window_start = 0;
+      double next_segment = 0.0;
+
+      std::cout << "Soak: " << options.cycles << " cycles at " << sim_options.rate << " Hz, windows of "
+                << options.window_cycles << " cycles, seed " << options.seed << "\n";
+      admittance_controller_test::SoakMonitor::print_header(std::cout);
+
+      sim.start_run();
+      for (uint64_t cycle = 0; cycle < options.cycles; ++cycle) {
+        if (sim.time() >= next_segment) {
+          sim.send_trajectory(
+            random_trajectory(sim_options, options.segment_duration, options.amplitude, generator, waypoint));
+          sim.set_wrench_script(random_contact(next_segment, options.segment_duration, options, generator));
+          next_segment += options.segment_duration;
+        }
+
+        const uint64_t allocations_before = thread_allocations;
+        window_latency.record(sim.step());
+        window_allocations += thread_allocations - allocations_before;
+
+        const auto & rule = sim.controller().rule();
+        for (const auto value : rule.get_sum_of_admittance_displacements()) {
+          window.max_displacement_sum = std::max(window.max_displacement_sum, std::fabs(value));
+        }
+        for (const auto value : rule.get_joint_position_offsets()) {
+          window.max_joint_offset = std::max(window.max_joint_offset, std::fabs(value));
+        }
+
+        if (cycle + 1 - window_start == options.window_cycles || cycle + 1 == options.cycles) {
+          const uint64_t window_cycles = cycle + 1 - window_start;
+          window.cycles = cycle + 1;
+          window.sim_time = sim.time();
+          window.rss_bytes = admittance_controller_test::resident_set_size();
+          window.allocations_per_cycle = static_cast<double>(window_allocations) / window_cycles;
+          window.p50_us = window_latency.percentile(50.0) * 1e-3;
+          window.p99_us = window_latency.percentile(99.0) * 1e-3;
+          window.p999_us = window_latency.percentile(99.9) * 1e-3;
+          window.max_us = window_latency.max() * 1e-3;
+          monitor.add_window(window);
+          admittance_controller_test::SoakMonitor::print_window(std::cout, window);
+          if (csv.is_open()) {
+            admittance_controller_test::SoakMonitor::print_window(csv, window);
+          }
+
+          window = admittance_controller_test::SoakWindow();
+          window_latency.reset();
+          window_allocations = 0;
+          window_start = cycle + 1;
+        }
+      }
+
+      std::cout << "\n";
+      sim.print_report(std::cout);
+      if (sim.result().update_errors > 0) {
+        std::fprintf(stderr, "%zu updates failed\n", sim.result().update_errors);
+        ret = 1;
+      }
+      if (!monitor.evaluate()) {
+        for (const auto & failure : monitor.failures()) {
+          std::fprintf(stderr, "%s\n", failure.c_str());
+        }
+        ret = 1;
+      }
+    }
+  }
+  if (rclcpp::ok()) {
+    rclcpp::shutdown();
+  }
+  return ret;
+}
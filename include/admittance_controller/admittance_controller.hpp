@@ -23,9 +23,17 @@
 #include <vector>
 
 #include "admittance_controller/admittance_rule.hpp"
+#include "admittance_controller/contact_event_capture.hpp"
+#include "admittance_controller/cycle_timing.hpp"
+#include "admittance_controller/flight_recorder.hpp"
+#include "admittance_controller/msg/admittance_controller_compact_state.hpp"
+#include "admittance_controller/msg/admittance_controller_state_metadata.hpp"
+#include "admittance_controller/srv/select_admittance_profile.hpp"
 #include "admittance_controller/visibility_control.h"
+#include "admittance_joint_limits/admittance_joint_limits.hpp"
 #include "control_msgs/msg/admittance_controller_state.hpp"
 #include "controller_interface/controller_interface.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "geometry_msgs/msg/pose_stamped.hpp"
 #include "geometry_msgs/msg/transform_stamped.hpp"
 #include "geometry_msgs/msg/wrench_stamped.hpp"
@@ -38,6 +46,7 @@
 #include "realtime_tools/realtime_buffer.h"
 #include "realtime_tools/realtime_publisher.h"
 #include "semantic_components/force_torque_sensor.hpp"
+#include "std_srvs/srv/trigger.hpp"
 #include "rclcpp/time.hpp"
 #include "rclcpp/duration.hpp"
 #include "joint_trajectory_controller/trajectory_execution_impl.hpp"
@@ -55,6 +64,9 @@ namespace admittance_controller
 {
     using RealtimeGoalHandle = realtime_tools::RealtimeServerGoalHandle<control_msgs::action::FollowJointTrajectory>;
     using ControllerStateMsg = control_msgs::msg::AdmittanceControllerState;
+    using ControllerCompactStateMsg = admittance_controller::msg::AdmittanceControllerCompactState;
+    using ControllerStateMetadataMsg = admittance_controller::msg::AdmittanceControllerStateMetadata;
+    using SelectAdmittanceProfileSrv = admittance_controller::srv::SelectAdmittanceProfile;
 
     struct RTBuffers{
         realtime_tools::RealtimeBuffer<std::shared_ptr<trajectory_msgs::msg::JointTrajectory>> input_traj_command;
@@ -62,6 +74,7 @@ namespace admittance_controller
         realtime_tools::RealtimeBuffer<std::shared_ptr<geometry_msgs::msg::PoseStamped>> input_pose_command_;
         std::shared_ptr<RealtimeGoalHandle> rt_active_goal_;
         std::unique_ptr<realtime_tools::RealtimePublisher<ControllerStateMsg>> state_publisher_;
+        std::unique_ptr<realtime_tools::RealtimePublisher<ControllerCompactStateMsg>> compact_state_publisher_;
     };
 
 using CallbackReturn = rclcpp_lifecycle::node_interfaces::LifecycleNodeInterface::CallbackReturn;
@@ -116,24 +129,42 @@ protected:
     std::vector<std::reference_wrapper<hardware_interface::LoanedStateInterface>> joint_acceleration_state_interface_;
     // Admittance rule and dependent variables;
     std::unique_ptr<admittance_controller::AdmittanceRule> admittance_;
-    // joint limiter
-    using JointLimiter = joint_limits_interface::PositionJointSaturationHandle;
-    std::shared_ptr<pluginlib::ClassLoader<JointLimiter>> joint_limiter_loader_;
-    std::unique_ptr<JointLimiter> joint_limiter_;
+    // Applies admittance gain changes outside of the update loop
+    rclcpp::node_interfaces::OnSetParametersCallbackHandle::SharedPtr on_set_callback_handle_;
+    // joint limits from the URDF, enforced on the desired state every cycle
+    admittance_joint_limits::AdmittanceJointLimits joint_limits_;
     std::unique_ptr<semantic_components::ForceTorqueSensor> force_torque_sensor_;
     // controller parameters filled by ROS
     std::string ft_sensor_name_;
     bool use_joint_commands_as_input_{};
     std::string joint_limiter_type_;
+    bool joint_limits_enable_{};
     bool allow_partial_joints_goal_{};
     bool allow_integration_in_goal_trajectories_{};
     double action_monitor_rate{};
     bool open_loop_control_;
+    bool publish_state_{};
+    bool publish_compact_state_{};
+    bool flight_recorder_enable_{};
+    std::string flight_recorder_path_;
+    bool flight_recorder_delta_compression_{};
+    int64_t flight_recorder_buffer_size_{};
+    bool contact_capture_enable_{};
+    ContactEventCaptureOptions contact_capture_options_;
+    bool cycle_timing_enable_{};
+    double cycle_timing_publish_rate_{};
+    bool cycle_timing_perf_counters_{};
+    double profile_transition_duration_{};
     // ROS subscribers
 //    rclcpp::Subscription<trajectory_msgs::msg::JointTrajectory>::SharedPtr input_joint_command_subscriber_ = nullptr;
     rclcpp::Subscription<geometry_msgs::msg::WrenchStamped>::SharedPtr input_wrench_command_subscriber_ = nullptr;
     rclcpp::Subscription<geometry_msgs::msg::PoseStamped>::SharedPtr input_pose_command_subscriber_ = nullptr;
     rclcpp::Publisher<control_msgs::msg::AdmittanceControllerState>::SharedPtr  s_publisher_ = nullptr;
+    rclcpp::Publisher<ControllerCompactStateMsg>::SharedPtr compact_state_publisher_ = nullptr;
+    rclcpp::Publisher<ControllerStateMetadataMsg>::SharedPtr state_metadata_publisher_ = nullptr;
+    rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr cycle_timing_publisher_ = nullptr;
+    rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr reset_cycle_timing_service_ = nullptr;
+    rclcpp::Service<SelectAdmittanceProfileSrv>::SharedPtr select_admittance_profile_service_ = nullptr;
     // ROS messages
     std::shared_ptr<trajectory_msgs::msg::JointTrajectory> traj_command_msg;
     std::shared_ptr<geometry_msgs::msg::WrenchStamped> wrench_msg;
@@ -164,14 +195,33 @@ protected:
     trajectory_msgs::msg::JointTrajectoryPoint state_reference, state_current, state_desired,
             state_error;
     trajectory_msgs::msg::JointTrajectory pre_admittance_point;
+    // full-rate recording of the control loop
+    FlightRecorder flight_recorder_;
+    // pre-trigger capture of contact events
+    ContactEventCapture contact_event_capture_;
+    CycleRecord cycle_record_{};
+    int64_t cycle_index_ = 0;
+    // latency histograms of the update phases
+    CycleTimer cycle_timer_;
+    // hardware counters of the update thread in benchmark mode
+    PerfCounters perf_counters_;
+    bool perf_counters_failed_{};
     // held references
     rclcpp::TimerBase::SharedPtr goal_handle_timer_;
+    rclcpp::TimerBase::SharedPtr cycle_timing_timer_;
     // helper methods
     void joint_trajectory_callback(const std::shared_ptr<trajectory_msgs::msg::JointTrajectory> msg);
     void wrench_stamped_callback(const std::shared_ptr<geometry_msgs::msg::WrenchStamped> msg);
     void pose_stamped_callback(const std::shared_ptr<geometry_msgs::msg::PoseStamped> msg);
     void read_state_from_hardware(trajectory_msgs::msg::JointTrajectoryPoint & state);
     void read_state_from_command_interfaces(trajectory_msgs::msg::JointTrajectoryPoint & state);
+    void fill_cycle_record(const rclcpp::Time & time, const rclcpp::Duration & period,
+                           const geometry_msgs::msg::Wrench & measured_wrench,
+                           std::chrono::steady_clock::time_point update_start, CycleRecord & record);
+    void fill_compact_state(const rclcpp::Time & time, const rclcpp::Duration & period,
+                            ControllerCompactStateMsg & msg);
+    void publish_cycle_timing();
+    bool configure_admittance_profiles();
     bool get_string_array_param_and_error_if_empty(std::vector<std::string> & parameter, const char * parameter_name);
     bool get_string_param_and_error_if_empty(std::string & parameter, const char * parameter_name);
     bool get_bool_param_and_error_if_empty (bool & parameter, const char * parameter_name);
@@ -0,0 +1,238 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__ADMITTANCE_PROFILES_HPP_
+#define ADMITTANCE_CONTROLLER__ADMITTANCE_PROFILES_HPP_
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/snapshot_buffer.hpp"
+
+namespace admittance_controller
+{
+
+/**
+ * Immutable admittance gains read by the update loop. Built outside of the realtime loop, so damping is already
+ * resolved from the damping ratio and the mass is inverted. A default snapshot has no selected axes.
+ */
+struct AdmittanceParameterSnapshot
+{
+  std::array<bool, 6> selected_axes;
+  // selected_axes as bits, bit i for axis i of [x, y, z, rx, ry, rz]
+  uint8_t axis_mask;
+  std::array<double, 6> inverse_mass;
+  std::array<double, 6> damping;
+  std::array<double, 6> stiffness;
+};
+
+// Axis masks the admittance rule has a specialized kernel for
+constexpr uint8_t ALL_AXES_MASK = 0x3F;
+constexpr uint8_t TRANSLATION_AXES_MASK = 0x07;
+constexpr uint8_t Z_AXIS_MASK = 0x04;
+
+inline bool admittance_axis_gains_valid(double mass, double damping, double stiffness)
+{
+  return mass > 0.0 && std::isfinite(mass) && std::isfinite(1.0 / mass) && std::isfinite(damping) &&
+         std::isfinite(stiffness);
+}
+
+/**
+ * Build a gain snapshot. Unselected axes get zero gains, so they blend smoothly with a selected axis.
+ *
+ * \return false if a selected axis has a non-positive mass or a gain that is not finite
+ */
+inline bool make_parameter_snapshot(
+  const std::array<bool, 6> & selected_axes, const std::array<double, 6> & mass,
+  const std::array<double, 6> & damping, const std::array<double, 6> & stiffness,
+  AdmittanceParameterSnapshot & snapshot)
+{
+  bool ret = true;
+  snapshot.axis_mask = 0;
+  for (size_t i = 0; i < 6; ++i) {
+    snapshot.selected_axes[i] = selected_axes[i];
+    if (selected_axes[i]) {
+      snapshot.axis_mask |= static_cast<uint8_t>(1u << i);
+      snapshot.inverse_mass[i] = 1.0 / mass[i];
+      snapshot.damping[i] = damping[i];
+      snapshot.stiffness[i] = stiffness[i];
+      ret = ret && admittance_axis_gains_valid(mass[i], damping[i], stiffness[i]);
+    } else {
+      snapshot.inverse_mass[i] = 0.0;
+      snapshot.damping[i] = 0.0;
+      snapshot.stiffness[i] = 0.0;
+    }
+  }
+  return ret;
+}
+
+/**
+ * Named gain sets loaded at configure time, e.g. for free-space transport, insertion and hand-guiding.
+ * Switching is requested from any non-realtime thread and taken over by the update loop in constant time;
+ * with a transition duration the gains are interpolated linearly (the mass as inverse mass) and the union
+ * of the selected axes of both profiles stays active until the transition is finished.
+ */
+class AdmittanceProfiles
+{
+public:
+  enum : int
+  {
+    NOT_FOUND = -2,
+    // Index of the gains published from the 'admittance.*' parameters
+    PARAMETERS = -1,
+  };
+
+  AdmittanceProfiles()
+  {
+    request(PARAMETERS, 0.0);
+    reset();
+  }
+
+  /// Not realtime safe. Replaces all profiles and selects the parameter gains.
+  void configure(
+    const std::vector<std::string> & names, const std::vector<AdmittanceParameterSnapshot> & profiles)
+  {
+    names_ = names;
+    profiles_ = profiles;
+    request(PARAMETERS, 0.0);
+    reset();
+  }
+
+  size_t size() const {return profiles_.size();}
+
+  /// Index of a profile, PARAMETERS for an empty name
+  int find(const std::string & name) const
+  {
+    if (name.empty()) {
+      return PARAMETERS;
+    }
+    for (size_t i = 0; i < names_.size(); ++i) {
+      if (names_[i] == name) {
+        return static_cast<int>(i);
+      }
+    }
+    return NOT_FOUND;
+  }
+
+  /**
+   * Request a switch, taken over by the next update(). Only one thread may request.
+   *
+   * \param[in] index profile index or PARAMETERS
+   * \param[in] transition_duration seconds to interpolate the gains, <= 0 to switch at once
+   * \return false if the index is out of range
+   */
+  bool request(int index, double transition_duration)
+  {
+    if (index < PARAMETERS || index >= static_cast<int>(profiles_.size())) {
+      return false;
+    }
+    ProfileRequest next;
+    next.sequence = ++request_sequence_;
+    next.index = index;
+    next.transition_duration = transition_duration;
+    requests_.write(next);
+    return true;
+  }
+
+  /// Realtime. Take over the last request without transition, e.g. on activation.
+  void reset()
+  {
+    const auto & request = requests_.read();
+    handled_sequence_ = request.sequence;
+    active_ = request.index;
+    transition_duration_ = 0.0;
+  }
+
+  /// Profile the update loop uses or moves to
+  int active() const {return active_;}
+
+  bool in_transition() const {return transition_duration_ > 0.0;}
+
+  /**
+   * Realtime. Gains for this cycle; does not allocate.
+   *
+   * \param[in] parameters gains published from the parameters, used for PARAMETERS
+   * \param[in] dt seconds since the last cycle, advances a transition
+   * \return reference valid until the next call
+   */
+  const AdmittanceParameterSnapshot & update(const AdmittanceParameterSnapshot & parameters, double dt)
+  {
+    const auto & request = requests_.read();
+    if (request.sequence != handled_sequence_) {
+      handled_sequence_ = request.sequence;
+      // An interrupted transition continues from the gains used in the last cycle
+      from_ = in_transition() ? blended_ : gains(active_, parameters);
+      active_ = request.index;
+      elapsed_ = 0.0;
+      transition_duration_ = request.transition_duration > 0.0 ? request.transition_duration : 0.0;
+    }
+
+    const auto & to = gains(active_, parameters);
+    if (!in_transition()) {
+      return to;
+    }
+    elapsed_ += dt;
+    if (elapsed_ >= transition_duration_) {
+      transition_duration_ = 0.0;
+      return to;
+    }
+
+    const double alpha = elapsed_ / transition_duration_;
+    blended_.axis_mask = static_cast<uint8_t>(from_.axis_mask | to.axis_mask);
+    for (size_t i = 0; i < 6; ++i) {
+      blended_.selected_axes[i] = from_.selected_axes[i] || to.selected_axes[i];
+      blended_.inverse_mass[i] = from_.inverse_mass[i] + alpha * (to.inverse_mass[i] - from_.inverse_mass[i]);
+      blended_.damping[i] = from_.damping[i] + alpha * (to.damping[i] - from_.damping[i]);
+      blended_.stiffness[i] = from_.stiffness[i] + alpha * (to.stiffness[i] - from_.stiffness[i]);
+    }
+    return blended_;
+  }
+
+private:
+  struct ProfileRequest
+  {
+    uint64_t sequence;
+    int index;
+    double transition_duration;
+  };
+
+  const AdmittanceParameterSnapshot & gains(int index, const AdmittanceParameterSnapshot & parameters) const
+  {
+    return index == PARAMETERS ? parameters : profiles_[static_cast<size_t>(index)];
+  }
+
+  std::vector<std::string> names_;
+  std::vector<AdmittanceParameterSnapshot> profiles_;
+
+  // Requesting thread
+  SnapshotBuffer<ProfileRequest> requests_;
+  uint64_t request_sequence_ = 0;
+
+  // Update loop
+  uint64_t handled_sequence_ = 0;
+  int active_ = PARAMETERS;
+  double elapsed_ = 0.0;
+  double transition_duration_ = 0.0;
+  AdmittanceParameterSnapshot from_{};
+  AdmittanceParameterSnapshot blended_{};
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__ADMITTANCE_PROFILES_HPP_
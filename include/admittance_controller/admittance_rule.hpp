@@ -19,6 +19,11 @@
 
 #include <map>
 
+#include "admittance_controller/admittance_profiles.hpp"
+#include "admittance_controller/cycle_record.hpp"
+#include "admittance_controller/cycle_timing.hpp"
+#include "admittance_controller/msg/admittance_controller_compact_state.hpp"
+#include "admittance_controller/tracing.hpp"
 #include "angles/angles.h"
 #include "control_msgs/msg/admittance_controller_state.hpp"
 #include "control_toolbox/parameter_handler.hpp"
@@ -34,7 +39,9 @@
 #include <tf2_ros/buffer.h>
 
 // Differential kinematics plugins
+#include "ik_eigen_interface/ik_eigen_interface.hpp"
 #include "ik_interface/ik_plugin_base.hpp"
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
 #include "pluginlib/class_loader.hpp"
 
 namespace {  // Utility namespace
@@ -322,7 +329,15 @@ public:
         logger_name_.c_str(),
        "Using update without reactivation: %s", (enable_parameter_update_without_reactivation_ ? "True" : "False"));
 
+    update_gain_storage();
+  }
 
+  /**
+   * Store the admittance gains from the parameter lists. Does not touch the frames, so it can be called from the
+   * parameter callback thread while the update loop runs; the loop only reads published snapshots.
+   */
+  void update_gain_storage()
+  {
     int offset_index_bool = 2;  // 2 because there are already two parameters used above
     for (size_t i = 0; i < 6; ++i)
     {
@@ -352,6 +367,73 @@ public:
     convert_damping_ratio_to_damping();
   }
 
+  /**
+   * Build the gain snapshot for the update loop from the stored gains.
+   *
+   * \param[out] snapshot filled in any case
+   * \return false if a selected axis has a non-positive mass or a gain that is not finite
+   */
+  bool get_snapshot(AdmittanceParameterSnapshot & snapshot) const
+  {
+    if (make_parameter_snapshot(selected_axes_, mass_, damping_, stiffness_, snapshot)) {
+      return true;
+    }
+    for (size_t i = 0; i < 6; ++i)
+    {
+      if (selected_axes_[i] && !admittance_axis_gains_valid(mass_[i], damping_[i], stiffness_[i]))
+      {
+        RCUTILS_LOG_ERROR_NAMED(
+          logger_name_.c_str(),
+          "Admittance gains of axis %zu are invalid: mass %e, damping %e, stiffness %e",
+          i, mass_[i], damping_[i], stiffness_[i]);
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Parameter callback of a configured controller. The gains of the new values are checked before anything is kept:
+   * if a selected axis would get invalid gains, the set is rejected and the parameter values and gains before the
+   * call are restored, so that neither the handler nor the next activation uses them.
+   *
+   * \param[in] update_gains store the new gains now instead of at the next activation
+   */
+  rcl_interfaces::msg::SetParametersResult set_parameters_if_gains_valid(
+    const std::vector<rclcpp::Parameter> & parameters, bool update_gains)
+  {
+    const auto string_parameters = string_parameters_;
+    const auto bool_parameters = bool_parameters_;
+    const auto double_parameters = double_parameters_;
+    const auto selected_axes = selected_axes_;
+    const auto mass = mass_;
+    const auto stiffness = stiffness_;
+    const auto damping = damping_;
+    const auto damping_ratio = damping_ratio_;
+
+    auto result = set_parameter_callback(parameters);
+    if (result.successful) {
+      update_gain_storage();
+      AdmittanceParameterSnapshot candidate;
+      if (!get_snapshot(candidate)) {
+        result.successful = false;
+        result.reason = "Invalid admittance gains, keeping the previous ones";
+      }
+    }
+    if (!result.successful) {
+      string_parameters_ = string_parameters;
+      bool_parameters_ = bool_parameters;
+      double_parameters_ = double_parameters;
+    }
+    if (!result.successful || !update_gains) {
+      selected_axes_ = selected_axes;
+      mass_ = mass;
+      stiffness_ = stiffness;
+      damping_ = damping;
+      damping_ratio_ = damping_ratio;
+    }
+    return result;
+  }
+
   // IK parameters
   std::string ik_base_frame_;
   std::string ik_group_name_;
@@ -380,8 +462,22 @@ public:
 
   controller_interface::return_type configure(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node);
 
+  /**
+   * Configure with an initialized differential IK solver instead of loading the 'IK.plugin_name' plugin,
+   * e.g. a mock in benchmarks and tests.
+   */
+  controller_interface::return_type configure(
+    std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node, std::unique_ptr<ik_interface::IKBaseClass> ik);
+
   controller_interface::return_type reset();
 
+  /**
+   * Publish the stored gains of 'parameters_' to the update loop. Call from a non-realtime thread, e.g. the
+   * parameter callback; the update loop picks the new gains up at the start of its next cycle.
+   * Invalid gains are not published and the update loop keeps the previous ones.
+   */
+  controller_interface::return_type publish_parameters();
+
   controller_interface::return_type update(
     const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state,
     const geometry_msgs::msg::Wrench & measured_wrench,
@@ -427,6 +523,40 @@ public:
     control_msgs::msg::AdmittanceControllerState & state_message
   );
 
+  /**
+   * Fill the Cartesian fields of the compact state message. Does not allocate.
+   *
+   * \param[out] state_message compact state; joint and time fields are left untouched
+   */
+  controller_interface::return_type get_compact_state(
+    admittance_controller::msg::AdmittanceControllerCompactState & state_message
+  );
+
+  /**
+   * Fill the Cartesian state fields of a per-cycle record. Does not allocate.
+   *
+   * \param[out] record cycle record; input, joint and time fields are left untouched
+   */
+  controller_interface::return_type get_cycle_record(CycleRecord & record);
+
+  /// Open-loop accumulator of the admittance displacements in the IK base frame, e.g. to monitor long-run drift
+  const std::array<double, 6> & get_sum_of_admittance_displacements() const
+  {
+    return sum_of_admittance_displacements_arr_;
+  }
+
+  /// Joint-space integrator of the update from a reference joint state, e.g. to monitor long-run drift
+  const std::vector<double> & get_joint_position_offsets() const {return pos;}
+
+  /**
+   * Realtime safe: continue the update from a reference joint state from \p limited_joint_state, its desired state
+   * after the joint limits. The joint offsets and the Cartesian admittance state take over what the limits clamped,
+   * braked or pushed back, so that it persists in the next cycles and the rule does not wind up past a limit.
+   */
+  void feed_back_limited_joint_state(
+    const trajectory_msgs::msg::JointTrajectoryPoint & reference_joint_state,
+    const trajectory_msgs::msg::JointTrajectoryPoint & limited_joint_state);
+
   controller_interface::return_type get_pose_of_control_frame_in_base_frame(geometry_msgs::msg::PoseStamped & pose);
 
 public:
@@ -443,9 +573,15 @@ public:
   // Dynamic admittance parameters
   AdmittanceParameters parameters_;
 
+  // Named gain sets that replace the parameter gains when selected
+  AdmittanceProfiles profiles_;
+
   // Filter chain for Wrench data
   std::unique_ptr<filters::FilterChain<geometry_msgs::msg::WrenchStamped>> filter_chain_;
 
+  // Optional timer for the wrench, FK and IK sub-phases of update; owned by the controller
+  CycleTimer * cycle_timer_ = nullptr;
+
 protected:
   void process_wrench_measurements(
     const geometry_msgs::msg::Wrench & measured_wrench
@@ -461,6 +597,53 @@ protected:
     std::array<double, 6> & desired_relative_pose
   );
 
+  using AdmittanceKernel = void (AdmittanceRule::*)(
+    const AdmittanceParameterSnapshot & gains,
+    double dt,
+    const std::array<double, 6> & measured_wrench,
+    const std::array<double, 6> & pose_error,
+    std::array<double, 6> & desired_relative_pose);
+
+  /// Kernel specialized for an axis mask if there is one, otherwise the kernel checking the mask per axis
+  static AdmittanceKernel select_admittance_kernel(uint8_t axis_mask);
+
+  /// Select the kernel for \p axis_mask into admittance_kernel_ if the mask changed since the last cycle
+  void update_admittance_kernel(uint8_t axis_mask)
+  {
+    if (axis_mask != admittance_kernel_mask_)
+    {
+      admittance_kernel_ = select_admittance_kernel(axis_mask);
+      admittance_kernel_mask_ = axis_mask;
+    }
+  }
+
+  /// Admittance rule for the axes of a compile-time mask; the other axes compile away
+  template<unsigned AxisMask>
+  void calculate_admittance_rule_for_axes(
+    const AdmittanceParameterSnapshot & gains,
+    double dt,
+    const std::array<double, 6> & measured_wrench,
+    const std::array<double, 6> & pose_error,
+    std::array<double, 6> & desired_relative_pose
+  );
+
+  void calculate_admittance_rule_for_selected_axes(
+    const AdmittanceParameterSnapshot & gains,
+    double dt,
+    const std::array<double, 6> & measured_wrench,
+    const std::array<double, 6> & pose_error,
+    std::array<double, 6> & desired_relative_pose
+  );
+
+  void calculate_admittance_rule_for_axis(
+    const AdmittanceParameterSnapshot & gains,
+    size_t axis,
+    double dt,
+    const std::array<double, 6> & measured_wrench,
+    const std::array<double, 6> & pose_error,
+    std::array<double, 6> & desired_relative_pose
+  );
+
   controller_interface::return_type calculate_desired_joint_state(
     const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state,
     const std::array<double, 6> & relative_pose,
@@ -468,9 +651,48 @@ protected:
     trajectory_msgs::msg::JointTrajectoryPoint & desired_joint_state
   );
 
+  /**
+   * Conversions of the IK plugin in the ik_base frame. \p delta_theta has one value per joint. They use the
+   * overloads on caller-owned buffers if the plugin has them, and copy through ik_delta_x_vec_ and
+   * ik_delta_theta_vec_ otherwise. Plugins without them convert every \p quantity like a motion.
+   */
+  bool convert_cartesian_deltas_to_joint_deltas(
+    const std::array<double, 6> & delta_x, std::vector<double> & delta_theta,
+    ik_eigen_interface::CartesianQuantity quantity = ik_eigen_interface::CartesianQuantity::MOTION);
+
+  bool convert_joint_deltas_to_cartesian_deltas(
+    const std::vector<double> & delta_theta, std::array<double, 6> & delta_x);
+
+  /// Realtime safe: select the kinematic context of the following IK calls, if the plugin has contexts
+  void select_kinematic_context(ik_kinematic_contexts::KinematicContext context)
+  {
+    if (ik_contexts_) {
+      ik_contexts_->select_kinematic_context(context);
+    }
+  }
+
   // Differential IK algorithm (loads a plugin)
   std::shared_ptr<pluginlib::ClassLoader<ik_interface::IKBaseClass>> ik_loader_;
   std::unique_ptr<ik_interface::IKBaseClass> ik_;
+  // Allocation-free conversions of ik_, nullptr if the plugin has only the std::vector ones
+  ik_eigen_interface::IKEigenInterface * ik_eigen_ = nullptr;
+  std::vector<double> ik_delta_x_vec_;
+  std::vector<double> ik_delta_theta_vec_;
+  // Kinematic contexts of ik_, nullptr if it has one state only. Every update of the current state selects CURRENT.
+  ik_kinematic_contexts::IKContextInterface * ik_contexts_ = nullptr;
+
+  // Gains published by publish_parameters(); read once per cycle by the update loop
+  SnapshotBuffer<AdmittanceParameterSnapshot> parameter_snapshots_;
+
+  // Admittance kernel of both updates for the axis mask of the current gains, -1 before the first cycle
+  AdmittanceKernel admittance_kernel_ = &AdmittanceRule::calculate_admittance_rule_for_selected_axes;
+  int admittance_kernel_mask_ = -1;
+
+  /// Gains of this cycle: the published parameter gains or the selected profile. Call once per cycle.
+  const AdmittanceParameterSnapshot & read_gains(const rclcpp::Duration & period)
+  {
+    return profiles_.update(parameter_snapshots_.read(), period.seconds());
+  }
 
   // Clock
   rclcpp::Clock::SharedPtr clock_;
@@ -508,7 +730,7 @@ protected:
 
   // Joint deltas calculation variables
   std::vector<double> reference_joint_deltas_vec_;
-  std::vector<double> reference_deltas_vec_ik_base_;
+  std::array<double, 6> reference_deltas_arr_ik_base_;
   geometry_msgs::msg::TransformStamped reference_deltas_ik_base_;
 
   bool movement_caused_by_wrench_ = false;
@@ -527,6 +749,15 @@ protected:
   std::vector<double> relative_desired_joint_state_vec_;
 
     std::vector<double> pos;//paul
+    // Joint velocities, accelerations and efforts of the last update from a reference joint state, sized for the
+    // joints in configure, and what the joint limits changed of them
+    std::vector<double> admittance_joint_velocities_vec_;
+    std::vector<double> admittance_joint_accelerations_vec_;
+    std::vector<double> admittance_joint_efforts_vec_;
+    std::vector<double> joint_limit_correction_vec_;
+    // Joint positions the joint step of the admittance is added to, origin of the joint bounds of the IK
+    std::vector<double> joint_delta_origin_vec_;
+    std::array<double, 6> joint_limit_correction_arr_;
 
     // TODO(destogl): find out better datatype for this
   // Values calculated by admittance rule (Cartesian space: [x, y, z, rx, ry, rz]) - state output
@@ -534,7 +765,6 @@ protected:
   // "effort" hold "measured_wrench" values
   trajectory_msgs::msg::JointTrajectoryPoint admittance_rule_calculated_values_;
 
-private:
   template<typename MsgType>
   controller_interface::return_type
   transform_to_control_frame(const MsgType & message_in, MsgType & message_out)
@@ -36,6 +36,52 @@ namespace admittance_controller
 
 controller_interface::return_type AdmittanceRule::configure(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node)
 {
+  // Load the differential IK plugin
+  std::unique_ptr<ik_interface::IKBaseClass> ik;
+  if (!parameters_.ik_plugin_name_.empty())
+  {
+    try
+    {
+      // TODO(destogl): add "ik_interface" into separate package and then rename the package in
+      // the next line from "admittance_controller" to "ik_base_plugin"
+      ik_loader_ = std::make_shared<pluginlib::ClassLoader<ik_interface::IKBaseClass>>(
+        "ik_interface", "ik_interface::IKBaseClass");
+      ik = std::unique_ptr<ik_interface::IKBaseClass>(
+        ik_loader_->createUnmanagedInstance(parameters_.ik_plugin_name_));
+      if (!ik->initialize(node, parameters_.ik_group_name_))
+      {
+        return controller_interface::return_type::ERROR;
+      }
+    }
+    catch (pluginlib::PluginlibException& ex)
+    {
+      RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "Exception while loading the IK plugin '%s': '%s'",
+                   parameters_.ik_plugin_name_.c_str(), ex.what());
+      return controller_interface::return_type::ERROR;
+    }
+  }
+  else
+  {
+    RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "A differential IK plugin name was not specified in the config file.");
+    return controller_interface::return_type::ERROR;
+  }
+
+  return configure(node, std::move(ik));
+}
+
+controller_interface::return_type AdmittanceRule::configure(
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node, std::unique_ptr<ik_interface::IKBaseClass> ik)
+{
+  if (!ik)
+  {
+    RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "No differential IK solver given.");
+    return controller_interface::return_type::ERROR;
+  }
+  ik_ = std::move(ik);
+  ik_eigen_ = ik_eigen_interface::get_eigen_interface(ik_.get());
+  ik_contexts_ = ik_kinematic_contexts::get_context_interface(ik_.get());
+  ik_delta_x_vec_.resize(6, 0.0);
+
   clock_ = node->get_clock();
   tf_buffer_ = std::make_shared<tf2_ros::Buffer>(clock_);
   tf_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf_buffer_);
@@ -58,7 +104,7 @@ controller_interface::return_type AdmittanceRule::configure(std::shared_ptr<rclc
   sum_of_admittance_displacements_.header.frame_id = parameters_.ik_base_frame_;
 
   reference_joint_deltas_vec_.resize(6, 0.0);
-  reference_deltas_vec_ik_base_.reserve(6);
+  reference_deltas_arr_ik_base_.fill(0.0);
   // The variables represent transformation within the same frame
   reference_deltas_ik_base_.header.frame_id = parameters_.ik_base_frame_;
   reference_deltas_ik_base_.child_frame_id = parameters_.ik_base_frame_;
@@ -75,36 +121,17 @@ controller_interface::return_type AdmittanceRule::configure(std::shared_ptr<rclc
 
 
 
-  pos.resize(6, 0.0); // paul should be joint num
-
-  // Load the differential IK plugin
-  if (!parameters_.ik_plugin_name_.empty())
-  {
-    try
-    {
-      // TODO(destogl): add "ik_interface" into separate package and then rename the package in
-      // the next line from "admittance_controller" to "ik_base_plugin"
-      ik_loader_ = std::make_shared<pluginlib::ClassLoader<ik_interface::IKBaseClass>>(
-        "ik_interface", "ik_interface::IKBaseClass");
-      ik_ = std::unique_ptr<ik_interface::IKBaseClass>(
-        ik_loader_->createUnmanagedInstance(parameters_.ik_plugin_name_));
-      if (!ik_->initialize(node, parameters_.ik_group_name_))
-      {
-        return controller_interface::return_type::ERROR;
-      }
-    }
-    catch (pluginlib::PluginlibException& ex)
-    {
-      RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "Exception while loading the IK plugin '%s': '%s'",
-                   parameters_.ik_plugin_name_.c_str(), ex.what());
-      return controller_interface::return_type::ERROR;
-    }
-  }
-  else
-  {
-    RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "A differential IK plugin name was not specified in the config file.");
-    return controller_interface::return_type::ERROR;
-  }
+  // Joint-space buffers of the update from reference joint states, for the joints of the controller
+  std::vector<std::string> joint_names;
+  const size_t num_joints = node->get_parameter("joints", joint_names) && !joint_names.empty() ?
+    joint_names.size() : 6;
+  pos.assign(num_joints, 0.0);
+  admittance_joint_velocities_vec_.assign(num_joints, 0.0);
+  admittance_joint_accelerations_vec_.assign(num_joints, 0.0);
+  admittance_joint_efforts_vec_.assign(num_joints, 0.0);
+  joint_limit_correction_vec_.assign(num_joints, 0.0);
+  joint_delta_origin_vec_.assign(num_joints, 0.0);
+  ik_delta_theta_vec_.assign(num_joints, 0.0);
 
   return controller_interface::return_type::OK;
 }
@@ -116,6 +143,13 @@ controller_interface::return_type AdmittanceRule::reset()
   current_pose_arr_.fill(0.0);
   admittance_velocity_arr_.fill(0.0);
   sum_of_admittance_displacements_arr_.fill(0.0);
+  std::fill(pos.begin(), pos.end(), 0.0);
+
+  if (publish_parameters() != controller_interface::return_type::OK) {
+    RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"), "Invalid admittance gains, not resetting");
+    return controller_interface::return_type::ERROR;
+  }
+  profiles_.reset();
 
   get_pose_of_control_frame_in_base_frame(current_pose_ik_base_frame_);
   reference_pose_from_joint_deltas_ik_base_frame_ = current_pose_ik_base_frame_;
@@ -130,6 +164,16 @@ controller_interface::return_type AdmittanceRule::reset()
   return controller_interface::return_type::OK;
 }
 
+controller_interface::return_type AdmittanceRule::publish_parameters()
+{
+  AdmittanceParameterSnapshot snapshot;
+  if (!parameters_.get_snapshot(snapshot)) {
+    return controller_interface::return_type::ERROR;
+  }
+  parameter_snapshots_.write(snapshot);
+  return controller_interface::return_type::OK;
+}
+
 // Update with target Cartesian pose - the main update method!
 controller_interface::return_type AdmittanceRule::update(
   const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state,
@@ -147,6 +191,7 @@ controller_interface::return_type AdmittanceRule::update(
   pose_error_pose.header.frame_id = parameters_.ik_base_frame_;
   pose_error_pose.child_frame_id = parameters_.control_frame_;
 
+  PhaseTimer phase_timer(cycle_timer_, UpdatePhase::ADMITTANCE_FK);
   if (!parameters_.open_loop_control_ || true) {
     get_pose_of_control_frame_in_base_frame(current_pose_ik_base_frame_);
 
@@ -190,7 +235,9 @@ controller_interface::return_type AdmittanceRule::update(
     convert_message_to_array(sum_of_admittance_displacements_control_frame_, pose_error);
   }
 
+  phase_timer.next(UpdatePhase::ADMITTANCE_WRENCH);
   process_wrench_measurements(measured_wrench);
+  phase_timer.stop();
 
   // Transform internal state to updated control frame - could be changed since the last update
   transform_relative_to_control_frame(
@@ -216,6 +263,7 @@ controller_interface::return_type AdmittanceRule::update(
   tf2::doTransform(current_pose_ik_base_frame_, admittance_pose_ik_base_frame_,
                    relative_admittance_pose_ik_base_frame_);
 
+  phase_timer.next(UpdatePhase::ADMITTANCE_IK);
   return calculate_desired_joint_state(current_joint_state, relative_admittance_pose_arr_,
                                        period, desired_joint_state);
 }
@@ -230,95 +278,111 @@ controller_interface::return_type AdmittanceRule::update(
 {
 
     auto num_joints_ = current_joint_state.positions.size();
-  desired_joint_state.positions.assign(num_joints_, 0.0);
+    if (num_joints_ != pos.size() || reference_joint_state.positions.size() != num_joints_ ||
+        reference_joint_state.velocities.size() != num_joints_)
+    {
+        RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"),
+                     "Expected current and reference joint states of %zu joints.", pos.size());
+        return controller_interface::return_type::ERROR;
+    }
+    // Until the admittance is added, e.g. if a conversion fails, the reference is commanded
+    desired_joint_state.positions = reference_joint_state.positions;
     desired_joint_state.velocities.assign(num_joints_, 0.0);
+    desired_joint_state.accelerations.assign(num_joints_, 0.0);
     desired_joint_state.effort.assign(num_joints_, 0.0);
 //    reference_joint_deltas_vec_.assign(reference_joint_deltas_vec_.size(), 0.0);
-    std::vector<double> desired_relative_pose(6);
-    std::vector<double> pose_error(6);
-    std::vector<double> cur_ee_pos(6);
-    std::vector<double> desired_ee_pos(6);
-    std::vector<double> desired_ee_vel(6);
-    std::vector<double> admittance_acceleration(6);
+    std::array<double, 6> desired_ee_vel;
+    std::array<double, 6> admittance_acceleration{};
+    std::array<double, 6> reference_wrench;
+    std::array<double, 6> relative_pose{};
 
-    std::vector<double> joint_vel(num_joints_);
-    std::vector<double> joint_acc(num_joints_);
-    std::vector<double> joint_torques(num_joints_);
-
-
-    if (reference_joint_state.positions.empty())
-    {
-      desired_joint_state.accelerations.assign(num_joints_, 0.0);
-    }
-    else
-    {
-        desired_joint_state.positions = reference_joint_state.positions;
-    }
+    auto & joint_vel = admittance_joint_velocities_vec_;
+    auto & joint_acc = admittance_joint_accelerations_vec_;
+    auto & joint_torques = admittance_joint_efforts_vec_;
 
 
+    PhaseTimer phase_timer(cycle_timer_, UpdatePhase::ADMITTANCE_WRENCH);
     process_wrench_measurements(measured_wrench);
-        std::vector<double> wrench;
-    for(auto val : measured_wrench_ik_base_frame_arr_){
-        wrench.push_back(val);
-    }
+    const auto & wrench = measured_wrench_ik_base_frame_arr_;
 //    {measured_wrench.force.x, measured_wrench.force.y, measured_wrench.force.z,
 //                                  measured_wrench.torque.x*0, measured_wrench.torque.y*0, measured_wrench.torque.z*0};
 
     // TODO fix this ^^
 
 
+        // Reference and current state in their own kinematic contexts, so that neither evicts the other and
+        // a reference that holds still is not recomputed. The reference velocity maps with its own Jacobian.
+        phase_timer.next(UpdatePhase::ADMITTANCE_FK);
+        select_kinematic_context(ik_kinematic_contexts::KinematicContext::REFERENCE);
+        IkCallTimer ik_timer(cycle_timer_, IkCall::UPDATE_ROBOT_STATE);
         ik_->update_robot_state(reference_joint_state);
-        ik_->calculate_end_effector_position(desired_ee_pos);
+        ik_timer.next(IkCall::JOINT_TO_CARTESIAN_DELTAS);
+        const bool ee_vel_converted = convert_joint_deltas_to_cartesian_deltas(
+                reference_joint_state.velocities, desired_ee_vel);
+        select_kinematic_context(ik_kinematic_contexts::KinematicContext::CURRENT);
 
+        ik_timer.next(IkCall::UPDATE_ROBOT_STATE);
         ik_->update_robot_state(current_joint_state);
-        ik_->calculate_end_effector_position(cur_ee_pos);
-        // copy to vec
-        std::vector<double> tmp(6);
-        for(int i =0; i < 6; i++){
-            tmp[i] = reference_joint_state.velocities[i];
-        }
-
-        if (!ik_->convert_joint_deltas_to_cartesian_deltas(
-                tmp, identity_transform_, desired_ee_vel) ){
+        ik_timer.stop();
+        if (!ee_vel_converted){
             RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"),
                          "Conversion of joint deltas to Cartesian deltas failed. Sending current joint"
                          " values to the robot.");
             return controller_interface::return_type::ERROR;
         }
-
-        // Compute admittance control law: F = M*a + D*v + S*(x - x_d)
-
-    for (size_t axis = 0; axis < 3; ++axis) { //TODO 6
-        if (parameters_.selected_axes_[axis]) {
-//            pose_error[axis] = -(cur_ee_pos[axis] - desired_ee_pos[axis]) - current_pose_arr_[axis];   not terrible
-            pose_error[axis] = -current_pose_arr_[axis];
-            // TODO(destogl): check if velocity is measured from hardware
-            admittance_acceleration[axis] = (1.0 / parameters_.mass_[axis]) * (wrench[axis] +
-                    (parameters_.damping_[axis] * (desired_ee_vel[axis] - admittance_velocity_arr_[axis])) +
-                    (parameters_.stiffness_[axis] * pose_error[axis]) );
-
-                    admittance_velocity_arr_[axis] += admittance_acceleration[axis] *(1.0 / 1000);//period.nanoseconds()
-                    current_pose_arr_[axis] += admittance_velocity_arr_[axis]*(1.0 / 1000);
+        phase_timer.stop();
+
+        // Compute admittance control law: F = M*a + D*(v_d - v) + S*(x - x_d) with the kernel of the Cartesian
+        // update. The reference velocity enters as the wrench D*v_d and the pose error is the admittance offset.
+        const auto & gains = read_gains(period);
+        update_admittance_kernel(gains.axis_mask);
+        for (size_t axis = 0; axis < 6; ++axis) {
+            reference_wrench[axis] = wrench[axis] + gains.damping[axis] * desired_ee_vel[axis];
+        }
+        (this->*admittance_kernel_)(gains, period.seconds(), reference_wrench, current_pose_arr_, relative_pose);
+        for (size_t axis = 0; axis < 6; ++axis) {
+            current_pose_arr_[axis] += relative_pose[axis];
+            admittance_acceleration[axis] = (admittance_kernel_mask_ & (1u << axis)) ?
+                    admittance_rule_calculated_values_.accelerations[axis] : 0.0;
         }
-    }
-
-    for(int i =0; i < 6; i++){
-        tmp[i] = admittance_velocity_arr_[i];
-    }
 
-        if (!ik_->convert_cartesian_deltas_to_joint_deltas(tmp, identity_transform_, joint_vel)
-                || !ik_->convert_cartesian_deltas_to_joint_deltas(admittance_acceleration, identity_transform_, joint_acc)
-                || !ik_->convert_cartesian_deltas_to_joint_deltas(wrench, identity_transform_, joint_torques))
+        // Motion conversions take the Cartesian delta of one cycle, which the joint bounds of the IK are distances
+        // for, so the admittance velocity goes through it as its step of this cycle
+        // The joint step is added to the decaying offset from the reference, not to the current state, so the joint
+        // bounds of the IK are taken relative to that
+        const double dt = period.seconds();
+        const double offset_decay = 1.0 - .2 * dt;
+        if (ik_eigen_)
+        {
+            for (size_t j = 0; j < num_joints_; j++)
+            {
+                joint_delta_origin_vec_[j] = reference_joint_state.positions[j] + offset_decay * pos[j];
+            }
+            ik_eigen_->set_joint_delta_origin(
+                    Eigen::Map<const Eigen::VectorXd>(joint_delta_origin_vec_.data(), joint_delta_origin_vec_.size()));
+        }
+        phase_timer.next(UpdatePhase::ADMITTANCE_IK);
+        ik_timer.next(IkCall::CARTESIAN_TO_JOINT_DELTAS);
+        const bool joint_deltas_converted =
+                convert_cartesian_deltas_to_joint_deltas(relative_pose, joint_vel)
+                && convert_cartesian_deltas_to_joint_deltas(
+                        admittance_acceleration, joint_acc, ik_eigen_interface::CartesianQuantity::ACCELERATION)
+                && convert_cartesian_deltas_to_joint_deltas(
+                        wrench, joint_torques, ik_eigen_interface::CartesianQuantity::WRENCH);
+        ik_timer.stop();
+        if (!joint_deltas_converted)
         {
             RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"),
                          "Conversion of joint deltas to Cartesian deltas failed. Sending current joint"
                          " values to the robot.");
             return controller_interface::return_type::ERROR;
         }
+        phase_timer.stop();
 
         for (size_t j = 0; j < num_joints_; j++)
         {
-            pos[j] += joint_vel[j]*(1.0/1000.0) - .2*pos[j]*(1.0/1000.0) ;
+            joint_vel[j] = dt > 0.0 ? joint_vel[j] / dt : 0.0;
+            pos[j] = offset_decay * pos[j] + joint_vel[j] * dt;
             // Store data for publishing to state variable
             desired_joint_state.positions[j] = reference_joint_state.positions[j] + pos[j];
             desired_joint_state.velocities[j] = reference_joint_state.velocities[j] + joint_vel[j];
@@ -351,7 +415,7 @@ controller_interface::return_type AdmittanceRule::update(
   // Since ik_base is MoveIt's working frame, the transform is identity.
 //  ik_->update_robot_state(current_joint_state);
 //  if (!ik_->convert_joint_deltas_to_cartesian_deltas(
-//    reference_joint_deltas_vec_, identity_transform_, reference_deltas_vec_ik_base_))
+//    reference_joint_deltas_vec_, identity_transform_, reference_deltas_arr_ik_base_))
 //  {
 //    RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"),
 //                 "Conversion of joint deltas to Cartesian deltas failed. Sending current joint"
@@ -361,7 +425,7 @@ controller_interface::return_type AdmittanceRule::update(
 //    return controller_interface::return_type::ERROR;
 //  }
 
-//  convert_array_to_message(reference_deltas_vec_ik_base_, reference_deltas_ik_base_);
+//  convert_array_to_message(reference_deltas_arr_ik_base_, reference_deltas_ik_base_);
 //
 //    reference_pose_from_joint_deltas_ik_base_frame_ = geometry_msgs::msg::PoseStamped(); // reset to zero
 //  // Add deltas to previously-desired pose to get the next desired pose
@@ -375,6 +439,45 @@ controller_interface::return_type AdmittanceRule::update(
   return controller_interface::return_type::OK;
 }
 
+void AdmittanceRule::feed_back_limited_joint_state(
+  const trajectory_msgs::msg::JointTrajectoryPoint & reference_joint_state,
+  const trajectory_msgs::msg::JointTrajectoryPoint & limited_joint_state)
+{
+  const auto num_joints = pos.size();
+  if (limited_joint_state.positions.size() != num_joints || reference_joint_state.positions.size() != num_joints ||
+    limited_joint_state.velocities.size() != num_joints || reference_joint_state.velocities.size() != num_joints)
+  {
+    return;
+  }
+  select_kinematic_context(ik_kinematic_contexts::KinematicContext::CURRENT);
+
+  // Positions: the offsets continue from the limited state, the admittance pose moves along
+  bool limited = false;
+  for (size_t j = 0; j < num_joints; ++j) {
+    joint_limit_correction_vec_[j] = limited_joint_state.positions[j] - reference_joint_state.positions[j] - pos[j];
+    pos[j] += joint_limit_correction_vec_[j];
+    limited |= joint_limit_correction_vec_[j] != 0.0;
+  }
+  if (limited && convert_joint_deltas_to_cartesian_deltas(joint_limit_correction_vec_, joint_limit_correction_arr_)) {
+    for (size_t axis = 0; axis < 6; ++axis) {
+      current_pose_arr_[axis] += joint_limit_correction_arr_[axis];
+    }
+  }
+
+  // Velocities: the admittance velocity continues from the braked one
+  limited = false;
+  for (size_t j = 0; j < num_joints; ++j) {
+    joint_limit_correction_vec_[j] = limited_joint_state.velocities[j] - reference_joint_state.velocities[j] -
+      admittance_joint_velocities_vec_[j];
+    limited |= joint_limit_correction_vec_[j] != 0.0;
+  }
+  if (limited && convert_joint_deltas_to_cartesian_deltas(joint_limit_correction_vec_, joint_limit_correction_arr_)) {
+    for (size_t axis = 0; axis < 6; ++axis) {
+      admittance_velocity_arr_[axis] += joint_limit_correction_arr_[axis];
+    }
+  }
+}
+
 // Update from reference joint deltas
 controller_interface::return_type AdmittanceRule::update(
   const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state,
@@ -387,9 +490,14 @@ controller_interface::return_type AdmittanceRule::update(
 
   // Get feed-forward cartesian deltas in the ik_base frame.
   // Since ik_base is MoveIt's working frame, the transform is identity.
+  select_kinematic_context(ik_kinematic_contexts::KinematicContext::CURRENT);
+  IkCallTimer ik_timer(cycle_timer_, IkCall::UPDATE_ROBOT_STATE);
   ik_->update_robot_state(current_joint_state);
-  if (!ik_->convert_joint_deltas_to_cartesian_deltas(
-      reference_joint_deltas_vec_, identity_transform_, reference_deltas_vec_ik_base_))
+  ik_timer.next(IkCall::JOINT_TO_CARTESIAN_DELTAS);
+  const bool reference_deltas_converted = convert_joint_deltas_to_cartesian_deltas(
+      reference_joint_deltas_vec_, reference_deltas_arr_ik_base_);
+  ik_timer.stop();
+  if (!reference_deltas_converted)
   {
     RCLCPP_ERROR(rclcpp::get_logger("AdmittanceRule"),
                  "Conversion of joint deltas to Cartesian deltas failed. Sending current joint"
@@ -399,7 +507,7 @@ controller_interface::return_type AdmittanceRule::update(
     return controller_interface::return_type::ERROR;
   }
 
-  convert_array_to_message(reference_deltas_vec_ik_base_, reference_deltas_ik_base_);
+  convert_array_to_message(reference_deltas_arr_ik_base_, reference_deltas_ik_base_);
 
   // Add deltas to previously-desired pose to get the next desired pose
   tf2::doTransform(reference_pose_from_joint_deltas_ik_base_frame_,
@@ -454,6 +562,29 @@ controller_interface::return_type AdmittanceRule::get_controller_state(
   return controller_interface::return_type::OK;
 }
 
+controller_interface::return_type AdmittanceRule::get_compact_state(
+  admittance_controller::msg::AdmittanceControllerCompactState & state_message)
+{
+  convert_message_to_array(measured_wrench_.wrench, state_message.wrench_raw);
+  std::copy(measured_wrench_ik_base_frame_arr_.begin(), measured_wrench_ik_base_frame_arr_.end(),
+            state_message.wrench_filtered.begin());
+  // In the joint-reference update the admittance displacement is integrated into current_pose_arr_
+  std::copy(current_pose_arr_.begin(), current_pose_arr_.end(), state_message.admittance_pose.begin());
+  std::copy(admittance_velocity_arr_.begin(), admittance_velocity_arr_.end(),
+            state_message.admittance_velocity.begin());
+
+  return controller_interface::return_type::OK;
+}
+
+controller_interface::return_type AdmittanceRule::get_cycle_record(CycleRecord & record)
+{
+  record.wrench_filtered = measured_wrench_ik_base_frame_arr_;
+  record.admittance_pose = current_pose_arr_;
+  record.admittance_velocity = admittance_velocity_arr_;
+
+  return controller_interface::return_type::OK;
+}
+
 controller_interface::return_type AdmittanceRule::get_pose_of_control_frame_in_base_frame(geometry_msgs::msg::PoseStamped & pose)
 {
   try {
@@ -516,35 +647,97 @@ void AdmittanceRule::calculate_admittance_rule(
   const rclcpp::Duration & period,
   std::array<double, 6> & desired_relative_pose
 )
+{
+  const auto & gains = read_gains(period);
+  // The axis selection only changes with the gains, so the kernel is chosen again only then
+  update_admittance_kernel(gains.axis_mask);
+  (this->*admittance_kernel_)(gains, period.seconds(), measured_wrench, pose_error, desired_relative_pose);
+}
+
+void AdmittanceRule::calculate_admittance_rule_for_axis(
+  const AdmittanceParameterSnapshot & gains,
+  size_t axis,
+  double dt,
+  const std::array<double, 6> & measured_wrench,
+  const std::array<double, 6> & pose_error,
+  std::array<double, 6> & desired_relative_pose
+)
 {
   // Compute admittance control law: F = M*a + D*v + S*(x - x_d)
-  for (size_t axis = 0; axis < 6; ++axis)
+  // TODO(destogl): check if velocity is measured from hardware
+  const double admittance_acceleration = gains.inverse_mass[axis] * (measured_wrench[axis] -
+                                               gains.damping[axis] * admittance_velocity_arr_[axis] -
+                                               gains.stiffness[axis] * pose_error[axis]);
+
+  admittance_velocity_arr_[axis] += admittance_acceleration * dt;
+
+  // Calculate position
+  desired_relative_pose[axis] = admittance_velocity_arr_[axis] * dt;
+  if (std::fabs(desired_relative_pose[axis]) < POSE_EPSILON)
   {
-    if (parameters_.selected_axes_[axis])
-    {
-      // TODO(destogl): check if velocity is measured from hardware
-      const double admittance_acceleration = (1.0 / parameters_.mass_[axis]) * (measured_wrench[axis] -
-                                                   parameters_.damping_[axis] * admittance_velocity_arr_[axis] -
-                                                   parameters_.stiffness_[axis] * pose_error[axis]);
+    desired_relative_pose[axis] = 0.0;
+  }
 
-      admittance_velocity_arr_[axis] += admittance_acceleration * 1.0/100;//period.nanoseconds()
+  // Store data for publishing to state variable
+  admittance_rule_calculated_values_.positions[axis] = pose_error[axis];
+  admittance_rule_calculated_values_.velocities[axis] = admittance_velocity_arr_[axis];
+  admittance_rule_calculated_values_.accelerations[axis] = admittance_acceleration;
+  admittance_rule_calculated_values_.effort[axis] = measured_wrench[axis];
+}
 
-      // Calculate position
-      desired_relative_pose[axis] = admittance_velocity_arr_[axis] * 1.0/100;
-      if (std::fabs(desired_relative_pose[axis]) < POSE_EPSILON)
-      {
-        desired_relative_pose[axis] = 0.0;
-      }
+template<unsigned AxisMask>
+void AdmittanceRule::calculate_admittance_rule_for_axes(
+  const AdmittanceParameterSnapshot & gains,
+  double dt,
+  const std::array<double, 6> & measured_wrench,
+  const std::array<double, 6> & pose_error,
+  std::array<double, 6> & desired_relative_pose
+)
+{
+  // The condition is a compile-time constant, so the loop unrolls into the selected axes only
+  for (size_t axis = 0; axis < 6; ++axis)
+  {
+    if (AxisMask & (1u << axis))
+    {
+      calculate_admittance_rule_for_axis(gains, axis, dt, measured_wrench, pose_error, desired_relative_pose);
+    }
+  }
+}
 
-      // Store data for publishing to state variable
-      admittance_rule_calculated_values_.positions[axis] = pose_error[axis];
-      admittance_rule_calculated_values_.velocities[axis] = admittance_velocity_arr_[axis];
-      admittance_rule_calculated_values_.accelerations[axis] = admittance_acceleration;
-      admittance_rule_calculated_values_.effort[axis] = measured_wrench[axis];
+void AdmittanceRule::calculate_admittance_rule_for_selected_axes(
+  const AdmittanceParameterSnapshot & gains,
+  double dt,
+  const std::array<double, 6> & measured_wrench,
+  const std::array<double, 6> & pose_error,
+  std::array<double, 6> & desired_relative_pose
+)
+{
+  for (size_t axis = 0; axis < 6; ++axis)
+  {
+    if (admittance_kernel_mask_ & (1u << axis))
+    {
+      calculate_admittance_rule_for_axis(gains, axis, dt, measured_wrench, pose_error, desired_relative_pose);
     }
   }
 }
 
+AdmittanceRule::AdmittanceKernel AdmittanceRule::select_admittance_kernel(uint8_t axis_mask)
+{
+  switch (axis_mask)
+  {
+    case ALL_AXES_MASK:
+      return &AdmittanceRule::calculate_admittance_rule_for_axes<ALL_AXES_MASK>;
+    case TRANSLATION_AXES_MASK:
+      return &AdmittanceRule::calculate_admittance_rule_for_axes<TRANSLATION_AXES_MASK>;
+    case Z_AXIS_MASK:
+      return &AdmittanceRule::calculate_admittance_rule_for_axes<Z_AXIS_MASK>;
+    case 0:
+      return &AdmittanceRule::calculate_admittance_rule_for_axes<0>;
+    default:
+      return &AdmittanceRule::calculate_admittance_rule_for_selected_axes;
+  }
+}
+
 controller_interface::return_type AdmittanceRule::calculate_desired_joint_state(
   const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state,
   const std::array<double, 6> & relative_pose,
@@ -555,17 +748,23 @@ controller_interface::return_type AdmittanceRule::calculate_desired_joint_state(
   // Since ik_base is MoveIt's working frame, the transform is identity.
   identity_transform_.header.frame_id = parameters_.ik_base_frame_;
 
-  // Use Jacobian-based IK
-  std::vector<double> relative_admittance_pose_vec(relative_pose.begin(), relative_pose.end());
+  // Use Jacobian-based IK; only the first cycle or a change of the joint count allocates
+  relative_desired_joint_state_vec_.resize(current_joint_state.positions.size());
+  select_kinematic_context(ik_kinematic_contexts::KinematicContext::CURRENT);
+  IkCallTimer ik_timer(cycle_timer_, IkCall::UPDATE_ROBOT_STATE);
   ik_->update_robot_state(current_joint_state);
-  if (ik_->convert_cartesian_deltas_to_joint_deltas(
-        relative_admittance_pose_vec, identity_transform_, relative_desired_joint_state_vec_))
+  ik_timer.next(IkCall::CARTESIAN_TO_JOINT_DELTAS);
+  const bool joint_deltas_converted = convert_cartesian_deltas_to_joint_deltas(
+      relative_pose, relative_desired_joint_state_vec_);
+  ik_timer.stop();
+  if (joint_deltas_converted)
   {
+    const double dt = period.seconds();
     for (auto i = 0u; i < desired_joint_state.positions.size(); ++i)
     {
       desired_joint_state.positions[i] =
         current_joint_state.positions[i] + relative_desired_joint_state_vec_[i];
-      desired_joint_state.velocities[i] = relative_desired_joint_state_vec_[i] / (1.0/100);//period.seconds();
+      desired_joint_state.velocities[i] = dt > 0.0 ? relative_desired_joint_state_vec_[i] / dt : 0.0;
       // TODO(destogl): for now acceleration commands are not used but here simply resetted
       desired_joint_state.accelerations[i] = 0.0;
       // TODO(destogl): in the future we need here to remember previously commanded velocity
@@ -587,6 +786,39 @@ controller_interface::return_type AdmittanceRule::calculate_desired_joint_state(
   return controller_interface::return_type::OK;
 }
 
+bool AdmittanceRule::convert_cartesian_deltas_to_joint_deltas(
+  const std::array<double, 6> & delta_x, std::vector<double> & delta_theta,
+  ik_eigen_interface::CartesianQuantity quantity)
+{
+  if (ik_eigen_)
+  {
+    return ik_eigen_->convert_cartesian_to_joint(
+      Eigen::Map<const Eigen::VectorXd>(delta_x.data(), delta_x.size()), quantity, identity_transform_,
+      Eigen::Map<Eigen::VectorXd>(delta_theta.data(), delta_theta.size()));
+  }
+  ik_delta_x_vec_.assign(delta_x.begin(), delta_x.end());
+  return ik_->convert_cartesian_deltas_to_joint_deltas(ik_delta_x_vec_, identity_transform_, delta_theta);
+}
+
+bool AdmittanceRule::convert_joint_deltas_to_cartesian_deltas(
+  const std::vector<double> & delta_theta, std::array<double, 6> & delta_x)
+{
+  if (ik_eigen_)
+  {
+    return ik_eigen_->convert_joint_deltas_to_cartesian_deltas(
+      Eigen::Map<const Eigen::VectorXd>(delta_theta.data(), delta_theta.size()), identity_transform_,
+      Eigen::Map<Eigen::VectorXd>(delta_x.data(), delta_x.size()));
+  }
+  ik_delta_theta_vec_.assign(delta_theta.begin(), delta_theta.end());
+  if (!ik_->convert_joint_deltas_to_cartesian_deltas(ik_delta_theta_vec_, identity_transform_, ik_delta_x_vec_) ||
+    ik_delta_x_vec_.size() != delta_x.size())
+  {
+    return false;
+  }
+  std::copy(ik_delta_x_vec_.begin(), ik_delta_x_vec_.end(), delta_x.begin());
+  return true;
+}
+
 }  // namespace admittance_controller
 
 #endif  // ADMITTANCE_CONTROLLER__ADMITTANCE_RULE_IMPL_HPP_
@@ -0,0 +1,118 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__CONTACT_EVENT_CAPTURE_HPP_
+#define ADMITTANCE_CONTROLLER__CONTACT_EVENT_CAPTURE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "admittance_controller/cycle_record.hpp"
+#include "admittance_controller/flight_recorder.hpp"
+
+namespace admittance_controller
+{
+
+struct ContactEventCaptureOptions
+{
+  // Directory where event files are written as contact_event_<stamp>_<reason>.bin
+  std::string directory = ".";
+  size_t pre_trigger_records = 2000;
+  size_t post_trigger_records = 500;
+  // Triggers; a threshold <= 0 disables the trigger
+  double force_threshold = 0.0;  // N
+  double torque_threshold = 0.0;  // Nm
+  double force_derivative_threshold = 0.0;  // N/s
+  bool trigger_on_tolerance_abort = true;
+  FlightLogCompression compression = FlightLogCompression::XOR_DELTA;
+};
+
+/**
+ * Pre-trigger ring holding the last cycles of the controller. When a trigger fires, the ring keeps
+ * recording for the post-trigger window, freezes, and a background thread dumps it to a flight log
+ * file (readable with flight_log_tool). Triggers are only armed when the ring holds a full
+ * pre-trigger window; no cycles are captured while a dump is in progress.
+ */
+class ContactEventCapture
+{
+public:
+  enum TriggerReason : uint32_t
+  {
+    NONE = 0,
+    FORCE = 1,
+    TORQUE = 2,
+    FORCE_DERIVATIVE = 3,
+    TOLERANCE_ABORT = 4,
+  };
+
+  ContactEventCapture() = default;
+  ~ContactEventCapture();
+
+  /// Allocate the ring and start the dump thread. Not realtime safe.
+  bool start(const ContactEventCaptureOptions & options);
+
+  /// Stop the dump thread; a pending dump is written first. Not realtime safe.
+  void stop();
+
+  /**
+   * Realtime safe: copy the record into the ring and evaluate the triggers.
+   * \return true if this record fired a trigger
+   */
+  bool add(const CycleRecord & record);
+
+  bool is_running() const {return running_.load(std::memory_order_relaxed);}
+
+  /// Number of event files written since start().
+  size_t num_events() const {return num_events_.load(std::memory_order_relaxed);}
+
+  static const char * to_string(TriggerReason reason);
+
+private:
+  enum State : int
+  {
+    ARMED = 0,
+    TRIGGERED = 1,
+    FROZEN = 2,
+  };
+
+  TriggerReason evaluate_triggers(const CycleRecord & record);
+  void dump_loop();
+  void dump();
+
+  ContactEventCaptureOptions options_;
+  std::vector<CycleRecord> ring_;
+  size_t write_index_ = 0;
+  size_t count_ = 0;
+  size_t post_trigger_remaining_ = 0;
+  TriggerReason trigger_reason_ = NONE;
+  int64_t trigger_stamp_nanosec_ = 0;
+
+  std::array<double, 3> previous_force_{};
+  bool has_previous_force_ = false;
+
+  std::atomic<int> state_{ARMED};
+  std::atomic<bool> running_{false};
+  std::atomic<size_t> num_events_{0};
+  std::thread dump_thread_;
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__CONTACT_EVENT_CAPTURE_HPP_
@@ -0,0 +1,146 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__CYCLE_RECORD_HPP_
+#define ADMITTANCE_CONTROLLER__CYCLE_RECORD_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace admittance_controller
+{
+
+static constexpr size_t MAX_RECORDED_JOINTS = 8;
+
+/**
+ * Fixed-size snapshot of one update cycle of the admittance controller.
+ * Cartesian vectors are ordered as [x, y, z, rx, ry, rz]; joint arrays are valid up to `num_joints`.
+ * The record is trivially copyable so it can be passed through lock-free rings and written to disk as is.
+ *
+ * `wrench_raw`, `period_nanosec` and the reference and actual joint fields are the exact inputs of
+ * AdmittanceRule::update, so a complete log can be replayed offline (see rule_replay.hpp).
+ */
+struct CycleRecord
+{
+  int64_t stamp_nanosec;
+  // Wall time spent in AdmittanceController::update
+  int64_t update_duration_nanosec;
+  // Update cycles since the controller was activated; consecutive unless records were dropped
+  int64_t cycle_index;
+  int64_t period_nanosec;
+  double period;
+  uint32_t num_joints;
+  uint32_t flags;
+
+  std::array<double, 6> wrench_raw;
+  std::array<double, 6> wrench_filtered;
+  std::array<double, 6> admittance_pose;
+  std::array<double, 6> admittance_velocity;
+
+  std::array<double, MAX_RECORDED_JOINTS> joint_reference_positions;
+  std::array<double, MAX_RECORDED_JOINTS> joint_reference_velocities;
+  std::array<double, MAX_RECORDED_JOINTS> joint_reference_accelerations;
+  std::array<double, MAX_RECORDED_JOINTS> joint_actual_positions;
+  std::array<double, MAX_RECORDED_JOINTS> joint_actual_velocities;
+  std::array<double, MAX_RECORDED_JOINTS> joint_actual_accelerations;
+  std::array<double, MAX_RECORDED_JOINTS> joint_desired_positions;
+  std::array<double, MAX_RECORDED_JOINTS> joint_desired_velocities;
+  std::array<double, MAX_RECORDED_JOINTS> joint_desired_accelerations;
+  std::array<double, MAX_RECORDED_JOINTS> joint_desired_efforts;
+};
+
+static_assert(std::is_trivially_copyable<CycleRecord>::value, "CycleRecord has to be trivially copyable");
+static_assert(sizeof(CycleRecord) % sizeof(uint64_t) == 0, "CycleRecord has to consist of 8-byte words");
+
+// Values of CycleRecord::flags
+static constexpr uint32_t CYCLE_FLAG_UPDATE_ERROR = 1u << 0;
+static constexpr uint32_t CYCLE_FLAG_TOLERANCE_ABORT = 1u << 1;
+
+/// Field types used in the self-describing description of CycleRecord
+enum class CycleRecordFieldType : uint32_t
+{
+  INT64 = 0,
+  UINT32 = 1,
+  FLOAT64 = 2,
+};
+
+struct CycleRecordField
+{
+  const char * name;
+  uint32_t offset;
+  CycleRecordFieldType type;
+  uint32_t count;
+};
+
+/// Layout of CycleRecord; written into log file headers so files can be read without this header.
+inline const std::vector<CycleRecordField> & cycle_record_fields()
+{
+#define ADMITTANCE_CYCLE_RECORD_FIELD(name, type, count) \
+  CycleRecordField{#name, static_cast<uint32_t>(offsetof(CycleRecord, name)), type, count}
+
+  static const std::vector<CycleRecordField> fields = {
+    ADMITTANCE_CYCLE_RECORD_FIELD(stamp_nanosec, CycleRecordFieldType::INT64, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(update_duration_nanosec, CycleRecordFieldType::INT64, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(cycle_index, CycleRecordFieldType::INT64, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(period_nanosec, CycleRecordFieldType::INT64, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(period, CycleRecordFieldType::FLOAT64, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(num_joints, CycleRecordFieldType::UINT32, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(flags, CycleRecordFieldType::UINT32, 1),
+    ADMITTANCE_CYCLE_RECORD_FIELD(wrench_raw, CycleRecordFieldType::FLOAT64, 6),
+    ADMITTANCE_CYCLE_RECORD_FIELD(wrench_filtered, CycleRecordFieldType::FLOAT64, 6),
+    ADMITTANCE_CYCLE_RECORD_FIELD(admittance_pose, CycleRecordFieldType::FLOAT64, 6),
+    ADMITTANCE_CYCLE_RECORD_FIELD(admittance_velocity, CycleRecordFieldType::FLOAT64, 6),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_reference_positions, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_reference_velocities, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_reference_accelerations, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_actual_positions, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_actual_velocities, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_actual_accelerations, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_desired_positions, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_desired_velocities, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_desired_accelerations, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+    ADMITTANCE_CYCLE_RECORD_FIELD(
+      joint_desired_efforts, CycleRecordFieldType::FLOAT64, MAX_RECORDED_JOINTS),
+  };
+#undef ADMITTANCE_CYCLE_RECORD_FIELD
+
+  return fields;
+}
+
+/// Copy up to MAX_RECORDED_JOINTS values into a record field; missing values are set to zero.
+template<typename ArrayType>
+void copy_joint_values_to_record(const std::vector<double> & values, size_t num_joints, ArrayType & out)
+{
+  for (auto i = 0ul; i < out.size(); ++i) {
+    out[i] = (i < num_joints && i < values.size()) ? values[i] : 0.0;
+  }
+}
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__CYCLE_RECORD_HPP_
@@ -0,0 +1,358 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__CYCLE_TIMING_HPP_
+#define ADMITTANCE_CONTROLLER__CYCLE_TIMING_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "admittance_controller/perf_counters.hpp"
+#include "admittance_controller/tracing.hpp"
+
+namespace admittance_controller
+{
+
+/// Phases of AdmittanceController::update; ADMITTANCE_* sub-phases are measured inside the rule.
+enum class UpdatePhase : size_t
+{
+  INPUT_READ = 0,
+  HARDWARE_READ,
+  SAMPLE_TRAJECTORY,
+  ADMITTANCE_UPDATE,
+  ADMITTANCE_WRENCH,
+  ADMITTANCE_FK,
+  ADMITTANCE_IK,
+  COMMAND_WRITE,
+  TOLERANCE_CHECK,
+  ACTION_SERVER_UPDATE,
+  STATE_PUBLISH,
+  TOTAL,
+  COUNT
+};
+
+inline const char * to_string(UpdatePhase phase)
+{
+  static constexpr std::array<const char *, static_cast<size_t>(UpdatePhase::COUNT)> names = {
+    "input_read", "hardware_read", "sample_trajectory", "admittance_update", "admittance_wrench",
+    "admittance_fk", "admittance_ik", "command_write", "tolerance_check", "action_server_update",
+    "state_publish", "total"
+  };
+  return names[static_cast<size_t>(phase)];
+}
+
+/// IK plugin calls of the admittance rule
+enum class IkCall : size_t
+{
+  UPDATE_ROBOT_STATE = 0,
+  END_EFFECTOR_POSITION,
+  JOINT_TO_CARTESIAN_DELTAS,
+  CARTESIAN_TO_JOINT_DELTAS,
+  COUNT
+};
+
+inline const char * to_string(IkCall call)
+{
+  static constexpr std::array<const char *, static_cast<size_t>(IkCall::COUNT)> names = {
+    "update_robot_state", "end_effector_position", "joint_to_cartesian_deltas", "cartesian_to_joint_deltas"
+  };
+  return names[static_cast<size_t>(call)];
+}
+
+/**
+ * Lock-free latency histogram with log-linear (HDR-style) buckets in nanoseconds.
+ * Every power of two is split into 32 linear sub-buckets, so the relative error of reported values
+ * is below 3.2 % over the whole range [0 ns, 2^41 ns).
+ *
+ * `record` is realtime safe. Reading and `reset` may run concurrently on another thread; the
+ * result is then approximate, which is acceptable for monitoring.
+ */
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned SUB_BUCKET_BITS = 5;
+  static constexpr uint64_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+  static constexpr unsigned MAX_VALUE_BITS = 41;
+  static constexpr size_t NUM_BUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  LatencyHistogram() {reset();}
+
+  void record(int64_t value_ns)
+  {
+    const uint64_t value = value_ns > 0 ? static_cast<uint64_t>(value_ns) : 0;
+    buckets_[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+  }
+
+  void reset()
+  {
+    for (auto & bucket : buckets_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const {return count_.load(std::memory_order_relaxed);}
+
+  uint64_t max() const {return max_.load(std::memory_order_relaxed);}
+
+  double mean() const
+  {
+    const uint64_t count = this->count();
+    return count > 0 ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / count : 0.0;
+  }
+
+  /// Upper bound of the bucket holding the p-th percentile (p in [0, 100]), capped at max().
+  uint64_t percentile(double p) const
+  {
+    const uint64_t count = this->count();
+    if (count == 0) {
+      return 0;
+    }
+    const double target = p / 100.0 * count;
+    uint64_t cumulative = 0;
+    for (auto i = 0ul; i < NUM_BUCKETS; ++i) {
+      cumulative += buckets_[i].load(std::memory_order_relaxed);
+      if (cumulative >= target && cumulative > 0) {
+        const uint64_t upper = bucket_upper_bound(i);
+        return upper < max() ? upper : max();
+      }
+    }
+    return max();
+  }
+
+  static size_t bucket_index(uint64_t value)
+  {
+    if (value < 2 * SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+    const unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(value));
+    if (msb >= MAX_VALUE_BITS) {
+      return NUM_BUCKETS - 1;
+    }
+    const unsigned shift = msb - SUB_BUCKET_BITS;
+    return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+  }
+
+  static uint64_t bucket_upper_bound(size_t index)
+  {
+    if (index < 2 * SUB_BUCKETS) {
+      return index;
+    }
+    const uint64_t shift = index / SUB_BUCKETS - 1;
+    const uint64_t mantissa = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((mantissa + 1) << shift) - 1;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, NUM_BUCKETS> buckets_;
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+/**
+ * One histogram per UpdatePhase, measured with the monotonic clock.
+ *
+ * In benchmark mode (`set_perf_counters`), hardware counters are also read at every phase boundary and
+ * around every IK call and summed per phase and call. The counters must belong to the measured thread.
+ */
+class CycleTimer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  bool enabled() const {return enabled_.load(std::memory_order_relaxed);}
+
+  void set_enabled(bool enabled) {enabled_.store(enabled, std::memory_order_relaxed);}
+
+  void record(UpdatePhase phase, Clock::duration duration)
+  {
+    histograms_[static_cast<size_t>(phase)].record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+  }
+
+  const LatencyHistogram & histogram(UpdatePhase phase) const
+  {
+    return histograms_[static_cast<size_t>(phase)];
+  }
+
+  /// Use nullptr to leave benchmark mode.
+  void set_perf_counters(const PerfCounters * counters) {perf_counters_ = counters;}
+
+  const PerfCounters * perf_counters() const {return perf_counters_;}
+
+  PerfCounterTotals & perf_totals(UpdatePhase phase) {return phase_perf_totals_[static_cast<size_t>(phase)];}
+
+  const PerfCounterTotals & perf_totals(UpdatePhase phase) const
+  {
+    return phase_perf_totals_[static_cast<size_t>(phase)];
+  }
+
+  PerfCounterTotals & perf_totals(IkCall call) {return ik_perf_totals_[static_cast<size_t>(call)];}
+
+  const PerfCounterTotals & perf_totals(IkCall call) const {return ik_perf_totals_[static_cast<size_t>(call)];}
+
+  void reset()
+  {
+    for (auto & histogram : histograms_) {
+      histogram.reset();
+    }
+    for (auto & totals : phase_perf_totals_) {
+      totals.reset();
+    }
+    for (auto & totals : ik_perf_totals_) {
+      totals.reset();
+    }
+  }
+
+private:
+  std::atomic<bool> enabled_{true};
+  std::array<LatencyHistogram, static_cast<size_t>(UpdatePhase::COUNT)> histograms_;
+  const PerfCounters * perf_counters_ = nullptr;
+  std::array<PerfCounterTotals, static_cast<size_t>(UpdatePhase::COUNT)> phase_perf_totals_;
+  std::array<PerfCounterTotals, static_cast<size_t>(IkCall::COUNT)> ik_perf_totals_;
+};
+
+/**
+ * Measures consecutive phases: the running phase ends when `next` is called or the timer is destroyed.
+ * A nullptr or disabled CycleTimer skips the histograms. Phase boundaries are also emitted as
+ * tracepoints when tracing is compiled in; the CycleTimer address identifies the controller in the trace.
+ */
+class PhaseTimer
+{
+public:
+  PhaseTimer(CycleTimer * timer, UpdatePhase phase)
+  : context_(timer), timer_(timer != nullptr && timer->enabled() ? timer : nullptr), phase_(phase)
+  {
+    begin();
+  }
+
+  ~PhaseTimer() {stop();}
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer & operator=(const PhaseTimer &) = delete;
+
+  /// End the running phase and start measuring `phase`.
+  void next(UpdatePhase phase)
+  {
+    stop();
+    phase_ = phase;
+    begin();
+  }
+
+  void stop()
+  {
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    if (timer_ != nullptr) {
+      timer_->record(phase_, CycleTimer::Clock::now() - start_);
+      PerfCounterSample end;
+      if (has_perf_sample_ && timer_->perf_counters()->read(end)) {
+        timer_->perf_totals(phase_).add(perf_start_, end);
+      }
+    }
+    ADMITTANCE_TRACEPOINT(phase_end, context_, static_cast<int>(phase_));
+  }
+
+private:
+  void begin()
+  {
+    running_ = true;
+    ADMITTANCE_TRACEPOINT(phase_begin, context_, static_cast<int>(phase_));
+    if (timer_ != nullptr) {
+      has_perf_sample_ = timer_->perf_counters() != nullptr && timer_->perf_counters()->read(perf_start_);
+      start_ = CycleTimer::Clock::now();
+    }
+  }
+
+  const void * context_;
+  CycleTimer * timer_;
+  UpdatePhase phase_;
+  CycleTimer::Clock::time_point start_;
+  PerfCounterSample perf_start_;
+  bool has_perf_sample_ = false;
+  bool running_ = false;
+};
+
+/**
+ * Brackets consecutive IK plugin calls with tracepoints and, in benchmark mode, hardware counters.
+ */
+class IkCallTimer
+{
+public:
+  IkCallTimer(CycleTimer * timer, IkCall call)
+  : context_(timer), timer_(timer != nullptr && timer->enabled() ? timer : nullptr), call_(call)
+  {
+    begin();
+  }
+
+  ~IkCallTimer() {stop();}
+
+  IkCallTimer(const IkCallTimer &) = delete;
+  IkCallTimer & operator=(const IkCallTimer &) = delete;
+
+  /// End the running call and start measuring `call`.
+  void next(IkCall call)
+  {
+    stop();
+    call_ = call;
+    begin();
+  }
+
+  void stop()
+  {
+    if (!running_) {
+      return;
+    }
+    running_ = false;
+    PerfCounterSample end;
+    if (has_perf_sample_ && timer_->perf_counters()->read(end)) {
+      timer_->perf_totals(call_).add(perf_start_, end);
+    }
+    ADMITTANCE_TRACEPOINT(ik_call_end, context_, static_cast<int>(call_));
+  }
+
+private:
+  void begin()
+  {
+    running_ = true;
+    ADMITTANCE_TRACEPOINT(ik_call_begin, context_, static_cast<int>(call_));
+    has_perf_sample_ = timer_ != nullptr && timer_->perf_counters() != nullptr &&
+      timer_->perf_counters()->read(perf_start_);
+  }
+
+  const void * context_;
+  CycleTimer * timer_;
+  IkCall call_;
+  PerfCounterSample perf_start_;
+  bool has_perf_sample_ = false;
+  bool running_ = false;
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__CYCLE_TIMING_HPP_
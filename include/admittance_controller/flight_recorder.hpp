@@ -0,0 +1,252 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__FLIGHT_RECORDER_HPP_
+#define ADMITTANCE_CONTROLLER__FLIGHT_RECORDER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "admittance_controller/cycle_record.hpp"
+#include "admittance_controller/spsc_ring_buffer.hpp"
+
+namespace admittance_controller
+{
+
+/**
+ * Binary flight log layout:
+ *   FlightLogFileHeader
+ *   FlightLogFieldDescriptor[num_fields]   - describes one record, so files are self-describing
+ *   chunks: FlightLogChunkHeader + payload
+ *
+ * The payload holds `num_records` records. Without compression the records are stored as is.
+ * With delta compression every record is XOR-ed word by word with the previous record of the chunk
+ * (the first one with zeros) and stored as a bitmask of non-zero words followed by those words.
+ * Chunks are therefore independently decodable.
+ */
+static constexpr char FLIGHT_LOG_MAGIC[8] = {'A', 'D', 'M', 'F', 'L', 'O', 'G', '\0'};
+static constexpr uint32_t FLIGHT_LOG_VERSION = 1;
+static constexpr uint32_t FLIGHT_LOG_CHUNK_MAGIC = 0x4b4e4843;  // "CHNK"
+
+enum class FlightLogCompression : uint32_t
+{
+  NONE = 0,
+  XOR_DELTA = 1,
+};
+
+struct FlightLogFileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;  // bytes before the first chunk
+  uint32_t record_size;
+  uint32_t num_fields;
+  uint32_t compression;
+  uint32_t lost_records;  // records that could not be written, e.g. on a full disk; updated when the log is closed
+  uint64_t num_records;  // updated when the log is closed
+  uint64_t num_chunks;
+};
+
+struct FlightLogFieldDescriptor
+{
+  char name[48];
+  uint32_t offset;
+  uint32_t type;  // CycleRecordFieldType
+  uint32_t count;
+  uint32_t reserved;
+};
+
+struct FlightLogChunkHeader
+{
+  uint32_t magic;
+  uint32_t num_records;
+  uint64_t payload_size;
+};
+
+/**
+ * Writes CycleRecords into a chunked, memory-mapped log file. Not realtime safe.
+ */
+class FlightLogWriter
+{
+public:
+  FlightLogWriter() = default;
+  ~FlightLogWriter();
+
+  FlightLogWriter(const FlightLogWriter &) = delete;
+  FlightLogWriter & operator=(const FlightLogWriter &) = delete;
+
+  bool open(const std::string & path, FlightLogCompression compression);
+
+  bool write_chunk(const CycleRecord * records, size_t num_records);
+
+  /// Finalize header and truncate the file to its used size.
+  bool close();
+
+  bool is_open() const {return fd_ >= 0;}
+
+  uint64_t num_records() const {return num_records_;}
+
+  /// Count records that were not written, so readers of the log see that it is incomplete.
+  void add_lost_records(uint64_t num_records) {lost_records_ += num_records;}
+
+  uint64_t lost_records() const {return lost_records_;}
+
+private:
+  bool reserve(uint64_t size);
+
+  int fd_ = -1;
+  FlightLogCompression compression_ = FlightLogCompression::NONE;
+  uint64_t offset_ = 0;
+  uint64_t file_size_ = 0;
+  uint64_t num_records_ = 0;
+  uint64_t num_chunks_ = 0;
+  uint64_t lost_records_ = 0;
+};
+
+/**
+ * Reads logs written by FlightLogWriter.
+ */
+class FlightLogReader
+{
+public:
+  FlightLogReader() = default;
+  ~FlightLogReader();
+
+  FlightLogReader(const FlightLogReader &) = delete;
+  FlightLogReader & operator=(const FlightLogReader &) = delete;
+
+  bool open(const std::string & path);
+
+  const FlightLogFileHeader & header() const {return header_;}
+
+  const std::vector<FlightLogFieldDescriptor> & fields() const {return fields_;}
+
+  /// Find a field descriptor by name, nullptr if it is not in the file.
+  const FlightLogFieldDescriptor * find_field(const std::string & name) const;
+
+  /**
+   * Decode all records in file order.
+   * \param[in] callback called with a pointer to `header().record_size` bytes of one record
+   * \return false if the file is corrupt
+   */
+  bool for_each_record(const std::function<void(const uint8_t * record)> & callback) const;
+
+  std::string error() const {return error_;}
+
+private:
+  friend class FlightLogCursor;
+
+  const uint8_t * data_ = nullptr;
+  size_t size_ = 0;
+  FlightLogFileHeader header_{};
+  std::vector<FlightLogFieldDescriptor> fields_;
+  mutable std::string error_;
+};
+
+/**
+ * Decodes the records of a FlightLogReader one at a time, so several logs can be walked in lockstep.
+ * The reader has to outlive the cursor.
+ */
+class FlightLogCursor
+{
+public:
+  explicit FlightLogCursor(const FlightLogReader & reader);
+
+  /**
+   * Decode the next record.
+   * \return pointer to `header().record_size` bytes, valid until the next call; nullptr at the end of the
+   * log or if it is corrupt, see error()
+   */
+  const uint8_t * next();
+
+  /// Empty unless next() stopped because the log is corrupt.
+  std::string error() const {return error_;}
+
+private:
+  bool next_chunk();
+
+  const FlightLogReader & reader_;
+  size_t offset_;
+  const uint8_t * payload_ = nullptr;
+  const uint8_t * payload_end_ = nullptr;
+  uint32_t remaining_records_ = 0;
+  std::vector<uint64_t> record_;
+  std::string error_;
+};
+
+struct FlightRecorderOptions
+{
+  FlightLogCompression compression = FlightLogCompression::XOR_DELTA;
+  // Capacity of the realtime ring, in records
+  size_t buffer_size = 8192;
+  size_t records_per_chunk = 1024;
+  // Incomplete chunks are flushed at least with this period
+  std::chrono::milliseconds flush_period{500};
+};
+
+/**
+ * Full-rate recorder: the realtime loop pushes records into a lock-free ring, a background thread
+ * appends them to a FlightLogWriter.
+ */
+class FlightRecorder
+{
+public:
+  FlightRecorder() = default;
+  ~FlightRecorder();
+
+  /// Open the log and start the writer thread. Not realtime safe.
+  bool start(const std::string & path, const FlightRecorderOptions & options);
+
+  /// Stop the writer thread, write all buffered records and close the log. Not realtime safe.
+  void stop();
+
+  /// Realtime safe. Returns false if the recorder is not running or the ring is full.
+  bool record(const CycleRecord & record)
+  {
+    if (!running_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    return ring_->try_push(record);
+  }
+
+  bool is_running() const {return running_.load(std::memory_order_relaxed);}
+
+  /// Number of records lost because the writer thread did not keep up.
+  size_t dropped() const {return ring_ ? ring_->dropped() : 0;}
+
+  /// Number of records lost because writing them to the log failed, e.g. on a full disk.
+  size_t write_failures() const {return write_failures_.load(std::memory_order_relaxed);}
+
+private:
+  void writer_loop();
+
+  FlightRecorderOptions options_;
+  FlightLogWriter writer_;
+  std::unique_ptr<SpscRingBuffer<CycleRecord>> ring_;
+  std::thread writer_thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<size_t> write_failures_{0};
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__FLIGHT_RECORDER_HPP_
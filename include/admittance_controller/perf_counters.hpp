@@ -0,0 +1,117 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__PERF_COUNTERS_HPP_
+#define ADMITTANCE_CONTROLLER__PERF_COUNTERS_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace admittance_controller
+{
+
+struct PerfCounterSample
+{
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cache_misses = 0;
+  uint64_t branch_misses = 0;
+};
+
+/**
+ * Hardware performance counters (cycles, instructions, cache misses, branch misses) of the calling
+ * thread, opened as one perf_event_open group so all four are read with a single syscall.
+ * Only user-space events are counted, which works with the default kernel.perf_event_paranoid=2.
+ */
+class PerfCounters
+{
+public:
+  PerfCounters() = default;
+  ~PerfCounters();
+
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters & operator=(const PerfCounters &) = delete;
+
+  /// Open the counters for the calling thread. Must be called from the thread that is measured.
+  bool open();
+
+  void close();
+
+  bool is_open() const {return fds_[0] >= 0;}
+
+  /// Read the running totals. Does not allocate; costs one read() syscall.
+  bool read(PerfCounterSample & sample) const;
+
+  const std::string & error() const {return error_;}
+
+private:
+  std::array<int, 4> fds_{{-1, -1, -1, -1}};
+  std::string error_;
+};
+
+/**
+ * Sums of counter deltas over many calls. Written by one thread, read concurrently for reporting.
+ */
+class PerfCounterTotals
+{
+public:
+  void add(const PerfCounterSample & begin, const PerfCounterSample & end)
+  {
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    cycles_.fetch_add(end.cycles - begin.cycles, std::memory_order_relaxed);
+    instructions_.fetch_add(end.instructions - begin.instructions, std::memory_order_relaxed);
+    cache_misses_.fetch_add(end.cache_misses - begin.cache_misses, std::memory_order_relaxed);
+    branch_misses_.fetch_add(end.branch_misses - begin.branch_misses, std::memory_order_relaxed);
+  }
+
+  void reset()
+  {
+    calls_.store(0, std::memory_order_relaxed);
+    cycles_.store(0, std::memory_order_relaxed);
+    instructions_.store(0, std::memory_order_relaxed);
+    cache_misses_.store(0, std::memory_order_relaxed);
+    branch_misses_.store(0, std::memory_order_relaxed);
+  }
+
+  uint64_t calls() const {return calls_.load(std::memory_order_relaxed);}
+
+  /// Averages per call
+  PerfCounterSample mean() const
+  {
+    PerfCounterSample sample;
+    const uint64_t calls = this->calls();
+    if (calls > 0) {
+      sample.cycles = cycles_.load(std::memory_order_relaxed) / calls;
+      sample.instructions = instructions_.load(std::memory_order_relaxed) / calls;
+      sample.cache_misses = cache_misses_.load(std::memory_order_relaxed) / calls;
+      sample.branch_misses = branch_misses_.load(std::memory_order_relaxed) / calls;
+    }
+    return sample;
+  }
+
+private:
+  std::atomic<uint64_t> calls_{0};
+  std::atomic<uint64_t> cycles_{0};
+  std::atomic<uint64_t> instructions_{0};
+  std::atomic<uint64_t> cache_misses_{0};
+  std::atomic<uint64_t> branch_misses_{0};
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__PERF_COUNTERS_HPP_
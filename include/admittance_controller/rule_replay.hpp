@@ -0,0 +1,163 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__RULE_REPLAY_HPP_
+#define ADMITTANCE_CONTROLLER__RULE_REPLAY_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "admittance_controller/cycle_record.hpp"
+#include "admittance_controller/flight_recorder.hpp"
+#include "geometry_msgs/msg/wrench.hpp"
+#include "rclcpp/duration.hpp"
+#include "trajectory_msgs/msg/joint_trajectory_point.hpp"
+
+namespace admittance_controller
+{
+
+/// Inputs of AdmittanceRule::update for one cycle, in the containers the controller passes to it.
+struct RuleReplayInputs
+{
+  trajectory_msgs::msg::JointTrajectoryPoint current_joint_state;
+  geometry_msgs::msg::Wrench measured_wrench;
+  trajectory_msgs::msg::JointTrajectoryPoint reference_joint_state;
+  rclcpp::Duration period{0, 0};
+};
+
+/// Rebuild the inputs of a recorded cycle. Does not allocate once the vectors have grown to `num_joints`.
+void inputs_from_cycle_record(const CycleRecord & record, RuleReplayInputs & inputs);
+
+/**
+ * Decodes records of a flight log into CycleRecords by field name, so logs written with an older layout of
+ * the record can be read as well. Fields missing in the file are left zero.
+ */
+class CycleRecordDecoder
+{
+public:
+  /**
+   * \param[in] reader opened log
+   * \param[in] required_fields names that have to be in the log
+   * \param[out] error names the first missing field
+   */
+  bool init(const FlightLogReader & reader, const std::vector<std::string> & required_fields, std::string & error);
+
+  void decode(const uint8_t * data, CycleRecord & record) const;
+
+private:
+  struct FieldMapping
+  {
+    uint32_t file_offset;
+    uint32_t record_offset;
+    uint32_t size;
+  };
+  std::vector<FieldMapping> mappings_;
+};
+
+/// Fields a log needs to be replayed
+const std::vector<std::string> & rule_replay_input_fields();
+
+/// Fields compared between a replay and the golden log
+const std::vector<std::string> & rule_replay_output_fields();
+
+struct RuleReplayOptions
+{
+  // Largest accepted absolute difference of an output; ignored if `bit_exact` is set
+  double tolerance = 1e-9;
+  bool bit_exact = false;
+  size_t max_reported_mismatches = 10;
+};
+
+struct RuleReplayMismatch
+{
+  int64_t cycle_index;
+  std::string field;
+  uint32_t index;
+  double golden;
+  double replayed;
+};
+
+struct RuleReplayResult
+{
+  size_t cycles = 0;
+  size_t mismatched_cycles = 0;
+  double max_abs_error = 0.0;
+  // The first `RuleReplayOptions::max_reported_mismatches` differing values
+  std::vector<RuleReplayMismatch> mismatches;
+  // Sum of the recorded periods, to compare the replay speed with real time
+  double recorded_duration = 0.0;
+  // Set if the replay could not be completed, e.g. because records are missing in the log
+  std::string error;
+
+  bool ok() const {return error.empty() && mismatched_cycles == 0;}
+};
+
+/**
+ * Compare the outputs of the admittance rule in two records of the same cycle.
+ * \return true if all outputs match within the options
+ */
+bool compare_rule_outputs(
+  const CycleRecord & golden, const CycleRecord & replayed, const RuleReplayOptions & options,
+  RuleReplayResult & result);
+
+/**
+ * Feeds recorded cycles through an admittance rule. The rule has to be configured with the parameters of the
+ * recording and reset, as the controller does on activation.
+ */
+class RuleReplay
+{
+public:
+  explicit RuleReplay(AdmittanceRule & rule)
+  : rule_(rule) {}
+
+  /**
+   * Run one recorded cycle through the rule.
+   *
+   * \param[in] recorded cycle with the inputs of the rule
+   * \param[out] replayed copy of `recorded` with the rule outputs and the update error flag replaced
+   */
+  controller_interface::return_type step(const CycleRecord & recorded, CycleRecord & replayed);
+
+private:
+  AdmittanceRule & rule_;
+  RuleReplayInputs inputs_;
+  trajectory_msgs::msg::JointTrajectoryPoint desired_joint_state_;
+};
+
+/**
+ * Replay a flight log through `rule` and compare every cycle with a golden log.
+ *
+ * The replay stops at the first gap in `cycle_index`, since the state of the rule can not be reproduced
+ * past records dropped by the recorder.
+ *
+ * \param[in] rule configured and reset admittance rule
+ * \param[in] input log with the inputs
+ * \param[in] golden log with the expected outputs; usually the input log itself
+ * \param[in] options comparison tolerance
+ * \param[in] output if not null, the replayed records are written to it
+ * \param[out] result statistics and mismatches
+ * \return true if the complete log was replayed and matched
+ */
+bool replay_flight_log(
+  AdmittanceRule & rule, const FlightLogReader & input, const FlightLogReader & golden,
+  const RuleReplayOptions & options, FlightLogWriter * output, RuleReplayResult & result);
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__RULE_REPLAY_HPP_
@@ -0,0 +1,81 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__SNAPSHOT_BUFFER_HPP_
+#define ADMITTANCE_CONTROLLER__SNAPSHOT_BUFFER_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace admittance_controller
+{
+
+/**
+ * Lock-free triple buffer handing complete snapshots from one non-realtime writer to one realtime reader.
+ * The writer fills a private slot and swaps it with the shared middle slot; the reader swaps the middle slot with
+ * its own slot only when a newer snapshot was published. Neither side blocks or allocates, and a reader without
+ * a pending snapshot does a single acquire-load.
+ */
+template<typename T>
+class SnapshotBuffer
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Snapshots have to be trivially copyable");
+
+public:
+  SnapshotBuffer() = default;
+
+  /// Writer side. Publishes a copy of the snapshot; a snapshot the reader did not pick up yet is replaced.
+  void write(const T & snapshot)
+  {
+    slots_[back_] = snapshot;
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    published_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Reader side. The returned snapshot stays valid and unchanged until the next call of read().
+   * A default-constructed T is returned until the first write().
+   */
+  const T & read()
+  {
+    if (middle_.load(std::memory_order_acquire) & FRESH) {
+      front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+    return slots_[front_];
+  }
+
+  /// Number of snapshots written so far
+  uint64_t published() const {return published_.load(std::memory_order_relaxed);}
+
+private:
+  static constexpr uint8_t INDEX_MASK = 0x3;
+  static constexpr uint8_t FRESH = 0x4;
+
+  std::array<T, 3> slots_{};
+  // Slot owned by the reader
+  alignas(64) uint8_t front_ = 0;
+  // Slot exchanged between writer and reader, FRESH if it holds a snapshot the reader did not pick up
+  alignas(64) std::atomic<uint8_t> middle_{1};
+  // Slot owned by the writer
+  alignas(64) uint8_t back_ = 2;
+  std::atomic<uint64_t> published_{0};
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__SNAPSHOT_BUFFER_HPP_
@@ -0,0 +1,94 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__SPSC_RING_BUFFER_HPP_
+#define ADMITTANCE_CONTROLLER__SPSC_RING_BUFFER_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace admittance_controller
+{
+
+/**
+ * Lock-free single-producer/single-consumer ring of trivially copyable elements.
+ * Storage is allocated once in the constructor; push and pop never allocate or block, so the
+ * producer side can be used from the realtime loop.
+ */
+template<typename T>
+class SpscRingBuffer
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Ring elements have to be trivially copyable");
+
+public:
+  /**
+   * \param[in] capacity minimal number of elements; rounded up to the next power of two
+   */
+  explicit SpscRingBuffer(size_t capacity)
+  {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    buffer_.resize(size);
+    mask_ = size - 1;
+  }
+
+  size_t capacity() const {return buffer_.size();}
+
+  /// Producer side. Returns false (and drops the element) if the ring is full.
+  bool try_push(const T & element)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= buffer_.size()) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    buffer_[head & mask_] = element;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Consumer side. Returns false if the ring is empty.
+  bool try_pop(T & element)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    element = buffer_[tail & mask_];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Number of elements dropped by try_push because the consumer did not keep up.
+  size_t dropped() const {return dropped_.load(std::memory_order_relaxed);}
+
+private:
+  std::vector<T> buffer_;
+  size_t mask_;
+
+  // Producer and consumer indices live on separate cache lines to avoid false sharing
+  alignas(64) std::atomic<size_t> head_{0};
+  alignas(64) std::atomic<size_t> tail_{0};
+  std::atomic<size_t> dropped_{0};
+};
+
+}  // namespace admittance_controller
+
+#endif  // ADMITTANCE_CONTROLLER__SPSC_RING_BUFFER_HPP_
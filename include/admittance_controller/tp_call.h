@@ -0,0 +1,88 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+///
+/// LTTng-UST tracepoint provider of the admittance controller. Only compiled in when the package is built
+/// with -DADMITTANCE_CONTROLLER_TRACING=ON; use the macros of admittance_controller/tracing.hpp instead of
+/// including this file directly.
+
+#undef TRACEPOINT_PROVIDER
+#define TRACEPOINT_PROVIDER admittance_controller
+
+#undef TRACEPOINT_INCLUDE
+#define TRACEPOINT_INCLUDE "admittance_controller/tp_call.h"
+
+#if !defined(ADMITTANCE_CONTROLLER__TP_CALL_H_) || defined(TRACEPOINT_HEADER_MULTI_READ)
+#define ADMITTANCE_CONTROLLER__TP_CALL_H_
+
+#include <lttng/tracepoint.h>
+
+// context: identifies the controller instance, phase: admittance_controller::UpdatePhase
+TRACEPOINT_EVENT(
+  TRACEPOINT_PROVIDER,
+  phase_begin,
+  TP_ARGS(
+    const void *, context_arg,
+    int, phase_arg
+  ),
+  TP_FIELDS(
+    ctf_integer_hex(const void *, context, context_arg)
+    ctf_integer(int, phase, phase_arg)
+  )
+)
+
+TRACEPOINT_EVENT(
+  TRACEPOINT_PROVIDER,
+  phase_end,
+  TP_ARGS(
+    const void *, context_arg,
+    int, phase_arg
+  ),
+  TP_FIELDS(
+    ctf_integer_hex(const void *, context, context_arg)
+    ctf_integer(int, phase, phase_arg)
+  )
+)
+
+// call: admittance_controller::IkCall
+TRACEPOINT_EVENT(
+  TRACEPOINT_PROVIDER,
+  ik_call_begin,
+  TP_ARGS(
+    const void *, context_arg,
+    int, call_arg
+  ),
+  TP_FIELDS(
+    ctf_integer_hex(const void *, context, context_arg)
+    ctf_integer(int, call, call_arg)
+  )
+)
+
+TRACEPOINT_EVENT(
+  TRACEPOINT_PROVIDER,
+  ik_call_end,
+  TP_ARGS(
+    const void *, context_arg,
+    int, call_arg
+  ),
+  TP_FIELDS(
+    ctf_integer_hex(const void *, context, context_arg)
+    ctf_integer(int, call, call_arg)
+  )
+)
+
+#endif  // ADMITTANCE_CONTROLLER__TP_CALL_H_
+
+#include <lttng/tracepoint-event.h>
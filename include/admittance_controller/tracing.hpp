@@ -0,0 +1,30 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef ADMITTANCE_CONTROLLER__TRACING_HPP_
+#define ADMITTANCE_CONTROLLER__TRACING_HPP_
+
+#ifdef ADMITTANCE_CONTROLLER_TRACING_ENABLED
+#include "admittance_controller/tp_call.h"
+/// Emit an LTTng event of the admittance_controller provider (see tp_call.h)
+#define ADMITTANCE_TRACEPOINT(event_name, ...) \
+  tracepoint(admittance_controller, event_name, __VA_ARGS__)
+#else
+/// Tracing is compiled out; arguments are not evaluated
+#define ADMITTANCE_TRACEPOINT(event_name, ...) ((void)0)
+#endif
+
+#endif  // ADMITTANCE_CONTROLLER__TRACING_HPP_
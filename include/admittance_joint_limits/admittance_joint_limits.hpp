@@ -1,32 +1,101 @@
+// Copyright (c) 2022, PickNik, Inc.
 //
-// Created by paul on 5/31/22.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
 //
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
 
-#ifndef ADMITTANCE_WS_ADMITTANCE_JOINT_LIMITS_H
-#define ADMITTANCE_WS_ADMITTANCE_JOINT_LIMITS_H
+#ifndef ADMITTANCE_JOINT_LIMITS__ADMITTANCE_JOINT_LIMITS_HPP_
+#define ADMITTANCE_JOINT_LIMITS__ADMITTANCE_JOINT_LIMITS_HPP_
 
-#include "joint_limits_interface/joint_limits_interface.hpp"
-#include <urdf/urdfdom_compatibility.h>
-#include <urdf_model/joint.h>
-#include <joint_limits_interface/joint_limits.hpp>
+#include <limits>
+#include <string>
+#include <vector>
 
 namespace admittance_joint_limits
 {
-    class AdmittanceJointLimits : public joint_limits_interface::JointLimitHandle{
-    AdmittanceJointLimits(
-            const transmission_interface::JointHandle & jposh, const transmission_interface::JointHandle & jcmdh,
-            const joint_limits_interface::JointLimits & limits);
-    public:
-        void enforce_limits(const rclcpp::Duration &period) override;
 
-    private:
-        double min_pos_limit_ = 0.0;
-        double max_pos_limit_ = 0.0;
-    };
+/**
+ * Position, velocity and acceleration limits of all joints of the controller, enforced on the desired
+ * joint state in one pass. The limits are stored as contiguous per-quantity arrays so that the clamps
+ * are vectorized over the joints; joints without a limit use NO_LIMIT.
+ */
+class AdmittanceJointLimits
+{
+public:
+  static constexpr double NO_LIMIT = std::numeric_limits<double>::max();
+
+  /**
+   * Not realtime safe: read the position and velocity limits of \p joint_names from the URDF.
+   * URDF has no acceleration limits, they are given per joint in \p max_accelerations (<= 0 for none).
+   * \return false with \p error set if the URDF cannot be parsed or a joint is missing
+   */
+  bool configure(
+    const std::vector<std::string> & joint_names, const std::string & robot_description,
+    const std::vector<double> & max_accelerations, std::string & error);
+
+  /// Not realtime safe: set the limits directly; all vectors must have the same size.
+  void configure(
+    const std::vector<double> & min_positions, const std::vector<double> & max_positions,
+    const std::vector<double> & max_velocities, const std::vector<double> & max_accelerations);
+
+  /**
+   * Not realtime safe: enable the stages applied before the clamps. Predictive braking scales the motion of
+   * each joint so that it can still stop at the position limit it moves towards with its acceleration limit;
+   * joints without acceleration limit are not braked before the limit. Within \p repulsive_zone of a
+   * position limit a velocity of \p repulsive_gain times the depth in the zone pushes the joint back; a gain
+   * of 0 disables it.
+   */
+  void configure_braking(bool predictive_braking, double repulsive_zone, double repulsive_gain);
+
+  /**
+   * Realtime safe: start the rate limits from the given state, e.g. at activation. Empty velocities are
+   * zero; without positions the rate limits start from the first desired state.
+   */
+  void reset(const std::vector<double> & positions, const std::vector<double> & velocities);
 
+  /**
+   * Realtime safe: clamp the desired state in place. Accelerations are clamped to their limits, velocities
+   * to their limits and to the change reachable within \p dt from the last output, positions to their
+   * limits and to the distance reachable within \p dt. Velocities pointing out of a position limit that
+   * has been reached are set to zero. Before the clamps, positions and velocities are braked and repelled
+   * if enabled, see configure_braking(). Vectors that are not sized for all joints are left untouched.
+   */
+  void enforce(
+    std::vector<double> & positions, std::vector<double> & velocities, std::vector<double> & accelerations,
+    double dt);
 
+  size_t size() const {return min_positions_.size();}
+  const std::vector<double> & min_positions() const {return min_positions_;}
+  const std::vector<double> & max_positions() const {return max_positions_;}
+  const std::vector<double> & max_velocities() const {return max_velocities_;}
+  const std::vector<double> & max_accelerations() const {return max_accelerations_;}
 
-}
+private:
+  std::vector<double> min_positions_;
+  std::vector<double> max_positions_;
+  std::vector<double> max_velocities_;
+  std::vector<double> max_accelerations_;
+  // Last limited output, origin of the rate limits
+  std::vector<double> last_positions_;
+  std::vector<double> last_velocities_;
+  bool has_last_state_ = false;
+  bool predictive_braking_ = false;
+  double repulsive_zone_ = 0.0;
+  double repulsive_gain_ = 0.0;
+  // Per-joint scratch of the braking stage
+  std::vector<double> braking_;
+};
 
+}  // namespace admittance_joint_limits
 
-#endif //ADMITTANCE_WS_ADMITTANCE_JOINT_LIMITS_H
+#endif  // ADMITTANCE_JOINT_LIMITS__ADMITTANCE_JOINT_LIMITS_HPP_
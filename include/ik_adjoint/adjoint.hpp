@@ -0,0 +1,152 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_ADJOINT__ADJOINT_HPP_
+#define IK_ADJOINT__ADJOINT_HPP_
+
+#include <array>
+#include <cstddef>
+
+#include "eigen3/Eigen/Core"
+#include "eigen3/Eigen/Geometry"
+#include "geometry_msgs/msg/transform.hpp"
+
+namespace ik_adjoint
+{
+
+// Twists (vx, vy, vz, wx, wy, wz) and wrenches (fx, fy, fz, tx, ty, tz), linear part first, like the IK deltas
+using Matrix6d = Eigen::Matrix<double, 6, 6>;
+using Vector6d = Eigen::Matrix<double, 6, 1>;
+
+/// Cross-product matrix, skew(p) * v = p x v
+inline Eigen::Matrix3d skew(const Eigen::Vector3d & p)
+{
+  Eigen::Matrix3d matrix;
+  matrix << 0.0, -p.z(), p.y(),
+    p.z(), 0.0, -p.x(),
+    -p.y(), p.x(), 0.0;
+  return matrix;
+}
+
+/**
+ * Adjoint of the transform from frame B to frame A that takes a twist of B in B to A:
+ *   [R  skew(p) R]
+ *   [0  R        ]
+ */
+inline Matrix6d twist_adjoint(const Eigen::Matrix3d & rotation, const Eigen::Vector3d & translation)
+{
+  Matrix6d adjoint;
+  adjoint.topLeftCorner<3, 3>() = rotation;
+  adjoint.topRightCorner<3, 3>().noalias() = skew(translation) * rotation;
+  adjoint.bottomLeftCorner<3, 3>().setZero();
+  adjoint.bottomRightCorner<3, 3>() = rotation;
+  return adjoint;
+}
+
+/**
+ * Dual of twist_adjoint(), the inverse transpose, which takes a wrench in B to A so that the power of a wrench and a
+ * twist is the same in both frames:
+ *   [R          0]
+ *   [skew(p) R  R]
+ */
+inline Matrix6d wrench_adjoint(const Eigen::Matrix3d & rotation, const Eigen::Vector3d & translation)
+{
+  Matrix6d adjoint;
+  adjoint.topLeftCorner<3, 3>() = rotation;
+  adjoint.topRightCorner<3, 3>().setZero();
+  adjoint.bottomLeftCorner<3, 3>().noalias() = skew(translation) * rotation;
+  adjoint.bottomRightCorner<3, 3>() = rotation;
+  return adjoint;
+}
+
+/**
+ * Adjoints of the last transform message it was given, recomputed only when the message changes. Transforming with the
+ * identity, e.g. when the caller already works in the IK base frame, leaves the vector as it is without a multiply.
+ * Use one cache per transform that is applied regularly, so that alternating transforms do not evict each other.
+ */
+class AdjointCache
+{
+public:
+  /// Realtime safe: take \p twist, a 6-vector, from the child to the parent frame of \p transform, in place
+  template<typename VectorT>
+  void transform_twist(const geometry_msgs::msg::Transform & transform, Eigen::MatrixBase<VectorT> & twist)
+  {
+    if (!update(transform)) {
+      const Vector6d transformed = twist_ * twist;
+      twist = transformed;
+    }
+  }
+
+  /// Realtime safe: take \p wrench, a 6-vector, from the child to the parent frame of \p transform, in place
+  template<typename VectorT>
+  void transform_wrench(const geometry_msgs::msg::Transform & transform, Eigen::MatrixBase<VectorT> & wrench)
+  {
+    if (!update(transform)) {
+      const Vector6d transformed = wrench_ * wrench;
+      wrench = transformed;
+    }
+  }
+
+  /// Realtime safe: adjoints of \p transform
+  const Matrix6d & twist_adjoint(const geometry_msgs::msg::Transform & transform)
+  {
+    update(transform);
+    return twist_;
+  }
+
+  const Matrix6d & wrench_adjoint(const geometry_msgs::msg::Transform & transform)
+  {
+    update(transform);
+    return wrench_;
+  }
+
+  /// Number of times the adjoints were computed, for tests and diagnostics
+  size_t updates() const {return updates_;}
+
+private:
+  /// \return true if \p transform is the identity
+  bool update(const geometry_msgs::msg::Transform & transform)
+  {
+    const std::array<double, 7> key = {
+      transform.translation.x, transform.translation.y, transform.translation.z,
+      transform.rotation.x, transform.rotation.y, transform.rotation.z, transform.rotation.w};
+    if (valid_ && key == key_) {
+      return identity_;
+    }
+    key_ = key;
+    valid_ = true;
+    ++updates_;
+    identity_ = key[0] == 0.0 && key[1] == 0.0 && key[2] == 0.0 && key[3] == 0.0 && key[4] == 0.0 &&
+      key[5] == 0.0 && (key[6] == 1.0 || key[6] == -1.0);
+    const Eigen::Matrix3d rotation =
+      Eigen::Quaterniond(key[6], key[3], key[4], key[5]).normalized().toRotationMatrix();
+    const Eigen::Vector3d translation(key[0], key[1], key[2]);
+    twist_ = ik_adjoint::twist_adjoint(rotation, translation);
+    wrench_ = ik_adjoint::wrench_adjoint(rotation, translation);
+    return identity_;
+  }
+
+  std::array<double, 7> key_{};
+  bool valid_ = false;
+  bool identity_ = false;
+  size_t updates_ = 0;
+  Matrix6d twist_;
+  Matrix6d wrench_;
+};
+
+}  // namespace ik_adjoint
+
+#endif  // IK_ADJOINT__ADJOINT_HPP_
@@ -0,0 +1,106 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_EIGEN_INTERFACE__IK_EIGEN_INTERFACE_HPP_
+#define IK_EIGEN_INTERFACE__IK_EIGEN_INTERFACE_HPP_
+
+#include "eigen3/Eigen/Core"
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "ik_interface/ik_plugin_base.hpp"
+
+namespace ik_eigen_interface
+{
+
+/// Kind of a Cartesian vector converted to joint space
+enum class CartesianQuantity
+{
+  /**
+   * Cartesian delta of one cycle. Only motions keep the singularity direction history, get the null-space motion and
+   * are bounded by the joint limits, as distances; convert a velocity as its delta over the cycle period.
+   */
+  MOTION,
+  /// Acceleration that goes with the motion, scaled near singularities like it without changing the history
+  ACCELERATION,
+  /// Wrench, mapped with the same inverse but never scaled
+  WRENCH,
+};
+
+/**
+ * Overloads of the conversions of ik_interface::IKBaseClass on caller-owned buffers: no input is copied into a
+ * temporary vector and the result is written in place, so a conversion does not allocate.
+ */
+class IKEigenInterface
+{
+public:
+  virtual ~IKEigenInterface() = default;
+
+  /**
+   * \brief Convert Cartesian delta-x to joint delta-theta, using the Jacobian.
+   * \param[in] delta_x Cartesian deltas (x, y, z, rx, ry, rz)
+   * \param[in] control_frame_to_ik_base transform the requested delta_x to the ik_base frame
+   * \param[out] delta_theta joint deltas, one per joint of the plugin
+   * \return false if a size does not match or the conversion fails
+   */
+  virtual bool
+  convert_cartesian_deltas_to_joint_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> delta_theta) = 0;
+
+  /**
+   * \brief Convert a Cartesian vector of kind \p quantity to joint space, using the Jacobian. For MOTION this is
+   * convert_cartesian_deltas_to_joint_deltas().
+   * \return false if a size does not match or the conversion fails
+   */
+  virtual bool
+  convert_cartesian_to_joint(
+    const Eigen::Ref<const Eigen::VectorXd> & cartesian,
+    CartesianQuantity quantity,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> joint) = 0;
+
+  /**
+   * \brief Convert joint delta-theta to Cartesian delta-x, using the Jacobian.
+   * \param[in] delta_theta joint deltas, one per joint of the plugin
+   * \param[in] tf_ik_base_to_desired_cartesian_frame transformation to the desired Cartesian frame
+   * \param[out] delta_x Cartesian deltas (x, y, z, rx, ry, rz)
+   * \return false if a size does not match or the conversion fails
+   */
+  virtual bool
+  convert_joint_deltas_to_cartesian_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_theta,
+    const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
+    Eigen::Ref<Eigen::VectorXd> delta_x) = 0;
+
+  /**
+   * \brief Set the joint positions that the result of the next MOTION conversion is added to, if they are not those
+   * of the robot state, e.g. a reference plus an admittance offset. Plugins that bound the joint deltas by the
+   * position limits bound them relative to these positions; afterwards, or with a size that does not match, the
+   * robot state is the origin again. Plugins without bounds ignore it.
+   */
+  virtual void
+  set_joint_delta_origin(const Eigen::Ref<const Eigen::VectorXd> & /*joint_positions*/) {}
+};
+
+/// The overloads of \p ik, or nullptr for plugins with the std::vector conversions only
+inline IKEigenInterface * get_eigen_interface(ik_interface::IKBaseClass * ik)
+{
+  return dynamic_cast<IKEigenInterface *>(ik);
+}
+
+}  // namespace ik_eigen_interface
+
+#endif  // IK_EIGEN_INTERFACE__IK_EIGEN_INTERFACE_HPP_
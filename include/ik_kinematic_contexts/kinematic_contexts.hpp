@@ -0,0 +1,151 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_KINEMATIC_CONTEXTS__KINEMATIC_CONTEXTS_HPP_
+#define IK_KINEMATIC_CONTEXTS__KINEMATIC_CONTEXTS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "ik_interface/ik_plugin_base.hpp"
+
+namespace ik_kinematic_contexts
+{
+
+/// Joint states a plugin keeps the kinematics of side by side, e.g. the reference and the current state of a cycle
+enum class KinematicContext : size_t
+{
+  CURRENT = 0,
+  REFERENCE = 1,
+};
+
+constexpr size_t NUM_KINEMATIC_CONTEXTS = 2;
+
+/**
+ * Plugins of ik_interface::IKBaseClass with a forward kinematics and Jacobian per kinematic context. The selected
+ * context is the one update_robot_state(), calculate_end_effector_position() and the conversions act on; selecting
+ * another does not discard the results of the first, and a context recomputes only when its joint state changes.
+ */
+class IKContextInterface
+{
+public:
+  virtual ~IKContextInterface() = default;
+
+  /// Realtime safe: select the context of the following calls, CURRENT after initialize()
+  virtual void select_kinematic_context(KinematicContext context) = 0;
+
+  /// Number of times the forward kinematics of \p context were computed, for tests and diagnostics
+  virtual size_t forward_kinematics_updates(KinematicContext context) const = 0;
+
+  /// Number of times the Jacobian of \p context was computed, for tests and diagnostics
+  virtual size_t jacobian_updates(KinematicContext context) const = 0;
+};
+
+/// The contexts of \p ik, or nullptr for plugins that keep a single joint state
+inline IKContextInterface * get_context_interface(ik_interface::IKBaseClass * ik)
+{
+  return dynamic_cast<IKContextInterface *>(ik);
+}
+
+/**
+ * Bookkeeping of the plugins: the joint positions of each context and whether its forward kinematics and Jacobian
+ * still belong to them. The plugins keep the results themselves.
+ */
+class KinematicContexts
+{
+public:
+  /// Not realtime safe: \p num_joints positions per context, none of them set yet; selects CURRENT
+  void resize(size_t num_joints)
+  {
+    for (auto & context : contexts_) {
+      context = Context{};
+      context.positions.assign(num_joints, 0.0);
+    }
+    selected_ = 0;
+  }
+
+  /// Realtime safe
+  void select(KinematicContext context) {selected_ = static_cast<size_t>(context);}
+
+  /// Index of the selected context, for arrays of NUM_KINEMATIC_CONTEXTS results
+  size_t index() const {return selected_;}
+
+  /**
+   * Realtime safe: set the positions of the selected context, of the size given to resize()
+   * \return true if they changed, which invalidates the forward kinematics and Jacobian of the context
+   */
+  bool update(const std::vector<double> & positions)
+  {
+    auto & context = contexts_[selected_];
+    if (context.has_positions && std::equal(positions.begin(), positions.end(), context.positions.begin())) {
+      return false;
+    }
+    std::copy(positions.begin(), positions.end(), context.positions.begin());
+    context.has_positions = true;
+    context.forward_kinematics_valid = false;
+    context.jacobian_valid = false;
+    return true;
+  }
+
+  const std::vector<double> & positions() const {return contexts_[selected_].positions;}
+
+  bool forward_kinematics_valid() const {return contexts_[selected_].forward_kinematics_valid;}
+  bool jacobian_valid() const {return contexts_[selected_].jacobian_valid;}
+
+  /// Call after computing the forward kinematics of the selected context
+  void set_forward_kinematics_valid()
+  {
+    contexts_[selected_].forward_kinematics_valid = true;
+    ++contexts_[selected_].forward_kinematics_updates;
+  }
+
+  /// Call after computing the Jacobian of the selected context
+  void set_jacobian_valid()
+  {
+    contexts_[selected_].jacobian_valid = true;
+    ++contexts_[selected_].jacobian_updates;
+  }
+
+  size_t forward_kinematics_updates(KinematicContext context) const
+  {
+    return contexts_[static_cast<size_t>(context)].forward_kinematics_updates;
+  }
+
+  size_t jacobian_updates(KinematicContext context) const
+  {
+    return contexts_[static_cast<size_t>(context)].jacobian_updates;
+  }
+
+private:
+  struct Context
+  {
+    std::vector<double> positions;
+    bool has_positions = false;
+    bool forward_kinematics_valid = false;
+    bool jacobian_valid = false;
+    size_t forward_kinematics_updates = 0;
+    size_t jacobian_updates = 0;
+  };
+
+  std::array<Context, NUM_KINEMATIC_CONTEXTS> contexts_;
+  size_t selected_ = 0;
+};
+
+}  // namespace ik_kinematic_contexts
+
+#endif  // IK_KINEMATIC_CONTEXTS__KINEMATIC_CONTEXTS_HPP_
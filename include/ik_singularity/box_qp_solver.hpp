@@ -0,0 +1,195 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_SINGULARITY__BOX_QP_SOLVER_HPP_
+#define IK_SINGULARITY__BOX_QP_SOLVER_HPP_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+#include "eigen3/Eigen/Cholesky"
+#include "eigen3/Eigen/Core"
+
+namespace ik_singularity
+{
+
+/**
+ * Primal active-set solver for small dense quadratic programs with box constraints,
+ *   minimize 1/2 x^T H x + g^T x subject to lower <= x <= upper,
+ * with H symmetric positive definite. All storage has the fixed maximum size \p MaxVariables, so solving does not
+ * allocate. The working set of bounds is kept from one solve to the next; when the problem changes little between
+ * calls, e.g. from one control cycle to the next, the first subproblem is usually already optimal and a solve costs
+ * one Cholesky factorization of the free variables.
+ */
+template<int MaxVariables>
+class BoxQpSolver
+{
+public:
+  using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0, MaxVariables, MaxVariables>;
+  using Vector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, MaxVariables, 1>;
+
+  enum class Bound : int8_t
+  {
+    FREE,
+    LOWER,
+    UPPER,
+  };
+
+  /// Not realtime safe: set the number of variables, at most MaxVariables, and clear the working set.
+  void resize(Eigen::Index num_variables)
+  {
+    num_variables_ = std::min<Eigen::Index>(num_variables, MaxVariables);
+    reset();
+  }
+
+  /// Realtime safe: forget the working set, e.g. when the state jumps.
+  void reset() {working_set_.fill(Bound::FREE);}
+
+  Eigen::Index size() const {return num_variables_;}
+
+  /// Bound of variable \p i in the working set of the last solve
+  Bound bound(Eigen::Index i) const {return working_set_[i];}
+
+  /// Number of subproblems of the last solve
+  int iterations() const {return iterations_;}
+
+  /**
+   * Realtime safe: solve the problem, starting from the working set of the last solve.
+   * \param[out] x solution; always within the bounds
+   * \return false if the bounds are inconsistent, the Hessian is not positive definite or \p max_iterations is
+   * reached; \p x is still within the bounds unless they are inconsistent
+   */
+  template<typename HessianT, typename GradientT, typename LowerT, typename UpperT>
+  bool solve(
+    const Eigen::MatrixBase<HessianT> & hessian, const Eigen::MatrixBase<GradientT> & gradient,
+    const Eigen::MatrixBase<LowerT> & lower, const Eigen::MatrixBase<UpperT> & upper, Vector & x,
+    int max_iterations = 4 * MaxVariables)
+  {
+    const Eigen::Index n = num_variables_;
+    x.resize(n);
+    // Start at the bounds of the working set; free variables start at 0, or the nearest bound if 0 is outside
+    for (Eigen::Index i = 0; i < n; ++i) {
+      if (!(lower(i) <= upper(i))) {
+        return false;
+      }
+      if (lower(i) == upper(i)) {
+        working_set_[i] = Bound::LOWER;
+      }
+      x(i) = working_set_[i] == Bound::LOWER ? lower(i) :
+        working_set_[i] == Bound::UPPER ? upper(i) : std::min(std::max(0.0, lower(i)), upper(i));
+    }
+
+    for (iterations_ = 1; iterations_ <= max_iterations; ++iterations_) {
+      // Minimum over the free variables with the others held at their bounds
+      Eigen::Index num_free = 0;
+      for (Eigen::Index i = 0; i < n; ++i) {
+        if (working_set_[i] == Bound::FREE) {
+          free_[num_free++] = i;
+        }
+      }
+      reduced_hessian_.resize(num_free, num_free);
+      reduced_rhs_.resize(num_free);
+      for (Eigen::Index a = 0; a < num_free; ++a) {
+        double rhs = -gradient(free_[a]);
+        for (Eigen::Index i = 0; i < n; ++i) {
+          if (working_set_[i] != Bound::FREE) {
+            rhs -= hessian(free_[a], i) * x(i);
+          }
+        }
+        reduced_rhs_(a) = rhs;
+        for (Eigen::Index b = 0; b < num_free; ++b) {
+          reduced_hessian_(a, b) = hessian(free_[a], free_[b]);
+        }
+      }
+      if (num_free > 0) {
+        llt_.compute(reduced_hessian_);
+        if (llt_.info() != Eigen::Success) {
+          return false;
+        }
+        target_.noalias() = llt_.solve(reduced_rhs_);
+      } else {
+        target_.resize(0);
+      }
+
+      // Move towards that minimum until the first bound blocks
+      double step = 1.0;
+      Eigen::Index blocking = -1;
+      Bound blocking_bound = Bound::FREE;
+      for (Eigen::Index a = 0; a < num_free; ++a) {
+        const Eigen::Index i = free_[a];
+        const double direction = target_(a) - x(i);
+        if (direction < 0.0 && x(i) + step * direction < lower(i)) {
+          step = std::max(0.0, (lower(i) - x(i)) / direction);
+          blocking = i;
+          blocking_bound = Bound::LOWER;
+        } else if (direction > 0.0 && x(i) + step * direction > upper(i)) {
+          step = std::max(0.0, (upper(i) - x(i)) / direction);
+          blocking = i;
+          blocking_bound = Bound::UPPER;
+        }
+      }
+      for (Eigen::Index a = 0; a < num_free; ++a) {
+        x(free_[a]) += step * (target_(a) - x(free_[a]));
+      }
+      if (blocking >= 0) {
+        x(blocking) = blocking_bound == Bound::LOWER ? lower(blocking) : upper(blocking);
+        working_set_[blocking] = blocking_bound;
+        continue;
+      }
+
+      // Optimal for the working set; release the bound whose multiplier has the wrong sign the most
+      Eigen::Index release = -1;
+      double most_negative = -MULTIPLIER_TOLERANCE;
+      for (Eigen::Index i = 0; i < n; ++i) {
+        if (working_set_[i] == Bound::FREE || lower(i) == upper(i)) {
+          continue;
+        }
+        const double slope = hessian.row(i).head(n).dot(x) + gradient(i);
+        const double multiplier = working_set_[i] == Bound::LOWER ? slope : -slope;
+        if (multiplier < most_negative) {
+          most_negative = multiplier;
+          release = i;
+        }
+      }
+      if (release < 0) {
+        return true;
+      }
+      working_set_[release] = Bound::FREE;
+    }
+    iterations_ = max_iterations;
+    return false;
+  }
+
+private:
+  static constexpr double MULTIPLIER_TOLERANCE = 1e-12;
+
+  Eigen::Index num_variables_ = 0;
+  std::array<Bound, MaxVariables> working_set_{};
+  std::array<Eigen::Index, MaxVariables> free_{};
+  int iterations_ = 0;
+  Matrix reduced_hessian_;
+  Vector reduced_rhs_;
+  Vector target_;
+  Eigen::LLT<Matrix> llt_;
+};
+
+template<int MaxVariables>
+constexpr double BoxQpSolver<MaxVariables>::MULTIPLIER_TOLERANCE;
+
+}  // namespace ik_singularity
+
+#endif  // IK_SINGULARITY__BOX_QP_SOLVER_HPP_
@@ -0,0 +1,114 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_SINGULARITY__MANIPULABILITY_ATLAS_HPP_
+#define IK_SINGULARITY__MANIPULABILITY_ATLAS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ik_singularity
+{
+
+/**
+ * Manipulability atlas file: a header followed by one ManipulabilityAtlasCell per grid point, row-major
+ * with the last joint varying fastest. Joints with a count of 1 are not sampled and ignored by lookups.
+ * Periodic joints are sampled at count points over [min, max) and wrap around; the others at count
+ * points over [min, max] and are clamped. The file is used in place through a read-only memory map.
+ */
+static constexpr char MANIPULABILITY_ATLAS_MAGIC[8] = {'M', 'A', 'N', 'A', 'T', 'L', 'S', '\0'};
+static constexpr uint32_t MANIPULABILITY_ATLAS_VERSION = 1;
+enum : uint32_t {MANIPULABILITY_ATLAS_MAX_JOINTS = 8};
+
+struct ManipulabilityAtlasHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t num_joints;
+  uint32_t counts[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  uint32_t periodic[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  double min_positions[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  double max_positions[MANIPULABILITY_ATLAS_MAX_JOINTS];
+};
+
+struct ManipulabilityAtlasCell
+{
+  // Product of the singular values of the Jacobian
+  float manipulability;
+  // Smallest over largest singular value, 0 at a singularity; interpolates better than the condition number
+  float inverse_condition;
+};
+
+struct ManipulabilitySample
+{
+  double manipulability;
+  double inverse_condition;
+
+  double condition() const {return 1.0 / inverse_condition;}
+};
+
+/// Number of grid points of the atlas.
+size_t manipulability_atlas_cells(const ManipulabilityAtlasHeader & header);
+
+/// Joint position of grid point \p index of \p joint.
+double manipulability_atlas_position(const ManipulabilityAtlasHeader & header, size_t joint, uint32_t index);
+
+/// Not realtime safe: write an atlas file; \p cells must hold manipulability_atlas_cells(header) cells.
+bool write_manipulability_atlas(
+  const std::string & path, const ManipulabilityAtlasHeader & header,
+  const std::vector<ManipulabilityAtlasCell> & cells, std::string & error);
+
+/**
+ * Read-only view of a memory-mapped manipulability atlas. Lookups interpolate multilinearly between the
+ * grid points around the joint positions, so they take the same time everywhere in the workspace.
+ */
+class ManipulabilityAtlas
+{
+public:
+  ManipulabilityAtlas() = default;
+  ~ManipulabilityAtlas();
+  ManipulabilityAtlas(const ManipulabilityAtlas &) = delete;
+  ManipulabilityAtlas & operator=(const ManipulabilityAtlas &) = delete;
+
+  /// Not realtime safe: map and validate an atlas file.
+  bool open(const std::string & path, std::string & error);
+  void close();
+
+  bool is_open() const {return header_ != nullptr;}
+  size_t num_joints() const {return header_ ? header_->num_joints : 0;}
+  const ManipulabilityAtlasHeader * header() const {return header_;}
+
+  /**
+   * Realtime safe: interpolated manipulability and inverse condition number at \p positions, which must
+   * hold num_joints() values. The atlas must be open.
+   * \param[out] inverse_condition_gradient if not null, receives the derivative of the inverse condition
+   * number with respect to each joint position; it must hold num_joints() values
+   */
+  ManipulabilitySample lookup(const double * positions, double * inverse_condition_gradient = nullptr) const;
+
+private:
+  void * mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const ManipulabilityAtlasHeader * header_ = nullptr;
+  const ManipulabilityAtlasCell * cells_ = nullptr;
+  size_t strides_[MANIPULABILITY_ATLAS_MAX_JOINTS] = {};
+};
+
+}  // namespace ik_singularity
+
+#endif  // IK_SINGULARITY__MANIPULABILITY_ATLAS_HPP_
@@ -0,0 +1,149 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_SINGULARITY__NULL_SPACE_OBJECTIVES_HPP_
+#define IK_SINGULARITY__NULL_SPACE_OBJECTIVES_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include "eigen3/Eigen/Core"
+
+namespace ik_singularity
+{
+
+/**
+ * Realtime safe: gradient of the log-manipulability, log sqrt(det(J J^T)), with respect to the joint positions of a
+ * serial chain of revolute joints, d/dq_k = trace(J^+ dJ/dq_k). The derivatives of the Jacobian follow from its own
+ * columns, so no further kinematics are evaluated.
+ * \param jacobian geometric Jacobian of the tip, linear rows first, joints in chain order, all in the base frame
+ * \param inverse pseudoinverse of \p jacobian, e.g. the damped one of the conversion, which keeps the gradient
+ * bounded at singularities
+ * \param[out] gradient one value per joint
+ */
+inline void log_manipulability_gradient(
+  const Eigen::MatrixXd & jacobian, const Eigen::MatrixXd & inverse, Eigen::VectorXd & gradient)
+{
+  const auto num_joints = jacobian.cols();
+  for (Eigen::Index k = 0; k < num_joints; ++k) {
+    const Eigen::Vector3d linear_k = jacobian.block<3, 1>(0, k);
+    const Eigen::Vector3d axis_k = jacobian.block<3, 1>(3, k);
+    double derivative = 0.0;
+    for (Eigen::Index i = 0; i < num_joints; ++i) {
+      const Eigen::Vector3d linear_i = jacobian.block<3, 1>(0, i);
+      const Eigen::Vector3d axis_i = jacobian.block<3, 1>(3, i);
+      if (k < i) {
+        // Joint k rotates the axis of joint i and its lever to the tip
+        derivative += inverse.block<1, 3>(i, 0).dot(axis_k.cross(linear_i)) +
+          inverse.block<1, 3>(i, 3).dot(axis_k.cross(axis_i));
+      } else {
+        // Joint k moves the tip, the axis of joint i stays
+        derivative += inverse.block<1, 3>(i, 0).dot(axis_i.cross(linear_k));
+      }
+    }
+    gradient(k) = derivative;
+  }
+}
+
+/// Gains of the secondary objectives, in joint motion per conversion and unit of the objective gradient
+struct NullSpaceGains
+{
+  // Towards the middle of the position limits, relative to the range
+  double joint_centering = 0.0;
+  // Up the gradient of the log-manipulability
+  double manipulability = 0.0;
+  // Towards a preferred posture
+  double posture = 0.0;
+};
+
+/**
+ * Secondary objectives of a redundant arm, resolved in the null space of the task: the joint motion they
+ * request is projected so that it does not move the tip, see project_onto_null_space().
+ */
+class NullSpaceObjectives
+{
+public:
+  /**
+   * Not realtime safe: joints whose position limits are not finite or span a full turn or more are not centered.
+   * \p posture may be empty if the posture gain is 0.
+   */
+  void configure(
+    const std::vector<double> & min_positions, const std::vector<double> & max_positions,
+    const std::vector<double> & posture, const NullSpaceGains & gains)
+  {
+    const auto num_joints = min_positions.size();
+    centers_ = Eigen::VectorXd::Zero(num_joints);
+    centering_weights_ = Eigen::VectorXd::Zero(num_joints);
+    for (auto i = 0ul; i < num_joints; ++i) {
+      const double range = max_positions[i] - min_positions[i];
+      if (std::isfinite(range) && range > 0.0 && range < 2.0 * M_PI) {
+        centers_(i) = min_positions[i] + 0.5 * range;
+        centering_weights_(i) = 1.0 / (range * range);
+      }
+    }
+    posture_ = Eigen::VectorXd::Zero(num_joints);
+    if (posture.size() == num_joints) {
+      posture_ = Eigen::Map<const Eigen::VectorXd>(posture.data(), num_joints);
+    }
+    gains_ = gains;
+    gradient_ = Eigen::VectorXd::Zero(num_joints);
+  }
+
+  const NullSpaceGains & gains() const {return gains_;}
+
+  /**
+   * Realtime safe: joint motion requested by the objectives, before the projection.
+   * \param jacobian, inverse as for log_manipulability_gradient(), only used with a manipulability gain
+   */
+  void motion(
+    const std::vector<double> & positions, const Eigen::MatrixXd & jacobian, const Eigen::MatrixXd & inverse,
+    Eigen::VectorXd & motion)
+  {
+    const Eigen::Map<const Eigen::VectorXd> q(positions.data(), static_cast<Eigen::Index>(positions.size()));
+    motion = -gains_.joint_centering * centering_weights_.cwiseProduct(q - centers_);
+    if (gains_.posture != 0.0) {
+      motion -= gains_.posture * (q - posture_);
+    }
+    if (gains_.manipulability != 0.0) {
+      log_manipulability_gradient(jacobian, inverse, gradient_);
+      motion += gains_.manipulability * gradient_;
+    }
+  }
+
+private:
+  Eigen::VectorXd centers_;
+  Eigen::VectorXd centering_weights_;
+  Eigen::VectorXd posture_;
+  NullSpaceGains gains_;
+  Eigen::VectorXd gradient_;
+};
+
+/**
+ * Realtime safe: project \p motion onto the null space of a matrix from its thin right singular vectors \p v,
+ * motion - V V^T motion, without building the projector or inverting a matrix.
+ * \param coefficients scratch with one entry per column of \p v
+ */
+template<typename MatrixT>
+void project_onto_null_space(
+  const Eigen::MatrixBase<MatrixT> & v, Eigen::VectorXd & motion, Eigen::VectorXd & coefficients)
+{
+  coefficients.noalias() = v.transpose() * motion;
+  motion.noalias() -= v * coefficients;
+}
+
+}  // namespace ik_singularity
+
+#endif  // IK_SINGULARITY__NULL_SPACE_OBJECTIVES_HPP_
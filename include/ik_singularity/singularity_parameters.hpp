@@ -0,0 +1,95 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_SINGULARITY__SINGULARITY_PARAMETERS_HPP_
+#define IK_SINGULARITY__SINGULARITY_PARAMETERS_HPP_
+
+#include <memory>
+#include <string>
+
+#include "ik_singularity/singularity_velocity_scaling.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+namespace ik_singularity
+{
+
+template<typename T>
+T get_or_declare_parameter(
+  const std::shared_ptr<rclcpp_lifecycle::LifecycleNode> & node, const std::string & name, const T & default_value)
+{
+  if (!node->has_parameter(name)) {
+    return node->declare_parameter<T>(name, default_value);
+  }
+  return node->get_parameter(name).get_value<T>();
+}
+
+/**
+ * Read the singularity parameters of a differential IK plugin: 'IK.singularity.enable' and the condition
+ * number thresholds 'IK.singularity.lower_threshold', 'IK.singularity.approaching_stop_threshold' and
+ * 'IK.singularity.hard_stop_threshold'.
+ * \return false if the thresholds are not increasing
+ */
+inline bool get_singularity_parameters(
+  const std::shared_ptr<rclcpp_lifecycle::LifecycleNode> & node, bool & enable, SingularityThresholds & thresholds)
+{
+  enable = get_or_declare_parameter<bool>(node, "IK.singularity.enable", true);
+  thresholds.lower = get_or_declare_parameter<double>(node, "IK.singularity.lower_threshold", thresholds.lower);
+  thresholds.approaching_stop = get_or_declare_parameter<double>(
+    node, "IK.singularity.approaching_stop_threshold", thresholds.approaching_stop);
+  thresholds.hard_stop = get_or_declare_parameter<double>(
+    node, "IK.singularity.hard_stop_threshold", thresholds.hard_stop);
+  if (!thresholds.valid()) {
+    RCLCPP_ERROR(node->get_logger(), "The IK singularity thresholds must satisfy 0 < lower < approaching_stop <= "
+                 "hard_stop");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Read the damping schedule of a damped least-squares IK: 'IK.damping.measure' ("constant",
+ * "smallest_singular_value" or "manipulability"), 'IK.damping.min', 'IK.damping.threshold' and 'IK.damping.max'.
+ * The default threshold depends on the measure.
+ * \return false if the measure is unknown or the schedule is invalid
+ */
+inline bool get_damping_parameters(
+  const std::shared_ptr<rclcpp_lifecycle::LifecycleNode> & node, DampingSchedule & schedule)
+{
+  const auto measure = get_or_declare_parameter<std::string>(node, "IK.damping.measure", "smallest_singular_value");
+  if (measure == "constant") {
+    schedule.measure = DampingMeasure::CONSTANT;
+  } else if (measure == "smallest_singular_value") {
+    schedule.measure = DampingMeasure::SMALLEST_SINGULAR_VALUE;
+  } else if (measure == "manipulability") {
+    schedule.measure = DampingMeasure::MANIPULABILITY;
+    schedule.threshold = 0.003;
+  } else {
+    RCLCPP_ERROR(node->get_logger(), "Unknown IK damping measure '%s'", measure.c_str());
+    return false;
+  }
+  schedule.min_damping = get_or_declare_parameter<double>(node, "IK.damping.min", schedule.min_damping);
+  schedule.threshold = get_or_declare_parameter<double>(node, "IK.damping.threshold", schedule.threshold);
+  schedule.max_damping = get_or_declare_parameter<double>(node, "IK.damping.max", schedule.max_damping);
+  if (!schedule.valid()) {
+    RCLCPP_ERROR(node->get_logger(), "The IK damping must be positive at singularities and the threshold positive");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace ik_singularity
+
+#endif  // IK_SINGULARITY__SINGULARITY_PARAMETERS_HPP_
@@ -0,0 +1,233 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef IK_SINGULARITY__SINGULARITY_VELOCITY_SCALING_HPP_
+#define IK_SINGULARITY__SINGULARITY_VELOCITY_SCALING_HPP_
+
+#include <algorithm>
+#include <cmath>
+
+#include "eigen3/Eigen/Core"
+
+namespace ik_singularity
+{
+
+/// Jacobian condition numbers at which the differential IK slows down and stops
+struct SingularityThresholds
+{
+  // Full speed below this condition number
+  double lower = 20.0;
+  // Stop at this condition number when moving towards the singularity
+  double approaching_stop = 80.0;
+  // Stop at this condition number in any direction
+  double hard_stop = 120.0;
+
+  bool valid() const {return 0.0 < lower && lower < approaching_stop && approaching_stop <= hard_stop;}
+};
+
+/**
+ * Damping of a damped least-squares inverse from a measure of the distance to a singularity, e.g. the
+ * manipulability or the smallest singular value: 0 at or above \p threshold, rising quadratically to
+ * \p max_damping as the measure falls to 0. Away from singularities the inverse stays exact.
+ */
+inline double damping_for_measure(double measure, double threshold, double max_damping)
+{
+  if (std::isnan(measure)) {
+    return max_damping;
+  }
+  measure = std::max(measure, 0.0);
+  if (measure >= threshold) {
+    return 0.0;
+  }
+  const double depth = 1.0 - measure / threshold;
+  return max_damping * depth * depth;
+}
+
+/// Measure of the distance to a singularity that drives the damping of a damped least-squares inverse
+enum class DampingMeasure
+{
+  CONSTANT,
+  SMALLEST_SINGULAR_VALUE,
+  MANIPULABILITY,
+};
+
+/**
+ * Damping of a damped least-squares inverse: \p min_damping everywhere, plus up to \p max_damping as the
+ * measure falls below \p threshold, see damping_for_measure(). The measures are taken from the singular
+ * values the inverse is computed from, so the schedule costs no further decomposition.
+ */
+struct DampingSchedule
+{
+  DampingMeasure measure = DampingMeasure::SMALLEST_SINGULAR_VALUE;
+  double min_damping = 0.0;
+  double threshold = 0.05;
+  double max_damping = 0.01;
+
+  /// The damping must be positive at a singularity, otherwise the inverse is not defined there
+  bool valid() const
+  {
+    if (measure == DampingMeasure::CONSTANT) {
+      return min_damping > 0.0;
+    }
+    return min_damping >= 0.0 && max_damping >= 0.0 && min_damping + max_damping > 0.0 && threshold > 0.0;
+  }
+
+  /// Damping for a value of the measure
+  double damping(double measure_value) const
+  {
+    if (measure == DampingMeasure::CONSTANT) {
+      return min_damping;
+    }
+    return min_damping + damping_for_measure(measure_value, threshold, max_damping);
+  }
+
+  /// Damping for the singular values of the (weighted) Jacobian, sorted in decreasing order
+  template<typename SingularValuesT>
+  double damping_for_singular_values(const Eigen::MatrixBase<SingularValuesT> & singular_values) const
+  {
+    switch (measure) {
+      case DampingMeasure::SMALLEST_SINGULAR_VALUE:
+        return damping(singular_values(singular_values.size() - 1));
+      case DampingMeasure::MANIPULABILITY:
+        return damping(singular_values.prod());
+      default:
+        return min_damping;
+    }
+  }
+};
+
+/**
+ * Velocity scaling near singularities from the singular value decomposition the differential IK already
+ * computed for the conversion; no further Jacobian is evaluated.
+ *
+ * The left singular vector of the smallest singular value points towards or away from the singularity,
+ * and its sign is arbitrary. Instead of evaluating the Jacobian at a look-ahead state, the sign is kept
+ * continuous from cycle to cycle and oriented by the change of the condition number that followed the
+ * motion along this vector in the previous cycle. The speed ramps down linearly between
+ * SingularityThresholds::lower and the stop threshold of the direction of motion.
+ */
+class SingularityVelocityScaling
+{
+public:
+  using Vector6d = Eigen::Matrix<double, 6, 1>;
+
+  explicit SingularityVelocityScaling(const SingularityThresholds & thresholds = SingularityThresholds())
+  : thresholds_(thresholds)
+  {
+    reset();
+  }
+
+  void set_thresholds(const SingularityThresholds & thresholds) {thresholds_ = thresholds;}
+  const SingularityThresholds & thresholds() const {return thresholds_;}
+
+  /// Forget the direction history, e.g. when the robot state jumps.
+  void reset()
+  {
+    toward_singularity_.setZero();
+    previous_condition_ = 0.0;
+    previous_projection_ = 0.0;
+    has_previous_ = false;
+    condition_ = 1.0;
+  }
+
+  /**
+   * Realtime safe: scale for the commanded Cartesian motion.
+   * \param commanded Cartesian velocity or delta in the frame of the Jacobian
+   * \param singular_vector left singular vector of the smallest singular value, any sign
+   * \param condition condition number, largest over smallest singular value
+   * \return factor in [0, 1] for the joint motion
+   */
+  template<typename CommandT, typename VectorT>
+  double update(
+    const Eigen::MatrixBase<CommandT> & commanded, const Eigen::MatrixBase<VectorT> & singular_vector,
+    double condition)
+  {
+    Vector6d toward_singularity = singular_vector;
+    if (has_previous_) {
+      // Same sign as last cycle; singular vectors only turn slowly with the robot state
+      if (toward_singularity.dot(toward_singularity_) < 0.0) {
+        toward_singularity = -toward_singularity;
+      }
+      // The last motion along the vector either raised the condition number (it pointed towards the
+      // singularity) or lowered it
+      if (previous_projection_ != 0.0 && condition != previous_condition_ &&
+        (condition > previous_condition_) != (previous_projection_ > 0.0))
+      {
+        toward_singularity = -toward_singularity;
+      }
+    }
+
+    const double projection = toward_singularity.dot(commanded);
+    const double scale = this->scale(condition, projection > 0.0);
+
+    toward_singularity_ = toward_singularity;
+    previous_condition_ = condition;
+    previous_projection_ = projection * scale;
+    has_previous_ = true;
+    condition_ = condition;
+    return scale;
+  }
+
+  /**
+   * Realtime safe: scale for a Cartesian quantity that goes with the motion of update() but is not one, e.g. its
+   * acceleration. The singular vector is oriented like the last update(); the history does not change.
+   */
+  template<typename CommandT, typename VectorT>
+  double scale_along(
+    const Eigen::MatrixBase<CommandT> & commanded, const Eigen::MatrixBase<VectorT> & singular_vector,
+    double condition) const
+  {
+    Vector6d toward_singularity = singular_vector;
+    if (has_previous_ && toward_singularity.dot(toward_singularity_) < 0.0) {
+      toward_singularity = -toward_singularity;
+    }
+    return scale(condition, toward_singularity.dot(commanded) > 0.0);
+  }
+
+  /**
+   * Realtime safe: scale for a motion at \p condition whose direction is already known, e.g. from a
+   * precomputed gradient of the condition number. Does not change the direction history.
+   */
+  double scale(double condition, bool toward_singularity) const
+  {
+    const double upper_threshold = toward_singularity ? thresholds_.approaching_stop : thresholds_.hard_stop;
+    if (condition >= upper_threshold || std::isnan(condition)) {
+      return 0.0;
+    }
+    if (condition > thresholds_.lower) {
+      return 1.0 - (condition - thresholds_.lower) / (upper_threshold - thresholds_.lower);
+    }
+    return 1.0;
+  }
+
+  /// Condition number of the last update
+  double condition() const {return condition_;}
+
+  /// Oriented direction towards the singularity of the last update
+  const Vector6d & toward_singularity() const {return toward_singularity_;}
+
+private:
+  SingularityThresholds thresholds_;
+  Vector6d toward_singularity_;
+  double previous_condition_;
+  double previous_projection_;
+  bool has_previous_;
+  double condition_;
+};
+
+}  // namespace ik_singularity
+
+#endif  // IK_SINGULARITY__SINGULARITY_VELOCITY_SCALING_HPP_
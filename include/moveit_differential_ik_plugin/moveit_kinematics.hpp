@@ -16,28 +16,45 @@
 
 #pragma once
 
+#include <array>
+
 #include "eigen3/Eigen/Core"
+#include "eigen3/Eigen/Eigenvalues"
 
+#include "ik_adjoint/adjoint.hpp"
+#include "ik_eigen_interface/ik_eigen_interface.hpp"
 #include "ik_interface/ik_plugin_base.hpp"
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
+#include "ik_singularity/singularity_velocity_scaling.hpp"
 #include "geometry_msgs/msg/transform_stamped.hpp"
-#include "moveit/robot_model_loader/robot_model_loader.h"
+#include "moveit/robot_model/robot_model.h"
 #include "moveit/robot_state/robot_state.h"
 #include "rclcpp/rclcpp.hpp"
 
 namespace moveit_differential_ik_plugin
 {
 
-class RLKinematics : public ik_interface::IKBaseClass
+class RLKinematics : public ik_interface::IKBaseClass, public ik_eigen_interface::IKEigenInterface,
+  public ik_kinematic_contexts::IKContextInterface
 {
 public:
   RLKinematics();
 
   /**
    * \brief Create an object which takes Cartesian delta-x and converts to joint delta-theta.
-   * It uses the Jacobian from MoveIt.
+   * It uses the Jacobian from MoveIt, of the last link of the group \p group_name in the SRDF of the
+   * 'robot_description_semantic' parameter.
    */
   bool initialize(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node, const std::string & group_name);
 
+  /**
+   * \brief Calculates the end effector position last set robot state.
+   * \param end_effector_position output vector with end effector position
+   * \return true if successful
+   */
+  bool
+  calculate_end_effector_position(std::vector<double> & end_effector_position);
+
   /**
    * \brief Convert Cartesian delta-x to joint delta-theta, using the Jacobian.
    * \param delta_x_vec input Cartesian deltas (x, y, z, rx, ry, rz)
@@ -64,38 +81,102 @@ public:
     const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
     std::vector<double> & delta_x_vec);
 
+  /// Realtime safe: the conversions above on caller-owned buffers, see ik_eigen_interface::IKEigenInterface
+  bool
+  convert_cartesian_deltas_to_joint_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> delta_theta);
+
+  bool
+  convert_cartesian_to_joint(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+    ik_eigen_interface::CartesianQuantity quantity,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> delta_theta);
+
+  bool
+  convert_joint_deltas_to_cartesian_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_theta,
+    const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
+    Eigen::Ref<Eigen::VectorXd> delta_x);
+
   bool update_robot_state(const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state)
   {
-    if (current_joint_state.positions.size() != joint_model_group_->getVariableNames().size())
+    if (current_joint_state.positions.size() != joint_model_group_->getVariableCount())
     {
       RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in update_robot_state()");
       return false;
     }
 
-    kinematic_state_->setJointGroupPositions(joint_model_group_, current_joint_state.positions);
+    // The link transforms and Jacobian of the selected context are computed when needed, and only if it changed
+    if (contexts_.update(current_joint_state.positions))
+    {
+      kinematic_state_->setJointGroupPositions(joint_model_group_, current_joint_state.positions);
+    }
     return true;
   }
 
+  /// Realtime safe: see ik_kinematic_contexts::IKContextInterface
+  void select_kinematic_context(ik_kinematic_contexts::KinematicContext context)
+  {
+    contexts_.select(context);
+    kinematic_state_ = kinematic_states_[contexts_.index()].get();
+  }
+
+  size_t forward_kinematics_updates(ik_kinematic_contexts::KinematicContext context) const
+  {
+    return contexts_.forward_kinematics_updates(context);
+  }
+
+  size_t jacobian_updates(ik_kinematic_contexts::KinematicContext context) const
+  {
+    return contexts_.jacobian_updates(context);
+  }
+
 private:
-  /** \brief Possibly calculate a velocity scaling factor, due to proximity of
-   * singularity and direction of motion
-   */
-  double velocityScalingFactorForSingularity(const Eigen::VectorXd& commanded_velocity,
-                                             const Eigen::JacobiSVD<Eigen::MatrixXd>& svd,
-                                             const Eigen::MatrixXd& pseudo_inverse);
+  void calculate_forward_kinematics();
+  const Eigen::MatrixXd & calculate_jacobian();
 
     Eigen::Isometry3d get_link_transform(
             const std::string& link_name, const trajectory_msgs::msg::JointTrajectoryPoint & joint_state);
 
-  // MoveIt setup
-  const moveit::core::JointModelGroup* joint_model_group_;
-  moveit::core::RobotStatePtr kinematic_state_;
+  // MoveIt setup, created once from the robot description
+  moveit::core::RobotModelConstPtr robot_model_;
+  const moveit::core::JointModelGroup* joint_model_group_ = nullptr;
+  const moveit::core::LinkModel* tip_link_ = nullptr;
+  // One state per kinematic context, kinematic_state_ is the selected one
+  ik_kinematic_contexts::KinematicContexts contexts_;
+  std::array<moveit::core::RobotStatePtr, ik_kinematic_contexts::NUM_KINEMATIC_CONTEXTS> kinematic_states_;
+  moveit::core::RobotState * kinematic_state_ = nullptr;
   std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
 
   // Pre-allocate for speed
-  Eigen::MatrixXd jacobian_;
-  Eigen::MatrixXd matrix_s_;
-  Eigen::MatrixXd pseudo_inverse_;
+  std::array<Eigen::MatrixXd, ik_kinematic_contexts::NUM_KINEMATIC_CONTEXTS> jacobians_;
+  Eigen::VectorXd joint_scales_;
+  Eigen::MatrixXd weighted_jacobian_;
+  // Gram matrix of the weighted Jacobian over its shorter side, Js^T Js for up to 6 joints and Js Js^T otherwise;
+  // its eigenvalues are the squared singular values of Js
+  bool gram_of_columns_ = true;
+  Eigen::MatrixXd gram_;
+  Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eigen_solver_;
+  Eigen::VectorXd singular_values_;
+  Eigen::VectorXd damped_inverse_eigenvalues_;
+  Eigen::VectorXd coefficients_;
+  Eigen::Matrix<double, 6, 1> delta_x_;
+  Eigen::VectorXd delta_theta_;
+  Eigen::Matrix<double, 6, 1> singular_direction_;
+
+  // Adjoints of the transforms of the two conversions, kept apart so that alternating calls reuse them
+  ik_adjoint::AdjointCache control_frame_adjoint_;
+  ik_adjoint::AdjointCache desired_frame_adjoint_;
+
+  // Slows down near singularities, from the decomposition of the conversion
+  ik_singularity::SingularityVelocityScaling singularity_scaling_;
+  bool singularity_scaling_enable_ = true;
+
+  // Damping of the least-squares inverse, rising near singularities
+  ik_singularity::DampingSchedule damping_schedule_;
 };
 
 }  // namespace moveit_differential_ik_plugin
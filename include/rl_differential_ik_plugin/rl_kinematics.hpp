@@ -16,9 +16,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+
+#include "eigen3/Eigen/Cholesky"
 #include "eigen3/Eigen/Core"
+#include "eigen3/Eigen/SVD"
 
+#include "ik_adjoint/adjoint.hpp"
+#include "ik_eigen_interface/ik_eigen_interface.hpp"
 #include "ik_interface/ik_plugin_base.hpp"
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
+#include "ik_singularity/box_qp_solver.hpp"
+#include "ik_singularity/manipulability_atlas.hpp"
+#include "ik_singularity/null_space_objectives.hpp"
+#include "ik_singularity/singularity_velocity_scaling.hpp"
 #include "geometry_msgs/msg/transform_stamped.hpp"
 #include "rclcpp/rclcpp.hpp"
 
@@ -36,7 +48,8 @@
 namespace rl_differential_ik_plugin
 {
 
-class RLKinematics : public ik_interface::IKBaseClass
+class RLKinematics : public ik_interface::IKBaseClass, public ik_eigen_interface::IKEigenInterface,
+  public ik_kinematic_contexts::IKContextInterface
 {
 public:
   RLKinematics();
@@ -82,6 +95,29 @@ public:
     const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
     std::vector<double> & delta_x_vec);
 
+  /// Realtime safe: the conversions above on caller-owned buffers, see ik_eigen_interface::IKEigenInterface
+  bool
+  convert_cartesian_deltas_to_joint_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> delta_theta);
+
+  bool
+  convert_cartesian_to_joint(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+    ik_eigen_interface::CartesianQuantity quantity,
+    const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+    Eigen::Ref<Eigen::VectorXd> delta_theta);
+
+  bool
+  convert_joint_deltas_to_cartesian_deltas(
+    const Eigen::Ref<const Eigen::VectorXd> & delta_theta,
+    const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
+    Eigen::Ref<Eigen::VectorXd> delta_x);
+
+  /// Realtime safe: origin of the joint bounds of the QP for the next motion conversion
+  void set_joint_delta_origin(const Eigen::Ref<const Eigen::VectorXd> & joint_positions);
+
   bool update_robot_state(const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state)
   {
     if (current_joint_state.positions.size() != control_inds.size())
@@ -90,25 +126,34 @@ public:
       return false;
     }
 
-    auto positions = model.getPosition();
-    for(int i =0; i < control_inds.size(); i++){
-        positions[control_inds[i]] = current_joint_state.positions[i];
-    }
-    model.setPosition(positions);
-    model.forwardPosition();
-
+    // The kinematics of the selected context are computed when needed, and only if its joint state changed
+    contexts_.update(current_joint_state.positions);
     return true;
   }
 
+  /// Realtime safe: see ik_kinematic_contexts::IKContextInterface
+  void select_kinematic_context(ik_kinematic_contexts::KinematicContext context)
+  {
+    contexts_.select(context);
+  }
+
+  size_t forward_kinematics_updates(ik_kinematic_contexts::KinematicContext context) const
+  {
+    return contexts_.forward_kinematics_updates(context);
+  }
+
+  size_t jacobian_updates(ik_kinematic_contexts::KinematicContext context) const
+  {
+    return contexts_.jacobian_updates(context);
+  }
+
 private:
-  /** \brief Possibly calculate a velocity scaling factor, due to proximity of
-   * singularity and direction of motion
-//   */
+  // Largest number of control joints of the QP, which has fixed-size storage
+  static constexpr int QP_MAX_JOINTS = 8;
 
-  void calculateJacobian();
-//  double velocityScalingFactorForSingularity(const Eigen::VectorXd& commanded_velocity,
-//                                             const Eigen::JacobiSVD<Eigen::MatrixXd>& svd,
-//                                             const Eigen::MatrixXd& pseudo_inverse);
+  void calculateForwardKinematics();
+  const Eigen::MatrixXd & calculateJacobian();
+  void solveWithJointBounds(const Eigen::VectorXd & delta_x, double damping, Eigen::VectorXd & delta_theta);
 
 //    Eigen::Isometry3d get_link_transform(
 //            const std::string& link_name, const trajectory_msgs::msg::JointTrajectoryPoint & joint_state);
@@ -120,9 +165,61 @@ private:
 
   // Pre-allocate for speed
   Eigen::MatrixXd all_jacobians_;
-  Eigen::MatrixXd jacobian_;
+  // Kinematics of each context; the model holds the joint state of model_context_
+  ik_kinematic_contexts::KinematicContexts contexts_;
+  std::array<Eigen::MatrixXd, ik_kinematic_contexts::NUM_KINEMATIC_CONTEXTS> jacobians_;
+  std::array<Eigen::Vector3d, ik_kinematic_contexts::NUM_KINEMATIC_CONTEXTS> end_effector_positions_;
+  rl::math::Vector model_positions_;
+  size_t model_context_ = 0;
   Eigen::MatrixXd matrix_s_;
   Eigen::MatrixXd pseudo_inverse_;
+  Eigen::VectorXd joint_scales_;
+  Eigen::MatrixXd weighted_jacobian_;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd_;
+  Eigen::VectorXd damped_singular_values_;
+  // Input of the conversion, transformed to the IK base frame in place, and its result
+  Eigen::VectorXd delta_x_;
+  Eigen::VectorXd delta_theta_;
+
+  // Adjoints of the transforms of the two conversions, kept apart so that alternating calls reuse them
+  ik_adjoint::AdjointCache control_frame_adjoint_;
+  ik_adjoint::AdjointCache desired_frame_adjoint_;
+
+  // Slows down near singularities, from the decomposition of the conversion
+  ik_singularity::SingularityVelocityScaling singularity_scaling_;
+  bool singularity_scaling_enable_ = true;
+
+  // Damping of the least-squares inverse, rising near singularities
+  ik_singularity::DampingSchedule damping_schedule_;
+  // Configured joint weights as scales W^-1/2, computed once; otherwise the column norms of each cycle
+  bool fixed_joint_scales_ = false;
+
+  // Self-motion of redundant arms towards secondary objectives
+  ik_singularity::NullSpaceObjectives null_space_objectives_;
+  bool null_space_enable_ = false;
+  Eigen::VectorXd null_space_motion_;
+  Eigen::VectorXd null_space_coefficients_;
+
+  // Damped least squares as a QP with the joint bounds, warm-started from the bounds active in the last cycle
+  ik_singularity::BoxQpSolver<QP_MAX_JOINTS> qp_solver_;
+  bool qp_enable_ = false;
+  double qp_max_joint_delta_ = 0.0;
+  Eigen::MatrixXd qp_hessian_;
+  Eigen::VectorXd qp_gradient_;
+  Eigen::VectorXd qp_lower_;
+  Eigen::VectorXd qp_upper_;
+  ik_singularity::BoxQpSolver<QP_MAX_JOINTS>::Vector qp_solution_;
+  std::vector<double> min_positions_;
+  std::vector<double> max_positions_;
+  // Joint positions the next motion conversion is added to, if set; otherwise those of the selected context
+  Eigen::VectorXd joint_delta_origin_;
+  bool joint_delta_origin_set_ = false;
+
+  // Precomputed singularity proximity, replaces the decomposition if loaded
+  ik_singularity::ManipulabilityAtlas atlas_;
+  Eigen::VectorXd atlas_gradient_;
+  Eigen::MatrixXd normal_matrix_;
+  Eigen::LDLT<Eigen::MatrixXd> ldlt_;
 
   std::vector<int> control_inds;
 
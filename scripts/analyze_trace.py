@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022, PickNik, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors: Paul Gesel
+
+"""
+Per-phase latency breakdown of the admittance controller from an LTTng trace.
+
+The controller has to be built with -DADMITTANCE_CONTROLLER_TRACING=ON. Record e.g. with
+
+    ros2 trace -s admittance -u 'admittance_controller:*' -k sched_switch
+
+and run
+
+    analyze_trace.py ~/.ros/tracing/admittance
+
+If the trace contains the sched_switch kernel event, the breakdown also shows how often the
+controller thread was switched out during each phase and for how long.
+"""
+
+import argparse
+import collections
+import math
+import sys
+
+# Keep in sync with admittance_controller::UpdatePhase and admittance_controller::IkCall
+PHASE_NAMES = [
+    'input_read', 'hardware_read', 'sample_trajectory', 'admittance_update', 'admittance_wrench',
+    'admittance_fk', 'admittance_ik', 'command_write', 'tolerance_check', 'action_server_update',
+    'state_publish', 'total',
+]
+IK_CALL_NAMES = [
+    'update_robot_state', 'end_effector_position', 'joint_to_cartesian_deltas',
+    'cartesian_to_joint_deltas',
+]
+
+PROVIDER = 'admittance_controller'
+
+
+class Interval:
+    """Statistics of one phase or IK call."""
+
+    def __init__(self):
+        self.durations = []
+        self.switches = 0
+        self.off_cpu = 0
+
+
+class TraceAnalysis:
+    """Matches begin/end events per thread and attributes scheduler switches to open intervals."""
+
+    def __init__(self):
+        self.phases = collections.defaultdict(Interval)
+        self.ik_calls = collections.defaultdict(Interval)
+        # (tid, context, kind, id) -> begin timestamp
+        self._open = {}
+        # tid -> timestamp when the thread was switched out
+        self._switched_out = {}
+
+    def begin(self, tid, context, kind, index, stamp):
+        self._open[(tid, context, kind, index)] = stamp
+
+    def end(self, tid, context, kind, index, stamp):
+        begin = self._open.pop((tid, context, kind, index), None)
+        if begin is None:
+            return
+        self._intervals(kind)[index].durations.append(stamp - begin)
+
+    def sched_switch(self, prev_tid, next_tid, stamp):
+        if self._has_open(prev_tid):
+            self._switched_out[prev_tid] = stamp
+            for (tid, _, kind, index) in self._open:
+                if tid == prev_tid:
+                    self._intervals(kind)[index].switches += 1
+        switched_out = self._switched_out.pop(next_tid, None)
+        if switched_out is not None:
+            for (tid, _, kind, index) in self._open:
+                if tid == next_tid:
+                    self._intervals(kind)[index].off_cpu += stamp - switched_out
+
+    def _has_open(self, tid):
+        return any(key[0] == tid for key in self._open)
+
+    def _intervals(self, kind):
+        return self.phases if kind == 'phase' else self.ik_calls
+
+
+def percentile(sorted_values, p):
+    index = max(int(math.ceil(p / 100.0 * len(sorted_values))) - 1, 0)
+    return sorted_values[min(index, len(sorted_values) - 1)]
+
+
+def print_table(title, intervals, names, show_scheduling):
+    print(title)
+    header = '  {:<26}{:>9}{:>10}{:>10}{:>10}{:>10}{:>10}'.format(
+        'name', 'count', 'mean', 'p50', 'p99', 'p99.9', 'max')
+    if show_scheduling:
+        header += '{:>10}{:>12}'.format('switches', 'off-cpu')
+    print(header)
+    for index in sorted(intervals):
+        interval = intervals[index]
+        if not interval.durations:
+            continue
+        values = sorted(d * 1e-3 for d in interval.durations)
+        name = names[index] if 0 <= index < len(names) else str(index)
+        line = '  {:<26}{:>9}{:>10.2f}{:>10.2f}{:>10.2f}{:>10.2f}{:>10.2f}'.format(
+            name, len(values), sum(values) / len(values), percentile(values, 50.0),
+            percentile(values, 99.0), percentile(values, 99.9), values[-1])
+        if show_scheduling:
+            line += '{:>10}{:>12.2f}'.format(interval.switches, interval.off_cpu * 1e-3)
+        print(line)
+    print('  (latencies in us)')
+
+
+def analyze(trace_path):
+    try:
+        import bt2
+    except ImportError:
+        sys.exit('The babeltrace2 Python bindings (python3-bt2) are required to read traces.')
+
+    analysis = TraceAnalysis()
+    has_sched_switch = False
+    for msg in bt2.TraceCollectionMessageIterator(trace_path):
+        if type(msg) is not bt2._EventMessageConst:
+            continue
+        event = msg.event
+        stamp = msg.default_clock_snapshot.ns_from_origin
+        if event.name == 'sched_switch':
+            has_sched_switch = True
+            analysis.sched_switch(int(event['prev_tid']), int(event['next_tid']), stamp)
+            continue
+        if not event.name.startswith(PROVIDER + ':'):
+            continue
+        name = event.name[len(PROVIDER) + 1:]
+        try:
+            tid = int(event['vtid'])
+        except KeyError:
+            sys.exit('Events need the vtid context (ros2 trace adds it by default).')
+        context = int(event['context'])
+        if name == 'phase_begin':
+            analysis.begin(tid, context, 'phase', int(event['phase']), stamp)
+        elif name == 'phase_end':
+            analysis.end(tid, context, 'phase', int(event['phase']), stamp)
+        elif name == 'ik_call_begin':
+            analysis.begin(tid, context, 'ik', int(event['call']), stamp)
+        elif name == 'ik_call_end':
+            analysis.end(tid, context, 'ik', int(event['call']), stamp)
+    return analysis, has_sched_switch
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('trace', help='path of the trace directory')
+    args = parser.parse_args()
+
+    analysis, has_sched_switch = analyze(args.trace)
+    if not analysis.phases:
+        sys.exit('No admittance_controller events found in ' + args.trace)
+    print_table('Update phases', analysis.phases, PHASE_NAMES, has_sched_switch)
+    if analysis.ik_calls:
+        print()
+        print_table('IK plugin calls', analysis.ik_calls, IK_CALL_NAMES, has_sched_switch)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022, PickNik, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Authors: Paul Gesel
+
+"""
+Compare two Google Benchmark JSON results, e.g. of benchmark_admittance, against each other.
+
+    compare_benchmarks.py baseline.json current.json --threshold 0.1
+
+Prints the relative change of every benchmark present in both files and exits with 1 if any of them got
+slower than the baseline by more than the threshold. With --benchmark_repetitions the median is compared.
+"""
+
+import argparse
+import json
+import sys
+
+UNITS = {'ns': 1.0, 'us': 1e3, 'ms': 1e6, 's': 1e9}
+
+
+def load(path, metric):
+    """Return {benchmark name: time in ns}, preferring the median aggregate of repeated runs."""
+    with open(path) as f:
+        benchmarks = json.load(f)['benchmarks']
+    results = {}
+    medians = {}
+    for benchmark in benchmarks:
+        if benchmark.get('error_occurred'):
+            continue
+        time = benchmark[metric] * UNITS[benchmark.get('time_unit', 'ns')]
+        if benchmark.get('run_type') == 'aggregate':
+            if benchmark.get('aggregate_name') == 'median':
+                medians[benchmark['run_name']] = time
+        else:
+            results.setdefault(benchmark.get('run_name', benchmark['name']), time)
+    results.update(medians)
+    return results
+
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('baseline', help='JSON output of the baseline run')
+    parser.add_argument('current', help='JSON output of the run to check')
+    parser.add_argument('--threshold', type=float, default=0.1,
+                        help='allowed relative slowdown (default: 0.1 = 10%%)')
+    parser.add_argument('--metric', choices=['cpu_time', 'real_time'], default='cpu_time',
+                        help='time to compare (default: cpu_time)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline, args.metric)
+    current = load(args.current, args.metric)
+
+    regressions = []
+    print('{:<70}{:>14}{:>14}{:>10}'.format('benchmark', 'baseline ns', 'current ns', 'change'))
+    for name in sorted(set(baseline) & set(current)):
+        change = current[name] / baseline[name] - 1.0 if baseline[name] > 0 else 0.0
+        flag = ''
+        if change > args.threshold:
+            regressions.append(name)
+            flag = '  REGRESSION'
+        print('{:<70}{:>14.1f}{:>14.1f}{:>+9.1f}%{}'.format(
+            name, baseline[name], current[name], change * 100.0, flag))
+    for name in sorted(set(baseline) ^ set(current)):
+        print('{:<70}  only in {}'.format(name, 'baseline' if name in baseline else 'current'))
+
+    if regressions:
+        print('\n{} benchmark(s) slower than the baseline by more than {:.0f}%'.format(
+            len(regressions), args.threshold * 100.0))
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
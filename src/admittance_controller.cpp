@@ -88,6 +88,29 @@ namespace admittance_controller
         }
 
         try{
+            auto_declare<bool>("publish_state", true);
+            auto_declare<bool>("publish_compact_state", false);
+            auto_declare<bool>("flight_recorder.enable", false);
+            auto_declare<std::string>("flight_recorder.path", "admittance_flight_log.bin");
+            auto_declare<bool>("flight_recorder.delta_compression", true);
+            auto_declare<int64_t>("flight_recorder.buffer_size", 8192);
+            auto_declare<bool>("contact_capture.enable", false);
+            auto_declare<std::string>("contact_capture.directory", ".");
+            auto_declare<double>("contact_capture.pre_trigger_duration", 2.0);
+            auto_declare<double>("contact_capture.post_trigger_duration", 0.5);
+            auto_declare<double>("contact_capture.force_threshold", 0.0);
+            auto_declare<double>("contact_capture.torque_threshold", 0.0);
+            auto_declare<double>("contact_capture.force_derivative_threshold", 0.0);
+            auto_declare<bool>("contact_capture.trigger_on_tolerance_abort", true);
+            auto_declare<bool>("cycle_timing.enable", true);
+            auto_declare<double>("cycle_timing.publish_rate", 1.0);
+            auto_declare<bool>("cycle_timing.perf_counters", false);
+            auto_declare<std::vector<std::string>>("admittance.profiles", std::vector<std::string>());
+            auto_declare<double>("admittance.profile_transition_duration", 0.0);
+            auto_declare<bool>("joint_limits.enable", true);
+            auto_declare<bool>("joint_limits.predictive_braking", true);
+            auto_declare<double>("joint_limits.repulsive_zone", 0.0);
+            auto_declare<double>("joint_limits.repulsive_gain", 0.0);
             admittance_->parameters_.declare_parameters();
         } catch (const std::exception & e) {
             fprintf(stderr, "Exception thrown during init stage with message: %s \n", e.what());
@@ -162,6 +185,18 @@ namespace admittance_controller
         if (get_state().id() == lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE) {
             return controller_interface::return_type::OK;
         }
+        if (cycle_timing_perf_counters_ && cycle_timer_.perf_counters() == nullptr && !perf_counters_failed_) {
+            // Counters measure the calling thread, so they can only be opened from the update loop
+            if (perf_counters_.open()) {
+                cycle_timer_.set_perf_counters(&perf_counters_);
+            } else {
+                perf_counters_failed_ = true;
+                RCLCPP_WARN(get_node()->get_logger(), "Benchmark mode without hardware counters: %s",
+                            perf_counters_.error().c_str());
+            }
+        }
+        const auto update_start = std::chrono::steady_clock::now();
+        PhaseTimer phase_timer(&cycle_timer_, UpdatePhase::INPUT_READ);
 
         // sense: get all controller inputs
         auto current_external_msg = traj_external_point_ptr_->get_trajectory_msg();
@@ -179,6 +214,7 @@ namespace admittance_controller
         if (check_and_assign_new_message(rtBuffers.input_wrench_command_, wrench_msg)) {
         }
 
+        phase_timer.next(UpdatePhase::HARDWARE_READ);
         geometry_msgs::msg::Wrench ft_values;
         force_torque_sensor_->get_values_as_message(ft_values);
         read_state_from_hardware(state_current);
@@ -189,6 +225,7 @@ namespace admittance_controller
         if (state_current.velocities.empty()) state_current.velocities = last_commanded_state_.velocities;
         if (state_current.accelerations.empty()) state_current.accelerations = last_commanded_state_.accelerations;
 
+        phase_timer.next(UpdatePhase::SAMPLE_TRAJECTORY);
         // find segment for current timestamp. In the case that the trajectory sample is invalid, state_reference
         // will be set to empty.
         std::vector<trajectory_msgs::msg::JointTrajectoryPoint>::const_iterator start_segment_itr, end_segment_itr;
@@ -229,7 +266,9 @@ namespace admittance_controller
         // command: determine desired state from trajectory or pose goal
         // and apply admittance controller
 
-        admittance_->update(state_current, ft_values, state_reference, period, state_desired);
+        phase_timer.next(UpdatePhase::ADMITTANCE_UPDATE);
+        const auto admittance_ret = admittance_->update(state_current, ft_values, state_reference, period, state_desired);
+        phase_timer.next(UpdatePhase::COMMAND_WRITE);
 
 //        state_desired = state_reference;
 
@@ -237,12 +276,15 @@ namespace admittance_controller
 //
 //RCLCPP_INFO(get_node()->get_logger(), "current_reference [%f, %f, %f]", state_current.positions[0],state_current.positions[1],state_current.positions[2]);
 //
-        RCLCPP_INFO(get_node()->get_logger(), "state_reference [%f, %f, %f]", state_reference.positions[0],state_reference.positions[1],state_reference.positions[2]);
-        RCLCPP_INFO(get_node()->get_logger(), "state_desired [%f, %f, %f] ", state_desired.positions[0],state_desired.positions[1],state_desired.positions[2]);
 
 
-        // Apply joint limiter
-//        if (joint_limiter_) joint_limiter_->enforce_limits(period);
+        // Apply joint limits to the desired state before it is commanded
+        if (joint_limits_enable_) {
+            joint_limits_.enforce(state_desired.positions, state_desired.velocities, state_desired.accelerations,
+                                  period.seconds());
+            // The rule continues from the limited state, so that it does not wind up past a limit
+            admittance_->feed_back_limited_joint_state(state_reference, state_desired);
+        }
 
         // write calculated values to joint interfaces
         // at goal time (end of trajectory), check goal reference error and send fail to
@@ -264,6 +306,7 @@ namespace admittance_controller
             joint_acceleration_command_interface_[i].get().set_value(state_desired.accelerations[i]);
             last_commanded_state_.accelerations[i] = state_desired.accelerations[i];
         }
+        phase_timer.next(UpdatePhase::TOLERANCE_CHECK);
         // Compute state_error
         auto compute_error_for_joint = [&](
                 trajectory_msgs::msg::JointTrajectoryPoint & error, int index,
@@ -291,19 +334,41 @@ namespace admittance_controller
             outside_goal_state_tolerance |= !before_last_point && !check_state_tolerance_per_joint(
                                 state_error, index, default_tolerances_.goal_state_tolerance[index], false);
         }
+        phase_timer.next(UpdatePhase::ACTION_SERVER_UPDATE);
         perform_action_server_update(
                 before_last_point, abort, outside_goal_state_tolerance,
                 default_tolerances_.goal_time_tolerance, time, joint_names_, state_current,
                 state_desired, state_error, start_segment_itr);
 
+        phase_timer.next(UpdatePhase::STATE_PUBLISH);
+        // Record the cycle for the flight log and the contact event capture
+        if (flight_recorder_.is_running() || contact_event_capture_.is_running()) {
+            fill_cycle_record(time, period, ft_values, update_start, cycle_record_);
+            cycle_record_.flags = (admittance_ret != controller_interface::return_type::OK ? CYCLE_FLAG_UPDATE_ERROR : 0u) |
+                                  (abort ? CYCLE_FLAG_TOLERANCE_ABORT : 0u);
+            flight_recorder_.record(cycle_record_);
+            contact_event_capture_.add(cycle_record_);
+        }
+        ++cycle_index_;
+
         // Publish controller state
-        rtBuffers.state_publisher_->lock();
-        rtBuffers.state_publisher_->msg_.input_joint_command = pre_admittance_point;
-        rtBuffers.state_publisher_->msg_.desired_joint_state = state_desired;
-        rtBuffers.state_publisher_->msg_.actual_joint_state = state_current;
-        rtBuffers.state_publisher_->msg_.error_joint_state = state_error;
-        admittance_->get_controller_state(rtBuffers.state_publisher_->msg_);
-        rtBuffers.state_publisher_->unlockAndPublish();
+        if (publish_state_ && rtBuffers.state_publisher_->trylock()) {
+            rtBuffers.state_publisher_->msg_.input_joint_command = pre_admittance_point;
+            rtBuffers.state_publisher_->msg_.desired_joint_state = state_desired;
+            rtBuffers.state_publisher_->msg_.actual_joint_state = state_current;
+            rtBuffers.state_publisher_->msg_.error_joint_state = state_error;
+            admittance_->get_controller_state(rtBuffers.state_publisher_->msg_);
+            rtBuffers.state_publisher_->unlockAndPublish();
+        }
+        if (publish_compact_state_ && rtBuffers.compact_state_publisher_->trylock()) {
+            fill_compact_state(time, period, rtBuffers.compact_state_publisher_->msg_);
+            rtBuffers.compact_state_publisher_->unlockAndPublish();
+        }
+
+        phase_timer.stop();
+        if (cycle_timer_.enabled()) {
+            cycle_timer_.record(UpdatePhase::TOTAL, std::chrono::steady_clock::now() - update_start);
+        }
 
         return controller_interface::return_type::OK;
     }
@@ -320,6 +385,25 @@ namespace admittance_controller
                 get_bool_param_and_error_if_empty(allow_integration_in_goal_trajectories_, "allow_integration_in_goal_trajectories") ||
                 get_double_param_and_error_if_empty(action_monitor_rate, "action_monitor_rate") ||
                 get_bool_param_and_error_if_empty(open_loop_control_, "open_loop_control") ||
+                get_bool_param_and_error_if_empty(publish_state_, "publish_state") ||
+                get_bool_param_and_error_if_empty(publish_compact_state_, "publish_compact_state") ||
+                get_bool_param_and_error_if_empty(flight_recorder_enable_, "flight_recorder.enable") ||
+                get_string_param_and_error_if_empty(flight_recorder_path_, "flight_recorder.path") ||
+                get_bool_param_and_error_if_empty(flight_recorder_delta_compression_, "flight_recorder.delta_compression") ||
+                get_bool_param_and_error_if_empty(contact_capture_enable_, "contact_capture.enable") ||
+                get_string_param_and_error_if_empty(contact_capture_options_.directory, "contact_capture.directory") ||
+                get_double_param_and_error_if_empty(contact_capture_options_.force_threshold, "contact_capture.force_threshold") ||
+                get_double_param_and_error_if_empty(contact_capture_options_.torque_threshold, "contact_capture.torque_threshold") ||
+                get_double_param_and_error_if_empty(contact_capture_options_.force_derivative_threshold,
+                                                    "contact_capture.force_derivative_threshold") ||
+                get_bool_param_and_error_if_empty(contact_capture_options_.trigger_on_tolerance_abort,
+                                                  "contact_capture.trigger_on_tolerance_abort") ||
+                get_bool_param_and_error_if_empty(cycle_timing_enable_, "cycle_timing.enable") ||
+                get_double_param_and_error_if_empty(cycle_timing_publish_rate_, "cycle_timing.publish_rate") ||
+                get_bool_param_and_error_if_empty(cycle_timing_perf_counters_, "cycle_timing.perf_counters") ||
+                get_double_param_and_error_if_empty(profile_transition_duration_,
+                                                    "admittance.profile_transition_duration") ||
+                get_bool_param_and_error_if_empty(joint_limits_enable_, "joint_limits.enable") ||
                 !admittance_->parameters_.get_parameters()
                 )
         {
@@ -390,6 +474,47 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         s_publisher_ = get_node()->create_publisher<control_msgs::msg::AdmittanceControllerState>(
                 "~/state", rclcpp::SystemDefaultsQoS());
         rtBuffers.state_publisher_ = std::make_unique<realtime_tools::RealtimePublisher<ControllerStateMsg>>(s_publisher_);
+        // Compact state publisher; names are sent once on the latched metadata topic
+        compact_state_publisher_ = get_node()->create_publisher<ControllerCompactStateMsg>(
+                "~/state_compact", rclcpp::SystemDefaultsQoS());
+        rtBuffers.compact_state_publisher_ =
+                std::make_unique<realtime_tools::RealtimePublisher<ControllerCompactStateMsg>>(compact_state_publisher_);
+        state_metadata_publisher_ = get_node()->create_publisher<ControllerStateMetadataMsg>(
+                "~/state_compact/metadata", rclcpp::QoS(1).transient_local());
+        // Cycle timing: histograms are filled in update and published at a low rate from a non-realtime timer
+        cycle_timer_.set_enabled(cycle_timing_enable_);
+        cycle_timer_.reset();
+        admittance_->cycle_timer_ = &cycle_timer_;
+        cycle_timing_timer_.reset();
+        if (cycle_timing_enable_ && cycle_timing_publish_rate_ > 0.0) {
+            cycle_timing_publisher_ = get_node()->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+                    "~/cycle_timing", rclcpp::SystemDefaultsQoS());
+            cycle_timing_timer_ = get_node()->create_wall_timer(
+                    std::chrono::duration<double>(1.0 / cycle_timing_publish_rate_),
+                    std::bind(&AdmittanceController::publish_cycle_timing, this));
+        }
+        reset_cycle_timing_service_ = get_node()->create_service<std_srvs::srv::Trigger>(
+                "~/reset_cycle_timing",
+                [this](const std::shared_ptr<std_srvs::srv::Trigger::Request>,
+                       std::shared_ptr<std_srvs::srv::Trigger::Response> response) {
+                    cycle_timer_.reset();
+                    response->success = true;
+                    response->message = "Cycle timing histograms were reset.";
+                });
+        // Profile switches are only handed over here; the update loop takes them over at its next cycle
+        select_admittance_profile_service_ = get_node()->create_service<SelectAdmittanceProfileSrv>(
+                "~/select_admittance_profile",
+                [this](const std::shared_ptr<SelectAdmittanceProfileSrv::Request> request,
+                       std::shared_ptr<SelectAdmittanceProfileSrv::Response> response) {
+                    const double transition_duration = request->transition_duration < 0.0 ?
+                            profile_transition_duration_ : request->transition_duration;
+                    response->success = admittance_->profiles_.request(
+                            admittance_->profiles_.find(request->name), transition_duration);
+                    const std::string name = request->name.empty() ? "parameter gains" : "'" + request->name + "'";
+                    response->message = response->success ?
+                            "Switching to " + name + " over " + std::to_string(transition_duration) + " s." :
+                            "Unknown admittance profile " + name + ".";
+                });
         // set up TF listener
         tf_buffer_ = std::make_shared<tf2_ros::Buffer>(get_node()->get_clock());
         tf_listener_ = std::make_shared<tf2_ros::TransformListener>(*tf_buffer_);
@@ -404,6 +529,34 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         rtBuffers.state_publisher_->msg_.desired_joint_state.positions.resize(num_joints_, 0.0);
         rtBuffers.state_publisher_->msg_.error_joint_state.positions.resize(num_joints_, 0.0);
         rtBuffers.state_publisher_->unlock();
+        flight_recorder_buffer_size_ = get_node()->get_parameter("flight_recorder.buffer_size").as_int();
+        if (flight_recorder_enable_ && (num_joints_ > static_cast<int>(MAX_RECORDED_JOINTS) ||
+                                        flight_recorder_buffer_size_ <= 0)) {
+            RCLCPP_ERROR(get_node()->get_logger(), "Flight recorder supports at most %zu joints and needs a positive "
+                         "'flight_recorder.buffer_size'.", MAX_RECORDED_JOINTS);
+            return CallbackReturn::ERROR;
+        }
+        if (contact_capture_enable_) {
+            // window sizes are given in seconds, the ring holds one record per update cycle
+            const double update_rate = get_update_rate() > 0 ? static_cast<double>(get_update_rate()) : 1000.0;
+            contact_capture_options_.pre_trigger_records = static_cast<size_t>(
+                    std::ceil(get_node()->get_parameter("contact_capture.pre_trigger_duration").as_double() * update_rate));
+            contact_capture_options_.post_trigger_records = static_cast<size_t>(
+                    std::ceil(get_node()->get_parameter("contact_capture.post_trigger_duration").as_double() * update_rate));
+            if (num_joints_ > static_cast<int>(MAX_RECORDED_JOINTS) || contact_capture_options_.pre_trigger_records == 0) {
+                RCLCPP_ERROR(get_node()->get_logger(), "Contact capture supports at most %zu joints and needs a positive "
+                             "'contact_capture.pre_trigger_duration'.", MAX_RECORDED_JOINTS);
+                return CallbackReturn::ERROR;
+            }
+        }
+        if (num_joints_ > ControllerCompactStateMsg::MAX_JOINTS) {
+            RCLCPP_ERROR(get_node()->get_logger(), "Compact state supports at most %u joints, but %d are configured.",
+                         ControllerCompactStateMsg::MAX_JOINTS, num_joints_);
+            return CallbackReturn::ERROR;
+        }
+        rtBuffers.compact_state_publisher_->lock();
+        rtBuffers.compact_state_publisher_->msg_.num_joints = num_joints_;
+        rtBuffers.compact_state_publisher_->unlock();
         // get default tolerances
         default_tolerances_ = joint_trajectory_controller::get_segment_tolerances(*get_node(), joint_names_);
         // Initialize FTS semantic semantic_component
@@ -432,11 +585,24 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
 //            return CallbackReturn::ERROR;
 //          }
 
-        // TODO: this causes the error:
-       //[ERROR]  error: package 'joint_limits' not found, searching:
-        // Initialize joint limits
-
-//
+        // Initialize joint limits from the URDF; acceleration limits are parameters since URDF has none
+        if (joint_limits_enable_) {
+            std::string robot_description;
+            get_node()->get_parameter("robot_description", robot_description);
+            std::vector<double> max_accelerations(num_joints_);
+            for (auto i = 0ul; i < num_joints_; ++i) {
+                max_accelerations[i] = auto_declare<double>(
+                        "joint_limits." + joint_names_[i] + ".max_acceleration", 0.0);
+            }
+            std::string error;
+            if (!joint_limits_.configure(joint_names_, robot_description, max_accelerations, error)) {
+                RCLCPP_ERROR(get_node()->get_logger(), "Could not load joint limits: %s", error.c_str());
+                return CallbackReturn::ERROR;
+            }
+            joint_limits_.configure_braking(get_node()->get_parameter("joint_limits.predictive_braking").as_bool(),
+                                            get_node()->get_parameter("joint_limits.repulsive_zone").as_double(),
+                                            get_node()->get_parameter("joint_limits.repulsive_gain").as_double());
+        }
 
         // configure admittance rule
         admittance_->configure(get_node());
@@ -444,6 +610,34 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         // not work properly: why?
         admittance_->parameters_.update();
 
+        // Gain changes are stored and published by the parameter callback thread, so the update loop neither
+        // logs nor recomputes damping; it only picks up the new snapshot
+        on_set_callback_handle_ = get_node()->add_on_set_parameters_callback(
+                [this](const std::vector<rclcpp::Parameter> & parameters) {
+                    const bool update_gains = admittance_->parameters_.enable_parameter_update_without_reactivation_;
+                    auto result = admittance_->parameters_.set_parameters_if_gains_valid(parameters, update_gains);
+                    if (result.successful && update_gains &&
+                        admittance_->publish_parameters() != controller_interface::return_type::OK)
+                    {
+                        result.successful = false;
+                        result.reason = "Could not publish the admittance gains";
+                    }
+                    return result;
+                });
+
+        if (!configure_admittance_profiles())
+        {
+            return CallbackReturn::ERROR;
+        }
+
+        // Send frame and joint names once for the compact state stream
+        ControllerStateMetadataMsg metadata;
+        metadata.ik_base_frame = admittance_->parameters_.ik_base_frame_;
+        metadata.control_frame = admittance_->parameters_.control_frame_;
+        metadata.sensor_frame = admittance_->parameters_.sensor_frame_;
+        metadata.joint_names = joint_names_;
+        state_metadata_publisher_->publish(metadata);
+
         return LifecycleNodeInterface::on_configure(previous_state);
     }
 
@@ -537,8 +731,15 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
 
         // Initialize interface of the FTS semantic semantic component
         force_torque_sensor_->assign_loaned_state_interfaces(state_interfaces_);
-        // Initialize Admittance Rule from current states
-        admittance_->reset();
+        // Initialize Admittance Rule from current states; gains changed since configure are applied now
+        admittance_->parameters_.update_gain_storage();
+        if (admittance_->reset() != controller_interface::return_type::OK)
+        {
+            RCLCPP_ERROR(get_node()->get_logger(), "Invalid admittance gains, not activating");
+            controller_is_active_ = false;
+            return CallbackReturn::ERROR;
+        }
+        cycle_index_ = 0;
 
         // Handle state after restart or initial startup
         read_state_from_hardware(last_state_reference_);
@@ -553,6 +754,8 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         if (last_state_reference_.accelerations.empty()) last_state_reference_.accelerations.assign(num_joints_, 0.0);
         if (last_commanded_state_.velocities.empty()) last_commanded_state_.velocities.assign(num_joints_, 0.0);
         if (last_commanded_state_.accelerations.empty()) last_commanded_state_.accelerations.assign(num_joints_, 0.0);
+        // rate limits start from the last command
+        joint_limits_.reset(last_commanded_state_.positions, last_commanded_state_.velocities);
 
 
         // if in open loop mode, the position interface should be ignored even if it exist
@@ -571,6 +774,25 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
                 get_node(), this, action_monitor_rate, allow_partial_joints_goal_, joint_names_,
                 allow_integration_in_goal_trajectories_);
 
+        // start full-rate recording; the file is written from a background thread
+        if (flight_recorder_enable_) {
+            FlightRecorderOptions options;
+            options.compression = flight_recorder_delta_compression_ ? FlightLogCompression::XOR_DELTA
+                                                                     : FlightLogCompression::NONE;
+            options.buffer_size = static_cast<size_t>(flight_recorder_buffer_size_);
+            if (!flight_recorder_.start(flight_recorder_path_, options)) {
+                RCLCPP_ERROR(get_node()->get_logger(), "Could not open flight log '%s'.", flight_recorder_path_.c_str());
+                return CallbackReturn::ERROR;
+            }
+            RCLCPP_INFO(get_node()->get_logger(), "Recording flight log to '%s'.", flight_recorder_path_.c_str());
+        }
+        if (contact_capture_enable_) {
+            contact_event_capture_.start(contact_capture_options_);
+            RCLCPP_INFO(get_node()->get_logger(), "Capturing contact events with %zu pre-trigger and %zu post-trigger "
+                        "cycles into '%s'.", contact_capture_options_.pre_trigger_records,
+                        contact_capture_options_.post_trigger_records, contact_capture_options_.directory.c_str());
+        }
+
         return CallbackReturn::SUCCESS;;
     }
 
@@ -578,6 +800,25 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         controller_is_active_ = false;
         force_torque_sensor_->release_interfaces();
 
+        if (flight_recorder_.is_running()) {
+            flight_recorder_.stop();
+            if (flight_recorder_.dropped() > 0) {
+                RCLCPP_WARN(get_node()->get_logger(), "Flight recorder dropped %zu records because the writer did not "
+                            "keep up; consider increasing 'flight_recorder.buffer_size'.", flight_recorder_.dropped());
+            }
+            if (flight_recorder_.write_failures() > 0) {
+                RCLCPP_WARN(get_node()->get_logger(), "Flight recorder could not write %zu records to the log; it is "
+                            "incomplete.", flight_recorder_.write_failures());
+            }
+        }
+        if (contact_event_capture_.is_running()) {
+            contact_event_capture_.stop();
+            RCLCPP_INFO(get_node()->get_logger(), "Captured %zu contact events.", contact_event_capture_.num_events());
+        }
+        cycle_timer_.set_perf_counters(nullptr);
+        perf_counters_.close();
+        perf_counters_failed_ = false;
+
         return LifecycleNodeInterface::on_deactivate(previous_state);
     }
 
@@ -666,6 +907,159 @@ RCLCPP_INFO(get_node()->get_logger(), "Action status changes will be monitored a
         }
     }
 
+    void AdmittanceController::fill_cycle_record(
+            const rclcpp::Time & time, const rclcpp::Duration & period,
+            const geometry_msgs::msg::Wrench & measured_wrench,
+            std::chrono::steady_clock::time_point update_start, CycleRecord & record)
+    {
+        // Fill all fields of the per-cycle record. Does not allocate.
+        // The inputs of the admittance rule are stored exactly as passed to it, so the log can be replayed.
+        record.stamp_nanosec = time.nanoseconds();
+        record.cycle_index = cycle_index_;
+        record.period_nanosec = period.nanoseconds();
+        record.period = period.seconds();
+        record.num_joints = static_cast<uint32_t>(num_joints_);
+        admittance_->get_cycle_record(record);
+        convert_message_to_array(measured_wrench, record.wrench_raw);
+
+        copy_joint_values_to_record(state_reference.positions, num_joints_, record.joint_reference_positions);
+        copy_joint_values_to_record(state_reference.velocities, num_joints_, record.joint_reference_velocities);
+        copy_joint_values_to_record(state_reference.accelerations, num_joints_, record.joint_reference_accelerations);
+        copy_joint_values_to_record(state_current.positions, num_joints_, record.joint_actual_positions);
+        copy_joint_values_to_record(state_current.velocities, num_joints_, record.joint_actual_velocities);
+        copy_joint_values_to_record(state_current.accelerations, num_joints_, record.joint_actual_accelerations);
+        copy_joint_values_to_record(state_desired.positions, num_joints_, record.joint_desired_positions);
+        copy_joint_values_to_record(state_desired.velocities, num_joints_, record.joint_desired_velocities);
+        copy_joint_values_to_record(state_desired.accelerations, num_joints_, record.joint_desired_accelerations);
+        copy_joint_values_to_record(state_desired.effort, num_joints_, record.joint_desired_efforts);
+
+        record.update_duration_nanosec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - update_start).count();
+    }
+
+    void AdmittanceController::fill_compact_state(
+            const rclcpp::Time & time, const rclcpp::Duration & period, ControllerCompactStateMsg & msg)
+    {
+        // Fill fields of the compact state message. Only fixed-size fields are written, so this does not allocate.
+        // Joint fields missing from the state (e.g. no velocity interface) are reported as zero.
+        msg.stamp_nanosec = time.nanoseconds();
+        msg.period = period.seconds();
+        admittance_->get_compact_state(msg);
+
+        copy_joint_values_to_record(state_desired.positions, num_joints_, msg.joint_desired_positions);
+        copy_joint_values_to_record(state_desired.velocities, num_joints_, msg.joint_desired_velocities);
+        copy_joint_values_to_record(state_current.positions, num_joints_, msg.joint_actual_positions);
+        copy_joint_values_to_record(state_current.velocities, num_joints_, msg.joint_actual_velocities);
+        copy_joint_values_to_record(state_error.positions, num_joints_, msg.joint_error_positions);
+        copy_joint_values_to_record(state_error.velocities, num_joints_, msg.joint_error_velocities);
+    }
+
+    void AdmittanceController::publish_cycle_timing()
+    {
+        // Report percentiles of every measured phase in microseconds. Runs outside of the realtime loop.
+        diagnostic_msgs::msg::DiagnosticArray diagnostics;
+        diagnostics.header.stamp = get_node()->now();
+        auto add_value = [](diagnostic_msgs::msg::DiagnosticStatus & status, const std::string & key, double value) {
+            diagnostic_msgs::msg::KeyValue key_value;
+            key_value.key = key;
+            key_value.value = std::to_string(value);
+            status.values.push_back(key_value);
+        };
+        // Benchmark mode: hardware counter averages per call
+        auto add_perf_values = [&add_value](diagnostic_msgs::msg::DiagnosticStatus & status,
+                                            const PerfCounterTotals & totals) {
+            if (totals.calls() == 0) {
+                return;
+            }
+            const auto mean = totals.mean();
+            add_value(status, "calls", static_cast<double>(totals.calls()));
+            add_value(status, "cycles", static_cast<double>(mean.cycles));
+            add_value(status, "instructions", static_cast<double>(mean.instructions));
+            add_value(status, "ipc", mean.cycles > 0 ? static_cast<double>(mean.instructions) / mean.cycles : 0.0);
+            add_value(status, "cache_misses", static_cast<double>(mean.cache_misses));
+            add_value(status, "branch_misses", static_cast<double>(mean.branch_misses));
+        };
+        for (auto i = 0ul; i < static_cast<size_t>(UpdatePhase::COUNT); ++i) {
+            const auto phase = static_cast<UpdatePhase>(i);
+            const auto & histogram = cycle_timer_.histogram(phase);
+            if (histogram.count() == 0) {
+                continue;
+            }
+            diagnostic_msgs::msg::DiagnosticStatus status;
+            status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+            status.name = std::string(get_node()->get_name()) + ": cycle timing " + to_string(phase);
+            status.message = "latencies in us";
+            status.values.reserve(7);
+            add_value(status, "count", static_cast<double>(histogram.count()));
+            add_value(status, "mean", histogram.mean() * 1e-3);
+            add_value(status, "p50", histogram.percentile(50.0) * 1e-3);
+            add_value(status, "p90", histogram.percentile(90.0) * 1e-3);
+            add_value(status, "p99", histogram.percentile(99.0) * 1e-3);
+            add_value(status, "p99.9", histogram.percentile(99.9) * 1e-3);
+            add_value(status, "max", histogram.max() * 1e-3);
+            add_perf_values(status, cycle_timer_.perf_totals(phase));
+            diagnostics.status.push_back(status);
+        }
+        for (auto i = 0ul; i < static_cast<size_t>(IkCall::COUNT); ++i) {
+            const auto call = static_cast<IkCall>(i);
+            if (cycle_timer_.perf_totals(call).calls() == 0) {
+                continue;
+            }
+            diagnostic_msgs::msg::DiagnosticStatus status;
+            status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+            status.name = std::string(get_node()->get_name()) + ": ik call " + to_string(call);
+            status.message = "hardware counters per call";
+            add_perf_values(status, cycle_timer_.perf_totals(call));
+            diagnostics.status.push_back(status);
+        }
+        cycle_timing_publisher_->publish(diagnostics);
+    }
+
+    bool AdmittanceController::configure_admittance_profiles() {
+        // Each profile is a complete gain set under 'admittance.profiles.<name>', converted to a snapshot here so
+        // that switching in the update loop only exchanges references
+        const auto names = get_node()->get_parameter("admittance.profiles").as_string_array();
+        std::vector<AdmittanceParameterSnapshot> profiles(names.size());
+        for (auto p = 0ul; p < names.size(); ++p) {
+            const std::string prefix = "admittance.profiles." + names[p] + ".";
+            const auto selected_axes = auto_declare<std::vector<bool>>(prefix + "selected_axes", std::vector<bool>());
+            const auto mass = auto_declare<std::vector<double>>(prefix + "mass", std::vector<double>());
+            const auto stiffness = auto_declare<std::vector<double>>(prefix + "stiffness", std::vector<double>());
+            const auto damping = auto_declare<std::vector<double>>(prefix + "damping", std::vector<double>());
+            const auto damping_ratio = auto_declare<std::vector<double>>(
+                    prefix + "damping_ratio", std::vector<double>());
+            if (selected_axes.size() != 6 || mass.size() != 6 || stiffness.size() != 6 ||
+                (damping.size() != 6 && damping_ratio.size() != 6)) {
+                RCLCPP_ERROR(get_node()->get_logger(),
+                             "Admittance profile '%s' needs 6 values for 'selected_axes', 'mass', 'stiffness' and "
+                             "'damping' or 'damping_ratio'", names[p].c_str());
+                return false;
+            }
+
+            std::array<bool, 6> selected_axes_arr;
+            std::array<double, 6> mass_arr;
+            std::array<double, 6> stiffness_arr;
+            std::array<double, 6> damping_arr;
+            for (auto i = 0ul; i < 6; ++i) {
+                selected_axes_arr[i] = selected_axes[i];
+                mass_arr[i] = mass[i];
+                stiffness_arr[i] = stiffness[i];
+                // Same conversion as for the parameter gains: D = damping_ratio * 2 * sqrt( M * S )
+                damping_arr[i] = damping_ratio.size() == 6 ?
+                        damping_ratio[i] * 2 * sqrt(mass[i] * stiffness[i]) : damping[i];
+            }
+            if (!make_parameter_snapshot(selected_axes_arr, mass_arr, damping_arr, stiffness_arr, profiles[p])) {
+                RCLCPP_ERROR(get_node()->get_logger(),
+                             "Admittance profile '%s' has a non-positive mass or a gain that is not finite",
+                             names[p].c_str());
+                return false;
+            }
+            RCLCPP_INFO(get_node()->get_logger(), "Loaded admittance profile '%s'", names[p].c_str());
+        }
+        admittance_->profiles_.configure(names, profiles);
+        return true;
+    }
+
     bool AdmittanceController::get_string_array_param_and_error_if_empty(
             std::vector<std::string> & parameter, const char * parameter_name) {
         parameter = get_node()->get_parameter(parameter_name).as_string_array();
@@ -1,56 +1,185 @@
+// Copyright (c) 2022, PickNik, Inc.
 //
-// Created by paul on 5/31/22.
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
 //
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
 #include "admittance_joint_limits/admittance_joint_limits.hpp"
-#include "joint_limits_interface/joint_limits.hpp"
 
+#include <algorithm>
+
+#include "eigen3/Eigen/Core"
+#include "urdf/model.h"
+
+namespace admittance_joint_limits
+{
+
+constexpr double AdmittanceJointLimits::NO_LIMIT;
+
+namespace
+{
+// Below this speed the braking scale is not computed from the speed, avoiding a division by zero
+constexpr double MIN_BRAKING_VELOCITY = 1e-9;
+
+using ArrayMap = Eigen::Map<Eigen::ArrayXd>;
+
+ArrayMap map(std::vector<double> & values)
+{
+  return ArrayMap(values.data(), static_cast<Eigen::Index>(values.size()));
+}
+}  // namespace
 
-admittance_joint_limits::AdmittanceJointLimits::AdmittanceJointLimits(const transmission_interface::JointHandle &jposh,
-                                                                      const transmission_interface::JointHandle &jcmdh,
-                                                                      const joint_limits_interface::JointLimits &limits)
-        : JointLimitHandle(jposh, jcmdh, limits) {
+bool AdmittanceJointLimits::configure(
+  const std::vector<std::string> & joint_names, const std::string & robot_description,
+  const std::vector<double> & max_accelerations, std::string & error)
+{
+  urdf::Model model;
+  if (!model.initString(robot_description)) {
+    error = "could not parse the robot description";
+    return false;
+  }
+  if (max_accelerations.size() != joint_names.size()) {
+    error = "expected one acceleration limit per joint";
+    return false;
+  }
 
-    if (limits_.has_position_limits)
-    {
-        min_pos_limit_ = limits_.min_position;
-        max_pos_limit_ = limits_.max_position;
+  std::vector<double> min_positions(joint_names.size(), -NO_LIMIT);
+  std::vector<double> max_positions(joint_names.size(), NO_LIMIT);
+  std::vector<double> max_velocities(joint_names.size(), NO_LIMIT);
+  std::vector<double> accelerations(joint_names.size(), NO_LIMIT);
+  for (auto i = 0ul; i < joint_names.size(); ++i) {
+    const auto joint = model.getJoint(joint_names[i]);
+    if (!joint) {
+      error = "joint '" + joint_names[i] + "' is not in the robot description";
+      return false;
     }
-    else
-    {
-        min_pos_limit_ = -std::numeric_limits<double>::max();
-        max_pos_limit_ = std::numeric_limits<double>::max();
+    if (joint->limits) {
+      // Continuous joints have velocity but no position limits
+      if (joint->type == urdf::Joint::REVOLUTE || joint->type == urdf::Joint::PRISMATIC) {
+        min_positions[i] = joint->limits->lower;
+        max_positions[i] = joint->limits->upper;
+      }
+      if (joint->limits->velocity > 0.0) {
+        max_velocities[i] = joint->limits->velocity;
+      }
     }
+    if (max_accelerations[i] > 0.0) {
+      accelerations[i] = max_accelerations[i];
+    }
+  }
+  configure(min_positions, max_positions, max_velocities, accelerations);
+  return true;
+}
 
+void AdmittanceJointLimits::configure(
+  const std::vector<double> & min_positions, const std::vector<double> & max_positions,
+  const std::vector<double> & max_velocities, const std::vector<double> & max_accelerations)
+{
+  min_positions_ = min_positions;
+  max_positions_ = max_positions;
+  max_velocities_ = max_velocities;
+  max_accelerations_ = max_accelerations;
+  last_positions_.assign(min_positions_.size(), 0.0);
+  last_velocities_.assign(min_positions_.size(), 0.0);
+  braking_.assign(min_positions_.size(), 0.0);
+  has_last_state_ = false;
 }
 
+void AdmittanceJointLimits::configure_braking(bool predictive_braking, double repulsive_zone, double repulsive_gain)
+{
+  predictive_braking_ = predictive_braking;
+  repulsive_zone_ = repulsive_zone;
+  repulsive_gain_ = repulsive_gain;
+}
 
-void admittance_joint_limits::AdmittanceJointLimits::enforce_limits(const rclcpp::Duration &period) {
-    if (std::isnan(prev_pos_))
-    {
-        prev_pos_ = jposh_.get_value();
-    }
+void AdmittanceJointLimits::reset(const std::vector<double> & positions, const std::vector<double> & velocities)
+{
+  has_last_state_ = positions.size() == size();
+  if (has_last_state_) {
+    std::copy(positions.begin(), positions.end(), last_positions_.begin());
+  }
+  if (velocities.size() == size()) {
+    std::copy(velocities.begin(), velocities.end(), last_velocities_.begin());
+  } else {
+    std::fill(last_velocities_.begin(), last_velocities_.end(), 0.0);
+  }
+}
 
-    double min_pos, max_pos;
-    if (limits_.has_velocity_limits)
-    {
-        // enforce velocity limits
-        // set constraints on where the position can be based on the
-        // max velocity times seconds since last update
-        const double delta_pos = limits_.max_velocity * period.seconds();
-        min_pos = std::max(prev_pos_ - delta_pos, min_pos_limit_);
-        max_pos = std::min(prev_pos_ + delta_pos, max_pos_limit_);
+void AdmittanceJointLimits::enforce(
+  std::vector<double> & positions, std::vector<double> & velocities, std::vector<double> & accelerations,
+  double dt)
+{
+  const auto min_position = map(min_positions_);
+  const auto max_position = map(max_positions_);
+  const auto max_velocity = map(max_velocities_);
+  const auto max_acceleration = map(max_accelerations_);
+  auto last_position = map(last_positions_);
+  auto last_velocity = map(last_velocities_);
+  const bool has_positions = positions.size() == size();
+  const bool has_velocities = velocities.size() == size();
+
+  if (!has_last_state_ && has_positions) {
+    last_position = map(positions);
+    has_last_state_ = true;
+  }
+
+  if (has_positions && has_velocities) {
+    auto position = map(positions);
+    auto velocity = map(velocities);
+    auto braking = map(braking_);
+    if (predictive_braking_) {
+      // Fastest speed from which the joint still stops at the limit ahead: v^2 = 2 * a * distance. Position
+      // steps and velocities are scaled alike, so that the braking starts smoothly before the limit.
+      // The product with the distance comes first, so that NO_LIMIT only overflows to infinity if it is > 0.
+      braking = (max_acceleration *
+        (velocity > 0.0).select(max_position - last_position, last_position - min_position).max(0.0) * 2.0).sqrt();
+      braking = (braking / velocity.abs().max(MIN_BRAKING_VELOCITY)).min(1.0);
+      velocity *= braking;
+      position = last_position + braking * (position - last_position);
     }
-    else
-    {
-        // no velocity limit, so position is simply limited to set extents (our imposed soft limits)
-        min_pos = min_pos_limit_;
-        max_pos = max_pos_limit_;
+    if (repulsive_gain_ > 0.0) {
+      // Velocity away from the limits, growing linearly with the depth in the repulsive zone
+      braking = repulsive_gain_ * ((repulsive_zone_ - (last_position - min_position)).max(0.0) -
+        (repulsive_zone_ - (max_position - last_position)).max(0.0));
+      velocity += braking;
+      position += braking * dt;
     }
+  }
 
-    // clamp command position to our computed min/max position
-    const double cmd = rcppmath::clamp(jcmdh_.get_value(), min_pos, max_pos);
-    jcmdh_.set_value(cmd);
-
-    prev_pos_ = cmd;
+  if (accelerations.size() == size()) {
+    auto acceleration = map(accelerations);
+    acceleration = acceleration.max(-max_acceleration).min(max_acceleration);
+  }
+  if (has_velocities) {
+    auto velocity = map(velocities);
+    velocity = velocity.max((last_velocity - max_acceleration * dt).max(-max_velocity))
+      .min((last_velocity + max_acceleration * dt).min(max_velocity));
+  }
+  if (has_positions) {
+    auto position = map(positions);
+    position = position.max((last_position - max_velocity * dt).max(min_position))
+      .min((last_position + max_velocity * dt).min(max_position));
+    last_position = position;
+    if (has_velocities) {
+      // Do not command motion out of a limit that has been reached
+      auto velocity = map(velocities);
+      velocity = ((position >= max_position && velocity > 0.0) || (position <= min_position && velocity < 0.0))
+        .select(0.0, velocity);
+    }
+  }
+  if (has_velocities) {
+    last_velocity = map(velocities);
+  }
 }
 
+}  // namespace admittance_joint_limits
@@ -0,0 +1,212 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+/// Offline replay of flight logs through the admittance rule.
+///
+/// Usage:
+///   admittance_replay <log_file> [options] --ros-args --params-file <controller_parameters.yaml>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "admittance_controller/flight_recorder.hpp"
+#include "admittance_controller/rule_replay.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+namespace
+{
+
+void print_usage(const char * program)
+{
+  std::fprintf(
+    stderr,
+    "Usage: %s <log_file> [options] --ros-args --params-file <controller_parameters.yaml>\n"
+    "Feeds the inputs recorded in a flight log through the admittance rule and compares the outputs.\n\n"
+    "  --golden FILE           compare against this log instead of the outputs recorded in <log_file>\n"
+    "  --output FILE           write the replayed cycles as a flight log, e.g. as golden log for later runs\n"
+    "  --bit-exact             require bit-identical outputs\n"
+    "  --tolerance X           largest accepted absolute difference of an output (default 1e-9)\n"
+    "  --node-name NAME        name of the controller in the parameter file (default admittance_controller)\n"
+    "  --robot-description F   URDF for the IK plugin, if it is not set in the parameter file\n"
+    "  --transform PARENT CHILD X Y Z QX QY QZ QW\n"
+    "                          static transform used by the rule, e.g. from control to sensor frame; repeatable\n",
+    program);
+}
+
+/// Gives the replay access to the transform buffer, which is filled from /tf in the controller
+class ReplayAdmittanceRule : public admittance_controller::AdmittanceRule
+{
+public:
+  void add_static_transform(const geometry_msgs::msg::TransformStamped & transform)
+  {
+    tf_buffer_->setTransform(transform, "admittance_replay", true);
+  }
+};
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  const auto args = rclcpp::remove_ros_arguments(argc, argv);
+
+  std::string log_path;
+  std::string golden_path;
+  std::string output_path;
+  std::string node_name = "admittance_controller";
+  std::string robot_description_path;
+  std::vector<geometry_msgs::msg::TransformStamped> transforms;
+  admittance_controller::RuleReplayOptions options;
+
+  for (size_t i = 1; i < args.size(); ++i) {
+    const std::string & arg = args[i];
+    const bool has_value = i + 1 < args.size();
+    if (arg == "--bit-exact") {
+      options.bit_exact = true;
+    } else if (arg == "--golden" && has_value) {
+      golden_path = args[++i];
+    } else if (arg == "--output" && has_value) {
+      output_path = args[++i];
+    } else if (arg == "--tolerance" && has_value) {
+      options.tolerance = std::atof(args[++i].c_str());
+    } else if (arg == "--node-name" && has_value) {
+      node_name = args[++i];
+    } else if (arg == "--robot-description" && has_value) {
+      robot_description_path = args[++i];
+    } else if (arg == "--transform" && i + 9 < args.size()) {
+      geometry_msgs::msg::TransformStamped transform;
+      transform.header.frame_id = args[++i];
+      transform.child_frame_id = args[++i];
+      transform.transform.translation.x = std::atof(args[++i].c_str());
+      transform.transform.translation.y = std::atof(args[++i].c_str());
+      transform.transform.translation.z = std::atof(args[++i].c_str());
+      transform.transform.rotation.x = std::atof(args[++i].c_str());
+      transform.transform.rotation.y = std::atof(args[++i].c_str());
+      transform.transform.rotation.z = std::atof(args[++i].c_str());
+      transform.transform.rotation.w = std::atof(args[++i].c_str());
+      transforms.push_back(transform);
+    } else if (log_path.empty() && !arg.empty() && arg[0] != '-') {
+      log_path = arg;
+    } else {
+      print_usage(argv[0]);
+      rclcpp::shutdown();
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (log_path.empty()) {
+    print_usage(argv[0]);
+    rclcpp::shutdown();
+    return 1;
+  }
+
+  int ret = 1;
+  {
+    admittance_controller::FlightLogReader input;
+    admittance_controller::FlightLogReader golden_log;
+    if (!input.open(log_path)) {
+      std::fprintf(stderr, "%s\n", input.error().c_str());
+      rclcpp::shutdown();
+      return 1;
+    }
+    if (!golden_path.empty() && !golden_log.open(golden_path)) {
+      std::fprintf(stderr, "%s\n", golden_log.error().c_str());
+      rclcpp::shutdown();
+      return 1;
+    }
+    const auto & golden = golden_path.empty() ? input : golden_log;
+
+    // Configure the rule from the parameters of the controller, as the controller does
+    auto node_options = rclcpp::NodeOptions();
+    if (!robot_description_path.empty()) {
+      std::ifstream urdf_file(robot_description_path);
+      if (!urdf_file) {
+        std::fprintf(stderr, "Could not open robot description '%s'\n", robot_description_path.c_str());
+        rclcpp::shutdown();
+        return 1;
+      }
+      std::stringstream urdf;
+      urdf << urdf_file.rdbuf();
+      node_options.parameter_overrides({{"robot_description", urdf.str()}});
+    }
+    auto node = std::make_shared<rclcpp_lifecycle::LifecycleNode>(node_name, node_options);
+    node->declare_parameter<std::string>("robot_description", "");
+
+    ReplayAdmittanceRule rule;
+    rule.parameters_.initialize(node);
+    rule.parameters_.declare_parameters();
+    if (!rule.parameters_.get_parameters() ||
+      rule.configure(node) != controller_interface::return_type::OK)
+    {
+      std::fprintf(stderr, "Could not configure the admittance rule; check the parameters of '%s'.\n",
+        node_name.c_str());
+      rclcpp::shutdown();
+      return 1;
+    }
+    for (const auto & transform : transforms) {
+      rule.add_static_transform(transform);
+    }
+    rule.reset();
+
+    admittance_controller::FlightLogWriter writer;
+    if (!output_path.empty() && !writer.open(output_path, admittance_controller::FlightLogCompression::XOR_DELTA)) {
+      std::fprintf(stderr, "Could not open '%s' for writing\n", output_path.c_str());
+      rclcpp::shutdown();
+      return 1;
+    }
+
+    admittance_controller::RuleReplayResult result;
+    const auto start = std::chrono::steady_clock::now();
+    const bool ok = admittance_controller::replay_flight_log(
+      rule, input, golden, options, output_path.empty() ? nullptr : &writer, result);
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (writer.is_open()) {
+      writer.close();
+    }
+
+    std::printf("replayed cycles:    %zu\n", result.cycles);
+    if (input.header().lost_records > 0) {
+      std::printf("lost records:       %u (the log is incomplete, writing failed)\n", input.header().lost_records);
+    }
+    std::printf("recorded duration:  %.3f s\n", result.recorded_duration);
+    std::printf("replay time:        %.3f s (%.1fx real time)\n", elapsed,
+      elapsed > 0.0 ? result.recorded_duration / elapsed : 0.0);
+    std::printf("comparison:         %s\n", options.bit_exact ? "bit-exact" : "tolerance");
+    if (!options.bit_exact) {
+      std::printf("tolerance:          %g\n", options.tolerance);
+    }
+    std::printf("max abs error:      %g\n", result.max_abs_error);
+    std::printf("mismatched cycles:  %zu\n", result.mismatched_cycles);
+    for (const auto & mismatch : result.mismatches) {
+      std::printf("  cycle %lld %s[%u]: golden %.17g, replayed %.17g\n",
+        static_cast<long long>(mismatch.cycle_index), mismatch.field.c_str(), mismatch.index,
+        mismatch.golden, mismatch.replayed);
+    }
+    if (!result.error.empty()) {
+      std::fprintf(stderr, "%s\n", result.error.c_str());
+    }
+    ret = ok ? 0 : 1;
+  }
+  rclcpp::shutdown();
+  return ret;
+}
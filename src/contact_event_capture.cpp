@@ -0,0 +1,193 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include "admittance_controller/contact_event_capture.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace admittance_controller
+{
+
+ContactEventCapture::~ContactEventCapture()
+{
+  stop();
+}
+
+bool ContactEventCapture::start(const ContactEventCaptureOptions & options)
+{
+  stop();
+
+  options_ = options;
+  if (options_.pre_trigger_records == 0) {
+    return false;
+  }
+  ring_.assign(options_.pre_trigger_records + options_.post_trigger_records, CycleRecord{});
+  write_index_ = 0;
+  count_ = 0;
+  has_previous_force_ = false;
+  trigger_reason_ = NONE;
+  num_events_ = 0;
+  state_ = ARMED;
+
+  running_ = true;
+  dump_thread_ = std::thread(&ContactEventCapture::dump_loop, this);
+  return true;
+}
+
+void ContactEventCapture::stop()
+{
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  if (dump_thread_.joinable()) {
+    dump_thread_.join();
+  }
+}
+
+bool ContactEventCapture::add(const CycleRecord & record)
+{
+  if (!running_.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  const int state = state_.load(std::memory_order_acquire);
+  if (state == FROZEN) {
+    return false;
+  }
+
+  ring_[write_index_] = record;
+  write_index_ = (write_index_ + 1) % ring_.size();
+  if (count_ < ring_.size()) {
+    ++count_;
+  }
+
+  if (state == TRIGGERED) {
+    if (--post_trigger_remaining_ == 0) {
+      // Hand the ring over to the dump thread
+      state_.store(FROZEN, std::memory_order_release);
+    }
+    return false;
+  }
+
+  const TriggerReason reason = evaluate_triggers(record);
+  if (reason == NONE || count_ < options_.pre_trigger_records) {
+    return false;
+  }
+
+  trigger_reason_ = reason;
+  trigger_stamp_nanosec_ = record.stamp_nanosec;
+  post_trigger_remaining_ = options_.post_trigger_records;
+  state_.store(post_trigger_remaining_ == 0 ? FROZEN : TRIGGERED, std::memory_order_release);
+  return true;
+}
+
+ContactEventCapture::TriggerReason ContactEventCapture::evaluate_triggers(const CycleRecord & record)
+{
+  const auto & w = record.wrench_filtered;
+  const double force_squared = w[0] * w[0] + w[1] * w[1] + w[2] * w[2];
+  const double torque_squared = w[3] * w[3] + w[4] * w[4] + w[5] * w[5];
+
+  double force_change_squared = 0.0;
+  if (has_previous_force_) {
+    for (auto i = 0u; i < 3; ++i) {
+      force_change_squared += (w[i] - previous_force_[i]) * (w[i] - previous_force_[i]);
+    }
+  }
+  previous_force_ = {w[0], w[1], w[2]};
+  const bool has_derivative = has_previous_force_ && record.period > 0.0;
+  has_previous_force_ = true;
+
+  if (options_.trigger_on_tolerance_abort && (record.flags & CYCLE_FLAG_TOLERANCE_ABORT)) {
+    return TOLERANCE_ABORT;
+  }
+  if (options_.force_threshold > 0.0 &&
+    force_squared > options_.force_threshold * options_.force_threshold)
+  {
+    return FORCE;
+  }
+  if (options_.torque_threshold > 0.0 &&
+    torque_squared > options_.torque_threshold * options_.torque_threshold)
+  {
+    return TORQUE;
+  }
+  if (options_.force_derivative_threshold > 0.0 && has_derivative) {
+    const double max_change = options_.force_derivative_threshold * record.period;
+    if (force_change_squared > max_change * max_change) {
+      return FORCE_DERIVATIVE;
+    }
+  }
+  return NONE;
+}
+
+void ContactEventCapture::dump_loop()
+{
+  while (running_.load()) {
+    if (state_.load(std::memory_order_acquire) == FROZEN) {
+      dump();
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  // Do not lose an event that froze during shutdown
+  if (state_.load(std::memory_order_acquire) == FROZEN) {
+    dump();
+  }
+}
+
+void ContactEventCapture::dump()
+{
+  const std::string path = options_.directory + "/contact_event_" +
+    std::to_string(trigger_stamp_nanosec_) + "_" + to_string(trigger_reason_) + ".bin";
+
+  FlightLogWriter writer;
+  if (writer.open(path, options_.compression)) {
+    // Oldest record first; the ring may wrap around
+    const size_t start = (write_index_ + ring_.size() - count_) % ring_.size();
+    const size_t first_part = std::min(count_, ring_.size() - start);
+    writer.write_chunk(&ring_[start], first_part);
+    writer.write_chunk(&ring_[0], count_ - first_part);
+    writer.close();
+    num_events_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Re-arm with an empty ring so the next event again has a full pre-trigger window
+  count_ = 0;
+  write_index_ = 0;
+  has_previous_force_ = false;
+  trigger_reason_ = NONE;
+  state_.store(ARMED, std::memory_order_release);
+}
+
+const char * ContactEventCapture::to_string(TriggerReason reason)
+{
+  switch (reason) {
+    case FORCE:
+      return "force";
+    case TORQUE:
+      return "torque";
+    case FORCE_DERIVATIVE:
+      return "force_derivative";
+    case TOLERANCE_ABORT:
+      return "tolerance_abort";
+    case NONE:
+      break;
+  }
+  return "none";
+}
+
+}  // namespace admittance_controller
@@ -0,0 +1,234 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+///
+/// Offline tool for flight logs written by the admittance controller.
+///
+/// Usage:
+///   flight_log_tool csv <log_file> [<csv_file>]
+///   flight_log_tool summary <log_file>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/flight_recorder.hpp"
+
+using admittance_controller::CycleRecordFieldType;
+using admittance_controller::FlightLogFieldDescriptor;
+using admittance_controller::FlightLogReader;
+
+namespace
+{
+
+void print_usage()
+{
+  std::cerr << "Usage:\n"
+            << "  flight_log_tool csv <log_file> [<csv_file>]\n"
+            << "  flight_log_tool summary <log_file>\n";
+}
+
+double read_field_value(const uint8_t * record, const FlightLogFieldDescriptor & field, size_t index)
+{
+  switch (static_cast<CycleRecordFieldType>(field.type)) {
+    case CycleRecordFieldType::INT64: {
+        int64_t value;
+        std::memcpy(&value, record + field.offset + index * sizeof(value), sizeof(value));
+        return static_cast<double>(value);
+      }
+    case CycleRecordFieldType::UINT32: {
+        uint32_t value;
+        std::memcpy(&value, record + field.offset + index * sizeof(value), sizeof(value));
+        return static_cast<double>(value);
+      }
+    case CycleRecordFieldType::FLOAT64: {
+        double value;
+        std::memcpy(&value, record + field.offset + index * sizeof(value), sizeof(value));
+        return value;
+      }
+  }
+  return std::nan("");
+}
+
+void write_field_value(std::ostream & out, const uint8_t * record, const FlightLogFieldDescriptor & field, size_t index)
+{
+  // Print integers exactly, independent of the stream precision
+  if (static_cast<CycleRecordFieldType>(field.type) == CycleRecordFieldType::INT64) {
+    int64_t value;
+    std::memcpy(&value, record + field.offset + index * sizeof(value), sizeof(value));
+    out << value;
+  } else {
+    out << read_field_value(record, field, index);
+  }
+}
+
+int convert_to_csv(const FlightLogReader & reader, std::ostream & out)
+{
+  const auto & fields = reader.fields();
+  bool first = true;
+  for (const auto & field : fields) {
+    for (auto i = 0u; i < field.count; ++i) {
+      out << (first ? "" : ",") << field.name;
+      if (field.count > 1) {
+        out << "_" << i;
+      }
+      first = false;
+    }
+  }
+  out << "\n";
+  out.precision(17);
+
+  const bool ok = reader.for_each_record(
+    [&](const uint8_t * record) {
+      bool first_value = true;
+      for (const auto & field : fields) {
+        for (auto i = 0u; i < field.count; ++i) {
+          out << (first_value ? "" : ",");
+          write_field_value(out, record, field, i);
+          first_value = false;
+        }
+      }
+      out << "\n";
+    });
+  if (!ok) {
+    std::cerr << "Error while reading records: " << reader.error() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+double percentile(std::vector<double> & sorted_values, double p)
+{
+  if (sorted_values.empty()) {
+    return std::nan("");
+  }
+  const auto index = static_cast<size_t>(std::ceil(p / 100.0 * sorted_values.size())) - 1;
+  return sorted_values[std::min(index, sorted_values.size() - 1)];
+}
+
+int print_summary(const FlightLogReader & reader)
+{
+  const auto * stamp = reader.find_field("stamp_nanosec");
+  const auto * duration = reader.find_field("update_duration_nanosec");
+  const auto * period = reader.find_field("period");
+  const auto * wrench = reader.find_field("wrench_raw");
+  const auto * flags = reader.find_field("flags");
+  if (stamp == nullptr || duration == nullptr || period == nullptr || wrench == nullptr || wrench->count != 6) {
+    std::cerr << "Log does not contain the fields needed for a summary." << std::endl;
+    return 1;
+  }
+
+  std::vector<double> durations_us;
+  std::vector<double> periods_ms;
+  std::vector<double> forces;
+  std::vector<double> torques;
+  double first_stamp = 0.0;
+  double last_stamp = 0.0;
+  size_t flagged = 0;
+  durations_us.reserve(reader.header().num_records);
+
+  const bool ok = reader.for_each_record(
+    [&](const uint8_t * record) {
+      last_stamp = read_field_value(record, *stamp, 0);
+      if (durations_us.empty()) {
+        first_stamp = last_stamp;
+      }
+      durations_us.push_back(read_field_value(record, *duration, 0) * 1e-3);
+      periods_ms.push_back(read_field_value(record, *period, 0) * 1e3);
+      double f = 0.0;
+      double t = 0.0;
+      for (auto i = 0u; i < 3; ++i) {
+        f += std::pow(read_field_value(record, *wrench, i), 2);
+        t += std::pow(read_field_value(record, *wrench, i + 3), 2);
+      }
+      forces.push_back(std::sqrt(f));
+      torques.push_back(std::sqrt(t));
+      if (flags != nullptr && read_field_value(record, *flags, 0) != 0.0) {
+        ++flagged;
+      }
+    });
+  if (!ok) {
+    std::cerr << "Error while reading records: " << reader.error() << std::endl;
+    return 1;
+  }
+
+  const auto & header = reader.header();
+  std::printf("records:            %zu (%lu chunks, %s)\n", durations_us.size(),
+    static_cast<unsigned long>(header.num_chunks), header.compression ? "delta compressed" : "uncompressed");
+  std::printf("duration:           %.3f s\n", (last_stamp - first_stamp) * 1e-9);
+  std::printf("flagged cycles:     %zu\n", flagged);
+  if (header.lost_records > 0) {
+    std::printf("lost records:       %u (the log is incomplete, writing failed)\n", header.lost_records);
+  }
+
+  auto print_stats = [](const char * name, const char * unit, std::vector<double> values) {
+      if (values.empty()) {
+        return;
+      }
+      std::sort(values.begin(), values.end());
+      double mean = 0.0;
+      for (const auto v : values) {
+        mean += v;
+      }
+      mean /= values.size();
+      std::printf(
+        "%-19s mean %.3f, p50 %.3f, p99 %.3f, p99.9 %.3f, max %.3f [%s]\n", name, mean,
+        percentile(values, 50.0), percentile(values, 99.0), percentile(values, 99.9), values.back(), unit);
+    };
+  print_stats("update latency:", "us", durations_us);
+  print_stats("period:", "ms", periods_ms);
+  print_stats("force magnitude:", "N", forces);
+  print_stats("torque magnitude:", "Nm", torques);
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  if (argc < 3) {
+    print_usage();
+    return 1;
+  }
+  const std::string command = argv[1];
+
+  FlightLogReader reader;
+  if (!reader.open(argv[2])) {
+    std::cerr << reader.error() << std::endl;
+    return 1;
+  }
+
+  if (command == "csv") {
+    if (argc > 3) {
+      std::ofstream out(argv[3]);
+      if (!out) {
+        std::cerr << "Can not open '" << argv[3] << "' for writing" << std::endl;
+        return 1;
+      }
+      return convert_to_csv(reader, out);
+    }
+    return convert_to_csv(reader, std::cout);
+  } else if (command == "summary") {
+    return print_summary(reader);
+  }
+
+  print_usage();
+  return 1;
+}
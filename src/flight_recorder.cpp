@@ -0,0 +1,453 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include "admittance_controller/flight_recorder.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+// Files are grown in steps of this size to avoid calling ftruncate for every chunk
+constexpr uint64_t FILE_GROWTH_STEP = 4 * 1024 * 1024;
+
+constexpr size_t RECORD_WORDS = sizeof(admittance_controller::CycleRecord) / sizeof(uint64_t);
+constexpr size_t DELTA_MASK_BYTES = (RECORD_WORDS + 7) / 8;
+
+uint64_t page_size()
+{
+  static const uint64_t size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+size_t max_payload_size(admittance_controller::FlightLogCompression compression, size_t num_records)
+{
+  if (compression == admittance_controller::FlightLogCompression::XOR_DELTA) {
+    return num_records * (DELTA_MASK_BYTES + sizeof(admittance_controller::CycleRecord));
+  }
+  return num_records * sizeof(admittance_controller::CycleRecord);
+}
+
+// Encode records as XOR deltas. Returns number of bytes written to `out`.
+size_t encode_xor_delta(const admittance_controller::CycleRecord * records, size_t num_records, uint8_t * out)
+{
+  uint64_t previous[RECORD_WORDS] = {};
+  uint64_t current[RECORD_WORDS];
+  uint8_t * ptr = out;
+  for (auto r = 0ul; r < num_records; ++r) {
+    std::memcpy(current, &records[r], sizeof(current));
+    uint8_t * mask = ptr;
+    std::memset(mask, 0, DELTA_MASK_BYTES);
+    ptr += DELTA_MASK_BYTES;
+    for (auto w = 0ul; w < RECORD_WORDS; ++w) {
+      const uint64_t delta = current[w] ^ previous[w];
+      if (delta != 0) {
+        mask[w / 8] |= static_cast<uint8_t>(1u << (w % 8));
+        std::memcpy(ptr, &delta, sizeof(delta));
+        ptr += sizeof(delta);
+      }
+    }
+    std::memcpy(previous, current, sizeof(previous));
+  }
+  return static_cast<size_t>(ptr - out);
+}
+
+}  // namespace
+
+namespace admittance_controller
+{
+
+FlightLogWriter::~FlightLogWriter()
+{
+  close();
+}
+
+bool FlightLogWriter::open(const std::string & path, FlightLogCompression compression)
+{
+  close();
+
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  compression_ = compression;
+  num_records_ = 0;
+  num_chunks_ = 0;
+  lost_records_ = 0;
+  file_size_ = 0;
+
+  const auto & fields = cycle_record_fields();
+  FlightLogFileHeader header{};
+  std::memcpy(header.magic, FLIGHT_LOG_MAGIC, sizeof(header.magic));
+  header.version = FLIGHT_LOG_VERSION;
+  header.header_size = static_cast<uint32_t>(
+    sizeof(FlightLogFileHeader) + fields.size() * sizeof(FlightLogFieldDescriptor));
+  header.record_size = sizeof(CycleRecord);
+  header.num_fields = static_cast<uint32_t>(fields.size());
+  header.compression = static_cast<uint32_t>(compression);
+
+  std::vector<FlightLogFieldDescriptor> descriptors(fields.size());
+  for (auto i = 0ul; i < fields.size(); ++i) {
+    std::memset(&descriptors[i], 0, sizeof(FlightLogFieldDescriptor));
+    std::strncpy(descriptors[i].name, fields[i].name, sizeof(descriptors[i].name) - 1);
+    descriptors[i].offset = fields[i].offset;
+    descriptors[i].type = static_cast<uint32_t>(fields[i].type);
+    descriptors[i].count = fields[i].count;
+  }
+
+  if (pwrite(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+    pwrite(fd_, descriptors.data(), descriptors.size() * sizeof(FlightLogFieldDescriptor),
+    sizeof(header)) != static_cast<ssize_t>(descriptors.size() * sizeof(FlightLogFieldDescriptor)))
+  {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  offset_ = header.header_size;
+  file_size_ = offset_;
+  return true;
+}
+
+bool FlightLogWriter::reserve(uint64_t size)
+{
+  if (size <= file_size_) {
+    return true;
+  }
+  const uint64_t new_size = std::max(size, file_size_ + FILE_GROWTH_STEP);
+  if (ftruncate(fd_, static_cast<off_t>(new_size)) != 0) {
+    return false;
+  }
+  file_size_ = new_size;
+  return true;
+}
+
+bool FlightLogWriter::write_chunk(const CycleRecord * records, size_t num_records)
+{
+  if (fd_ < 0) {
+    return false;
+  }
+  if (num_records == 0) {
+    return true;
+  }
+
+  const uint64_t max_size = sizeof(FlightLogChunkHeader) + max_payload_size(compression_, num_records);
+  if (!reserve(offset_ + max_size)) {
+    return false;
+  }
+
+  // Map the region of this chunk; mmap offsets have to be page-aligned
+  const uint64_t map_offset = offset_ & ~(page_size() - 1);
+  const size_t map_length = static_cast<size_t>(offset_ - map_offset + max_size);
+  void * map = mmap(nullptr, map_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+      static_cast<off_t>(map_offset));
+  if (map == MAP_FAILED) {
+    return false;
+  }
+  uint8_t * chunk = static_cast<uint8_t *>(map) + (offset_ - map_offset);
+  uint8_t * payload = chunk + sizeof(FlightLogChunkHeader);
+
+  size_t payload_size = 0;
+  if (compression_ == FlightLogCompression::XOR_DELTA) {
+    payload_size = encode_xor_delta(records, num_records, payload);
+  } else {
+    payload_size = num_records * sizeof(CycleRecord);
+    std::memcpy(payload, records, payload_size);
+  }
+
+  FlightLogChunkHeader chunk_header{};
+  chunk_header.magic = FLIGHT_LOG_CHUNK_MAGIC;
+  chunk_header.num_records = static_cast<uint32_t>(num_records);
+  chunk_header.payload_size = payload_size;
+  std::memcpy(chunk, &chunk_header, sizeof(chunk_header));
+
+  munmap(map, map_length);
+
+  offset_ += sizeof(FlightLogChunkHeader) + payload_size;
+  num_records_ += num_records;
+  ++num_chunks_;
+  return true;
+}
+
+bool FlightLogWriter::close()
+{
+  if (fd_ < 0) {
+    return true;
+  }
+
+  bool ret = ftruncate(fd_, static_cast<off_t>(offset_)) == 0;
+
+  // Store totals so readers can preallocate
+  FlightLogFileHeader header{};
+  if (pread(fd_, &header, sizeof(header), 0) == sizeof(header)) {
+    header.num_records = num_records_;
+    header.num_chunks = num_chunks_;
+    header.lost_records = static_cast<uint32_t>(
+      std::min<uint64_t>(lost_records_, std::numeric_limits<uint32_t>::max()));
+    ret &= pwrite(fd_, &header, sizeof(header), 0) == sizeof(header);
+  } else {
+    ret = false;
+  }
+
+  ::close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+FlightLogReader::~FlightLogReader()
+{
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t *>(data_), size_);
+  }
+}
+
+bool FlightLogReader::open(const std::string & path)
+{
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error_ = "Can not open '" + path + "'";
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(FlightLogFileHeader)) {
+    ::close(fd);
+    error_ = "File '" + path + "' is too small to be a flight log";
+    return false;
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  void * map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    error_ = "Can not map '" + path + "'";
+    return false;
+  }
+  data_ = static_cast<const uint8_t *>(map);
+
+  std::memcpy(&header_, data_, sizeof(header_));
+  if (std::memcmp(header_.magic, FLIGHT_LOG_MAGIC, sizeof(header_.magic)) != 0) {
+    error_ = "Wrong magic number, '" + path + "' is not a flight log";
+    return false;
+  }
+  if (header_.version != FLIGHT_LOG_VERSION) {
+    error_ = "Unsupported flight log version " + std::to_string(header_.version);
+    return false;
+  }
+  if (header_.header_size > size_ || header_.record_size % sizeof(uint64_t) != 0 ||
+    sizeof(FlightLogFileHeader) + header_.num_fields * sizeof(FlightLogFieldDescriptor) > header_.header_size)
+  {
+    error_ = "Corrupt flight log header";
+    return false;
+  }
+
+  fields_.resize(header_.num_fields);
+  std::memcpy(fields_.data(), data_ + sizeof(FlightLogFileHeader),
+    fields_.size() * sizeof(FlightLogFieldDescriptor));
+  for (auto & field : fields_) {
+    field.name[sizeof(field.name) - 1] = '\0';
+  }
+  return true;
+}
+
+const FlightLogFieldDescriptor * FlightLogReader::find_field(const std::string & name) const
+{
+  for (const auto & field : fields_) {
+    if (name == field.name) {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+
+bool FlightLogReader::for_each_record(const std::function<void(const uint8_t * record)> & callback) const
+{
+  if (data_ == nullptr) {
+    return false;
+  }
+  FlightLogCursor cursor(*this);
+  while (const uint8_t * record = cursor.next()) {
+    callback(record);
+  }
+  if (!cursor.error().empty()) {
+    error_ = cursor.error();
+    return false;
+  }
+  return true;
+}
+
+FlightLogCursor::FlightLogCursor(const FlightLogReader & reader)
+: reader_(reader), offset_(reader.header_.header_size), record_(reader.header_.record_size / sizeof(uint64_t))
+{
+}
+
+bool FlightLogCursor::next_chunk()
+{
+  const auto & header = reader_.header_;
+  while (remaining_records_ == 0) {
+    if (reader_.data_ == nullptr || offset_ + sizeof(FlightLogChunkHeader) > reader_.size_) {
+      return false;
+    }
+    FlightLogChunkHeader chunk_header;
+    std::memcpy(&chunk_header, reader_.data_ + offset_, sizeof(chunk_header));
+    if (chunk_header.magic != FLIGHT_LOG_CHUNK_MAGIC ||
+      offset_ + sizeof(chunk_header) + chunk_header.payload_size > reader_.size_)
+    {
+      // A crashed writer may leave a preallocated, zero-filled tail
+      if (chunk_header.magic != 0) {
+        error_ = "Corrupt chunk at offset " + std::to_string(offset_);
+      }
+      offset_ = reader_.size_;
+      return false;
+    }
+    offset_ += sizeof(chunk_header);
+    payload_ = reader_.data_ + offset_;
+    payload_end_ = payload_ + chunk_header.payload_size;
+    offset_ += chunk_header.payload_size;
+
+    if (header.compression == static_cast<uint32_t>(FlightLogCompression::XOR_DELTA)) {
+      std::fill(record_.begin(), record_.end(), 0);
+    } else if (static_cast<uint64_t>(chunk_header.num_records) * header.record_size != chunk_header.payload_size) {
+      error_ = "Chunk size does not match the number of records";
+      offset_ = reader_.size_;
+      return false;
+    }
+    remaining_records_ = chunk_header.num_records;
+  }
+  return true;
+}
+
+const uint8_t * FlightLogCursor::next()
+{
+  if (!error_.empty() || !next_chunk()) {
+    return nullptr;
+  }
+  --remaining_records_;
+
+  const auto & header = reader_.header_;
+  if (header.compression == static_cast<uint32_t>(FlightLogCompression::XOR_DELTA)) {
+    const size_t words = record_.size();
+    const size_t mask_bytes = (words + 7) / 8;
+    if (payload_ + mask_bytes > payload_end_) {
+      error_ = "Truncated chunk payload";
+      return nullptr;
+    }
+    const uint8_t * mask = payload_;
+    payload_ += mask_bytes;
+    for (auto w = 0ul; w < words; ++w) {
+      if (mask[w / 8] & (1u << (w % 8))) {
+        if (payload_ + sizeof(uint64_t) > payload_end_) {
+          error_ = "Truncated chunk payload";
+          return nullptr;
+        }
+        uint64_t delta;
+        std::memcpy(&delta, payload_, sizeof(delta));
+        payload_ += sizeof(delta);
+        record_[w] ^= delta;
+      }
+    }
+  } else {
+    std::memcpy(record_.data(), payload_, header.record_size);
+    payload_ += header.record_size;
+  }
+  return reinterpret_cast<const uint8_t *>(record_.data());
+}
+
+FlightRecorder::~FlightRecorder()
+{
+  stop();
+}
+
+bool FlightRecorder::start(const std::string & path, const FlightRecorderOptions & options)
+{
+  stop();
+
+  options_ = options;
+  options_.records_per_chunk = std::max<size_t>(options_.records_per_chunk, 1);
+  if (!writer_.open(path, options_.compression)) {
+    return false;
+  }
+  ring_ = std::make_unique<SpscRingBuffer<CycleRecord>>(options_.buffer_size);
+  write_failures_ = 0;
+  running_ = true;
+  writer_thread_ = std::thread(&FlightRecorder::writer_loop, this);
+  return true;
+}
+
+void FlightRecorder::stop()
+{
+  if (!running_) {
+    return;
+  }
+  running_ = false;
+  if (writer_thread_.joinable()) {
+    writer_thread_.join();
+  }
+  writer_.close();
+}
+
+void FlightRecorder::writer_loop()
+{
+  std::vector<CycleRecord> chunk(options_.records_per_chunk);
+  size_t chunk_fill = 0;
+  auto last_flush = std::chrono::steady_clock::now();
+
+  auto flush = [&]() {
+    // The log stays readable up to the last complete chunk; the lost records are counted in its header
+    if (!writer_.write_chunk(chunk.data(), chunk_fill)) {
+      writer_.add_lost_records(chunk_fill);
+      write_failures_ += chunk_fill;
+    }
+    chunk_fill = 0;
+    last_flush = std::chrono::steady_clock::now();
+  };
+
+  bool keep_running = true;
+  while (keep_running) {
+    // Read the flag before draining so that records pushed before stop() are always written
+    keep_running = running_.load();
+
+    bool popped = false;
+    while (chunk_fill < chunk.size() && ring_->try_pop(chunk[chunk_fill])) {
+      ++chunk_fill;
+      popped = true;
+    }
+    if (chunk_fill == chunk.size() ||
+      (chunk_fill > 0 && std::chrono::steady_clock::now() - last_flush > options_.flush_period))
+    {
+      flush();
+    }
+    if (!popped && keep_running) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  // Drain what is left in the ring
+  while (true) {
+    while (chunk_fill < chunk.size() && ring_->try_pop(chunk[chunk_fill])) {
+      ++chunk_fill;
+    }
+    if (chunk_fill == 0) {
+      break;
+    }
+    flush();
+  }
+}
+
+}  // namespace admittance_controller
@@ -0,0 +1,247 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include "ik_singularity/manipulability_atlas.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace ik_singularity
+{
+
+size_t manipulability_atlas_cells(const ManipulabilityAtlasHeader & header)
+{
+  size_t cells = 1;
+  for (auto j = 0u; j < header.num_joints && j < MANIPULABILITY_ATLAS_MAX_JOINTS; ++j) {
+    cells *= header.counts[j];
+  }
+  return cells;
+}
+
+double manipulability_atlas_position(const ManipulabilityAtlasHeader & header, size_t joint, uint32_t index)
+{
+  const double min = header.min_positions[joint];
+  const double range = header.max_positions[joint] - min;
+  const uint32_t count = header.counts[joint];
+  if (header.periodic[joint]) {
+    return min + index * range / count;
+  }
+  if (count == 1) {
+    return min + 0.5 * range;
+  }
+  return min + index * range / (count - 1);
+}
+
+bool write_manipulability_atlas(
+  const std::string & path, const ManipulabilityAtlasHeader & header,
+  const std::vector<ManipulabilityAtlasCell> & cells, std::string & error)
+{
+  if (cells.size() != manipulability_atlas_cells(header)) {
+    error = "Expected " + std::to_string(manipulability_atlas_cells(header)) + " cells, got " +
+      std::to_string(cells.size());
+    return false;
+  }
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    error = "Can not open '" + path + "'";
+    return false;
+  }
+  file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char *>(cells.data()),
+    static_cast<std::streamsize>(cells.size() * sizeof(ManipulabilityAtlasCell)));
+  if (!file) {
+    error = "Can not write '" + path + "'";
+    return false;
+  }
+  return true;
+}
+
+ManipulabilityAtlas::~ManipulabilityAtlas()
+{
+  close();
+}
+
+void ManipulabilityAtlas::close()
+{
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  header_ = nullptr;
+  cells_ = nullptr;
+}
+
+bool ManipulabilityAtlas::open(const std::string & path, std::string & error)
+{
+  close();
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = "Can not open '" + path + "'";
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 ||
+    static_cast<size_t>(file_stat.st_size) < sizeof(ManipulabilityAtlasHeader))
+  {
+    ::close(fd);
+    error = "File '" + path + "' is too small to be a manipulability atlas";
+    return false;
+  }
+  const auto size = static_cast<size_t>(file_stat.st_size);
+  void * map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED) {
+    error = "Can not map '" + path + "'";
+    return false;
+  }
+  mapping_ = map;
+  mapping_size_ = size;
+
+  const auto * header = static_cast<const ManipulabilityAtlasHeader *>(map);
+  if (std::memcmp(header->magic, MANIPULABILITY_ATLAS_MAGIC, sizeof(header->magic)) != 0) {
+    error = "Wrong magic number, '" + path + "' is not a manipulability atlas";
+    close();
+    return false;
+  }
+  if (header->version != MANIPULABILITY_ATLAS_VERSION) {
+    error = "Unsupported manipulability atlas version " + std::to_string(header->version);
+    close();
+    return false;
+  }
+  bool valid = header->num_joints > 0 && header->num_joints <= MANIPULABILITY_ATLAS_MAX_JOINTS;
+  // Bounded by the file size, so that the product of the counts can not overflow
+  size_t cells = 1;
+  for (auto j = 0u; valid && j < header->num_joints; ++j) {
+    valid = header->counts[j] > 0 && std::isfinite(header->min_positions[j]) &&
+      std::isfinite(header->max_positions[j]) && header->min_positions[j] <= header->max_positions[j] &&
+      cells <= size / header->counts[j];
+    cells *= header->counts[j];
+  }
+  if (!valid || size != sizeof(ManipulabilityAtlasHeader) + cells * sizeof(ManipulabilityAtlasCell)) {
+    error = "Corrupt manipulability atlas '" + path + "'";
+    close();
+    return false;
+  }
+
+  header_ = header;
+  cells_ = reinterpret_cast<const ManipulabilityAtlasCell *>(static_cast<const uint8_t *>(map) + sizeof(*header));
+  // Row-major, the last joint varies fastest
+  size_t stride = 1;
+  for (auto j = header_->num_joints; j-- > 0; ) {
+    strides_[j] = stride;
+    stride *= header_->counts[j];
+  }
+  return true;
+}
+
+ManipulabilitySample ManipulabilityAtlas::lookup(const double * positions, double * inverse_condition_gradient) const
+{
+  // Grid points below and above the position of each sampled joint, the interpolation weight of the upper
+  // one and the derivative of that weight with respect to the joint position
+  size_t lower[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  size_t upper[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  double fraction[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  double fraction_rate[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  size_t sampled[MANIPULABILITY_ATLAS_MAX_JOINTS];
+  size_t num_sampled = 0;
+  size_t base = 0;
+  const size_t num_joints = header_->num_joints;
+
+  for (auto j = 0ul; j < num_joints; ++j) {
+    if (inverse_condition_gradient) {
+      inverse_condition_gradient[j] = 0.0;
+    }
+    const uint32_t count = header_->counts[j];
+    if (count == 1) {
+      continue;
+    }
+    const double min = header_->min_positions[j];
+    const double range = header_->max_positions[j] - min;
+    size_t index;
+    double f;
+    double rate;
+    if (header_->periodic[j]) {
+      const double step = range / count;
+      double t = std::fmod((positions[j] - min) / step, static_cast<double>(count));
+      if (t < 0.0) {
+        t += count;
+      }
+      index = std::min(static_cast<size_t>(t), static_cast<size_t>(count - 1));
+      f = t - index;
+      rate = 1.0 / step;
+      upper[num_sampled] = (index + 1) % count;
+    } else {
+      const double step = range / (count - 1);
+      const double t = (positions[j] - min) / step;
+      const double clamped = std::min(std::max(t, 0.0), static_cast<double>(count - 1));
+      index = std::min(static_cast<size_t>(clamped), static_cast<size_t>(count - 2));
+      f = clamped - index;
+      // Constant outside of the sampled range
+      rate = t == clamped ? 1.0 / step : 0.0;
+      upper[num_sampled] = index + 1;
+    }
+    lower[num_sampled] = index;
+    fraction[num_sampled] = f;
+    fraction_rate[num_sampled] = rate;
+    sampled[num_sampled] = j;
+    ++num_sampled;
+  }
+  for (auto s = 0ul; s < num_sampled; ++s) {
+    base += lower[s] * strides_[sampled[s]];
+  }
+
+  // Multilinear interpolation over the 2^n corners of the cell around the positions
+  ManipulabilitySample sample{0.0, 0.0};
+  for (size_t corner = 0; corner < (1ul << num_sampled); ++corner) {
+    size_t offset = base;
+    double weight = 1.0;
+    for (auto s = 0ul; s < num_sampled; ++s) {
+      if (corner & (1ul << s)) {
+        offset += (upper[s] - lower[s]) * strides_[sampled[s]];
+        weight *= fraction[s];
+      } else {
+        weight *= 1.0 - fraction[s];
+      }
+    }
+    const auto & cell = cells_[offset];
+    sample.manipulability += weight * cell.manipulability;
+    sample.inverse_condition += weight * cell.inverse_condition;
+
+    if (inverse_condition_gradient) {
+      // Derivative of the weight of this corner with respect to each sampled joint
+      for (auto s = 0ul; s < num_sampled; ++s) {
+        double partial = (corner & (1ul << s)) ? fraction_rate[s] : -fraction_rate[s];
+        for (auto r = 0ul; r < num_sampled; ++r) {
+          if (r != s) {
+            partial *= (corner & (1ul << r)) ? fraction[r] : 1.0 - fraction[r];
+          }
+        }
+        inverse_condition_gradient[sampled[s]] += partial * cell.inverse_condition;
+      }
+    }
+  }
+  return sample;
+}
+
+}  // namespace ik_singularity
@@ -0,0 +1,259 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+///
+/// Offline tool that samples the joint space of a robot into a manipulability atlas for the RL IK plugin.
+///
+/// Usage:
+///   manipulability_atlas_tool <urdf_file> <atlas_file> [--joints A,B,...] [--samples N|N1,N2,...] [--threads N]
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "eigen3/Eigen/Core"
+#include "eigen3/Eigen/SVD"
+#include "ik_singularity/manipulability_atlas.hpp"
+#include "rl/mdl/Dynamic.h"
+#include "rl/mdl/Joint.h"
+#include "rl/mdl/UrdfFactory.h"
+
+using ik_singularity::ManipulabilityAtlasCell;
+using ik_singularity::ManipulabilityAtlasHeader;
+
+namespace
+{
+// Cells handed to a worker at a time
+constexpr size_t BATCH_SIZE = 1024;
+constexpr uint32_t DEFAULT_SAMPLES = 16;
+
+void print_usage(const char * program)
+{
+  std::fprintf(
+    stderr,
+    "Usage: %s <urdf_file> <atlas_file> [options]\n"
+    "Samples the manipulability and inverse condition number of the Jacobian over the joint space.\n\n"
+    "  --joints A,B,...        joints of the atlas in the order of the IK plugin (default: all joints)\n"
+    "  --samples N|N1,N2,...   grid points per joint, 1 to hold a joint at the middle of its range (default 16)\n"
+    "  --threads N             worker threads (default: all cores)\n",
+    program);
+}
+
+std::vector<std::string> split(const std::string & list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    items.push_back(item);
+  }
+  return items;
+}
+
+/// Evaluates cells of the atlas with a model of its own, one per worker thread
+class CellEvaluator
+{
+public:
+  CellEvaluator(const ManipulabilityAtlasHeader & header, const std::vector<size_t> & joint_indices)
+  : header_(header), joint_indices_(joint_indices),
+    jacobian_(6, joint_indices.size()), svd_(6, joint_indices.size())
+  {
+  }
+
+  void load(const std::string & urdf_path)
+  {
+    rl::mdl::UrdfFactory factory;
+    factory.load(urdf_path, &model_);
+    all_jacobians_ = rl::math::Matrix(model_.getOperationalDof(), model_.getDof());
+    positions_ = model_.getPosition();
+  }
+
+  ManipulabilityAtlasCell evaluate(size_t cell)
+  {
+    // Row-major grid index, the last joint varies fastest
+    for (auto j = joint_indices_.size(); j-- > 0; ) {
+      positions_[joint_indices_[j]] = ik_singularity::manipulability_atlas_position(
+        header_, j, static_cast<uint32_t>(cell % header_.counts[j]));
+      cell /= header_.counts[j];
+    }
+    model_.setPosition(positions_);
+    model_.forwardPosition();
+    model_.calculateJacobian(all_jacobians_);
+
+    // Same column weighting as the IK plugin, so that translations and rotations are comparable
+    for (auto j = 0ul; j < joint_indices_.size(); ++j) {
+      jacobian_.col(j) = all_jacobians_.block(0, joint_indices_[j], 6, 1);
+      const double norm = jacobian_.col(j).norm();
+      if (norm > 0.0) {
+        jacobian_.col(j) /= norm;
+      }
+    }
+    svd_.compute(jacobian_);
+    const auto & singular_values = svd_.singularValues();
+    const double largest = singular_values(0);
+    const double smallest = singular_values(singular_values.size() - 1);
+    return {static_cast<float>(singular_values.prod()),
+      static_cast<float>(largest > 0.0 ? smallest / largest : 0.0)};
+  }
+
+private:
+  const ManipulabilityAtlasHeader & header_;
+  const std::vector<size_t> & joint_indices_;
+  rl::mdl::Dynamic model_;
+  rl::math::Vector positions_;
+  rl::math::Matrix all_jacobians_;
+  Eigen::MatrixXd jacobian_;
+  Eigen::JacobiSVD<Eigen::MatrixXd> svd_;
+};
+
+}  // namespace
+
+int main(int argc, char ** argv)
+{
+  std::vector<std::string> positional;
+  std::vector<std::string> joint_names;
+  std::vector<std::string> samples = {std::to_string(DEFAULT_SAMPLES)};
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--joints" && has_value) {
+      joint_names = split(argv[++i]);
+    } else if (arg == "--samples" && has_value) {
+      samples = split(argv[++i]);
+    } else if (arg == "--threads" && has_value) {
+      num_threads = std::max(1l, std::atol(argv[++i]));
+    } else if (!arg.empty() && arg[0] != '-') {
+      positional.push_back(arg);
+    } else {
+      print_usage(argv[0]);
+      return arg == "--help" || arg == "-h" ? 0 : 1;
+    }
+  }
+  if (positional.size() != 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const std::string & urdf_path = positional[0];
+  const std::string & atlas_path = positional[1];
+
+  rl::mdl::Dynamic model;
+  rl::mdl::UrdfFactory factory;
+  factory.load(urdf_path, &model);
+  // Like the IK plugin, joint i of the model is position i; this holds for single-DOF joints only
+  if (model.getDof() != model.getJoints()) {
+    std::cerr << "Only robots with single-DOF joints are supported" << std::endl;
+    return 1;
+  }
+  if (model.getOperationalDof() < 6) {
+    std::cerr << "The robot description has no end effector" << std::endl;
+    return 1;
+  }
+  if (joint_names.empty()) {
+    for (auto i = 0ul; i < model.getJoints(); ++i) {
+      joint_names.push_back(model.getJoint(i)->getName());
+    }
+  }
+  if (joint_names.size() > ik_singularity::MANIPULABILITY_ATLAS_MAX_JOINTS) {
+    std::cerr << "An atlas can have at most " << ik_singularity::MANIPULABILITY_ATLAS_MAX_JOINTS << " joints"
+              << std::endl;
+    return 1;
+  }
+  if (samples.size() != 1 && samples.size() != joint_names.size()) {
+    std::cerr << "Expected one sample count or one per joint" << std::endl;
+    return 1;
+  }
+
+  ManipulabilityAtlasHeader header = {};
+  std::memcpy(header.magic, ik_singularity::MANIPULABILITY_ATLAS_MAGIC, sizeof(header.magic));
+  header.version = ik_singularity::MANIPULABILITY_ATLAS_VERSION;
+  header.num_joints = static_cast<uint32_t>(joint_names.size());
+  std::vector<size_t> joint_indices;
+  const rl::math::Vector minimum = model.getMinimum();
+  const rl::math::Vector maximum = model.getMaximum();
+  for (auto j = 0ul; j < joint_names.size(); ++j) {
+    size_t index = 0;
+    while (index < model.getJoints() && model.getJoint(index)->getName() != joint_names[j]) {
+      ++index;
+    }
+    if (index == model.getJoints()) {
+      std::cerr << "Joint '" << joint_names[j] << "' is not in the robot description" << std::endl;
+      return 1;
+    }
+    joint_indices.push_back(index);
+    const long count = std::atol(samples[samples.size() == 1 ? 0 : j].c_str());
+    if (count < 1) {
+      std::cerr << "Invalid sample count for joint '" << joint_names[j] << "'" << std::endl;
+      return 1;
+    }
+    header.counts[j] = static_cast<uint32_t>(count);
+    // Joints with a full turn or more of range wrap around
+    if (!std::isfinite(minimum(index)) || !std::isfinite(maximum(index)) ||
+      maximum(index) - minimum(index) >= 2.0 * M_PI)
+    {
+      header.periodic[j] = 1;
+      header.min_positions[j] = -M_PI;
+      header.max_positions[j] = M_PI;
+    } else {
+      header.min_positions[j] = minimum(index);
+      header.max_positions[j] = maximum(index);
+    }
+  }
+
+  const size_t num_cells = ik_singularity::manipulability_atlas_cells(header);
+  std::cout << "Sampling " << num_cells << " cells of " << joint_names.size() << " joints with " << num_threads
+            << " threads" << std::endl;
+  std::vector<ManipulabilityAtlasCell> cells(num_cells);
+  std::atomic<size_t> next_batch(0);
+  std::vector<std::thread> workers;
+  for (auto t = 0ul; t < num_threads; ++t) {
+    workers.emplace_back([&]() {
+        CellEvaluator evaluator(header, joint_indices);
+        evaluator.load(urdf_path);
+        size_t begin;
+        while ((begin = next_batch.fetch_add(BATCH_SIZE)) < num_cells) {
+          const size_t end = std::min(begin + BATCH_SIZE, num_cells);
+          for (auto cell = begin; cell < end; ++cell) {
+            cells[cell] = evaluator.evaluate(cell);
+          }
+        }
+      });
+  }
+  for (auto & worker : workers) {
+    worker.join();
+  }
+
+  std::string error;
+  if (!ik_singularity::write_manipulability_atlas(atlas_path, header, cells, error)) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  const auto worst = std::min_element(cells.begin(), cells.end(),
+      [](const ManipulabilityAtlasCell & a, const ManipulabilityAtlasCell & b) {
+        return a.inverse_condition < b.inverse_condition;
+      });
+  std::cout << "Wrote '" << atlas_path << "', largest condition number " << 1.0 / worst->inverse_condition
+            << std::endl;
+  return 0;
+}
@@ -16,13 +16,11 @@
 
 #include "moveit_differential_ik_plugin/moveit_kinematics.hpp"
 
-#include "tf2_eigen/tf2_eigen.hpp"
+#include <algorithm>
 
-constexpr auto ROS_LOG_THROTTLE_PERIOD = std::chrono::milliseconds(1000).count();
-// TODO: Parameterize singularity thresholds
-constexpr double LOWER_SINGULARITY_THRESHOLD = 20.;
-constexpr double APPROACHING_STOP_SINGULARITY_THRESHOLD = 80;
-constexpr double HARD_STOP_SINGULARITY_THRESHOLD = 120.;
+#include "ik_singularity/singularity_parameters.hpp"
+#include "srdfdom/model.h"
+#include "urdf_parser/urdf_parser.h"
 
 namespace moveit_differential_ik_plugin
 {
@@ -34,24 +32,79 @@ bool RLKinematics::initialize(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> n
 {
     node_ = node;
 
-  // TODO(andyz): Parameterize robot description and joint group
-//  std::unique_ptr<robot_model_loader::RobotModelLoader> model_loader_ptr =
-//      std::unique_ptr<robot_model_loader::RobotModelLoader>(new robot_model_loader::RobotModelLoader(node, "robot_description", false /* do not load kinematics plugins */));
-//  const moveit::core::RobotModelPtr& kinematic_model = model_loader_ptr->getModel();
-  // TODO(andyz): joint_model_group_ is a raw pointer. Is it thread safe? (Denis: there should not be multi-threading here)
-//  joint_model_group_ = kinematic_model->getJointModelGroup(group_name);
-//  kinematic_state_ = std::make_shared<moveit::core::RobotState>(kinematic_model);
+  // The model is built from the description strings directly: the RobotModelLoader needs an rclcpp::Node, and
+  // kinematics solver plugins are not used here
+  const auto robot_description = ik_singularity::get_or_declare_parameter<std::string>(
+    node_, "robot_description", "");
+  const auto robot_description_semantic = ik_singularity::get_or_declare_parameter<std::string>(
+    node_, "robot_description_semantic", "");
+  if (robot_description.empty() || robot_description_semantic.empty())
+  {
+    RCLCPP_ERROR(node_->get_logger(), "The MoveIt kinematics need 'robot_description' and "
+                 "'robot_description_semantic'");
+    return false;
+  }
+  const urdf::ModelInterfaceSharedPtr urdf_model = urdf::parseURDF(robot_description);
+  if (!urdf_model)
+  {
+    RCLCPP_ERROR(node_->get_logger(), "Can not parse 'robot_description'");
+    return false;
+  }
+  auto srdf_model = std::make_shared<srdf::Model>();
+  if (!srdf_model->initString(*urdf_model, robot_description_semantic))
+  {
+    RCLCPP_ERROR(node_->get_logger(), "Can not parse 'robot_description_semantic'");
+    return false;
+  }
+  robot_model_ = std::make_shared<moveit::core::RobotModel>(urdf_model, srdf_model);
 
+  // joint_model_group_ and tip_link_ are owned by robot_model_; the conversions run in the control thread only
+  joint_model_group_ = robot_model_->getJointModelGroup(group_name);
+  if (!joint_model_group_ || joint_model_group_->getLinkModels().empty())
+  {
+    RCLCPP_ERROR(node_->get_logger(), "The robot has no group '%s' with links", group_name.c_str());
+    return false;
+  }
   // By default, the MoveIt Jacobian frame is the last link
+  tip_link_ = joint_model_group_->getLinkModels().back();
+  for (auto & kinematic_state : kinematic_states_)
+  {
+    kinematic_state = std::make_shared<moveit::core::RobotState>(robot_model_);
+    kinematic_state->setToDefaultValues();
+    kinematic_state->updateLinkTransforms();
+  }
 
-  // TODO(destogl): manage also is this parameter is set!
-  auto robot_description_semantic = node_->get_parameter("robot_description_semantic").as_string();
-    if (robot_description_semantic.empty())
-    {
-      RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in update_robot_state()");
-      // TODO(destogl): This should be cached in the AdmittanceController...
-      throw std::runtime_error(std::string("No 'robot_description_semantic' parameter found!"));
-    }
+  const auto num_joints = static_cast<Eigen::Index>(joint_model_group_->getVariableCount());
+  const auto rank = std::min<Eigen::Index>(6, num_joints);
+  gram_of_columns_ = num_joints <= 6;
+  contexts_.resize(num_joints);
+  kinematic_state_ = kinematic_states_[contexts_.index()].get();
+  for (auto & jacobian : jacobians_)
+  {
+    jacobian = Eigen::MatrixXd(6, num_joints);
+  }
+  joint_scales_ = Eigen::VectorXd(num_joints);
+  weighted_jacobian_ = Eigen::MatrixXd(6, num_joints);
+  gram_ = Eigen::MatrixXd(rank, rank);
+  eigen_solver_ = Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd>(rank);
+  singular_values_ = Eigen::VectorXd(rank);
+  damped_inverse_eigenvalues_ = Eigen::VectorXd(rank);
+  coefficients_ = Eigen::VectorXd(rank);
+  delta_theta_ = Eigen::VectorXd(num_joints);
+
+  ik_singularity::SingularityThresholds thresholds;
+  if (!ik_singularity::get_singularity_parameters(node_, singularity_scaling_enable_, thresholds))
+  {
+    return false;
+  }
+  singularity_scaling_.set_thresholds(thresholds);
+  singularity_scaling_.reset();
+
+  if (!ik_singularity::get_damping_parameters(node_, damping_schedule_))
+  {
+    return false;
+  }
+  return true;
 }
 
 bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
@@ -59,52 +112,101 @@ bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
   const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
   std::vector<double> & delta_theta_vec)
 {
-  // see here for this conversion: https://stackoverflow.com/questions/26094379/typecasting-eigenvectorxd-to-stdvector
-  Eigen::VectorXd delta_x = Eigen::Map<Eigen::VectorXd, Eigen::Unaligned>(&delta_x_vec[0], delta_x_vec.size());
-
-  // Transform delta_x to the moveit_jacobian_frame
-  // TODO: replace when this PR to tf2_eigen is merged
-  // https://github.com/ros2/geometry2/pull/406
-  try
-  {
-    // 4x4 transformation matrix
-    const Eigen::Isometry3d affine_transform = tf2::transformToEigen(control_frame_to_ik_base);
-
-    // Build the 6x6 transformation matrix
-    Eigen::MatrixXd twist_transform(6,6);
-    // upper left 3x3 block is the rotation part
-    twist_transform.block(0,0,3,3) = affine_transform.rotation();
-    // upper right 3x3 block is all zeros
-    twist_transform.block(0,3,3,3) = Eigen::MatrixXd::Zero(3,3);
-    // lower left 3x3 block is tricky. See https://core.ac.uk/download/pdf/154240607.pdf
-    Eigen::MatrixXd pos_vector_3x3(3,3);
-    pos_vector_3x3(0,0) = 0;  pos_vector_3x3(0,1) = -affine_transform.translation().z();  pos_vector_3x3(0,2) = affine_transform.translation().y();
-    pos_vector_3x3(1, 0) = affine_transform.translation().z();  pos_vector_3x3(1,1) = 0;  pos_vector_3x3(1,2) = -affine_transform.translation().x();
-    pos_vector_3x3(2, 0) = -affine_transform.translation().y();  pos_vector_3x3(2,1) = affine_transform.translation().x();  pos_vector_3x3(1,2) = 0;
-    twist_transform.block(3,0,3,3) = pos_vector_3x3 * affine_transform.rotation();
-    // lower right 3x3 block is the rotation part
-    twist_transform.block(3,3,3,3) = affine_transform.rotation();
-
-    delta_x = twist_transform * delta_x;
-  }
-  catch (const tf2::TransformException & ex)
-  {
-    RCLCPP_ERROR(node_->get_logger(), "Transformation of twist failed.");
+  delta_theta_vec.resize(delta_theta_.size());
+  return convert_cartesian_deltas_to_joint_deltas(
+    Eigen::Map<const Eigen::VectorXd>(delta_x_vec.data(), delta_x_vec.size()), control_frame_to_ik_base,
+    Eigen::Map<Eigen::VectorXd>(delta_theta_vec.data(), delta_theta_vec.size()));
+}
+
+bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+  const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+  Eigen::Ref<Eigen::VectorXd> delta_theta)
+{
+  return convert_cartesian_to_joint(
+    delta_x, ik_eigen_interface::CartesianQuantity::MOTION, control_frame_to_ik_base, delta_theta);
+}
+
+bool RLKinematics::convert_cartesian_to_joint(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+  ik_eigen_interface::CartesianQuantity quantity,
+  const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+  Eigen::Ref<Eigen::VectorXd> delta_theta)
+{
+  if (delta_x.size() != 6 || delta_theta.size() != delta_theta_.size())
+  {
+    RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in convert_cartesian_to_joint()");
     return false;
   }
+  delta_x_ = delta_x;
+
+  // Transform delta_x to the IK base frame; free if the caller already works in it
+  control_frame_adjoint_.transform_twist(control_frame_to_ik_base.transform, delta_x_);
 
   // Multiply with the pseudoinverse to get delta_theta
-  jacobian_ = kinematic_state_->getJacobian(joint_model_group_);
-  // TODO(andyz): consider what Olivier suggested: https://github.com/ros-controls/ros2_controllers/pull/173#discussion_r627936628
-  Eigen::JacobiSVD<Eigen::MatrixXd> svd = Eigen::JacobiSVD<Eigen::MatrixXd>(jacobian_, Eigen::ComputeThinU | Eigen::ComputeThinV);
-  matrix_s_ = svd.singularValues().asDiagonal();
-  pseudo_inverse_ = svd.matrixV() * matrix_s_.inverse() * svd.matrixU().transpose();
+  const Eigen::MatrixXd & jacobian = calculate_jacobian();
+  // Damped least squares with the column norms S of the Jacobian as joint scales, like the RL kinematics,
+  // S (Js^T Js + lambda I)^-1 Js^T with Js = J S. Instead of an SVD of Js, its Gram matrix over the shorter side is
+  // decomposed, which is symmetric and much cheaper; its eigenvalues are the squared singular values of Js.
+  for (auto c = 0; c < jacobian.cols(); c++)
+  {
+    joint_scales_(c) = jacobian.col(c).norm();
+  }
+  weighted_jacobian_.noalias() = jacobian * joint_scales_.asDiagonal();
+  if (gram_of_columns_)
+  {
+    gram_.noalias() = weighted_jacobian_.transpose() * weighted_jacobian_;
+  }
+  else
+  {
+    gram_.noalias() = weighted_jacobian_ * weighted_jacobian_.transpose();
+  }
+  eigen_solver_.compute(gram_);
+  // Eigenvalues are in increasing order, singular values in decreasing order
+  const auto & eigenvalues = eigen_solver_.eigenvalues();
+  const auto & eigenvectors = eigen_solver_.eigenvectors();
+  singular_values_ = eigenvalues.reverse().cwiseMax(0.0).cwiseSqrt();
+  // Exact pseudoinverse away from singularities, damped only near them
+  const double damping = damping_schedule_.damping_for_singular_values(singular_values_);
+  damped_inverse_eigenvalues_ = (eigenvalues.array().max(0.0) + damping).inverse();
+
+  if (gram_of_columns_)
+  {
+    // (Js^T Js + lambda I)^-1 Js^T delta_x with Js^T Js = V diag(s^2) V^T
+    coefficients_.noalias() = eigenvectors.transpose() * (weighted_jacobian_.transpose() * delta_x_);
+    coefficients_.array() *= damped_inverse_eigenvalues_.array();
+    delta_theta_.noalias() = eigenvectors * coefficients_;
+    // Task direction of the smallest singular value, u = Js v / s
+    singular_direction_.noalias() = weighted_jacobian_ * eigenvectors.col(0);
+    singular_direction_.normalize();
+  }
+  else
+  {
+    // Js^T (Js Js^T + lambda I)^-1 delta_x with Js Js^T = U diag(s^2) U^T
+    coefficients_.noalias() = eigenvectors.transpose() * delta_x_;
+    coefficients_.array() *= damped_inverse_eigenvalues_.array();
+    delta_theta_.noalias() = weighted_jacobian_.transpose() * (eigenvectors * coefficients_);
+    singular_direction_ = eigenvectors.col(0);
+  }
+  delta_theta_.array() *= joint_scales_.array();
 
-  Eigen::VectorXd  delta_theta = pseudo_inverse_ * delta_x;
-  // delta_theta *= velocityScalingFactorForSingularity(delta_x, svd, pseudo_inverse_);
+  // Only motions update the direction history, and wrenches are not scaled
+  if (singularity_scaling_enable_ && quantity != ik_eigen_interface::CartesianQuantity::WRENCH)
+  {
+    // Condition number and singular direction from the decomposition above, without another Jacobian
+    const auto last = singular_values_.size() - 1;
+    const double condition = singular_values_(0) / singular_values_(last);
+    if (quantity == ik_eigen_interface::CartesianQuantity::MOTION)
+    {
+      delta_theta_ *= singularity_scaling_.update(delta_x_, singular_direction_, condition);
+    }
+    else
+    {
+      delta_theta_ *= singularity_scaling_.scale_along(delta_x_, singular_direction_, condition);
+    }
+  }
 
-  std::vector<double> delta_theta_v(&delta_theta[0], delta_theta.data() + delta_theta.cols() * delta_theta.rows());
-  delta_theta_vec = delta_theta_v;
+  delta_theta = delta_theta_;
 
   return true;
 }
@@ -114,47 +216,46 @@ bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
   const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
   std::vector<double> & delta_x_vec)
 {
-  // see here for this conversion: https://stackoverflow.com/questions/26094379/typecasting-eigenvectorxd-to-stdvector
-  Eigen::VectorXd delta_theta = Eigen::Map<Eigen::VectorXd, Eigen::Unaligned>(&delta_theta_vec[0], delta_theta_vec.size());
+  delta_x_vec.resize(6);
+  return convert_joint_deltas_to_cartesian_deltas(
+    Eigen::Map<const Eigen::VectorXd>(delta_theta_vec.data(), delta_theta_vec.size()),
+    tf_ik_base_to_desired_cartesian_frame, Eigen::Map<Eigen::VectorXd>(delta_x_vec.data(), delta_x_vec.size()));
+}
+
+bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_theta,
+  const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
+  Eigen::Ref<Eigen::VectorXd> delta_x)
+{
+  if (delta_theta.size() != delta_theta_.size() || delta_x.size() != 6)
+  {
+    RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in convert_joint_deltas_to_cartesian_deltas()");
+    return false;
+  }
 
   // Multiply with the Jacobian to get delta_x
-  jacobian_ = kinematic_state_->getJacobian(joint_model_group_);
+  const Eigen::MatrixXd & jacobian = calculate_jacobian();
   // delta_x will be in the working frame of MoveIt (ik_base frame)
-  Eigen::VectorXd delta_x = jacobian_ * delta_theta;
-
-  // Transform delta_x to the tip frame
-  // TODO: replace when this PR to tf2_eigen is merged
-  // https://github.com/ros2/geometry2/pull/406
-  try
-  {
-    // 4x4 transformation matrix
-    const Eigen::Isometry3d affine_transform = tf2::transformToEigen(tf_ik_base_to_desired_cartesian_frame);
-
-    // Build the 6x6 transformation matrix
-    Eigen::MatrixXd twist_transform(6,6);
-    // upper left 3x3 block is the rotation part
-    twist_transform.block(0,0,3,3) = affine_transform.rotation();
-    // upper right 3x3 block is all zeros
-    twist_transform.block(0,3,3,3) = Eigen::MatrixXd::Zero(3,3);
-    // lower left 3x3 block is tricky. See https://core.ac.uk/download/pdf/154240607.pdf
-    Eigen::MatrixXd pos_vector_3x3(3,3);
-    pos_vector_3x3(0,0) = 0;  pos_vector_3x3(0,1) = -affine_transform.translation().z();  pos_vector_3x3(0,2) = affine_transform.translation().y();
-    pos_vector_3x3(1, 0) = affine_transform.translation().z();  pos_vector_3x3(1,1) = 0;  pos_vector_3x3(1,2) = -affine_transform.translation().x();
-    pos_vector_3x3(2, 0) = -affine_transform.translation().y();  pos_vector_3x3(2,1) = affine_transform.translation().x();  pos_vector_3x3(1,2) = 0;
-    twist_transform.block(3,0,3,3) = pos_vector_3x3 * affine_transform.rotation();
-    // lower right 3x3 block is the rotation part
-    twist_transform.block(3,3,3,3) = affine_transform.rotation();
-
-    delta_x = twist_transform * delta_x;
-  }
-  catch (const tf2::TransformException & ex)
-  {
-    RCLCPP_ERROR(node_->get_logger(), "Transformation of twist failed.");
+  delta_x.noalias() = jacobian * delta_theta;
+
+  // Transform delta_x to the desired Cartesian frame; free if that is the IK base frame
+  desired_frame_adjoint_.transform_twist(tf_ik_base_to_desired_cartesian_frame.transform, delta_x);
+
+  return true;
+}
+
+bool RLKinematics::calculate_end_effector_position(std::vector<double> & end_effector_position)
+{
+  if (end_effector_position.size() != 6)
+  {
+    RCLCPP_ERROR(node_->get_logger(), "the end_effector_position input vector must size 6");
     return false;
   }
-
-  std::vector<double> delta_x_v(&delta_x[0], delta_x.data() + delta_x.cols() * delta_x.rows());
-  delta_x_vec = delta_x_v;
+  calculate_forward_kinematics();
+  const Eigen::Vector3d & position = kinematic_state_->getGlobalLinkTransform(tip_link_).translation();
+  end_effector_position[0] = position.x();
+  end_effector_position[1] = position.y();
+  end_effector_position[2] = position.z();
 
   return true;
 }
@@ -163,75 +264,30 @@ Eigen::Isometry3d RLKinematics::get_link_transform(
   const std::string& link_name, const trajectory_msgs::msg::JointTrajectoryPoint & joint_state)
 {
   update_robot_state(joint_state);
+  calculate_forward_kinematics();
 
   return kinematic_state_->getGlobalLinkTransform(link_name);
 }
 
-// Possibly calculate a velocity scaling factor, due to proximity of singularity and direction of motion
-double RLKinematics::velocityScalingFactorForSingularity(const Eigen::VectorXd& commanded_velocity,
-                                                         const Eigen::JacobiSVD<Eigen::MatrixXd>& svd,
-                                                         const Eigen::MatrixXd& pseudo_inverse)
+void RLKinematics::calculate_forward_kinematics()
 {
-  double velocity_scale = 1;
-  std::size_t num_dimensions = commanded_velocity.size();
-
-  // Find the direction away from nearest singularity.
-  // The last column of U from the SVD of the Jacobian points directly toward or away from the singularity.
-  // The sign can flip at any time, so we have to do some extra checking.
-  // Look ahead to see if the Jacobian's condition will decrease.
-  Eigen::VectorXd vector_toward_singularity = svd.matrixU().col(num_dimensions - 1);
-
-  double ini_condition = svd.singularValues()(0) / svd.singularValues()(svd.singularValues().size() - 1);
-
-  // TODO: Remove or switch to DEBUG
-  RCLCPP_INFO_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), 50000., "Singularity condition number is " << ini_condition);
-
-  // This singular vector tends to flip direction unpredictably. See R. Bro,
-  // "Resolving the Sign Ambiguity in the Singular Value Decomposition".
-  // Look ahead to see if the Jacobian's condition will decrease in this
-  // direction. Start with a scaled version of the singular vector
-  Eigen::VectorXd delta_x(num_dimensions);
-  double scale = 100;
-  delta_x = vector_toward_singularity / scale;
-
-  // Calculate a small change in joints
-  Eigen::VectorXd new_theta;
-  kinematic_state_->copyJointGroupPositions(joint_model_group_, new_theta);
-  new_theta += pseudo_inverse * delta_x;
-  kinematic_state_->setJointGroupPositions(joint_model_group_, new_theta);
-  Eigen::MatrixXd new_jacobian = kinematic_state_->getJacobian(joint_model_group_);
-
-  Eigen::JacobiSVD<Eigen::MatrixXd> new_svd(new_jacobian);
-  double new_condition = new_svd.singularValues()(0) / new_svd.singularValues()(new_svd.singularValues().size() - 1);
-  // If new_condition < ini_condition, the singular vector does point towards a
-  // singularity. Otherwise, flip its direction.
-  if (ini_condition >= new_condition)
-  {
-    vector_toward_singularity *= -1;
-  }
-
-  // If this dot product is positive, we're moving toward singularity ==> decelerate
-  double dot = vector_toward_singularity.dot(commanded_velocity);
-  double upper_threshold = dot > 0 ? APPROACHING_STOP_SINGULARITY_THRESHOLD : HARD_STOP_SINGULARITY_THRESHOLD;
-  // Ramp velocity down linearly when the Jacobian condition is between lower_singularity_threshold and
-  // hard_stop_singularity_threshold, and we're moving towards the singularity
-  if ((ini_condition > LOWER_SINGULARITY_THRESHOLD) &&
-      (ini_condition < upper_threshold))
+  if (!contexts_.forward_kinematics_valid())
   {
-    velocity_scale =
-        1. - (ini_condition - LOWER_SINGULARITY_THRESHOLD) /
-                 (upper_threshold - LOWER_SINGULARITY_THRESHOLD);
-    RCLCPP_WARN_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), ROS_LOG_THROTTLE_PERIOD, "Close to a singularity, decelerating: " << LOWER_SINGULARITY_THRESHOLD << " < " << ini_condition << " < " << upper_threshold);
+    kinematic_state_->updateLinkTransforms();
+    contexts_.set_forward_kinematics_valid();
   }
+}
 
-  // Very close to singularity, so halt.
-  else if (ini_condition > upper_threshold)
+const Eigen::MatrixXd & RLKinematics::calculate_jacobian()
+{
+  auto & jacobian = jacobians_[contexts_.index()];
+  if (!contexts_.jacobian_valid())
   {
-    velocity_scale = 0;
-    RCLCPP_WARN_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), ROS_LOG_THROTTLE_PERIOD, "Very close to a singularity, emergency stop: " << ini_condition << " > " << upper_threshold);
+    calculate_forward_kinematics();
+    kinematic_state_->getJacobian(joint_model_group_, tip_link_, Eigen::Vector3d::Zero(), jacobian);
+    contexts_.set_jacobian_valid();
   }
-
-  return 1.0;
+  return jacobian;
 }
 
 }  // namespace admittance_controller
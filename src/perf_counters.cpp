@@ -0,0 +1,107 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include "admittance_controller/perf_counters.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace admittance_controller
+{
+
+namespace
+{
+int perf_event_open(perf_event_attr & attr, int group_fd)
+{
+  // Calling thread (pid 0) on any CPU
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+
+// Layout of a read() on the group leader with PERF_FORMAT_GROUP
+struct GroupReadFormat
+{
+  uint64_t nr;
+  uint64_t values[4];
+};
+}  // namespace
+
+PerfCounters::~PerfCounters()
+{
+  close();
+}
+
+bool PerfCounters::open()
+{
+  close();
+  const std::array<uint64_t, 4> configs = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+  for (auto i = 0u; i < configs.size(); ++i) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = configs[i];
+    attr.disabled = i == 0 ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    fds_[i] = perf_event_open(attr, i == 0 ? -1 : fds_[0]);
+    if (fds_[i] < 0) {
+      error_ = std::string("perf_event_open failed: ") + std::strerror(errno) +
+        " (check kernel.perf_event_paranoid and that hardware counters are available)";
+      close();
+      return false;
+    }
+  }
+  ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  return true;
+}
+
+void PerfCounters::close()
+{
+  // Members first, the group leader last
+  for (auto i = fds_.size(); i-- > 0; ) {
+    if (fds_[i] >= 0) {
+      ::close(fds_[i]);
+      fds_[i] = -1;
+    }
+  }
+}
+
+bool PerfCounters::read(PerfCounterSample & sample) const
+{
+  GroupReadFormat data;
+  if (!is_open() || ::read(fds_[0], &data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) ||
+    data.nr != 4)
+  {
+    return false;
+  }
+  sample.cycles = data.values[0];
+  sample.instructions = data.values[1];
+  sample.cache_misses = data.values[2];
+  sample.branch_misses = data.values[3];
+  return true;
+}
+
+}  // namespace admittance_controller
@@ -14,20 +14,23 @@
 //
 /// author: Paul Gesel
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 #include "rl_differential_ik_plugin/rl_kinematics.hpp"
+#include "ik_singularity/singularity_parameters.hpp"
 #include "rl/mdl/UrdfFactory.h"
 #include "rl/mdl/Joint.h"
+#include "rl/mdl/Revolute.h"
 
+// Added to the damping of the QP, so that its Hessian stays positive definite in the null space of redundant arms
+constexpr double QP_REGULARIZATION = 1e-9;
 
-constexpr auto ROS_LOG_THROTTLE_PERIOD = std::chrono::milliseconds(1000).count();
-// TODO: Parameterize singularity thresholds
-constexpr double LOWER_SINGULARITY_THRESHOLD = 20.;
-constexpr double APPROACHING_STOP_SINGULARITY_THRESHOLD = 80;
-constexpr double HARD_STOP_SINGULARITY_THRESHOLD = 120.;
 
 namespace rl_differential_ik_plugin
 {
+    constexpr int RLKinematics::QP_MAX_JOINTS;
+
     RLKinematics::RLKinematics(){
 
     }
@@ -48,18 +51,31 @@ bool RLKinematics::initialize(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> n
 
     urdf.load("robot.urdf", &model);
 
-    std::unordered_set<std::string> control_joint = {"shoulder_pan_joint",
-                                 "shoulder_lift_joint",
-                                 "elbow_joint",
-                                 "wrist_1_joint",
-                                 "wrist_2_joint",
-                                 "wrist_3_joint"};
-
-    for (int i = 0; i < model.getJoints(); i++){
-        if (control_joint.find(model.getJoint(i)->getName()) != control_joint.end()){
+    // Control joints of the controller, e.g. 7 of a redundant arm; without them all joints of the model. The
+    // Jacobian columns and the manipulability gradient follow the chain, so they have to be listed in its order.
+    const auto joint_names = ik_singularity::get_or_declare_parameter<std::vector<std::string>>(
+            node, "joints", std::vector<std::string>());
+    control_inds.clear();
+    if (joint_names.empty()) {
+        for (int i = 0; i < static_cast<int>(model.getJoints()); i++) {
             control_inds.push_back(i);
         }
     }
+    for (const auto & joint_name : joint_names) {
+        int index = 0;
+        while (index < static_cast<int>(model.getJoints()) && model.getJoint(index)->getName() != joint_name) {
+            index++;
+        }
+        if (index == static_cast<int>(model.getJoints())) {
+            RCLCPP_ERROR(node->get_logger(), "Joint '%s' is not in the robot description", joint_name.c_str());
+            return false;
+        }
+        if (!control_inds.empty() && index <= control_inds.back()) {
+            RCLCPP_ERROR(node->get_logger(), "The joints have to be listed in the order of the kinematic chain");
+            return false;
+        }
+        control_inds.push_back(index);
+    }
 
 
     numEE = model.getOperationalDof()/6;
@@ -68,19 +84,201 @@ bool RLKinematics::initialize(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> n
     offseti = endEffectorIndex*6;
 
     all_jacobians_ = rl::math::Matrix(6*numEE, numDof);
-    jacobian_ = rl::math::Matrix(6, control_inds.size());
+    for (auto & jacobian : jacobians_) {
+        jacobian = rl::math::Matrix(6, control_inds.size());
+    }
+    model_positions_ = model.getPosition();
+    contexts_.resize(control_inds.size());
     pseudo_inverse_ = rl::math::Matrix(control_inds.size(), 6);
+    joint_scales_ = Eigen::VectorXd(control_inds.size());
+    weighted_jacobian_ = Eigen::MatrixXd(6, control_inds.size());
+    svd_ = Eigen::JacobiSVD<Eigen::MatrixXd>(6, control_inds.size(), Eigen::ComputeThinU | Eigen::ComputeThinV);
+
+    ik_singularity::SingularityThresholds thresholds;
+    if (!ik_singularity::get_singularity_parameters(node, singularity_scaling_enable_, thresholds)) {
+        return false;
+    }
+    singularity_scaling_.set_thresholds(thresholds);
+    singularity_scaling_.reset();
+
+    if (!ik_singularity::get_damping_parameters(node, damping_schedule_)) {
+        return false;
+    }
 
+    // Weights of the joint motion in the damping, one per control joint; without them the columns of the Jacobian
+    // are normalized every cycle
+    const auto joint_weights = ik_singularity::get_or_declare_parameter<std::vector<double>>(
+            node, "IK.joint_weights", std::vector<double>());
+    fixed_joint_scales_ = !joint_weights.empty();
+    if (fixed_joint_scales_) {
+        if (joint_weights.size() != control_inds.size() ||
+            std::any_of(joint_weights.begin(), joint_weights.end(), [](double w) {return !(w > 0.0);})) {
+            RCLCPP_ERROR(node->get_logger(), "IK.joint_weights needs one positive weight per joint");
+            return false;
+        }
+        for (size_t i = 0; i < joint_weights.size(); i++) {
+            joint_scales_(i) = 1.0 / std::sqrt(joint_weights[i]);
+        }
+    }
+
+    // Optional manipulability atlas of the control joints, written by manipulability_atlas_tool
+    const auto atlas_path = ik_singularity::get_or_declare_parameter<std::string>(
+            node, "IK.manipulability_atlas.path", "");
+    atlas_.close();
+    if (!atlas_path.empty()) {
+        if (damping_schedule_.measure == ik_singularity::DampingMeasure::SMALLEST_SINGULAR_VALUE) {
+            RCLCPP_ERROR(node->get_logger(), "The manipulability atlas has no singular values, set IK.damping.measure "
+                         "to 'manipulability' or 'constant'");
+            return false;
+        }
+        std::string error;
+        if (!atlas_.open(atlas_path, error)) {
+            RCLCPP_ERROR(node->get_logger(), "Can not load the manipulability atlas: %s", error.c_str());
+            return false;
+        }
+        if (atlas_.num_joints() != control_inds.size()) {
+            RCLCPP_ERROR(node->get_logger(), "The manipulability atlas has %zu joints, expected %zu",
+                         atlas_.num_joints(), control_inds.size());
+            atlas_.close();
+            return false;
+        }
+    }
+    // Optional resolution of the self-motion of redundant arms
+    null_space_enable_ = ik_singularity::get_or_declare_parameter<bool>(node, "IK.null_space.enable", false);
+    ik_singularity::NullSpaceGains null_space_gains;
+    null_space_gains.joint_centering = ik_singularity::get_or_declare_parameter<double>(
+            node, "IK.null_space.joint_centering_gain", 0.0);
+    null_space_gains.manipulability = ik_singularity::get_or_declare_parameter<double>(
+            node, "IK.null_space.manipulability_gain", 0.0);
+    null_space_gains.posture = ik_singularity::get_or_declare_parameter<double>(
+            node, "IK.null_space.posture_gain", 0.0);
+    const auto posture = ik_singularity::get_or_declare_parameter<std::vector<double>>(
+            node, "IK.null_space.posture", std::vector<double>());
+    if (null_space_enable_) {
+        if (atlas_.is_open()) {
+            RCLCPP_ERROR(node->get_logger(), "The null space needs the decomposition, it can not be used with a "
+                         "manipulability atlas");
+            return false;
+        }
+        if (null_space_gains.posture != 0.0 && posture.size() != control_inds.size()) {
+            RCLCPP_ERROR(node->get_logger(), "IK.null_space.posture needs one position per joint");
+            return false;
+        }
+        // The gradient of the manipulability is derived for chains of revolute joints
+        if (null_space_gains.manipulability != 0.0 &&
+            std::any_of(control_inds.begin(), control_inds.end(), [this](int i) {
+                return dynamic_cast<rl::mdl::Revolute *>(model.getJoint(i)) == nullptr;})) {
+            RCLCPP_ERROR(node->get_logger(), "IK.null_space.manipulability_gain needs revolute joints");
+            return false;
+        }
+    }
+    min_positions_.clear();
+    max_positions_.clear();
+    for (int i : control_inds) {
+        min_positions_.push_back(model.getMinimum()(i));
+        max_positions_.push_back(model.getMaximum()(i));
+    }
+    null_space_objectives_.configure(min_positions_, max_positions_, posture, null_space_gains);
+    null_space_motion_ = Eigen::VectorXd::Zero(control_inds.size());
+    null_space_coefficients_ = Eigen::VectorXd::Zero(std::min<size_t>(6, control_inds.size()));
+
+    // Optional QP with the joint bounds instead of the pseudoinverse
+    qp_enable_ = ik_singularity::get_or_declare_parameter<bool>(node, "IK.qp.enable", false);
+    qp_max_joint_delta_ = ik_singularity::get_or_declare_parameter<double>(node, "IK.qp.max_joint_delta", 0.0);
+    if (qp_enable_) {
+        if (control_inds.size() > static_cast<size_t>(QP_MAX_JOINTS)) {
+            RCLCPP_ERROR(node->get_logger(), "The IK QP supports at most %d joints", QP_MAX_JOINTS);
+            return false;
+        }
+        if (null_space_enable_) {
+            RCLCPP_ERROR(node->get_logger(), "IK.qp.enable and IK.null_space.enable can not be combined");
+            return false;
+        }
+    }
+    qp_solver_.resize(control_inds.size());
+    qp_hessian_ = Eigen::MatrixXd(control_inds.size(), control_inds.size());
+    qp_gradient_ = Eigen::VectorXd(control_inds.size());
+    qp_lower_ = Eigen::VectorXd(control_inds.size());
+    qp_upper_ = Eigen::VectorXd(control_inds.size());
+    joint_delta_origin_ = Eigen::VectorXd::Zero(control_inds.size());
+    joint_delta_origin_set_ = false;
+
+    delta_x_ = Eigen::VectorXd::Zero(6);
+    delta_theta_ = Eigen::VectorXd::Zero(control_inds.size());
+    atlas_gradient_ = Eigen::VectorXd::Zero(control_inds.size());
+    normal_matrix_ = Eigen::MatrixXd(control_inds.size(), control_inds.size());
+    ldlt_ = Eigen::LDLT<Eigen::MatrixXd>(control_inds.size());
+
+    return true;
 }
 
-void RLKinematics::calculateJacobian(){
+void RLKinematics::calculateForwardKinematics(){
+    // The model is shared by the contexts and moved to the state of one only when its kinematics are out of date
+    const auto & positions = contexts_.positions();
+    for (size_t i = 0; i < control_inds.size(); i++){
+        model_positions_[control_inds[i]] = positions[i];
+    }
+    model.setPosition(model_positions_);
+    model.forwardPosition();
+    model_context_ = contexts_.index();
+    int endEffectorIndex = 0;
+    end_effector_positions_[model_context_] = model.getOperationalPosition(endEffectorIndex).translation();
+    contexts_.set_forward_kinematics_valid();
+}
+
+const Eigen::MatrixXd & RLKinematics::calculateJacobian(){
+    auto & jacobian = jacobians_[contexts_.index()];
+    if (contexts_.jacobian_valid()){
+        return jacobian;
+    }
+    if (!contexts_.forward_kinematics_valid() || model_context_ != contexts_.index()){
+        calculateForwardKinematics();
+    }
     model.calculateJacobian(all_jacobians_);
     for (int i =0; i < 6; i++){
         int ind = 0;
         for (int j : control_inds){
-            jacobian_(i, ind++) = all_jacobians_(i+offseti,j);
+            jacobian(i, ind++) = all_jacobians_(i+offseti,j);
         }
     }
+    contexts_.set_jacobian_valid();
+    return jacobian;
+}
+
+void RLKinematics::solveWithJointBounds(const Eigen::VectorXd & delta_x, double damping, Eigen::VectorXd & delta_theta)
+{
+  // The damped least squares in the joint coordinates of Js, y = S^-1 delta_theta, as a QP:
+  // minimize 1/2 |Js y - delta_x|^2 + 1/2 lambda |y|^2 with the position limits and the largest joint delta as bounds
+  qp_hessian_.noalias() = weighted_jacobian_.transpose() * weighted_jacobian_;
+  qp_hessian_.diagonal().array() += damping + QP_REGULARIZATION;
+  qp_gradient_.noalias() = -weighted_jacobian_.transpose() * delta_x;
+  // The bounds hold for the positions the delta is added to, which are not always those of the robot state
+  const auto & joint_positions = contexts_.positions();
+  for (auto i = 0; i < qp_gradient_.size(); i++) {
+    const double origin = joint_delta_origin_set_ ? joint_delta_origin_(i) : joint_positions[i];
+    // A joint beyond a limit may stay but not move further out
+    double lower = std::min(min_positions_[i] - origin, 0.0);
+    double upper = std::max(max_positions_[i] - origin, 0.0);
+    if (qp_max_joint_delta_ > 0.0) {
+      lower = std::max(lower, -qp_max_joint_delta_);
+      upper = std::min(upper, qp_max_joint_delta_);
+    }
+    qp_lower_(i) = lower / joint_scales_(i);
+    qp_upper_(i) = upper / joint_scales_(i);
+  }
+  // Without convergence the solution is still within the bounds; start the next cycle from scratch
+  if (!qp_solver_.solve(qp_hessian_, qp_gradient_, qp_lower_, qp_upper_, qp_solution_)) {
+    qp_solver_.reset();
+  }
+  delta_theta = joint_scales_.cwiseProduct(qp_solution_);
+}
+
+void RLKinematics::set_joint_delta_origin(const Eigen::Ref<const Eigen::VectorXd> & joint_positions)
+{
+  joint_delta_origin_set_ = joint_positions.size() == joint_delta_origin_.size();
+  if (joint_delta_origin_set_) {
+    joint_delta_origin_ = joint_positions;
+  }
 }
 
 bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
@@ -88,73 +286,111 @@ bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
   const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
   std::vector<double> & delta_theta_vec)
 {
-  // see here for this conversion: https://stackoverflow.com/questions/26094379/typecasting-eigenvectorxd-to-stdvector
-  Eigen::VectorXd delta_x = Eigen::Map<Eigen::VectorXd, Eigen::Unaligned>(&delta_x_vec[0], delta_x_vec.size());
+  delta_theta_vec.resize(control_inds.size());
+  return convert_cartesian_deltas_to_joint_deltas(
+    Eigen::Map<const Eigen::VectorXd>(delta_x_vec.data(), delta_x_vec.size()), control_frame_to_ik_base,
+    Eigen::Map<Eigen::VectorXd>(delta_theta_vec.data(), delta_theta_vec.size()));
+}
 
-//  try
-//  {
-//    // 4x4 transformation matrix
-//    const Eigen::Isometry3d affine_transform = tf2::transformToEigen(control_frame_to_ik_base);
-//
-//    // Build the 6x6 transformation matrix
-//    Eigen::MatrixXd twist_transform(6,6);
-//    // upper left 3x3 block is the rotation part
-//    twist_transform.block(0,0,3,3) = affine_transform.rotation();
-//    // upper right 3x3 block is all zeros
-//    twist_transform.block(0,3,3,3) = Eigen::MatrixXd::Zero(3,3);
-//    // lower left 3x3 block is tricky. See https://core.ac.uk/download/pdf/154240607.pdf
-//    Eigen::MatrixXd pos_vector_3x3(3,3);
-//    pos_vector_3x3(0,0) = 0;  pos_vector_3x3(0,1) = -affine_transform.translation().z();  pos_vector_3x3(0,2) = affine_transform.translation().y();
-//    pos_vector_3x3(1, 0) = affine_transform.translation().z();  pos_vector_3x3(1,1) = 0;  pos_vector_3x3(1,2) = -affine_transform.translation().x();
-//    pos_vector_3x3(2, 0) = -affine_transform.translation().y();  pos_vector_3x3(2,1) = affine_transform.translation().x();  pos_vector_3x3(1,2) = 0;
-//    twist_transform.block(3,0,3,3) = pos_vector_3x3 * affine_transform.rotation();
-//    // lower right 3x3 block is the rotation part
-//    twist_transform.block(3,3,3,3) = affine_transform.rotation();
-//
-//    delta_x = twist_transform * delta_x;
-//  }
-//  catch (const tf2::TransformException & ex)
-//  {
-//    RCLCPP_ERROR(node_->get_logger(), "Transformation of twist failed.");
-//    return false;
-//  }
+bool RLKinematics::convert_cartesian_deltas_to_joint_deltas(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+  const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+  Eigen::Ref<Eigen::VectorXd> delta_theta)
+{
+  return convert_cartesian_to_joint(
+    delta_x, ik_eigen_interface::CartesianQuantity::MOTION, control_frame_to_ik_base, delta_theta);
+}
 
-  // Multiply with the pseudoinverse to get delta_theta
-  calculateJacobian();
-  // TODO(andyz): consider what Olivier suggested: https://github.com/ros-controls/ros2_controllers/pull/173#discussion_r627936628
-//  Eigen::JacobiSVD<Eigen::MatrixXd> svd = Eigen::JacobiSVD<Eigen::MatrixXd>(jacobian_, Eigen::ComputeThinU | Eigen::ComputeThinV);
-//  matrix_s_ = svd.singularValues().asDiagonal();
-//  pseudo_inverse_ = svd.matrixV() * matrix_s_.inverse() * svd.matrixU().transpose();
-//
-//model.calculateJacobianInverse(jacobian_, pseudo_inverse_, .001f, true);
-        auto W = rl::math::Matrix(6,6);
-        W.setIdentity();
-        auto W2 = rl::math::Matrix(control_inds.size(),control_inds.size());
-        W2.setZero();
-//        double thresh = .3;
-//        double maxSum = 0;
-        for(auto r = 0; r < jacobian_.rows(); r++){
-            double sum = 0;
-            for(auto c = 0; c < jacobian_.cols(); c++){
-//             sum += std::max(std::abs(jacobian_(r, c))-thresh, 0.0);
-                W2(c,c) += std::abs(jacobian_(r, c))*std::abs(jacobian_(r, c));
-            }
-//            maxSum = std::max(maxSum, sum);
-//            W(r, r) = 1000*std::abs(delta_x[r]);// sum;
-        }
-        W2 = W2.inverse();
-        auto I = rl::math::Matrix(control_inds.size(),control_inds.size());
-        I.setIdentity();
+bool RLKinematics::convert_cartesian_to_joint(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_x,
+  ik_eigen_interface::CartesianQuantity quantity,
+  const geometry_msgs::msg::TransformStamped & control_frame_to_ik_base,
+  Eigen::Ref<Eigen::VectorXd> delta_theta)
+{
+  if (delta_x.size() != 6 || delta_theta.size() != delta_theta_.size()) {
+    RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in convert_cartesian_to_joint()");
+    return false;
+  }
+  delta_x_ = delta_x;
+
+  // Transform delta_x to the IK base frame; free if the caller already works in it
+  control_frame_adjoint_.transform_twist(control_frame_to_ik_base.transform, delta_x_);
 
+  // Multiply with the pseudoinverse to get delta_theta
+  const Eigen::MatrixXd & jacobian = calculateJacobian();
+  // Damped least squares with joint weights W = S^-2, configured or from the column norms S of the Jacobian,
+  // (J^T J + lambda W)^-1 J^T = S (Js^T Js + lambda I)^-1 Js^T with Js = J S. Without atlas it is computed as
+  // S V diag(s / (s^2 + lambda)) U^T from the SVD of Js, which also gives the damping schedule its measure and the
+  // singularity handling its condition number and direction.
+  if (!fixed_joint_scales_) {
+    for (auto c = 0; c < jacobian.cols(); c++) {
+      joint_scales_(c) = jacobian.col(c).norm();
+    }
+  }
+  weighted_jacobian_.noalias() = jacobian * joint_scales_.asDiagonal();
+
+  ik_singularity::ManipulabilitySample sample{};
+  double damping;
+  if (atlas_.is_open()) {
+    // Singularity proximity from the precomputed atlas instead of a decomposition: the damping rises as the
+    // manipulability falls, and the gradient of the inverse condition number tells the direction of motion.
+    sample = atlas_.lookup(contexts_.positions().data(), atlas_gradient_.data());
+    damping = damping_schedule_.damping(sample.manipulability);
+  } else {
+    svd_.compute(weighted_jacobian_, Eigen::ComputeThinU | Eigen::ComputeThinV);
+    // Exact pseudoinverse away from singularities, damped only near them
+    damping = damping_schedule_.damping_for_singular_values(svd_.singularValues());
+  }
 
-//    std::cout << W2 <<  std::endl;
-    pseudo_inverse_ = (jacobian_.transpose()*W*jacobian_ + 0.005*W2*I).inverse()*jacobian_.transpose()*W;
+  // The bounds of the QP are distances to the position limits, so only motions, which are deltas, are bounded
+  if (qp_enable_ && quantity == ik_eigen_interface::CartesianQuantity::MOTION) {
+    solveWithJointBounds(delta_x_, damping, delta_theta_);
+  } else if (atlas_.is_open()) {
+    normal_matrix_.noalias() = weighted_jacobian_.transpose() * weighted_jacobian_;
+    normal_matrix_.diagonal().array() += damping;
+    ldlt_.compute(normal_matrix_);
+    delta_theta_.noalias() = joint_scales_.asDiagonal() * ldlt_.solve(weighted_jacobian_.transpose() * delta_x_);
+  } else {
+    const auto & singular_values = svd_.singularValues();
+    damped_singular_values_ = singular_values.array() / (singular_values.array().square() + damping);
+    pseudo_inverse_.noalias() = joint_scales_.asDiagonal() * svd_.matrixV() * damped_singular_values_.asDiagonal() *
+                                svd_.matrixU().transpose();
+
+    delta_theta_.noalias() = pseudo_inverse_ * delta_x_;
+    if (null_space_enable_ && quantity == ik_eigen_interface::CartesianQuantity::MOTION) {
+      // Secondary objectives in the joint coordinates of Js, projected onto its null space with its right
+      // singular vectors, so that they do not move the tip. They are a motion of one cycle, so accelerations and
+      // wrenches do not get them.
+      null_space_objectives_.motion(contexts_.positions(), jacobian, pseudo_inverse_, null_space_motion_);
+      null_space_motion_.array() /= joint_scales_.array();
+      ik_singularity::project_onto_null_space(svd_.matrixV(), null_space_motion_, null_space_coefficients_);
+      delta_theta_ += joint_scales_.cwiseProduct(null_space_motion_);
+    }
+  }
+  if (quantity == ik_eigen_interface::CartesianQuantity::MOTION) {
+    // The origin of the joint bounds was set for this motion only
+    joint_delta_origin_set_ = false;
+  }
 
-  Eigen::VectorXd  delta_theta = pseudo_inverse_ * delta_x;
-//   delta_theta *= velocityScalingFactorForSingularity(delta_x, svd, pseudo_inverse_);
+  // Scaling keeps the joint bounds of the QP, they contain the zero motion. Only motions update the direction
+  // history, and wrenches are not scaled.
+  if (singularity_scaling_enable_ && quantity != ik_eigen_interface::CartesianQuantity::WRENCH) {
+    if (atlas_.is_open()) {
+      const double inverse_condition_rate = atlas_gradient_.dot(delta_theta_);
+      delta_theta_ *= singularity_scaling_.scale(sample.condition(), inverse_condition_rate < 0.0);
+    } else {
+      const auto & singular_values = svd_.singularValues();
+      const auto last = singular_values.size() - 1;
+      const double condition = singular_values(0) / singular_values(last);
+      if (quantity == ik_eigen_interface::CartesianQuantity::MOTION) {
+        delta_theta_ *= singularity_scaling_.update(delta_x_, svd_.matrixU().col(last), condition);
+      } else {
+        delta_theta_ *= singularity_scaling_.scale_along(delta_x_, svd_.matrixU().col(last), condition);
+      }
+    }
+  }
 
-  std::vector<double> delta_theta_v(&delta_theta[0], delta_theta.data() + delta_theta.cols() * delta_theta.rows());
-  delta_theta_vec = delta_theta_v;
+  delta_theta = delta_theta_;
 
   return true;
 }
@@ -164,47 +400,29 @@ bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
   const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
   std::vector<double> & delta_x_vec)
 {
-  // see here for this conversion: https://stackoverflow.com/questions/26094379/typecasting-eigenvectorxd-to-stdvector
-  Eigen::VectorXd delta_theta = Eigen::Map<Eigen::VectorXd, Eigen::Unaligned>(&delta_theta_vec[0], delta_theta_vec.size());
+  delta_x_vec.resize(6);
+  return convert_joint_deltas_to_cartesian_deltas(
+    Eigen::Map<const Eigen::VectorXd>(delta_theta_vec.data(), delta_theta_vec.size()),
+    tf_ik_base_to_desired_cartesian_frame, Eigen::Map<Eigen::VectorXd>(delta_x_vec.data(), delta_x_vec.size()));
+}
 
-  // Multiply with the Jacobian to get delta_x
-  calculateJacobian();
-  // delta_x will be in the working frame of MoveIt (ik_base frame)
-  Eigen::VectorXd delta_x = jacobian_ * delta_theta;
-
-  // Transform delta_x to the tip frame
-  // TODO: replace when this PR to tf2_eigen is merged
-  // https://github.com/ros2/geometry2/pull/406
-  try
-  {
-    // 4x4 transformation matrix
-    const Eigen::Isometry3d affine_transform = tf2::transformToEigen(tf_ik_base_to_desired_cartesian_frame);
-
-    // Build the 6x6 transformation matrix
-    Eigen::MatrixXd twist_transform(6,6);
-    // upper left 3x3 block is the rotation part
-    twist_transform.block(0,0,3,3) = affine_transform.rotation();
-    // upper right 3x3 block is all zeros
-    twist_transform.block(0,3,3,3) = Eigen::MatrixXd::Zero(3,3);
-    // lower left 3x3 block is tricky. See https://core.ac.uk/download/pdf/154240607.pdf
-    Eigen::MatrixXd pos_vector_3x3(3,3);
-    pos_vector_3x3(0,0) = 0;  pos_vector_3x3(0,1) = -affine_transform.translation().z();  pos_vector_3x3(0,2) = affine_transform.translation().y();
-    pos_vector_3x3(1, 0) = affine_transform.translation().z();  pos_vector_3x3(1,1) = 0;  pos_vector_3x3(1,2) = -affine_transform.translation().x();
-    pos_vector_3x3(2, 0) = -affine_transform.translation().y();  pos_vector_3x3(2,1) = affine_transform.translation().x();  pos_vector_3x3(1,2) = 0;
-    twist_transform.block(3,0,3,3) = pos_vector_3x3 * affine_transform.rotation();
-    // lower right 3x3 block is the rotation part
-    twist_transform.block(3,3,3,3) = affine_transform.rotation();
-
-    delta_x = twist_transform * delta_x;
-  }
-  catch (const tf2::TransformException & ex)
-  {
-    RCLCPP_ERROR(node_->get_logger(), "Transformation of twist failed.");
+bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
+  const Eigen::Ref<const Eigen::VectorXd> & delta_theta,
+  const geometry_msgs::msg::TransformStamped & tf_ik_base_to_desired_cartesian_frame,
+  Eigen::Ref<Eigen::VectorXd> delta_x)
+{
+  if (delta_theta.size() != delta_theta_.size() || delta_x.size() != 6) {
+    RCLCPP_ERROR(node_->get_logger(), "Vector size mismatch in convert_joint_deltas_to_cartesian_deltas()");
     return false;
   }
 
-  std::vector<double> delta_x_v(&delta_x[0], delta_x.data() + delta_x.cols() * delta_x.rows());
-  delta_x_vec = delta_x_v;
+  // Multiply with the Jacobian to get delta_x
+  const Eigen::MatrixXd & jacobian = calculateJacobian();
+  // delta_x will be in the working frame of MoveIt (ik_base frame)
+  delta_x.noalias() = jacobian * delta_theta;
+
+  // Transform delta_x to the desired Cartesian frame; free if that is the IK base frame
+  desired_frame_adjoint_.transform_twist(tf_ik_base_to_desired_cartesian_frame.transform, delta_x);
 
   return true;
 }
@@ -214,13 +432,13 @@ bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
             RCLCPP_ERROR(node_->get_logger(), "the end_effector_position input vector must size 6");
             return false;
         }
-        int endEffectorIndex = 0;
-        auto position = model.getOperationalPosition(endEffectorIndex);
-//        for (int i=0; i < 3; i++){
-            end_effector_position[0] = position.translation().x();
-        end_effector_position[1] = position.translation().y();
-        end_effector_position[2] = position.translation().z();
-//        }
+        if (!contexts_.forward_kinematics_valid()){
+            calculateForwardKinematics();
+        }
+        const auto & position = end_effector_positions_[contexts_.index()];
+        end_effector_position[0] = position.x();
+        end_effector_position[1] = position.y();
+        end_effector_position[2] = position.z();
 
         return true;
     }
@@ -233,73 +451,6 @@ bool RLKinematics::convert_joint_deltas_to_cartesian_deltas(
 //  return kinematic_state_->getGlobalLinkTransform(link_name);
 //}
 
-// Possibly calculate a velocity scaling factor, due to proximity of singularity and direction of motion
-//double RLKinematics::velocityScalingFactorForSingularity(const Eigen::VectorXd& commanded_velocity,
-//                                                         const Eigen::JacobiSVD<Eigen::MatrixXd>& svd,
-//                                                         const Eigen::MatrixXd& pseudo_inverse)
-//{
-//  double velocity_scale = 1;
-//  std::size_t num_dimensions = commanded_velocity.size();
-//
-//  // Find the direction away from nearest singularity.
-//  // The last column of U from the SVD of the Jacobian points directly toward or away from the singularity.
-//  // The sign can flip at any time, so we have to do some extra checking.
-//  // Look ahead to see if the Jacobian's condition will decrease.
-//  Eigen::VectorXd vector_toward_singularity = svd.matrixU().col(num_dimensions - 1);
-//
-//  double ini_condition = svd.singularValues()(0) / svd.singularValues()(svd.singularValues().size() - 1);
-//
-//  // TODO: Remove or switch to DEBUG
-//  RCLCPP_INFO_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), 50000., "Singularity condition number is " << ini_condition);
-//
-//  // This singular vector tends to flip direction unpredictably. See R. Bro,
-//  // "Resolving the Sign Ambiguity in the Singular Value Decomposition".
-//  // Look ahead to see if the Jacobian's condition will decrease in this
-//  // direction. Start with a scaled version of the singular vector
-//  Eigen::VectorXd delta_x(num_dimensions);
-//  double scale = 100;
-//  delta_x = vector_toward_singularity / scale;
-//
-//  // Calculate a small change in joints
-//  Eigen::VectorXd new_theta;
-//  kinematic_state_->copyJointGroupPositions(joint_model_group_, new_theta);
-//  new_theta += pseudo_inverse * delta_x;
-//  kinematic_state_->setJointGroupPositions(joint_model_group_, new_theta);
-//  Eigen::MatrixXd new_jacobian = kinematic_state_->getJacobian(joint_model_group_);
-//
-//  Eigen::JacobiSVD<Eigen::MatrixXd> new_svd(new_jacobian);
-//  double new_condition = new_svd.singularValues()(0) / new_svd.singularValues()(new_svd.singularValues().size() - 1);
-//  // If new_condition < ini_condition, the singular vector does point towards a
-//  // singularity. Otherwise, flip its direction.
-//  if (ini_condition >= new_condition)
-//  {
-//    vector_toward_singularity *= -1;
-//  }
-//
-//  // If this dot product is positive, we're moving toward singularity ==> decelerate
-//  double dot = vector_toward_singularity.dot(commanded_velocity);
-//  double upper_threshold = dot > 0 ? APPROACHING_STOP_SINGULARITY_THRESHOLD : HARD_STOP_SINGULARITY_THRESHOLD;
-//  // Ramp velocity down linearly when the Jacobian condition is between lower_singularity_threshold and
-//  // hard_stop_singularity_threshold, and we're moving towards the singularity
-//  if ((ini_condition > LOWER_SINGULARITY_THRESHOLD) &&
-//      (ini_condition < upper_threshold))
-//  {
-//    velocity_scale =
-//        1. - (ini_condition - LOWER_SINGULARITY_THRESHOLD) /
-//                 (upper_threshold - LOWER_SINGULARITY_THRESHOLD);
-//    RCLCPP_WARN_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), ROS_LOG_THROTTLE_PERIOD, "Close to a singularity, decelerating: " << LOWER_SINGULARITY_THRESHOLD << " < " << ini_condition << " < " << upper_threshold);
-//  }
-//
-//  // Very close to singularity, so halt.
-//  else if (ini_condition > upper_threshold)
-//  {
-//    velocity_scale = 0;
-//    RCLCPP_WARN_STREAM_THROTTLE(node_->get_logger(), *node_->get_clock(), ROS_LOG_THROTTLE_PERIOD, "Very close to a singularity, emergency stop: " << ini_condition << " > " << upper_threshold);
-//  }
-//
-//  return 1.0;
-//}
-
 }  // namespace admittance_controller
 
 #include "pluginlib/class_list_macros.hpp"
@@ -0,0 +1,286 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#include "admittance_controller/rule_replay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace admittance_controller
+{
+
+namespace
+{
+
+size_t field_type_size(uint32_t type)
+{
+  return static_cast<CycleRecordFieldType>(type) == CycleRecordFieldType::UINT32 ? sizeof(uint32_t) : sizeof(uint64_t);
+}
+
+const CycleRecordField * find_record_field(const std::string & name)
+{
+  for (const auto & field : cycle_record_fields()) {
+    if (name == field.name) {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+
+double read_double(const CycleRecord & record, uint32_t offset, size_t index)
+{
+  double value;
+  std::memcpy(&value, reinterpret_cast<const uint8_t *>(&record) + offset + index * sizeof(value), sizeof(value));
+  return value;
+}
+
+void add_mismatch(
+  int64_t cycle_index, const std::string & field, uint32_t index, double golden, double replayed,
+  const RuleReplayOptions & options, RuleReplayResult & result)
+{
+  if (result.mismatches.size() < options.max_reported_mismatches) {
+    result.mismatches.push_back(RuleReplayMismatch{cycle_index, field, index, golden, replayed});
+  }
+}
+
+}  // namespace
+
+void inputs_from_cycle_record(const CycleRecord & record, RuleReplayInputs & inputs)
+{
+  const size_t num_joints = std::min<size_t>(record.num_joints, MAX_RECORDED_JOINTS);
+  auto assign = [num_joints](const std::array<double, MAX_RECORDED_JOINTS> & values, std::vector<double> & out) {
+      out.assign(values.begin(), values.begin() + num_joints);
+    };
+
+  assign(record.joint_actual_positions, inputs.current_joint_state.positions);
+  assign(record.joint_actual_velocities, inputs.current_joint_state.velocities);
+  assign(record.joint_actual_accelerations, inputs.current_joint_state.accelerations);
+  assign(record.joint_reference_positions, inputs.reference_joint_state.positions);
+  assign(record.joint_reference_velocities, inputs.reference_joint_state.velocities);
+  assign(record.joint_reference_accelerations, inputs.reference_joint_state.accelerations);
+
+  inputs.measured_wrench.force.x = record.wrench_raw[0];
+  inputs.measured_wrench.force.y = record.wrench_raw[1];
+  inputs.measured_wrench.force.z = record.wrench_raw[2];
+  inputs.measured_wrench.torque.x = record.wrench_raw[3];
+  inputs.measured_wrench.torque.y = record.wrench_raw[4];
+  inputs.measured_wrench.torque.z = record.wrench_raw[5];
+
+  inputs.period = rclcpp::Duration::from_nanoseconds(record.period_nanosec);
+}
+
+bool CycleRecordDecoder::init(
+  const FlightLogReader & reader, const std::vector<std::string> & required_fields, std::string & error)
+{
+  for (const auto & name : required_fields) {
+    if (reader.find_field(name) == nullptr) {
+      error = "Log does not contain the field '" + name + "'";
+      return false;
+    }
+  }
+
+  mappings_.clear();
+  for (const auto & field : cycle_record_fields()) {
+    const auto * file_field = reader.find_field(field.name);
+    if (file_field == nullptr) {
+      continue;
+    }
+    if (file_field->type != static_cast<uint32_t>(field.type)) {
+      error = std::string("Field '") + field.name + "' has a different type in the log";
+      return false;
+    }
+    const size_t size = std::min(file_field->count, field.count) * field_type_size(file_field->type);
+    if (file_field->offset + size > reader.header().record_size) {
+      error = std::string("Field '") + field.name + "' exceeds the record size of the log";
+      return false;
+    }
+    mappings_.push_back(FieldMapping{file_field->offset, field.offset, static_cast<uint32_t>(size)});
+  }
+  return true;
+}
+
+void CycleRecordDecoder::decode(const uint8_t * data, CycleRecord & record) const
+{
+  record = CycleRecord{};
+  for (const auto & mapping : mappings_) {
+    std::memcpy(reinterpret_cast<uint8_t *>(&record) + mapping.record_offset, data + mapping.file_offset, mapping.size);
+  }
+}
+
+const std::vector<std::string> & rule_replay_input_fields()
+{
+  static const std::vector<std::string> fields = {
+    "cycle_index", "period_nanosec", "num_joints", "wrench_raw",
+    "joint_reference_positions", "joint_reference_velocities", "joint_reference_accelerations",
+    "joint_actual_positions", "joint_actual_velocities", "joint_actual_accelerations",
+  };
+  return fields;
+}
+
+const std::vector<std::string> & rule_replay_output_fields()
+{
+  static const std::vector<std::string> fields = {
+    "flags", "wrench_filtered", "admittance_pose", "admittance_velocity",
+    "joint_desired_positions", "joint_desired_velocities", "joint_desired_accelerations", "joint_desired_efforts",
+  };
+  return fields;
+}
+
+bool compare_rule_outputs(
+  const CycleRecord & golden, const CycleRecord & replayed, const RuleReplayOptions & options,
+  RuleReplayResult & result)
+{
+  bool match = true;
+  if ((golden.flags & CYCLE_FLAG_UPDATE_ERROR) != (replayed.flags & CYCLE_FLAG_UPDATE_ERROR)) {
+    add_mismatch(golden.cycle_index, "update_error", 0, (golden.flags & CYCLE_FLAG_UPDATE_ERROR) ? 1.0 : 0.0,
+      (replayed.flags & CYCLE_FLAG_UPDATE_ERROR) ? 1.0 : 0.0, options, result);
+    match = false;
+  }
+
+  const size_t num_joints = std::min<size_t>(golden.num_joints, MAX_RECORDED_JOINTS);
+  for (const auto & name : rule_replay_output_fields()) {
+    const auto * field = find_record_field(name);
+    if (field == nullptr || field->type != CycleRecordFieldType::FLOAT64) {
+      continue;
+    }
+    // Joint arrays are only valid up to the number of joints
+    const size_t count = name.compare(0, 6, "joint_") == 0 ? std::min<size_t>(field->count, num_joints) : field->count;
+    for (auto i = 0u; i < count; ++i) {
+      const double expected = read_double(golden, field->offset, i);
+      const double actual = read_double(replayed, field->offset, i);
+      bool equal;
+      if (options.bit_exact) {
+        equal = std::memcmp(&expected, &actual, sizeof(expected)) == 0;
+      } else {
+        equal = (std::isnan(expected) && std::isnan(actual)) || std::abs(expected - actual) <= options.tolerance;
+      }
+      const double error = std::isnan(expected) != std::isnan(actual) ?
+        std::numeric_limits<double>::infinity() : std::abs(expected - actual);
+      if (!std::isnan(error)) {
+        result.max_abs_error = std::max(result.max_abs_error, error);
+      }
+      if (!equal) {
+        add_mismatch(golden.cycle_index, name, i, expected, actual, options, result);
+        match = false;
+      }
+    }
+  }
+  return match;
+}
+
+controller_interface::return_type RuleReplay::step(const CycleRecord & recorded, CycleRecord & replayed)
+{
+  inputs_from_cycle_record(recorded, inputs_);
+  const auto ret = rule_.update(
+    inputs_.current_joint_state, inputs_.measured_wrench, inputs_.reference_joint_state, inputs_.period,
+    desired_joint_state_);
+
+  // Same fields as the controller fills after the update
+  replayed = recorded;
+  rule_.get_cycle_record(replayed);
+  const size_t num_joints = inputs_.current_joint_state.positions.size();
+  copy_joint_values_to_record(desired_joint_state_.positions, num_joints, replayed.joint_desired_positions);
+  copy_joint_values_to_record(desired_joint_state_.velocities, num_joints, replayed.joint_desired_velocities);
+  copy_joint_values_to_record(desired_joint_state_.accelerations, num_joints, replayed.joint_desired_accelerations);
+  copy_joint_values_to_record(desired_joint_state_.effort, num_joints, replayed.joint_desired_efforts);
+  replayed.flags = (recorded.flags & ~CYCLE_FLAG_UPDATE_ERROR) |
+    (ret != controller_interface::return_type::OK ? CYCLE_FLAG_UPDATE_ERROR : 0u);
+  return ret;
+}
+
+bool replay_flight_log(
+  AdmittanceRule & rule, const FlightLogReader & input, const FlightLogReader & golden,
+  const RuleReplayOptions & options, FlightLogWriter * output, RuleReplayResult & result)
+{
+  result = RuleReplayResult();
+
+  CycleRecordDecoder input_decoder;
+  CycleRecordDecoder golden_decoder;
+  if (!input_decoder.init(input, rule_replay_input_fields(), result.error)) {
+    return false;
+  }
+  std::vector<std::string> golden_fields = rule_replay_output_fields();
+  golden_fields.push_back("cycle_index");
+  golden_fields.push_back("num_joints");
+  if (!golden_decoder.init(golden, golden_fields, result.error)) {
+    return false;
+  }
+
+  static constexpr size_t OUTPUT_CHUNK_SIZE = 1024;
+  std::vector<CycleRecord> output_chunk;
+  output_chunk.reserve(output != nullptr ? OUTPUT_CHUNK_SIZE : 0);
+  auto flush_output = [&]() {
+      if (output != nullptr && !output_chunk.empty()) {
+        if (!output->write_chunk(output_chunk.data(), output_chunk.size()) && result.error.empty()) {
+          result.error = "Can not write the replayed records";
+        }
+        output_chunk.clear();
+      }
+    };
+
+  RuleReplay replay(rule);
+  FlightLogCursor input_cursor(input);
+  FlightLogCursor golden_cursor(golden);
+  CycleRecord recorded{};
+  CycleRecord expected{};
+  CycleRecord replayed{};
+  while (const uint8_t * input_data = input_cursor.next()) {
+    input_decoder.decode(input_data, recorded);
+    if (result.cycles > 0 && recorded.cycle_index != replayed.cycle_index + 1) {
+      result.error = "Log skips from cycle " + std::to_string(replayed.cycle_index) + " to cycle " +
+        std::to_string(recorded.cycle_index) + "; the rule state can not be reproduced past dropped records";
+      break;
+    }
+    const uint8_t * golden_data = golden_cursor.next();
+    if (golden_data == nullptr) {
+      result.error = "Golden log ends before cycle " + std::to_string(recorded.cycle_index);
+      break;
+    }
+    golden_decoder.decode(golden_data, expected);
+    if (expected.cycle_index != recorded.cycle_index) {
+      result.error = "Golden log has cycle " + std::to_string(expected.cycle_index) + " where cycle " +
+        std::to_string(recorded.cycle_index) + " is expected";
+      break;
+    }
+
+    replay.step(recorded, replayed);
+    ++result.cycles;
+    result.recorded_duration += static_cast<double>(recorded.period_nanosec) * 1e-9;
+    if (!compare_rule_outputs(expected, replayed, options, result)) {
+      ++result.mismatched_cycles;
+    }
+
+    if (output != nullptr) {
+      output_chunk.push_back(replayed);
+      if (output_chunk.size() == OUTPUT_CHUNK_SIZE) {
+        flush_output();
+      }
+    }
+  }
+  flush_output();
+
+  if (result.error.empty() && !input_cursor.error().empty()) {
+    result.error = "Input log: " + input_cursor.error();
+  }
+  if (result.error.empty() && !golden_cursor.error().empty()) {
+    result.error = "Golden log: " + golden_cursor.error();
+  }
+  return result.ok();
+}
+
+}  // namespace admittance_controller
@@ -0,0 +1,509 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef CLOSED_LOOP_SIM_HPP_
+#define CLOSED_LOOP_SIM_HPP_
+
+#include <time.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "admittance_controller/admittance_controller.hpp"
+#include "admittance_controller/cycle_timing.hpp"
+#include "hardware_interface/handle.hpp"
+#include "hardware_interface/loaned_command_interface.hpp"
+#include "hardware_interface/loaned_state_interface.hpp"
+#include "hardware_interface/types/hardware_interface_type_values.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rcutils/logging.h"
+#include "semantic_components/force_torque_sensor.hpp"
+#include "trajectory_msgs/msg/joint_trajectory.hpp"
+
+namespace admittance_controller_test
+{
+
+constexpr char SIM_FT_SENSOR_NAME[] = "ft_sensor";
+
+/// Wrench applied by the scripted F/T sensor at a time since the start; values between keyframes are interpolated
+struct WrenchKeyframe
+{
+  double time;
+  std::array<double, 6> wrench;
+};
+
+/// Push along z, release, pull along x, release, then settle without contact
+inline std::vector<WrenchKeyframe> default_wrench_script()
+{
+  return {
+    {0.0, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {1.0, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {1.05, {0.0, 0.0, -10.0, 0.0, 0.0, 0.0}},
+    {3.0, {0.0, 0.0, -10.0, 0.0, 0.0, 0.0}},
+    {3.05, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {5.0, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {5.05, {5.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {7.0, {5.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    {7.05, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+  };
+}
+
+/**
+ * Read a wrench script from a CSV file with the columns "time,fx,fy,fz,tx,ty,tz". Lines starting with '#' are
+ * ignored; times have to increase.
+ */
+inline bool load_wrench_script(const std::string & path, std::vector<WrenchKeyframe> & script, std::string & error)
+{
+  std::ifstream file(path);
+  if (!file) {
+    error = "Could not open wrench script '" + path + "'";
+    return false;
+  }
+  script.clear();
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::replace(line.begin(), line.end(), ',', ' ');
+    std::istringstream values(line);
+    WrenchKeyframe keyframe;
+    values >> keyframe.time;
+    for (auto & value : keyframe.wrench) {
+      values >> value;
+    }
+    if (values.fail() || (!script.empty() && keyframe.time <= script.back().time)) {
+      error = "Invalid line in wrench script '" + path + "': " + line;
+      return false;
+    }
+    script.push_back(keyframe);
+  }
+  if (script.empty()) {
+    error = "Wrench script '" + path + "' is empty";
+    return false;
+  }
+  return true;
+}
+
+struct ClosedLoopSimOptions
+{
+  /// Update rate of the controller in Hz, up to 10 kHz
+  double rate = 1000.0;
+  /// Simulated duration in seconds
+  double duration = 10.0;
+  /// Sleep until the deadline of every cycle instead of running as fast as possible
+  bool realtime = false;
+  /// Time constant of the first-order lag of the simulated joints in seconds; 0 tracks commands exactly
+  double plant_time_constant = 0.005;
+  /// Amplitude in rad and period in s of the reference trajectory of the first three joints
+  double trajectory_amplitude = 0.2;
+  double trajectory_period = 4.0;
+  std::string ik_plugin_name = "rl_differential_ik_plugin/RLKinematics";
+  std::string robot_description;
+  std::vector<std::string> joint_names = {
+    "shoulder_pan_joint", "shoulder_lift_joint", "elbow_joint", "wrist_1_joint", "wrist_2_joint", "wrist_3_joint"};
+  std::vector<double> initial_positions = {0.0, -1.57, 1.57, -1.57, -1.57, 0.0};
+  std::vector<WrenchKeyframe> wrench_script = default_wrench_script();
+};
+
+struct ClosedLoopSimResult
+{
+  size_t cycles = 0;
+  size_t update_errors = 0;
+  /// Updates that took longer than one period
+  size_t overruns = 0;
+  /// RMS and maximum over all joints and cycles of |actual - reference|, in rad
+  double tracking_error_rms = 0.0;
+  double tracking_error_max = 0.0;
+  /// Maximum of |desired - reference|, i.e. the largest displacement caused by the admittance
+  double admittance_displacement_max = 0.0;
+  /// Maximum of |actual - reference| at the end of the run, after the wrench script ended
+  double final_tracking_error = 0.0;
+};
+
+/// Gives the simulation access to the references and commands of the controller
+class SimulatedAdmittanceController : public admittance_controller::AdmittanceController
+{
+public:
+  using AdmittanceController::joint_trajectory_callback;
+
+  const trajectory_msgs::msg::JointTrajectoryPoint & reference() const {return state_reference;}
+  const trajectory_msgs::msg::JointTrajectoryPoint & desired() const {return state_desired;}
+  const admittance_controller::CycleTimer & cycle_timer() const {return cycle_timer_;}
+  const admittance_controller::AdmittanceRule & rule() const {return *admittance_;}
+};
+
+/**
+ * Runs the admittance controller in-process against simulated joints and a scripted force-torque sensor, with
+ * simulated time and without controller_manager. Joints follow the position commands with a first-order lag.
+ * Sensor and control frame are the same, so no transforms are needed.
+ */
+class ClosedLoopSim
+{
+public:
+  explicit ClosedLoopSim(const ClosedLoopSimOptions & options)
+  : options_(options),
+    num_joints_(options.joint_names.size()),
+    positions_(options.initial_positions),
+    velocities_(num_joints_, 0.0),
+    commands_(options.initial_positions),
+    ft_values_{}
+  {}
+
+  ~ClosedLoopSim()
+  {
+    if (controller_ && controller_->get_state().id() == lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE) {
+      controller_->get_node()->deactivate();
+    }
+  }
+
+  /// Initialize, configure and activate the controller, then send the reference trajectory
+  bool setup(std::string & error)
+  {
+    if (options_.rate <= 0.0 || options_.rate > 10000.0 || options_.duration <= 0.0 ||
+      options_.initial_positions.size() != num_joints_)
+    {
+      error = "Invalid simulation options";
+      return false;
+    }
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+
+    controller_ = std::make_unique<SimulatedAdmittanceController>();
+    auto node_options = rclcpp::NodeOptions()
+      .allow_undeclared_parameters(true)
+      .automatically_declare_parameters_from_overrides(true)
+      .parameter_overrides(parameters());
+    if (controller_->init("admittance_controller", "", node_options) != controller_interface::return_type::OK) {
+      error = "Initializing the controller failed";
+      return false;
+    }
+    // update logs every cycle at info level, which would dominate the latencies
+    rcutils_logging_set_logger_level(controller_->get_node()->get_logger().get_name(), RCUTILS_LOG_SEVERITY_WARN);
+
+    if (controller_->configure().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_INACTIVE) {
+      error = "Configuring the controller failed";
+      return false;
+    }
+    assign_interfaces();
+    if (controller_->get_node()->activate().id() != lifecycle_msgs::msg::State::PRIMARY_STATE_ACTIVE) {
+      error = "Activating the controller failed";
+      return false;
+    }
+    controller_->joint_trajectory_callback(reference_trajectory());
+    return true;
+  }
+
+  /// Run the whole scenario; returns false if any update failed
+  bool run()
+  {
+    const auto cycles = static_cast<size_t>(std::llround(options_.duration * options_.rate));
+    start_run();
+    for (size_t cycle = 0; cycle < cycles; ++cycle) {
+      step();
+    }
+    return result_.update_errors == 0;
+  }
+
+  /// Reset the statistics and the simulated time, e.g. to drive the simulation with step() instead of run()
+  void start_run()
+  {
+    period_ = rclcpp::Duration::from_seconds(1.0 / options_.rate);
+    alpha_ = options_.plant_time_constant > 0.0 ?
+      1.0 - std::exp(-period_.seconds() / options_.plant_time_constant) : 1.0;
+    result_ = ClosedLoopSimResult();
+    cycle_ = 0;
+    script_index_ = 0;
+    squared_error_sum_ = 0.0;
+    update_latency_.reset();
+    wakeup_latency_.reset();
+    clock_gettime(CLOCK_MONOTONIC, &deadline_);
+  }
+
+  /// Simulate one cycle; returns the duration of the update call in nanoseconds
+  int64_t step()
+  {
+    const auto period_ns = period_.nanoseconds();
+    // simulated ROS time starts away from zero, which the trajectory treats as "now"
+    const int64_t start_ns = 1000000000;
+    const int64_t sim_ns = static_cast<int64_t>(cycle_) * period_ns;
+    set_wrench(static_cast<double>(sim_ns) * 1e-9);
+
+    if (options_.realtime) {
+      add_nanoseconds(deadline_, period_ns);
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline_, nullptr);
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      wakeup_latency_.record(
+        (now.tv_sec - deadline_.tv_sec) * 1000000000LL + (now.tv_nsec - deadline_.tv_nsec));
+    }
+
+    const auto update_start = std::chrono::steady_clock::now();
+    const auto ret = controller_->update(rclcpp::Time(start_ns + sim_ns, RCL_ROS_TIME), period_);
+    const auto update_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - update_start).count();
+    update_latency_.record(update_ns);
+    result_.overruns += update_ns > period_ns ? 1 : 0;
+    result_.update_errors += ret != controller_interface::return_type::OK ? 1 : 0;
+
+    // simulated joints follow the position commands
+    for (size_t i = 0; i < num_joints_; ++i) {
+      const double previous = positions_[i];
+      positions_[i] += alpha_ * (commands_[i] - positions_[i]);
+      velocities_[i] = (positions_[i] - previous) / period_.seconds();
+    }
+
+    const auto & reference = controller_->reference();
+    const auto & desired = controller_->desired();
+    double final_error = 0.0;
+    for (size_t i = 0; i < num_joints_ && i < reference.positions.size(); ++i) {
+      const double error = std::fabs(positions_[i] - reference.positions[i]);
+      squared_error_sum_ += error * error;
+      result_.tracking_error_max = std::max(result_.tracking_error_max, error);
+      final_error = std::max(final_error, error);
+      if (i < desired.positions.size()) {
+        result_.admittance_displacement_max = std::max(
+          result_.admittance_displacement_max, std::fabs(desired.positions[i] - reference.positions[i]));
+      }
+    }
+    result_.final_tracking_error = final_error;
+    ++result_.cycles;
+    ++cycle_;
+    result_.tracking_error_rms = std::sqrt(squared_error_sum_ / static_cast<double>(result_.cycles * num_joints_));
+    return update_ns;
+  }
+
+  /// Simulated time since start_run() in seconds
+  double time() const {return static_cast<double>(cycle_) * period_.seconds();}
+
+  /// Replace the reference trajectory; without a header stamp it starts at the next update
+  void send_trajectory(const std::shared_ptr<trajectory_msgs::msg::JointTrajectory> & trajectory)
+  {
+    controller_->joint_trajectory_callback(trajectory);
+  }
+
+  /// Replace the wrench script; keyframe times are simulated seconds since start_run()
+  void set_wrench_script(std::vector<WrenchKeyframe> script)
+  {
+    options_.wrench_script = std::move(script);
+    script_index_ = 0;
+  }
+
+  const SimulatedAdmittanceController & controller() const {return *controller_;}
+
+  const ClosedLoopSimResult & result() const {return result_;}
+
+  /// Duration of every update call, measured around it
+  const admittance_controller::LatencyHistogram & update_latency() const {return update_latency_;}
+
+  /// Lateness of the wake-ups in realtime mode
+  const admittance_controller::LatencyHistogram & wakeup_latency() const {return wakeup_latency_;}
+
+  /// Per-phase histograms recorded by the controller
+  const admittance_controller::CycleTimer & cycle_timer() const {return controller_->cycle_timer();}
+
+  void print_report(std::ostream & out) const
+  {
+    out << "Closed-loop simulation: " << result_.cycles << " cycles at " << options_.rate << " Hz ("
+        << options_.duration << " s simulated" << (options_.realtime ? ", paced in real time" : "") << ")\n";
+    out << "  update errors: " << result_.update_errors << ", overruns: " << result_.overruns << "\n\n";
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "  %-24s%10s%10s%10s%10s%10s%10s\n",
+      "latency [us]", "mean", "p50", "p90", "p99", "p99.9", "max");
+    out << line;
+    auto print_histogram = [&out, &line](const char * name, const admittance_controller::LatencyHistogram & h) {
+        if (h.count() == 0) {
+          return;
+        }
+        std::snprintf(line, sizeof(line), "  %-24s%10.2f%10.2f%10.2f%10.2f%10.2f%10.2f\n", name,
+          h.mean() * 1e-3, h.percentile(50.0) * 1e-3, h.percentile(90.0) * 1e-3, h.percentile(99.0) * 1e-3,
+          h.percentile(99.9) * 1e-3, h.max() * 1e-3);
+        out << line;
+      };
+    print_histogram("update", update_latency_);
+    print_histogram("wake-up", wakeup_latency_);
+    for (size_t phase = 0; phase < static_cast<size_t>(admittance_controller::UpdatePhase::COUNT); ++phase) {
+      const auto update_phase = static_cast<admittance_controller::UpdatePhase>(phase);
+      print_histogram(admittance_controller::to_string(update_phase), cycle_timer().histogram(update_phase));
+    }
+
+    std::snprintf(line, sizeof(line),
+      "\n  tracking error [rad]: rms %.6f, max %.6f, final %.6f\n  admittance displacement max [rad]: %.6f\n",
+      result_.tracking_error_rms, result_.tracking_error_max, result_.final_tracking_error,
+      result_.admittance_displacement_max);
+    out << line;
+  }
+
+private:
+  std::vector<rclcpp::Parameter> parameters() const
+  {
+    std::vector<rclcpp::Parameter> parameters = {
+      {"joints", options_.joint_names},
+      {"command_interfaces", std::vector<std::string>{hardware_interface::HW_IF_POSITION}},
+      {"state_interfaces",
+        std::vector<std::string>{hardware_interface::HW_IF_POSITION, hardware_interface::HW_IF_VELOCITY}},
+      {"ft_sensor_name", SIM_FT_SENSOR_NAME},
+      {"use_joint_commands_as_input", true},
+      {"joint_limiter_type", "joint_limits/SimpleJointLimiter"},
+      {"allow_partial_joints_goal", false},
+      {"allow_integration_in_goal_trajectories", false},
+      {"action_monitor_rate", 20.0},
+      {"open_loop_control", false},
+      {"publish_state", false},
+      {"cycle_timing.publish_rate", 0.0},
+      {"update_rate", static_cast<int>(std::lround(options_.rate))},
+      {"robot_description", options_.robot_description},
+      {"IK.base", "base_link"},
+      {"IK.group_name", "ur_manipulator"},
+      {"IK.plugin_name", options_.ik_plugin_name},
+      {"control_frame", "tool0"},
+      {"sensor_frame", "tool0"},
+    };
+    const std::array<const char *, 6> axes = {"x", "y", "z", "rx", "ry", "rz"};
+    for (size_t i = 0; i < axes.size(); ++i) {
+      const std::string axis = axes[i];
+      const bool translation = i < 3;
+      parameters.emplace_back("admittance.selected_axes." + axis, true);
+      parameters.emplace_back("admittance.mass." + axis, translation ? 5.0 : 0.5);
+      parameters.emplace_back("admittance.stiffness." + axis, translation ? 100.0 : 10.0);
+      parameters.emplace_back("admittance.damping." + axis, translation ? 50.0 : 5.0);
+    }
+    return parameters;
+  }
+
+  void assign_interfaces()
+  {
+    // Interfaces are ordered as the controller expects: by interface type, then by joint, then the sensor
+    command_interfaces_.reserve(num_joints_);
+    for (size_t i = 0; i < num_joints_; ++i) {
+      command_interfaces_.emplace_back(options_.joint_names[i], hardware_interface::HW_IF_POSITION, &commands_[i]);
+    }
+    state_interfaces_.reserve(2 * num_joints_ + ft_values_.size());
+    for (size_t i = 0; i < num_joints_; ++i) {
+      state_interfaces_.emplace_back(options_.joint_names[i], hardware_interface::HW_IF_POSITION, &positions_[i]);
+    }
+    for (size_t i = 0; i < num_joints_; ++i) {
+      state_interfaces_.emplace_back(options_.joint_names[i], hardware_interface::HW_IF_VELOCITY, &velocities_[i]);
+    }
+    const std::array<const char *, 6> ft_interface_names = {
+      "force.x", "force.y", "force.z", "torque.x", "torque.y", "torque.z"};
+    for (size_t i = 0; i < ft_values_.size(); ++i) {
+      state_interfaces_.emplace_back(SIM_FT_SENSOR_NAME, ft_interface_names[i], &ft_values_[i]);
+    }
+
+    std::vector<hardware_interface::LoanedCommandInterface> loaned_command_interfaces;
+    for (auto & interface : command_interfaces_) {
+      loaned_command_interfaces.emplace_back(interface);
+    }
+    std::vector<hardware_interface::LoanedStateInterface> loaned_state_interfaces;
+    for (auto & interface : state_interfaces_) {
+      loaned_state_interfaces.emplace_back(interface);
+    }
+    controller_->assign_interfaces(std::move(loaned_command_interfaces), std::move(loaned_state_interfaces));
+  }
+
+  /// Smooth motion of the first three joints away from the initial positions and back, over the whole run
+  std::shared_ptr<trajectory_msgs::msg::JointTrajectory> reference_trajectory() const
+  {
+    auto trajectory = std::make_shared<trajectory_msgs::msg::JointTrajectory>();
+    trajectory->joint_names = options_.joint_names;
+    const double omega = 2.0 * M_PI / options_.trajectory_period;
+    const double step = 0.05;
+    for (double t = step; t <= options_.duration + 1e-9; t += step) {
+      trajectory_msgs::msg::JointTrajectoryPoint point;
+      point.positions = options_.initial_positions;
+      point.velocities.assign(num_joints_, 0.0);
+      for (size_t i = 0; i < std::min<size_t>(3, num_joints_); ++i) {
+        point.positions[i] += 0.5 * options_.trajectory_amplitude * (1.0 - std::cos(omega * t));
+        point.velocities[i] = 0.5 * options_.trajectory_amplitude * omega * std::sin(omega * t);
+      }
+      point.time_from_start = rclcpp::Duration::from_seconds(t);
+      trajectory->points.push_back(point);
+    }
+    return trajectory;
+  }
+
+  void set_wrench(double time)
+  {
+    const auto & script = options_.wrench_script;
+    if (script.empty()) {
+      ft_values_.fill(0.0);
+      return;
+    }
+    while (script_index_ + 1 < script.size() && script[script_index_ + 1].time <= time) {
+      ++script_index_;
+    }
+    const auto & current = script[script_index_];
+    if (script_index_ + 1 == script.size() || time <= current.time) {
+      ft_values_ = current.wrench;
+      return;
+    }
+    const auto & next = script[script_index_ + 1];
+    const double s = (time - current.time) / (next.time - current.time);
+    for (size_t i = 0; i < ft_values_.size(); ++i) {
+      ft_values_[i] = current.wrench[i] + s * (next.wrench[i] - current.wrench[i]);
+    }
+  }
+
+  static void add_nanoseconds(timespec & time, int64_t nanoseconds)
+  {
+    time.tv_nsec += nanoseconds;
+    while (time.tv_nsec >= 1000000000L) {
+      time.tv_nsec -= 1000000000L;
+      ++time.tv_sec;
+    }
+  }
+
+  ClosedLoopSimOptions options_;
+  size_t num_joints_;
+  size_t script_index_ = 0;
+
+  // Values of the simulated hardware; the interfaces point into them
+  std::vector<double> positions_;
+  std::vector<double> velocities_;
+  std::vector<double> commands_;
+  std::array<double, 6> ft_values_;
+  std::vector<hardware_interface::CommandInterface> command_interfaces_;
+  std::vector<hardware_interface::StateInterface> state_interfaces_;
+
+  // Declared last so that it is destroyed before the interfaces it holds
+  std::unique_ptr<SimulatedAdmittanceController> controller_;
+
+  ClosedLoopSimResult result_;
+  rclcpp::Duration period_{0, 0};
+  double alpha_ = 1.0;
+  size_t cycle_ = 0;
+  double squared_error_sum_ = 0.0;
+  timespec deadline_{};
+  admittance_controller::LatencyHistogram update_latency_;
+  admittance_controller::LatencyHistogram wakeup_latency_;
+};
+
+}  // namespace admittance_controller_test
+
+#endif  // CLOSED_LOOP_SIM_HPP_
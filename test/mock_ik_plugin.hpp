@@ -0,0 +1,101 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef MOCK_IK_PLUGIN_HPP_
+#define MOCK_IK_PLUGIN_HPP_
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "ik_interface/ik_plugin_base.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "trajectory_msgs/msg/joint_trajectory_point.hpp"
+
+namespace admittance_controller_test
+{
+
+/**
+ * Differential IK with a constant, diagonal Jacobian: Cartesian axis i maps to joint i (scaled by `gain`).
+ * It costs next to nothing and is deterministic, so benchmarks and tests can isolate the admittance rule
+ * from the kinematics. The end-effector position is the first three joint positions.
+ */
+class MockIKPlugin : public ik_interface::IKBaseClass
+{
+public:
+  explicit MockIKPlugin(size_t num_joints = 6, double gain = 1.0)
+  : num_joints_(num_joints), gain_(gain), positions_(num_joints, 0.0) {}
+
+  bool initialize(std::shared_ptr<rclcpp_lifecycle::LifecycleNode> /*node*/, const std::string & /*group_name*/)
+  {
+    return true;
+  }
+
+  bool update_robot_state(const trajectory_msgs::msg::JointTrajectoryPoint & current_joint_state)
+  {
+    if (current_joint_state.positions.size() != num_joints_) {
+      return false;
+    }
+    std::copy(current_joint_state.positions.begin(), current_joint_state.positions.end(), positions_.begin());
+    return true;
+  }
+
+  bool calculate_end_effector_position(std::vector<double> & end_effector_position)
+  {
+    if (end_effector_position.size() != 6) {
+      return false;
+    }
+    for (auto i = 0u; i < 3; ++i) {
+      end_effector_position[i] = i < num_joints_ ? gain_ * positions_[i] : 0.0;
+    }
+    return true;
+  }
+
+  bool convert_cartesian_deltas_to_joint_deltas(
+    std::vector<double> & delta_x_vec,
+    const geometry_msgs::msg::TransformStamped & /*control_frame_to_ik_base*/,
+    std::vector<double> & delta_theta_vec)
+  {
+    delta_theta_vec.resize(num_joints_);
+    for (auto i = 0u; i < num_joints_; ++i) {
+      delta_theta_vec[i] = i < delta_x_vec.size() ? delta_x_vec[i] / gain_ : 0.0;
+    }
+    return true;
+  }
+
+  bool convert_joint_deltas_to_cartesian_deltas(
+    std::vector<double> & delta_theta_vec,
+    const geometry_msgs::msg::TransformStamped & /*tf_ik_base_to_desired_cartesian_frame*/,
+    std::vector<double> & delta_x_vec)
+  {
+    delta_x_vec.resize(6);
+    for (auto i = 0u; i < 6; ++i) {
+      delta_x_vec[i] = i < delta_theta_vec.size() ? gain_ * delta_theta_vec[i] : 0.0;
+    }
+    return true;
+  }
+
+private:
+  size_t num_joints_;
+  double gain_;
+  std::vector<double> positions_;
+};
+
+}  // namespace admittance_controller_test
+
+#endif  // MOCK_IK_PLUGIN_HPP_
@@ -0,0 +1,186 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \authors: Paul Gesel
+
+#ifndef SOAK_MONITOR_HPP_
+#define SOAK_MONITOR_HPP_
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace admittance_controller_test
+{
+
+/// Resident set size of this process in bytes, 0 if it can not be read
+inline size_t resident_set_size()
+{
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages = 0;
+  size_t resident_pages = 0;
+  if (!(statm >> total_pages >> resident_pages)) {
+    return 0;
+  }
+  return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+/// Statistics of one window of a soak run
+struct SoakWindow
+{
+  uint64_t cycles = 0;
+  double sim_time = 0.0;
+  size_t rss_bytes = 0;
+  // Heap allocations made by the update thread during the window, divided by the cycles of the window
+  double allocations_per_cycle = 0.0;
+  // Update latency percentiles in microseconds
+  double p50_us = 0.0;
+  double p99_us = 0.0;
+  double p999_us = 0.0;
+  double max_us = 0.0;
+  // Largest magnitude of the open-loop displacement accumulator and of the joint-space integrator of the rule
+  double max_displacement_sum = 0.0;
+  double max_joint_offset = 0.0;
+};
+
+struct SoakLimits
+{
+  // Windows ignored while caches, allocator pools and page tables warm up
+  size_t warmup_windows = 2;
+  // Windows of which the median p99.9 is compared between the start and the end of the run
+  size_t drift_windows = 5;
+  // Allowed RSS increase over the first window after warm-up
+  double max_rss_growth_bytes = 8.0 * 1024 * 1024;
+  // Allowed relative increase of the p99.9 latency
+  double max_p999_drift = 0.5;
+  // Limits <= 0 are disabled
+  double max_allocations_per_cycle = -1.0;
+  double max_integrator = -1.0;
+};
+
+/**
+ * Collects the windows of a soak run and decides whether memory grew or latency drifted. The p99.9 drift is
+ * judged on medians over several windows, so single windows hit by scheduling noise do not fail a run.
+ */
+class SoakMonitor
+{
+public:
+  explicit SoakMonitor(const SoakLimits & limits)
+  : limits_(limits) {}
+
+  void add_window(const SoakWindow & window)
+  {
+    windows_.push_back(window);
+  }
+
+  const std::vector<SoakWindow> & windows() const {return windows_;}
+
+  /// Check all windows against the limits; the reasons of a failure are in failures()
+  bool evaluate()
+  {
+    failures_.clear();
+    char message[200];
+    if (windows_.size() <= limits_.warmup_windows) {
+      failures_.push_back("Not enough windows after warm-up");
+      return false;
+    }
+    const auto first = windows_.begin() + static_cast<std::ptrdiff_t>(limits_.warmup_windows);
+
+    const auto max_rss = std::max_element(first, windows_.end(),
+        [](const SoakWindow & a, const SoakWindow & b) {return a.rss_bytes < b.rss_bytes;});
+    const double rss_growth = static_cast<double>(max_rss->rss_bytes) - static_cast<double>(first->rss_bytes);
+    if (rss_growth > limits_.max_rss_growth_bytes) {
+      std::snprintf(message, sizeof(message), "RSS grew by %.1f MiB after warm-up (limit %.1f MiB)",
+        rss_growth / (1024.0 * 1024.0), limits_.max_rss_growth_bytes / (1024.0 * 1024.0));
+      failures_.push_back(message);
+    }
+
+    const size_t after_warmup = static_cast<size_t>(windows_.end() - first);
+    const size_t drift_windows = std::max<size_t>(1, std::min(limits_.drift_windows, after_warmup / 2));
+    if (after_warmup >= 2 * drift_windows) {
+      const double start_p999 = median_p999(first, first + static_cast<std::ptrdiff_t>(drift_windows));
+      const double end_p999 = median_p999(windows_.end() - static_cast<std::ptrdiff_t>(drift_windows), windows_.end());
+      if (end_p999 > start_p999 * (1.0 + limits_.max_p999_drift)) {
+        std::snprintf(message, sizeof(message), "p99.9 latency drifted from %.2f us to %.2f us (limit +%.0f%%)",
+          start_p999, end_p999, limits_.max_p999_drift * 100.0);
+        failures_.push_back(message);
+      }
+    }
+
+    for (auto window = first; window != windows_.end(); ++window) {
+      if (limits_.max_allocations_per_cycle > 0.0 &&
+        window->allocations_per_cycle > limits_.max_allocations_per_cycle)
+      {
+        std::snprintf(message, sizeof(message), "%.2f allocations per cycle at cycle %llu (limit %.2f)",
+          window->allocations_per_cycle, static_cast<unsigned long long>(window->cycles),
+          limits_.max_allocations_per_cycle);
+        failures_.push_back(message);
+        break;
+      }
+    }
+    for (auto window = first; window != windows_.end(); ++window) {
+      const double integrator = std::max(window->max_displacement_sum, window->max_joint_offset);
+      if (limits_.max_integrator > 0.0 && integrator > limits_.max_integrator) {
+        std::snprintf(message, sizeof(message), "Admittance integrators reached %.6f at cycle %llu (limit %.6f)",
+          integrator, static_cast<unsigned long long>(window->cycles), limits_.max_integrator);
+        failures_.push_back(message);
+        break;
+      }
+    }
+    return failures_.empty();
+  }
+
+  const std::vector<std::string> & failures() const {return failures_;}
+
+  static void print_header(std::ostream & out)
+  {
+    out << "cycles,sim_time_s,rss_mib,allocations_per_cycle,p50_us,p99_us,p999_us,max_us,"
+        << "max_displacement_sum,max_joint_offset\n";
+  }
+
+  static void print_window(std::ostream & out, const SoakWindow & window)
+  {
+    char line[256];
+    std::snprintf(line, sizeof(line), "%llu,%.3f,%.2f,%.3f,%.2f,%.2f,%.2f,%.2f,%.9f,%.9f\n",
+      static_cast<unsigned long long>(window.cycles), window.sim_time,
+      static_cast<double>(window.rss_bytes) / (1024.0 * 1024.0), window.allocations_per_cycle, window.p50_us,
+      window.p99_us, window.p999_us, window.max_us, window.max_displacement_sum, window.max_joint_offset);
+    out << line;
+  }
+
+private:
+  static double median_p999(std::vector<SoakWindow>::const_iterator begin, std::vector<SoakWindow>::const_iterator end)
+  {
+    std::vector<double> values;
+    for (auto window = begin; window != end; ++window) {
+      values.push_back(window->p999_us);
+    }
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+  }
+
+  SoakLimits limits_;
+  std::vector<SoakWindow> windows_;
+  std::vector<std::string> failures_;
+};
+
+}  // namespace admittance_controller_test
+
+#endif  // SOAK_MONITOR_HPP_
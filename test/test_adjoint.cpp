@@ -0,0 +1,90 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include "ik_adjoint/adjoint.hpp"
+
+namespace
+{
+geometry_msgs::msg::Transform make_transform(const Eigen::Vector3d & translation, const Eigen::Quaterniond & rotation)
+{
+  geometry_msgs::msg::Transform transform;
+  transform.translation.x = translation.x();
+  transform.translation.y = translation.y();
+  transform.translation.z = translation.z();
+  transform.rotation.x = rotation.x();
+  transform.rotation.y = rotation.y();
+  transform.rotation.z = rotation.z();
+  transform.rotation.w = rotation.w();
+  return transform;
+}
+}  // namespace
+
+TEST(AdjointTest, twist_adjoint_moves_the_velocity_to_the_parent_origin)
+{
+  // Frame B at p, rotated about z by 90 degrees, spinning about its own x axis with a linear velocity
+  const Eigen::Vector3d translation(0.3, -0.2, 0.5);
+  const Eigen::Matrix3d rotation = Eigen::AngleAxisd(M_PI / 2.0, Eigen::Vector3d::UnitZ()).toRotationMatrix();
+  ik_adjoint::Vector6d twist;
+  twist << 0.1, 0.2, 0.3, 1.0, 0.0, 0.0;
+
+  const ik_adjoint::Vector6d transformed = ik_adjoint::twist_adjoint(rotation, translation) * twist;
+  const Eigen::Vector3d angular = rotation * twist.tail<3>();
+  EXPECT_TRUE(transformed.tail<3>().isApprox(angular));
+  // Velocity of the point of the rigid body at the origin of A, which is at -p from the origin of B
+  EXPECT_TRUE(transformed.head<3>().isApprox(rotation * twist.head<3>() + angular.cross(-translation)));
+}
+
+TEST(AdjointTest, wrench_adjoint_preserves_power)
+{
+  const Eigen::Vector3d translation(-0.4, 0.1, 0.25);
+  const Eigen::Matrix3d rotation =
+    Eigen::AngleAxisd(0.7, Eigen::Vector3d(1.0, -2.0, 0.5).normalized()).toRotationMatrix();
+  const ik_adjoint::Vector6d twist = ik_adjoint::Vector6d::Random();
+  const ik_adjoint::Vector6d wrench = ik_adjoint::Vector6d::Random();
+
+  const auto twist_adjoint = ik_adjoint::twist_adjoint(rotation, translation);
+  const auto wrench_adjoint = ik_adjoint::wrench_adjoint(rotation, translation);
+  EXPECT_NEAR((wrench_adjoint * wrench).dot(twist_adjoint * twist), wrench.dot(twist), 1e-12);
+  EXPECT_TRUE((wrench_adjoint.transpose() * twist_adjoint).isIdentity(1e-12));
+}
+
+TEST(AdjointTest, cache_recomputes_only_for_new_transforms_and_skips_the_identity)
+{
+  ik_adjoint::AdjointCache cache;
+  Eigen::VectorXd twist(6);
+  twist << 0.1, 0.2, 0.3, 0.4, 0.5, 0.6;
+  const Eigen::VectorXd original = twist;
+
+  geometry_msgs::msg::Transform identity;
+  identity.rotation.w = 1.0;
+  cache.transform_twist(identity, twist);
+  cache.transform_wrench(identity, twist);
+  EXPECT_EQ(twist, original);
+  EXPECT_EQ(cache.updates(), 1u);
+
+  const Eigen::Vector3d translation(0.3, -0.2, 0.5);
+  const Eigen::Quaterniond rotation(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitY()));
+  const auto transform = make_transform(translation, rotation);
+  cache.transform_twist(transform, twist);
+  EXPECT_TRUE(twist.isApprox(ik_adjoint::twist_adjoint(rotation.toRotationMatrix(), translation) * original));
+  cache.transform_twist(transform, twist);
+  EXPECT_EQ(cache.updates(), 2u);
+  EXPECT_TRUE(cache.wrench_adjoint(transform).isApprox(
+    ik_adjoint::wrench_adjoint(rotation.toRotationMatrix(), translation)));
+  EXPECT_EQ(cache.updates(), 2u);
+}
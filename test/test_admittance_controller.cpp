@@ -313,6 +313,31 @@ TEST_F(AdmittanceControllerTest, reactivate_success)
             controller_interface::return_type::OK);
 }
 
+TEST_F(AdmittanceControllerTest, activate_with_invalid_gains_fails)
+{
+  SetUpController();
+  controller_->get_node()->set_parameter({"admittance.mass.x", 0.0});
+
+  ASSERT_EQ(controller_->on_configure(rclcpp_lifecycle::State()), NODE_SUCCESS);
+  ASSERT_EQ(controller_->on_activate(rclcpp_lifecycle::State()), NODE_ERROR);
+}
+
+TEST_F(AdmittanceControllerTest, invalid_gains_are_rejected_and_rolled_back)
+{
+  SetUpController();
+
+  ASSERT_EQ(controller_->on_configure(rclcpp_lifecycle::State()), NODE_SUCCESS);
+  const auto result = controller_->get_node()->set_parameter({"admittance.mass.x", -1.0});
+  EXPECT_FALSE(result.successful);
+  EXPECT_EQ(controller_->get_node()->get_parameter("admittance.mass.x").as_double(), admittance_mass_[0]);
+
+  // Activation stores the gains of the handler again; it must still have the previous ones
+  ASSERT_EQ(controller_->on_activate(rclcpp_lifecycle::State()), NODE_SUCCESS);
+  EXPECT_EQ(controller_->admittance_->parameters_.mass_[0], admittance_mass_[0]);
+
+  EXPECT_TRUE(controller_->get_node()->set_parameter({"admittance.mass.x", 2.0}).successful);
+}
+
 TEST_F(AdmittanceControllerTest, publish_status_success)
 {
   // TODO: Write also a test when Cartesian commands are used.
@@ -0,0 +1,172 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "admittance_joint_limits/admittance_joint_limits.hpp"
+
+using admittance_joint_limits::AdmittanceJointLimits;
+using ::testing::ElementsAre;
+
+namespace
+{
+const char ROBOT_DESCRIPTION[] =
+  R"(<robot name="test_robot">
+  <link name="base"/>
+  <link name="link1"/>
+  <link name="link2"/>
+  <joint name="joint1" type="revolute">
+    <parent link="base"/>
+    <child link="link1"/>
+    <limit lower="-1.5" upper="2.0" velocity="3.0" effort="100.0"/>
+  </joint>
+  <joint name="joint2" type="continuous">
+    <parent link="link1"/>
+    <child link="link2"/>
+    <limit velocity="4.0" effort="100.0"/>
+  </joint>
+</robot>)";
+
+class AdmittanceJointLimitsTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    // Joint 0: position [-1, 1], velocity 2, acceleration 10; joint 1: velocity 1 only
+    limits_.configure({-1.0, -AdmittanceJointLimits::NO_LIMIT}, {1.0, AdmittanceJointLimits::NO_LIMIT},
+                      {2.0, 1.0}, {10.0, AdmittanceJointLimits::NO_LIMIT});
+    limits_.reset({0.0, 0.0}, {0.0, 0.0});
+  }
+
+  AdmittanceJointLimits limits_;
+};
+}  // namespace
+
+TEST(AdmittanceJointLimitsUrdfTest, reads_limits_from_robot_description)
+{
+  AdmittanceJointLimits limits;
+  std::string error;
+  ASSERT_TRUE(limits.configure({"joint2", "joint1"}, ROBOT_DESCRIPTION, {0.0, 5.0}, error)) << error;
+  EXPECT_THAT(limits.min_positions(), ElementsAre(-AdmittanceJointLimits::NO_LIMIT, -1.5));
+  EXPECT_THAT(limits.max_positions(), ElementsAre(AdmittanceJointLimits::NO_LIMIT, 2.0));
+  EXPECT_THAT(limits.max_velocities(), ElementsAre(4.0, 3.0));
+  EXPECT_THAT(limits.max_accelerations(), ElementsAre(AdmittanceJointLimits::NO_LIMIT, 5.0));
+
+  EXPECT_FALSE(limits.configure({"joint1", "joint3"}, ROBOT_DESCRIPTION, {0.0, 0.0}, error));
+  EXPECT_FALSE(limits.configure({"joint1"}, ROBOT_DESCRIPTION, {}, error));
+  EXPECT_FALSE(limits.configure({"joint1"}, "", {0.0}, error));
+}
+
+TEST_F(AdmittanceJointLimitsTest, passes_state_within_limits)
+{
+  limits_.reset({0.0, 0.0}, {0.995, -0.5});
+  std::vector<double> positions = {0.001, -0.0005};
+  std::vector<double> velocities = {1.0, -0.5};
+  std::vector<double> accelerations = {5.0, -100.0};
+  limits_.enforce(positions, velocities, accelerations, 0.001);
+  EXPECT_THAT(positions, ElementsAre(0.001, -0.0005));
+  EXPECT_THAT(velocities, ElementsAre(1.0, -0.5));
+  EXPECT_THAT(accelerations, ElementsAre(5.0, -100.0));
+}
+
+TEST_F(AdmittanceJointLimitsTest, clamps_acceleration_and_velocity_change)
+{
+  std::vector<double> positions = {0.0, 0.0};
+  std::vector<double> velocities = {5.0, -5.0};
+  std::vector<double> accelerations = {50.0, 50.0};
+  limits_.enforce(positions, velocities, accelerations, 0.01);
+  EXPECT_DOUBLE_EQ(accelerations[0], 10.0);
+  EXPECT_DOUBLE_EQ(accelerations[1], 50.0);
+  // Joint 0 can reach 10 * 0.01 from rest, joint 1 is only velocity limited
+  EXPECT_DOUBLE_EQ(velocities[0], 0.1);
+  EXPECT_DOUBLE_EQ(velocities[1], -1.0);
+
+  velocities = {5.0, -5.0};
+  limits_.enforce(positions, velocities, accelerations, 0.01);
+  EXPECT_DOUBLE_EQ(velocities[0], 0.2);
+}
+
+TEST_F(AdmittanceJointLimitsTest, clamps_position_step_and_position_limits)
+{
+  std::vector<double> positions = {0.5, -0.5};
+  std::vector<double> velocities;
+  std::vector<double> accelerations;
+  limits_.enforce(positions, velocities, accelerations, 0.1);
+  // 2 rad/s and 1 rad/s within 0.1 s
+  EXPECT_DOUBLE_EQ(positions[0], 0.2);
+  EXPECT_DOUBLE_EQ(positions[1], -0.1);
+
+  limits_.reset({0.95, 0.0}, {});
+  positions = {1.5, 0.0};
+  velocities = {1.0, 0.0};
+  limits_.enforce(positions, velocities, accelerations, 0.1);
+  EXPECT_DOUBLE_EQ(positions[0], 1.0);
+  EXPECT_DOUBLE_EQ(velocities[0], 0.0);
+}
+
+TEST_F(AdmittanceJointLimitsTest, starts_from_first_state_without_reset_positions)
+{
+  limits_.reset({}, {});
+  std::vector<double> positions = {0.8, 100.0};
+  std::vector<double> velocities;
+  std::vector<double> accelerations;
+  limits_.enforce(positions, velocities, accelerations, 0.001);
+  EXPECT_THAT(positions, ElementsAre(0.8, 100.0));
+}
+
+TEST_F(AdmittanceJointLimitsTest, brakes_before_position_limit)
+{
+  limits_.configure_braking(true, 0.0, 0.0);
+  limits_.reset({0.9, 0.0}, {1.5, -0.5});
+  // Joint 0 is 0.1 from its limit and can stop from sqrt(2 * 10 * 0.1) = sqrt(2); joint 1 has no limits
+  std::vector<double> positions = {0.95, -0.05};
+  std::vector<double> velocities = {2.0, -0.5};
+  std::vector<double> accelerations;
+  limits_.enforce(positions, velocities, accelerations, 0.1);
+  EXPECT_DOUBLE_EQ(velocities[0], std::sqrt(2.0));
+  EXPECT_DOUBLE_EQ(positions[0], 0.9 + 0.05 * std::sqrt(2.0) / 2.0);
+  EXPECT_DOUBLE_EQ(velocities[1], -0.5);
+  EXPECT_DOUBLE_EQ(positions[1], -0.05);
+
+  // Moving away from the limit is not braked
+  limits_.reset({0.9, 0.0}, {-1.5, 0.0});
+  positions = {0.85, 0.0};
+  velocities = {-2.0, 0.0};
+  limits_.enforce(positions, velocities, accelerations, 0.1);
+  EXPECT_DOUBLE_EQ(velocities[0], -2.0);
+  EXPECT_DOUBLE_EQ(positions[0], 0.85);
+}
+
+TEST_F(AdmittanceJointLimitsTest, repels_from_position_limits)
+{
+  // Without acceleration limits, so that the rate limits do not hide the repulsive velocity; depths 0.05 and 0.08
+  limits_.configure({-1.0, -1.0}, {1.0, 1.0}, {2.0, 2.0},
+                    {AdmittanceJointLimits::NO_LIMIT, AdmittanceJointLimits::NO_LIMIT});
+  limits_.configure_braking(false, 0.1, 5.0);
+  limits_.reset({0.95, -0.98}, {0.0, 0.0});
+  std::vector<double> positions = {0.95, -0.98};
+  std::vector<double> velocities = {0.0, 0.0};
+  std::vector<double> accelerations;
+  limits_.enforce(positions, velocities, accelerations, 0.01);
+  EXPECT_NEAR(velocities[0], -0.25, 1e-12);
+  EXPECT_NEAR(positions[0], 0.95 - 0.0025, 1e-12);
+  EXPECT_NEAR(velocities[1], 0.4, 1e-12);
+  EXPECT_NEAR(positions[1], -0.98 + 0.004, 1e-12);
+}
@@ -0,0 +1,135 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "mock_ik_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+// Gain validation of the parameter callback and of the activation, without a controller manager
+
+namespace
+{
+const std::vector<std::string> AXES = {"x", "y", "z", "rx", "ry", "rz"};
+constexpr double MASS = 3.0;
+}  // namespace
+
+class AdmittanceParametersTest : public ::testing::Test
+{
+public:
+  static void TearDownTestCase()
+  {
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  void SetUp() override
+  {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+    std::vector<rclcpp::Parameter> overrides = {
+      {"IK.base", "base_link"},
+      {"IK.group_name", "ur_manipulator"},
+      {"IK.plugin_name", "admittance_controller_test/MockIKPlugin"},
+      {"control_frame", "tool0"},
+      {"sensor_frame", "tool0"},
+      {"open_loop_control", false},
+      {"enable_parameter_update_without_reactivation", true},
+    };
+    for (const auto & axis : AXES) {
+      overrides.emplace_back("admittance.selected_axes." + axis, true);
+      overrides.emplace_back("admittance.mass." + axis, MASS);
+      overrides.emplace_back("admittance.stiffness." + axis, 50.0);
+      overrides.emplace_back("admittance.damping_ratio." + axis, 1.0);
+    }
+    node_ = std::make_shared<rclcpp_lifecycle::LifecycleNode>(
+      "test_admittance_parameters", rclcpp::NodeOptions().parameter_overrides(overrides));
+
+    rule_ = std::make_unique<admittance_controller::AdmittanceRule>();
+    rule_->parameters_.initialize(node_);
+    rule_->parameters_.declare_parameters();
+    ASSERT_TRUE(rule_->parameters_.get_parameters());
+    ASSERT_EQ(
+      rule_->configure(node_, std::make_unique<admittance_controller_test::MockIKPlugin>()),
+      controller_interface::return_type::OK);
+  }
+
+  admittance_controller::AdmittanceParameters & parameters() {return rule_->parameters_;}
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<admittance_controller::AdmittanceRule> rule_;
+};
+
+TEST_F(AdmittanceParametersTest, valid_gains_are_stored)
+{
+  const auto result = parameters().set_parameters_if_gains_valid({{"admittance.mass.x", 2.0}}, true);
+  EXPECT_TRUE(result.successful) << result.reason;
+  EXPECT_EQ(parameters().mass_[0], 2.0);
+  EXPECT_EQ(rule_->reset(), controller_interface::return_type::OK);
+}
+
+TEST_F(AdmittanceParametersTest, gains_are_kept_for_the_next_activation)
+{
+  const auto result = parameters().set_parameters_if_gains_valid({{"admittance.mass.x", 2.0}}, false);
+  EXPECT_TRUE(result.successful) << result.reason;
+  EXPECT_EQ(parameters().mass_[0], MASS);
+
+  // Activation stores the gains of the handler
+  parameters().update_gain_storage();
+  EXPECT_EQ(parameters().mass_[0], 2.0);
+}
+
+TEST_F(AdmittanceParametersTest, invalid_gains_are_rejected_and_rolled_back)
+{
+  const auto stiffness = parameters().stiffness_;
+  const auto damping = parameters().damping_;
+  for (const double mass : {-1.0, 0.0, std::numeric_limits<double>::infinity()}) {
+    const auto result = parameters().set_parameters_if_gains_valid(
+      {{"admittance.stiffness.y", 10.0}, {"admittance.mass.x", mass}}, true);
+    EXPECT_FALSE(result.successful) << mass;
+    EXPECT_EQ(parameters().mass_[0], MASS);
+    EXPECT_EQ(parameters().stiffness_, stiffness);
+    EXPECT_EQ(parameters().damping_, damping);
+
+    // The handler does not keep the rejected values either, e.g. for the next activation
+    parameters().update_gain_storage();
+    EXPECT_EQ(parameters().mass_[0], MASS);
+    EXPECT_EQ(parameters().stiffness_, stiffness);
+  }
+  EXPECT_EQ(rule_->reset(), controller_interface::return_type::OK);
+
+  // An unselected axis may have any mass
+  EXPECT_TRUE(parameters().set_parameters_if_gains_valid(
+      {{"admittance.selected_axes.x", false}, {"admittance.mass.x", 0.0}}, true).successful);
+}
+
+TEST_F(AdmittanceParametersTest, reset_fails_with_invalid_gains)
+{
+  parameters().mass_[2] = 0.0;
+  EXPECT_EQ(rule_->reset(), controller_interface::return_type::ERROR);
+  parameters().mass_[2] = MASS;
+  EXPECT_EQ(rule_->reset(), controller_interface::return_type::OK);
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <array>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_profiles.hpp"
+
+using admittance_controller::AdmittanceParameterSnapshot;
+using admittance_controller::AdmittanceProfiles;
+using admittance_controller::make_parameter_snapshot;
+
+namespace
+{
+AdmittanceParameterSnapshot make_gains(const std::array<bool, 6> & selected_axes, double mass, double gain)
+{
+  std::array<double, 6> masses;
+  std::array<double, 6> gains;
+  masses.fill(mass);
+  gains.fill(gain);
+  AdmittanceParameterSnapshot snapshot;
+  EXPECT_TRUE(make_parameter_snapshot(selected_axes, masses, gains, gains, snapshot));
+  return snapshot;
+}
+
+const std::array<bool, 6> ALL_AXES = {true, true, true, true, true, true};
+const std::array<bool, 6> Z_ONLY = {false, false, true, false, false, false};
+
+class AdmittanceProfilesTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    parameters_ = make_gains(ALL_AXES, 1.0, 1.0);
+    // Transport: light and soft on all axes; insertion: heavy and stiff along z only
+    profiles_.configure({"transport", "insertion"}, {make_gains(ALL_AXES, 2.0, 10.0), make_gains(Z_ONLY, 4.0, 30.0)});
+  }
+
+  AdmittanceParameterSnapshot parameters_;
+  AdmittanceProfiles profiles_;
+};
+}  // namespace
+
+TEST(AdmittanceParameterSnapshotTest, unselected_axes_have_zero_gains)
+{
+  const auto nan = std::numeric_limits<double>::quiet_NaN();
+  AdmittanceParameterSnapshot snapshot;
+  EXPECT_TRUE(make_parameter_snapshot(
+      Z_ONLY, {nan, nan, 4.0, nan, nan, nan}, {nan, nan, 2.0, nan, nan, nan}, {nan, nan, 8.0, nan, nan, nan},
+      snapshot));
+  EXPECT_EQ(snapshot.axis_mask, admittance_controller::Z_AXIS_MASK);
+  EXPECT_EQ(snapshot.inverse_mass[2], 0.25);
+  EXPECT_EQ(snapshot.damping[2], 2.0);
+  EXPECT_EQ(snapshot.stiffness[2], 8.0);
+  EXPECT_EQ(snapshot.inverse_mass[0], 0.0);
+  EXPECT_EQ(snapshot.damping[5], 0.0);
+
+  EXPECT_FALSE(make_parameter_snapshot(
+      Z_ONLY, {1.0, 1.0, 0.0, 1.0, 1.0, 1.0}, {1.0, 1.0, 1.0, 1.0, 1.0, 1.0}, {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+      snapshot));
+  EXPECT_FALSE(make_parameter_snapshot(
+      Z_ONLY, {1.0, 1.0, 1.0, 1.0, 1.0, 1.0}, {1.0, 1.0, nan, 1.0, 1.0, 1.0}, {1.0, 1.0, 1.0, 1.0, 1.0, 1.0},
+      snapshot));
+}
+
+TEST_F(AdmittanceProfilesTest, uses_parameter_gains_until_a_profile_is_selected)
+{
+  EXPECT_EQ(profiles_.active(), AdmittanceProfiles::PARAMETERS);
+  EXPECT_EQ(&profiles_.update(parameters_, 0.001), &parameters_);
+
+  AdmittanceProfiles unconfigured;
+  EXPECT_EQ(&unconfigured.update(parameters_, 0.001), &parameters_);
+}
+
+TEST_F(AdmittanceProfilesTest, finds_profiles_by_name)
+{
+  EXPECT_EQ(profiles_.size(), 2u);
+  EXPECT_EQ(profiles_.find("transport"), 0);
+  EXPECT_EQ(profiles_.find("insertion"), 1);
+  EXPECT_EQ(profiles_.find(""), AdmittanceProfiles::PARAMETERS);
+  EXPECT_EQ(profiles_.find("hand_guiding"), AdmittanceProfiles::NOT_FOUND);
+  EXPECT_FALSE(profiles_.request(AdmittanceProfiles::NOT_FOUND, 0.0));
+  EXPECT_FALSE(profiles_.request(2, 0.0));
+}
+
+TEST_F(AdmittanceProfilesTest, switches_at_once_without_transition)
+{
+  ASSERT_TRUE(profiles_.request(1, 0.0));
+  const auto & gains = profiles_.update(parameters_, 0.001);
+  EXPECT_EQ(profiles_.active(), 1);
+  EXPECT_FALSE(profiles_.in_transition());
+  EXPECT_EQ(gains.selected_axes, Z_ONLY);
+  EXPECT_EQ(gains.inverse_mass[2], 0.25);
+  EXPECT_EQ(gains.stiffness[2], 30.0);
+
+  ASSERT_TRUE(profiles_.request(AdmittanceProfiles::PARAMETERS, 0.0));
+  EXPECT_EQ(&profiles_.update(parameters_, 0.001), &parameters_);
+}
+
+TEST_F(AdmittanceProfilesTest, interpolates_within_the_transition)
+{
+  ASSERT_TRUE(profiles_.request(0, 0.0));
+  profiles_.update(parameters_, 0.001);
+
+  // Transport (all axes, 1/m = 0.5, gains 10) to insertion (z only, 1/m = 0.25, gains 30) in 0.1 s
+  ASSERT_TRUE(profiles_.request(1, 0.1));
+  auto gains = profiles_.update(parameters_, 0.025);
+  EXPECT_TRUE(profiles_.in_transition());
+  EXPECT_EQ(gains.selected_axes, ALL_AXES);
+  EXPECT_EQ(gains.axis_mask, admittance_controller::ALL_AXES_MASK);
+  EXPECT_DOUBLE_EQ(gains.inverse_mass[2], 0.4375);
+  EXPECT_DOUBLE_EQ(gains.stiffness[2], 15.0);
+  EXPECT_DOUBLE_EQ(gains.damping[0], 7.5);
+  EXPECT_DOUBLE_EQ(gains.inverse_mass[0], 0.375);
+
+  gains = profiles_.update(parameters_, 0.05);
+  EXPECT_DOUBLE_EQ(gains.stiffness[2], 25.0);
+  EXPECT_DOUBLE_EQ(gains.stiffness[0], 2.5);
+
+  gains = profiles_.update(parameters_, 0.025);
+  EXPECT_FALSE(profiles_.in_transition());
+  EXPECT_EQ(gains.selected_axes, Z_ONLY);
+  EXPECT_EQ(gains.axis_mask, admittance_controller::Z_AXIS_MASK);
+  EXPECT_EQ(gains.stiffness[2], 30.0);
+  EXPECT_EQ(gains.stiffness[0], 0.0);
+}
+
+TEST_F(AdmittanceProfilesTest, interrupted_transition_continues_from_current_gains)
+{
+  ASSERT_TRUE(profiles_.request(0, 0.0));
+  profiles_.update(parameters_, 0.001);
+  ASSERT_TRUE(profiles_.request(1, 0.1));
+  EXPECT_DOUBLE_EQ(profiles_.update(parameters_, 0.05).stiffness[2], 20.0);
+
+  // Back to the parameter gains (stiffness 1) from stiffness 20, without a jump
+  ASSERT_TRUE(profiles_.request(AdmittanceProfiles::PARAMETERS, 0.1));
+  EXPECT_DOUBLE_EQ(profiles_.update(parameters_, 0.05).stiffness[2], 10.5);
+  EXPECT_EQ(profiles_.active(), AdmittanceProfiles::PARAMETERS);
+}
+
+TEST_F(AdmittanceProfilesTest, reset_finishes_transition)
+{
+  ASSERT_TRUE(profiles_.request(1, 10.0));
+  profiles_.reset();
+  EXPECT_EQ(profiles_.active(), 1);
+  EXPECT_FALSE(profiles_.in_transition());
+  EXPECT_EQ(profiles_.update(parameters_, 0.001).stiffness[2], 30.0);
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <memory>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "admittance_joint_limits/admittance_joint_limits.hpp"
+#include "mock_ik_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+// The admittance rule and the joint limits in the order of the controller cycle, with the limited state fed back
+
+namespace
+{
+constexpr double DT = 1e-3;
+constexpr double MAX_POSITION = 0.05;
+constexpr double PUSH_FORCE = 30.0;
+}  // namespace
+
+class AdmittanceRuleJointLimitsTest : public ::testing::Test
+{
+public:
+  static void TearDownTestCase()
+  {
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  void SetUp() override
+  {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+    node_ = std::make_shared<rclcpp_lifecycle::LifecycleNode>("test_admittance_rule_joint_limits");
+
+    // The sensor frame is the control frame, so no transforms are needed. At rest under the push force the
+    // spring would hold joint 0 at 0.6, far beyond its limit.
+    rule_ = std::make_unique<admittance_controller::AdmittanceRule>();
+    rule_->parameters_.ik_base_frame_ = "base_link";
+    rule_->parameters_.control_frame_ = "tool0";
+    rule_->parameters_.sensor_frame_ = "tool0";
+    rule_->parameters_.open_loop_control_ = false;
+    rule_->parameters_.selected_axes_.fill(true);
+    rule_->parameters_.mass_ = {3.0, 3.0, 3.0, 0.05, 0.05, 0.05};
+    rule_->parameters_.stiffness_ = {50.0, 50.0, 50.0, 1.0, 1.0, 1.0};
+    rule_->parameters_.damping_ratio_.fill(1.0);
+    rule_->parameters_.convert_damping_ratio_to_damping();
+    ASSERT_EQ(
+      rule_->configure(node_, std::make_unique<admittance_controller_test::MockIKPlugin>()),
+      controller_interface::return_type::OK);
+    ASSERT_EQ(rule_->reset(), controller_interface::return_type::OK);
+
+    limits_.configure(
+      {-1.0, -1.0, -1.0, -1.0, -1.0, -1.0}, {MAX_POSITION, 1.0, 1.0, 1.0, 1.0, 1.0},
+      std::vector<double>(6, 2.0), std::vector<double>(6, 10.0));
+    limits_.reset(std::vector<double>(6, 0.0), std::vector<double>(6, 0.0));
+
+    reference_.positions.assign(6, 0.0);
+    reference_.velocities.assign(6, 0.0);
+    current_ = reference_;
+    desired_ = reference_;
+    desired_.accelerations.assign(6, 0.0);
+  }
+
+  // Cycles of the controller on a robot that follows the command exactly
+  void run(double force_x, size_t num_cycles)
+  {
+    geometry_msgs::msg::Wrench wrench;
+    wrench.force.x = force_x;
+    for (auto i = 0u; i < num_cycles; ++i) {
+      ASSERT_EQ(
+        rule_->update(current_, wrench, reference_, rclcpp::Duration::from_seconds(DT), desired_),
+        controller_interface::return_type::OK);
+      limits_.enforce(desired_.positions, desired_.velocities, desired_.accelerations, DT);
+      rule_->feed_back_limited_joint_state(reference_, desired_);
+      current_.positions = desired_.positions;
+      current_.velocities = desired_.velocities;
+    }
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<admittance_controller::AdmittanceRule> rule_;
+  admittance_joint_limits::AdmittanceJointLimits limits_;
+  trajectory_msgs::msg::JointTrajectoryPoint reference_;
+  trajectory_msgs::msg::JointTrajectoryPoint current_;
+  trajectory_msgs::msg::JointTrajectoryPoint desired_;
+};
+
+TEST_F(AdmittanceRuleJointLimitsTest, does_not_wind_up_against_a_limit)
+{
+  limits_.configure_braking(true, 0.0, 0.0);
+  run(PUSH_FORCE, 2000);
+  EXPECT_NEAR(desired_.positions[0], MAX_POSITION, 1e-6);
+  EXPECT_EQ(desired_.velocities[0], 0.0);
+  // The offset of the rule holds at the limit instead of growing towards the rest position of the spring
+  EXPECT_NEAR(rule_->get_joint_position_offsets()[0], MAX_POSITION, 1e-6);
+
+  // Released, the spring pulls the joint back from the limit right away. Wound up to the rest position of the
+  // spring, the rule would still command the limit after 0.5 s.
+  run(0.0, 500);
+  EXPECT_LT(desired_.positions[0], MAX_POSITION - 0.01);
+  EXPECT_LT(desired_.velocities[0], 0.0);
+}
+
+TEST_F(AdmittanceRuleJointLimitsTest, repulsion_persists_over_cycles)
+{
+  // Repelled for a single cycle only, the push would hold the joint on its limit
+  limits_.configure_braking(true, 0.02, 5.0);
+  run(PUSH_FORCE, 2000);
+  EXPECT_LT(desired_.positions[0], MAX_POSITION - 0.01);
+  EXPECT_GT(desired_.positions[0], MAX_POSITION - 0.02);
+  EXPECT_NEAR(rule_->get_joint_position_offsets()[0], desired_.positions[0], 1e-9);
+}
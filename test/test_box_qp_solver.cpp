@@ -0,0 +1,98 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+
+#include "eigen3/Eigen/Cholesky"
+#include "ik_singularity/box_qp_solver.hpp"
+
+using Solver = ik_singularity::BoxQpSolver<8>;
+
+namespace
+{
+// Karush-Kuhn-Tucker conditions of the box-constrained problem
+void expect_optimal(
+  const Eigen::MatrixXd & hessian, const Eigen::VectorXd & gradient, const Eigen::VectorXd & lower,
+  const Eigen::VectorXd & upper, const Solver::Vector & x)
+{
+  const Eigen::VectorXd slope = hessian * x + gradient;
+  for (auto i = 0; i < x.size(); ++i) {
+    ASSERT_GE(x(i), lower(i));
+    ASSERT_LE(x(i), upper(i));
+    if (x(i) > lower(i) && x(i) < upper(i)) {
+      EXPECT_NEAR(slope(i), 0.0, 1e-10) << "variable " << i;
+    } else if (x(i) == lower(i)) {
+      EXPECT_GE(slope(i), -1e-10) << "variable " << i;
+    } else {
+      EXPECT_LE(slope(i), 1e-10) << "variable " << i;
+    }
+  }
+}
+}  // namespace
+
+TEST(BoxQpSolverTest, matches_unconstrained_minimum_inside_bounds)
+{
+  Eigen::MatrixXd hessian(2, 2);
+  hessian << 2.0, 0.5, 0.5, 1.0;
+  const Eigen::Vector2d gradient(-1.0, 0.5);
+  Solver solver;
+  solver.resize(2);
+  Solver::Vector x;
+  ASSERT_TRUE(solver.solve(hessian, gradient, Eigen::Vector2d(-10.0, -10.0), Eigen::Vector2d(10.0, 10.0), x));
+  EXPECT_TRUE(x.isApprox(hessian.llt().solve(-gradient)));
+  EXPECT_EQ(solver.iterations(), 1);
+}
+
+TEST(BoxQpSolverTest, solves_random_problems_and_warm_starts)
+{
+  std::srand(42);
+  for (auto trial = 0; trial < 50; ++trial) {
+    const Eigen::MatrixXd a = Eigen::MatrixXd::Random(6, 7);
+    const Eigen::MatrixXd hessian = a.transpose() * a + 1e-3 * Eigen::MatrixXd::Identity(7, 7);
+    const Eigen::VectorXd gradient = Eigen::VectorXd::Random(7);
+    const Eigen::VectorXd lower = -0.2 * Eigen::VectorXd::Ones(7) - 0.1 * Eigen::VectorXd::Random(7).cwiseAbs();
+    const Eigen::VectorXd upper = 0.2 * Eigen::VectorXd::Ones(7) + 0.1 * Eigen::VectorXd::Random(7).cwiseAbs();
+    Solver solver;
+    solver.resize(7);
+    Solver::Vector x;
+    ASSERT_TRUE(solver.solve(hessian, gradient, lower, upper, x));
+    expect_optimal(hessian, gradient, lower, upper, x);
+
+    // The working set of the last solve is already optimal
+    const Solver::Vector previous = x;
+    ASSERT_TRUE(solver.solve(hessian, gradient, lower, upper, x));
+    EXPECT_EQ(solver.iterations(), 1);
+    EXPECT_TRUE(x.isApprox(previous));
+  }
+}
+
+TEST(BoxQpSolverTest, holds_fixed_variables_and_rejects_inconsistent_bounds)
+{
+  const Eigen::MatrixXd hessian = Eigen::MatrixXd::Identity(3, 3);
+  const Eigen::Vector3d gradient(-1.0, -1.0, -1.0);
+  Solver solver;
+  solver.resize(3);
+  Solver::Vector x;
+  ASSERT_TRUE(solver.solve(hessian, gradient, Eigen::Vector3d(0.5, -1.0, -1.0), Eigen::Vector3d(0.5, 0.25, 2.0), x));
+  EXPECT_EQ(x(0), 0.5);
+  EXPECT_EQ(x(1), 0.25);
+  EXPECT_DOUBLE_EQ(x(2), 1.0);
+  EXPECT_EQ(solver.bound(1), Solver::Bound::UPPER);
+
+  EXPECT_FALSE(solver.solve(hessian, gradient, Eigen::Vector3d(1.0, 0.0, 0.0), Eigen::Vector3d(0.0, 1.0, 1.0), x));
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "closed_loop_sim.hpp"
+
+using admittance_controller_test::ClosedLoopSim;
+using admittance_controller_test::ClosedLoopSimOptions;
+
+class ClosedLoopSimTest : public ::testing::TestWithParam<double>
+{
+public:
+  static void TearDownTestCase()
+  {
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  ClosedLoopSimOptions short_scenario(double rate)
+  {
+    std::ifstream urdf_file(ADMITTANCE_BENCHMARK_URDF);
+    std::stringstream urdf;
+    urdf << urdf_file.rdbuf();
+
+    ClosedLoopSimOptions options;
+    options.rate = rate;
+    options.duration = 2.0;
+    options.trajectory_period = 2.0;
+    options.robot_description = urdf.str();
+    // push between 0.2 s and 0.8 s, then settle
+    options.wrench_script = {
+      {0.0, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+      {0.2, {0.0, 0.0, -10.0, 0.0, 0.0, 0.0}},
+      {0.8, {0.0, 0.0, -10.0, 0.0, 0.0, 0.0}},
+      {0.85, {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}},
+    };
+    return options;
+  }
+};
+
+TEST_P(ClosedLoopSimTest, runs_scenario_without_errors)
+{
+  const double rate = GetParam();
+  ClosedLoopSim sim(short_scenario(rate));
+  std::string error;
+  ASSERT_TRUE(sim.setup(error)) << error;
+  ASSERT_TRUE(sim.run());
+
+  const auto & result = sim.result();
+  EXPECT_EQ(result.cycles, static_cast<size_t>(2.0 * rate));
+  EXPECT_EQ(result.update_errors, 0u);
+  EXPECT_EQ(sim.update_latency().count(), result.cycles);
+  EXPECT_EQ(sim.cycle_timer().histogram(admittance_controller::UpdatePhase::TOTAL).count(), result.cycles);
+  // The push displaces the robot, which has to stay bounded and return to the reference afterwards
+  EXPECT_GT(result.admittance_displacement_max, 0.0);
+  EXPECT_LT(result.tracking_error_max, 0.5);
+  EXPECT_LT(result.final_tracking_error, 0.5 * result.admittance_displacement_max);
+}
+
+TEST_P(ClosedLoopSimTest, is_deterministic)
+{
+  const double rate = GetParam();
+  ClosedLoopSimOptions options = short_scenario(rate);
+  options.duration = 0.5;
+  std::string error;
+
+  ClosedLoopSim first(options);
+  ASSERT_TRUE(first.setup(error)) << error;
+  ASSERT_TRUE(first.run());
+  ClosedLoopSim second(options);
+  ASSERT_TRUE(second.setup(error)) << error;
+  ASSERT_TRUE(second.run());
+
+  EXPECT_EQ(first.result().tracking_error_rms, second.result().tracking_error_rms);
+  EXPECT_EQ(first.result().admittance_displacement_max, second.result().admittance_displacement_max);
+}
+
+INSTANTIATE_TEST_SUITE_P(Rates, ClosedLoopSimTest, ::testing::Values(1000.0, 10000.0));
+
+TEST(ClosedLoopSimWrenchScriptTest, loads_csv)
+{
+  const std::string path = testing::TempDir() + "wrench_script.csv";
+  {
+    std::ofstream file(path);
+    file << "# time,fx,fy,fz,tx,ty,tz\n0.0,0,0,0,0,0,0\n0.5,1,2,3,0.1,0.2,0.3\n";
+  }
+  std::vector<admittance_controller_test::WrenchKeyframe> script;
+  std::string error;
+  ASSERT_TRUE(admittance_controller_test::load_wrench_script(path, script, error)) << error;
+  ASSERT_EQ(script.size(), 2u);
+  EXPECT_DOUBLE_EQ(script[1].time, 0.5);
+  EXPECT_DOUBLE_EQ(script[1].wrench[2], 3.0);
+  EXPECT_DOUBLE_EQ(script[1].wrench[5], 0.3);
+
+  {
+    std::ofstream file(path);
+    file << "0.5,0,0,0,0,0,0\n0.1,0,0,0,0,0,0\n";
+  }
+  EXPECT_FALSE(admittance_controller_test::load_wrench_script(path, script, error));
+}
@@ -0,0 +1,127 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "admittance_controller/contact_event_capture.hpp"
+
+using admittance_controller::ContactEventCapture;
+using admittance_controller::CycleRecord;
+
+namespace
+{
+CycleRecord make_record(int index, double force_z)
+{
+  CycleRecord record{};
+  record.stamp_nanosec = index * 1000000ll;
+  record.period = 0.001;
+  record.wrench_filtered[2] = force_z;
+  return record;
+}
+
+bool wait_for_events(const ContactEventCapture & capture, size_t events)
+{
+  for (int i = 0; i < 200 && capture.num_events() < events; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return capture.num_events() >= events;
+}
+}  // namespace
+
+TEST(ContactEventCaptureTest, force_trigger_dumps_pre_and_post_window)
+{
+  admittance_controller::ContactEventCaptureOptions options;
+  options.pre_trigger_records = 50;
+  options.post_trigger_records = 10;
+  options.force_threshold = 20.0;
+
+  ContactEventCapture capture;
+  ASSERT_TRUE(capture.start(options));
+
+  int index = 0;
+  for (; index < 100; ++index) {
+    EXPECT_FALSE(capture.add(make_record(index, 1.0)));
+  }
+  const int trigger_index = index;
+  EXPECT_TRUE(capture.add(make_record(index++, 25.0)));
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FALSE(capture.add(make_record(index++, 25.0)));
+  }
+  ASSERT_TRUE(wait_for_events(capture, 1));
+  capture.stop();
+
+  const std::string path = "./contact_event_" + std::to_string(trigger_index * 1000000ll) + "_force.bin";
+  admittance_controller::FlightLogReader reader;
+  ASSERT_TRUE(reader.open(path)) << reader.error();
+  EXPECT_EQ(reader.header().num_records, 60u);
+
+  // The window ends with the post-trigger records and starts with the pre-trigger history
+  int64_t expected_stamp = (trigger_index + 11 - 60) * 1000000ll;
+  EXPECT_TRUE(reader.for_each_record([&](const uint8_t * data) {
+      CycleRecord record;
+      std::memcpy(&record, data, sizeof(record));
+      EXPECT_EQ(record.stamp_nanosec, expected_stamp);
+      expected_stamp += 1000000ll;
+    }));
+  std::remove(path.c_str());
+}
+
+TEST(ContactEventCaptureTest, derivative_trigger_needs_full_pre_trigger_window)
+{
+  admittance_controller::ContactEventCaptureOptions options;
+  options.pre_trigger_records = 20;
+  options.post_trigger_records = 0;
+  options.force_derivative_threshold = 1000.0;  // 1 N per 1 ms cycle
+
+  ContactEventCapture capture;
+  ASSERT_TRUE(capture.start(options));
+
+  // Jump in the first cycles does not trigger because there is no history yet
+  EXPECT_FALSE(capture.add(make_record(0, 0.0)));
+  EXPECT_FALSE(capture.add(make_record(1, 5.0)));
+  for (int i = 2; i < 30; ++i) {
+    EXPECT_FALSE(capture.add(make_record(i, 5.0)));
+  }
+  EXPECT_TRUE(capture.add(make_record(30, 7.0)));
+  ASSERT_TRUE(wait_for_events(capture, 1));
+  capture.stop();
+  std::remove("./contact_event_30000000_force_derivative.bin");
+}
+
+TEST(ContactEventCaptureTest, tolerance_abort_triggers)
+{
+  admittance_controller::ContactEventCaptureOptions options;
+  options.pre_trigger_records = 5;
+  options.post_trigger_records = 0;
+
+  ContactEventCapture capture;
+  ASSERT_TRUE(capture.start(options));
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_FALSE(capture.add(make_record(i, 0.0)));
+  }
+  auto record = make_record(5, 0.0);
+  record.flags = admittance_controller::CYCLE_FLAG_TOLERANCE_ABORT;
+  EXPECT_TRUE(capture.add(record));
+  ASSERT_TRUE(wait_for_events(capture, 1));
+  capture.stop();
+  std::remove("./contact_event_5000000_tolerance_abort.bin");
+}
@@ -0,0 +1,100 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cstdint>
+
+#include "admittance_controller/cycle_timing.hpp"
+
+using admittance_controller::CycleTimer;
+using admittance_controller::LatencyHistogram;
+using admittance_controller::PhaseTimer;
+using admittance_controller::UpdatePhase;
+
+TEST(CycleTimingTest, bucket_bounds_have_bounded_relative_error)
+{
+  for (uint64_t value = 0; value < (1ull << 22); value += 7) {
+    const auto upper = LatencyHistogram::bucket_upper_bound(LatencyHistogram::bucket_index(value));
+    ASSERT_GE(upper, value);
+    ASSERT_LE(upper - value, value / LatencyHistogram::SUB_BUCKETS);
+  }
+  // Values beyond the range end up in the last bucket
+  EXPECT_EQ(LatencyHistogram::bucket_index(UINT64_MAX), LatencyHistogram::NUM_BUCKETS - 1);
+}
+
+TEST(CycleTimingTest, percentiles_of_uniform_distribution)
+{
+  LatencyHistogram histogram;
+  for (int64_t value = 1; value <= 100000; ++value) {
+    histogram.record(value);
+  }
+  EXPECT_EQ(histogram.count(), 100000u);
+  EXPECT_EQ(histogram.max(), 100000u);
+  EXPECT_DOUBLE_EQ(histogram.mean(), 50000.5);
+  EXPECT_NEAR(histogram.percentile(50.0), 50000.0, 50000.0 / LatencyHistogram::SUB_BUCKETS);
+  EXPECT_NEAR(histogram.percentile(99.0), 99000.0, 99000.0 / LatencyHistogram::SUB_BUCKETS);
+  EXPECT_EQ(histogram.percentile(100.0), 100000u);
+
+  histogram.reset();
+  EXPECT_EQ(histogram.count(), 0u);
+  EXPECT_EQ(histogram.percentile(50.0), 0u);
+}
+
+TEST(CycleTimingTest, phase_timer_records_consecutive_phases)
+{
+  CycleTimer timer;
+  {
+    PhaseTimer phase_timer(&timer, UpdatePhase::INPUT_READ);
+    phase_timer.next(UpdatePhase::HARDWARE_READ);
+    phase_timer.stop();
+    phase_timer.next(UpdatePhase::STATE_PUBLISH);
+  }
+  EXPECT_EQ(timer.histogram(UpdatePhase::INPUT_READ).count(), 1u);
+  EXPECT_EQ(timer.histogram(UpdatePhase::HARDWARE_READ).count(), 1u);
+  EXPECT_EQ(timer.histogram(UpdatePhase::STATE_PUBLISH).count(), 1u);
+  EXPECT_EQ(timer.histogram(UpdatePhase::TOTAL).count(), 0u);
+
+  // Nothing is recorded while disabled or without a timer
+  timer.set_enabled(false);
+  {
+    PhaseTimer phase_timer(&timer, UpdatePhase::INPUT_READ);
+    PhaseTimer no_timer(nullptr, UpdatePhase::INPUT_READ);
+    no_timer.next(UpdatePhase::HARDWARE_READ);
+  }
+  EXPECT_EQ(timer.histogram(UpdatePhase::INPUT_READ).count(), 1u);
+}
+
+TEST(CycleTimingTest, perf_counters_are_summed_per_phase)
+{
+  admittance_controller::PerfCounters counters;
+  if (!counters.open()) {
+    GTEST_SKIP() << counters.error();
+  }
+  CycleTimer timer;
+  timer.set_perf_counters(&counters);
+  volatile double sum = 0.0;
+  {
+    PhaseTimer phase_timer(&timer, UpdatePhase::ADMITTANCE_UPDATE);
+    for (int i = 0; i < 100000; ++i) {
+      sum = sum + i;
+    }
+  }
+  const auto & totals = timer.perf_totals(UpdatePhase::ADMITTANCE_UPDATE);
+  EXPECT_EQ(totals.calls(), 1u);
+  EXPECT_GT(totals.mean().instructions, 100000u);
+  EXPECT_EQ(timer.perf_totals(UpdatePhase::TOTAL).calls(), 0u);
+}
@@ -0,0 +1,143 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <sys/resource.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "admittance_controller/flight_recorder.hpp"
+
+using admittance_controller::CycleRecord;
+using admittance_controller::FlightLogCompression;
+
+namespace
+{
+CycleRecord make_record(int index)
+{
+  CycleRecord record{};
+  record.stamp_nanosec = index * 1000000ll;
+  record.update_duration_nanosec = 20000 + index % 7;
+  record.period = 0.001;
+  record.num_joints = 6;
+  record.wrench_raw[2] = 0.01 * index;
+  record.joint_desired_positions[5] = -0.5 * index;
+  return record;
+}
+
+void write_and_read_back(FlightLogCompression compression)
+{
+  const std::string path = "test_flight_recorder.bin";
+  const int num_records = 2500;
+
+  admittance_controller::FlightRecorderOptions options;
+  options.compression = compression;
+  options.buffer_size = 256;
+  options.records_per_chunk = 100;
+
+  admittance_controller::FlightRecorder recorder;
+  ASSERT_TRUE(recorder.start(path, options));
+  for (int i = 0; i < num_records; ++i) {
+    while (!recorder.record(make_record(i))) {}
+  }
+  recorder.stop();
+
+  admittance_controller::FlightLogReader reader;
+  ASSERT_TRUE(reader.open(path)) << reader.error();
+  EXPECT_EQ(reader.header().num_records, static_cast<uint64_t>(num_records));
+  EXPECT_EQ(reader.header().record_size, sizeof(CycleRecord));
+  ASSERT_NE(reader.find_field("wrench_raw"), nullptr);
+  EXPECT_EQ(reader.find_field("wrench_raw")->count, 6u);
+
+  int index = 0;
+  EXPECT_TRUE(reader.for_each_record([&](const uint8_t * data) {
+      CycleRecord record;
+      std::memcpy(&record, data, sizeof(record));
+      const CycleRecord expected = make_record(index++);
+      EXPECT_EQ(std::memcmp(&record, &expected, sizeof(record)), 0);
+    })) << reader.error();
+  EXPECT_EQ(index, num_records);
+
+  std::remove(path.c_str());
+}
+}  // namespace
+
+TEST(FlightRecorderTest, uncompressed_round_trip)
+{
+  write_and_read_back(FlightLogCompression::NONE);
+}
+
+TEST(FlightRecorderTest, delta_compressed_round_trip)
+{
+  write_and_read_back(FlightLogCompression::XOR_DELTA);
+}
+
+TEST(FlightRecorderTest, records_are_rejected_when_not_running)
+{
+  admittance_controller::FlightRecorder recorder;
+  EXPECT_FALSE(recorder.record(make_record(0)));
+}
+
+TEST(FlightRecorderTest, counts_records_that_could_not_be_written)
+{
+  const std::string path = "test_flight_recorder_full.bin";
+  const int num_records = 10000;
+
+  // A file size limit stands in for a full disk: growing the log past it fails instead of raising SIGXFSZ
+  rlimit previous_limit;
+  ASSERT_EQ(getrlimit(RLIMIT_FSIZE, &previous_limit), 0);
+  rlimit limit = previous_limit;
+  limit.rlim_cur = 5 * 1024 * 1024;
+  const auto previous_handler = std::signal(SIGXFSZ, SIG_IGN);
+  ASSERT_EQ(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+  admittance_controller::FlightRecorderOptions options;
+  options.compression = FlightLogCompression::NONE;
+  options.buffer_size = 256;
+  options.records_per_chunk = 100;
+  admittance_controller::FlightRecorder recorder;
+  ASSERT_TRUE(recorder.start(path, options));
+  for (int i = 0; i < num_records; ++i) {
+    while (!recorder.record(make_record(i))) {}
+  }
+  recorder.stop();
+
+  setrlimit(RLIMIT_FSIZE, &previous_limit);
+  std::signal(SIGXFSZ, previous_handler);
+
+  admittance_controller::FlightLogReader reader;
+  ASSERT_TRUE(reader.open(path)) << reader.error();
+  const auto & header = reader.header();
+  EXPECT_GT(header.lost_records, 0u);
+  EXPECT_EQ(header.lost_records, recorder.write_failures());
+  EXPECT_EQ(header.num_records + header.lost_records, static_cast<uint64_t>(num_records));
+
+  // The records before the failure are intact
+  uint64_t index = 0;
+  EXPECT_TRUE(reader.for_each_record([&](const uint8_t * data) {
+      CycleRecord record;
+      std::memcpy(&record, data, sizeof(record));
+      const CycleRecord expected = make_record(static_cast<int>(index++));
+      EXPECT_EQ(std::memcmp(&record, &expected, sizeof(record)), 0);
+    })) << reader.error();
+  EXPECT_EQ(index, header.num_records);
+
+  std::remove(path.c_str());
+}
@@ -0,0 +1,367 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "eigen3/Eigen/Core"
+#include "geometry_msgs/msg/transform_stamped.hpp"
+#include "ik_eigen_interface/ik_eigen_interface.hpp"
+#include "ik_interface/ik_plugin_base.hpp"
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
+#include "pluginlib/class_loader.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "trajectory_msgs/msg/joint_trajectory_point.hpp"
+
+// Conformance of every differential IK plugin declared to pluginlib: all of them run on the same random joint states
+// and Cartesian deltas of a UR5e and have to agree with each other, and the latency of each call is reported. The
+// plugins are found through the ament index, so source the workspace first.
+
+namespace
+{
+
+const std::array<double, 6> NOMINAL_JOINT_POSITIONS = {0.0, -1.57, 1.57, -1.57, -1.57, 0.0};
+// Random offsets from the nominal pose stay clear of the elbow and wrist singularities
+constexpr double JOINT_OFFSET = 0.5;
+constexpr double CARTESIAN_DELTA = 0.01;
+constexpr size_t NUM_STATES = 50;
+constexpr size_t LATENCY_REPETITIONS = 200;
+constexpr double TOLERANCE = 1e-9;
+const std::string PACKAGE = "admittance_controller";
+
+struct LoadedPlugin
+{
+  std::string name;
+  std::unique_ptr<ik_interface::IKBaseClass> ik;
+};
+
+Eigen::Map<const Eigen::VectorXd> as_eigen(const std::vector<double> & vector)
+{
+  return Eigen::Map<const Eigen::VectorXd>(vector.data(), static_cast<Eigen::Index>(vector.size()));
+}
+
+}  // namespace
+
+class IkPluginConformance : public ::testing::Test
+{
+public:
+  static void SetUpTestCase()
+  {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+    std::ifstream urdf_file(ADMITTANCE_BENCHMARK_URDF);
+    std::stringstream urdf;
+    urdf << urdf_file.rdbuf();
+    std::ifstream srdf_file(ADMITTANCE_BENCHMARK_SRDF);
+    std::stringstream srdf;
+    srdf << srdf_file.rdbuf();
+    // Pseudoinverses without singularity scaling, so that all plugins have the same answer. A constant damping
+    // must be positive to be valid; at 1e-12 it is far below the tolerance near the nominal configuration.
+    auto options = rclcpp::NodeOptions()
+      .automatically_declare_parameters_from_overrides(true)
+      .parameter_overrides({
+        {"robot_description", urdf.str()},
+        {"robot_description_semantic", srdf.str()},
+        {"IK.singularity.enable", false},
+        {"IK.damping.measure", "constant"},
+        {"IK.damping.min", 1e-12},
+      });
+    node_ = std::make_shared<rclcpp_lifecycle::LifecycleNode>("test_ik_plugin_conformance", options);
+
+    loader_ = std::make_unique<pluginlib::ClassLoader<ik_interface::IKBaseClass>>(
+      "ik_interface", "ik_interface::IKBaseClass");
+    for (const auto & name : loader_->getDeclaredClasses()) {
+      LoadedPlugin plugin{name, nullptr};
+      try {
+        plugin.ik.reset(loader_->createUnmanagedInstance(name));
+      } catch (const pluginlib::PluginlibException & ex) {
+        load_errors_.push_back(name + ": " + ex.what());
+        continue;
+      }
+      // Plugins of other packages may not support this robot; the ones of this package have to
+      if (!plugin.ik->initialize(node_, "ur_manipulator")) {
+        if (loader_->getClassPackage(name) == PACKAGE) {
+          load_errors_.push_back(name + ": initialize failed");
+        } else {
+          std::printf("Skipping %s, it does not initialize on the UR5e\n", name.c_str());
+        }
+        continue;
+      }
+      plugins_.push_back(std::move(plugin));
+    }
+
+    std::mt19937 generator(42);
+    std::uniform_real_distribution<double> joint_offset(-JOINT_OFFSET, JOINT_OFFSET);
+    std::uniform_real_distribution<double> cartesian_delta(-CARTESIAN_DELTA, CARTESIAN_DELTA);
+    joint_states_.resize(NUM_STATES);
+    cartesian_deltas_.resize(NUM_STATES);
+    for (auto i = 0u; i < NUM_STATES; ++i) {
+      for (auto position : NOMINAL_JOINT_POSITIONS) {
+        joint_states_[i].positions.push_back(position + joint_offset(generator));
+      }
+      for (auto j = 0u; j < 6; ++j) {
+        cartesian_deltas_[i].push_back(cartesian_delta(generator));
+      }
+    }
+    identity_transform_.header.frame_id = "base_link";
+    identity_transform_.transform.rotation.w = 1.0;
+  }
+
+  static void TearDownTestCase()
+  {
+    // The instances have to go before the loader that holds their libraries
+    plugins_.clear();
+    loader_.reset();
+    node_.reset();
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  void SetUp() override
+  {
+    ASSERT_THAT(load_errors_, ::testing::IsEmpty());
+    ASSERT_FALSE(plugins_.empty()) << "No differential IK plugin is declared to pluginlib";
+  }
+
+  // Jacobian in the IK base frame through the public interface: column i is the Cartesian delta of a unit delta of
+  // joint i
+  static Eigen::MatrixXd jacobian(ik_interface::IKBaseClass & ik)
+  {
+    Eigen::MatrixXd jacobian(6, 6);
+    for (auto i = 0; i < 6; ++i) {
+      std::vector<double> delta_theta(6, 0.0);
+      delta_theta[i] = 1.0;
+      std::vector<double> delta_x(6);
+      EXPECT_TRUE(ik.convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x));
+      jacobian.col(i) = as_eigen(delta_x);
+    }
+    return jacobian;
+  }
+
+  static std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  static std::unique_ptr<pluginlib::ClassLoader<ik_interface::IKBaseClass>> loader_;
+  static std::vector<LoadedPlugin> plugins_;
+  static std::vector<std::string> load_errors_;
+  static std::vector<trajectory_msgs::msg::JointTrajectoryPoint> joint_states_;
+  static std::vector<std::vector<double>> cartesian_deltas_;
+  static geometry_msgs::msg::TransformStamped identity_transform_;
+};
+
+std::shared_ptr<rclcpp_lifecycle::LifecycleNode> IkPluginConformance::node_;
+std::unique_ptr<pluginlib::ClassLoader<ik_interface::IKBaseClass>> IkPluginConformance::loader_;
+std::vector<LoadedPlugin> IkPluginConformance::plugins_;
+std::vector<std::string> IkPluginConformance::load_errors_;
+std::vector<trajectory_msgs::msg::JointTrajectoryPoint> IkPluginConformance::joint_states_;
+std::vector<std::vector<double>> IkPluginConformance::cartesian_deltas_;
+geometry_msgs::msg::TransformStamped IkPluginConformance::identity_transform_;
+
+TEST_F(IkPluginConformance, jacobians_agree)
+{
+  for (const auto & joint_state : joint_states_) {
+    ASSERT_TRUE(plugins_[0].ik->update_robot_state(joint_state));
+    const Eigen::MatrixXd reference = jacobian(*plugins_[0].ik);
+    for (auto p = 1u; p < plugins_.size(); ++p) {
+      ASSERT_TRUE(plugins_[p].ik->update_robot_state(joint_state));
+      const Eigen::MatrixXd other = jacobian(*plugins_[p].ik);
+      EXPECT_LT((other - reference).cwiseAbs().maxCoeff(), TOLERANCE)
+        << plugins_[p].name << " and " << plugins_[0].name << " differ\n" << other << "\n\n" << reference;
+    }
+  }
+}
+
+TEST_F(IkPluginConformance, end_effector_positions_agree)
+{
+  for (const auto & joint_state : joint_states_) {
+    std::vector<double> reference(6, 0.0);
+    ASSERT_TRUE(plugins_[0].ik->update_robot_state(joint_state));
+    ASSERT_TRUE(plugins_[0].ik->calculate_end_effector_position(reference));
+    for (auto p = 1u; p < plugins_.size(); ++p) {
+      std::vector<double> other(6, 0.0);
+      ASSERT_TRUE(plugins_[p].ik->update_robot_state(joint_state));
+      ASSERT_TRUE(plugins_[p].ik->calculate_end_effector_position(other));
+      for (auto i = 0u; i < 3; ++i) {
+        EXPECT_NEAR(other[i], reference[i], TOLERANCE) << plugins_[p].name << " and " << plugins_[0].name;
+      }
+    }
+  }
+}
+
+TEST_F(IkPluginConformance, joint_deltas_agree_and_round_trip)
+{
+  for (auto s = 0u; s < joint_states_.size(); ++s) {
+    std::vector<double> reference;
+    for (auto & plugin : plugins_) {
+      ASSERT_TRUE(plugin.ik->update_robot_state(joint_states_[s]));
+      std::vector<double> delta_x = cartesian_deltas_[s];
+      std::vector<double> delta_theta(6);
+      ASSERT_TRUE(plugin.ik->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta));
+      std::vector<double> round_trip(6);
+      ASSERT_TRUE(plugin.ik->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, round_trip));
+      EXPECT_LT((as_eigen(round_trip) - as_eigen(cartesian_deltas_[s])).norm(), TOLERANCE) << plugin.name;
+
+      if (reference.empty()) {
+        reference = delta_theta;
+      } else {
+        EXPECT_LT((as_eigen(delta_theta) - as_eigen(reference)).norm(), 1e-6 * as_eigen(reference).norm())
+          << plugin.name << " and " << plugins_[0].name;
+      }
+    }
+  }
+}
+
+TEST_F(IkPluginConformance, eigen_conversions_match_vector_conversions)
+{
+  for (auto & plugin : plugins_) {
+    auto eigen_ik = ik_eigen_interface::get_eigen_interface(plugin.ik.get());
+    if (!eigen_ik) {
+      continue;
+    }
+    for (auto s = 0u; s < joint_states_.size(); ++s) {
+      ASSERT_TRUE(plugin.ik->update_robot_state(joint_states_[s]));
+      std::vector<double> delta_x = cartesian_deltas_[s];
+      std::vector<double> delta_theta(6);
+      ASSERT_TRUE(plugin.ik->convert_cartesian_deltas_to_joint_deltas(delta_x, identity_transform_, delta_theta));
+      Eigen::VectorXd eigen_delta_theta(6);
+      ASSERT_TRUE(eigen_ik->convert_cartesian_deltas_to_joint_deltas(
+          as_eigen(cartesian_deltas_[s]), identity_transform_, eigen_delta_theta));
+      EXPECT_LT((eigen_delta_theta - as_eigen(delta_theta)).norm(), TOLERANCE) << plugin.name;
+
+      std::vector<double> round_trip(6);
+      ASSERT_TRUE(plugin.ik->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, round_trip));
+      Eigen::VectorXd eigen_round_trip(6);
+      ASSERT_TRUE(eigen_ik->convert_joint_deltas_to_cartesian_deltas(
+          eigen_delta_theta, identity_transform_, eigen_round_trip));
+      EXPECT_LT((eigen_round_trip - as_eigen(round_trip)).norm(), TOLERANCE) << plugin.name;
+
+      // Buffers of the wrong size are rejected instead of written past
+      Eigen::VectorXd too_short(5);
+      EXPECT_FALSE(eigen_ik->convert_cartesian_deltas_to_joint_deltas(
+          as_eigen(cartesian_deltas_[s]), identity_transform_, too_short)) << plugin.name;
+    }
+  }
+}
+
+TEST_F(IkPluginConformance, kinematic_contexts_are_independent_and_lazy)
+{
+  using ik_kinematic_contexts::KinematicContext;
+  for (auto & plugin : plugins_) {
+    auto contexts = ik_kinematic_contexts::get_context_interface(plugin.ik.get());
+    if (!contexts) {
+      continue;
+    }
+    const auto & reference = joint_states_[0];
+    const auto & current = joint_states_[1];
+    std::vector<double> reference_position(6);
+    std::vector<double> current_position(6);
+    contexts->select_kinematic_context(KinematicContext::REFERENCE);
+    ASSERT_TRUE(plugin.ik->update_robot_state(reference));
+    ASSERT_TRUE(plugin.ik->calculate_end_effector_position(reference_position));
+    const Eigen::MatrixXd reference_jacobian = jacobian(*plugin.ik);
+    contexts->select_kinematic_context(KinematicContext::CURRENT);
+    ASSERT_TRUE(plugin.ik->update_robot_state(current));
+    ASSERT_TRUE(plugin.ik->calculate_end_effector_position(current_position));
+    const Eigen::MatrixXd current_jacobian = jacobian(*plugin.ik);
+    ASSERT_GT((as_eigen(reference_position) - as_eigen(current_position)).norm(), CARTESIAN_DELTA) << plugin.name;
+
+    const auto reference_updates = contexts->forward_kinematics_updates(KinematicContext::REFERENCE);
+    const auto current_updates = contexts->forward_kinematics_updates(KinematicContext::CURRENT);
+    const auto reference_jacobian_updates = contexts->jacobian_updates(KinematicContext::REFERENCE);
+    const auto current_jacobian_updates = contexts->jacobian_updates(KinematicContext::CURRENT);
+
+    // Alternating like the rule does neither evicts nor recomputes the other context
+    for (auto cycle = 0; cycle < 3; ++cycle) {
+      std::vector<double> position(6);
+      contexts->select_kinematic_context(KinematicContext::REFERENCE);
+      ASSERT_TRUE(plugin.ik->update_robot_state(reference));
+      ASSERT_TRUE(plugin.ik->calculate_end_effector_position(position));
+      EXPECT_EQ(position, reference_position) << plugin.name;
+      EXPECT_TRUE(jacobian(*plugin.ik).isApprox(reference_jacobian, TOLERANCE)) << plugin.name;
+      contexts->select_kinematic_context(KinematicContext::CURRENT);
+      ASSERT_TRUE(plugin.ik->update_robot_state(current));
+      ASSERT_TRUE(plugin.ik->calculate_end_effector_position(position));
+      EXPECT_EQ(position, current_position) << plugin.name;
+      EXPECT_TRUE(jacobian(*plugin.ik).isApprox(current_jacobian, TOLERANCE)) << plugin.name;
+    }
+    EXPECT_EQ(contexts->forward_kinematics_updates(KinematicContext::REFERENCE), reference_updates) << plugin.name;
+    EXPECT_EQ(contexts->forward_kinematics_updates(KinematicContext::CURRENT), current_updates) << plugin.name;
+    EXPECT_EQ(contexts->jacobian_updates(KinematicContext::REFERENCE), reference_jacobian_updates) << plugin.name;
+    EXPECT_EQ(contexts->jacobian_updates(KinematicContext::CURRENT), current_jacobian_updates) << plugin.name;
+
+    // A changed joint state is recomputed once, in its own context only
+    ASSERT_TRUE(plugin.ik->update_robot_state(joint_states_[2]));
+    ASSERT_TRUE(plugin.ik->calculate_end_effector_position(current_position));
+    jacobian(*plugin.ik);
+    EXPECT_EQ(contexts->forward_kinematics_updates(KinematicContext::CURRENT), current_updates + 1) << plugin.name;
+    EXPECT_EQ(contexts->jacobian_updates(KinematicContext::CURRENT), current_jacobian_updates + 1) << plugin.name;
+    EXPECT_EQ(contexts->forward_kinematics_updates(KinematicContext::REFERENCE), reference_updates) << plugin.name;
+  }
+}
+
+TEST_F(IkPluginConformance, reports_latency_per_call)
+{
+  // Median and 99th percentile of each call in ns, printed and recorded as properties of this test in the XML result
+  auto report = [](const std::string & plugin, const std::string & call, std::vector<int64_t> & samples) {
+      std::sort(samples.begin(), samples.end());
+      const auto median = samples[samples.size() / 2];
+      const auto p99 = samples[samples.size() * 99 / 100];
+      std::printf("%-50s %-42s median %8ld ns  p99 %8ld ns\n", plugin.c_str(), call.c_str(),
+                  static_cast<long>(median), static_cast<long>(p99));
+      RecordProperty(plugin + "." + call + ".median_ns", static_cast<int>(median));
+      RecordProperty(plugin + "." + call + ".p99_ns", static_cast<int>(p99));
+    };
+  auto time = [](auto && call) {
+      const auto start = std::chrono::steady_clock::now();
+      call();
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    };
+
+  for (auto & plugin : plugins_) {
+    std::vector<int64_t> update, end_effector, to_joint, to_cartesian;
+    std::vector<double> delta_theta(6);
+    std::vector<double> delta_x(6);
+    std::vector<double> position(6);
+    for (auto r = 0u; r < LATENCY_REPETITIONS; ++r) {
+      const auto s = r % joint_states_.size();
+      std::vector<double> cartesian_delta = cartesian_deltas_[s];
+      update.push_back(time([&] {plugin.ik->update_robot_state(joint_states_[s]);}));
+      end_effector.push_back(time([&] {plugin.ik->calculate_end_effector_position(position);}));
+      to_joint.push_back(time([&] {
+          plugin.ik->convert_cartesian_deltas_to_joint_deltas(cartesian_delta, identity_transform_, delta_theta);
+        }));
+      to_cartesian.push_back(time([&] {
+          plugin.ik->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x);
+        }));
+    }
+    report(plugin.name, "update_robot_state", update);
+    report(plugin.name, "calculate_end_effector_position", end_effector);
+    report(plugin.name, "convert_cartesian_deltas_to_joint_deltas", to_joint);
+    report(plugin.name, "convert_joint_deltas_to_cartesian_deltas", to_cartesian);
+  }
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <vector>
+
+#include "ik_kinematic_contexts/kinematic_contexts.hpp"
+
+using ik_kinematic_contexts::KinematicContext;
+using ik_kinematic_contexts::KinematicContexts;
+
+TEST(KinematicContextsTest, only_a_changed_state_invalidates_its_context)
+{
+  KinematicContexts contexts;
+  contexts.resize(3);
+  EXPECT_EQ(contexts.index(), static_cast<size_t>(KinematicContext::CURRENT));
+
+  // The first state always counts as a change, even if it is all zeros
+  EXPECT_TRUE(contexts.update({0.0, 0.0, 0.0}));
+  EXPECT_FALSE(contexts.forward_kinematics_valid());
+  contexts.set_forward_kinematics_valid();
+  contexts.set_jacobian_valid();
+
+  EXPECT_FALSE(contexts.update({0.0, 0.0, 0.0}));
+  EXPECT_TRUE(contexts.forward_kinematics_valid());
+  EXPECT_TRUE(contexts.jacobian_valid());
+
+  EXPECT_TRUE(contexts.update({0.0, 0.1, 0.0}));
+  EXPECT_FALSE(contexts.forward_kinematics_valid());
+  EXPECT_FALSE(contexts.jacobian_valid());
+  EXPECT_THAT(contexts.positions(), testing::ElementsAre(0.0, 0.1, 0.0));
+}
+
+TEST(KinematicContextsTest, contexts_keep_their_own_state)
+{
+  KinematicContexts contexts;
+  contexts.resize(2);
+  contexts.update({1.0, 2.0});
+  contexts.set_forward_kinematics_valid();
+
+  contexts.select(KinematicContext::REFERENCE);
+  EXPECT_FALSE(contexts.forward_kinematics_valid());
+  EXPECT_TRUE(contexts.update({3.0, 4.0}));
+  contexts.set_forward_kinematics_valid();
+  contexts.set_forward_kinematics_valid();
+
+  contexts.select(KinematicContext::CURRENT);
+  EXPECT_TRUE(contexts.forward_kinematics_valid());
+  EXPECT_FALSE(contexts.update({1.0, 2.0}));
+  EXPECT_THAT(contexts.positions(), testing::ElementsAre(1.0, 2.0));
+
+  EXPECT_EQ(contexts.forward_kinematics_updates(KinematicContext::CURRENT), 1u);
+  EXPECT_EQ(contexts.forward_kinematics_updates(KinematicContext::REFERENCE), 2u);
+  EXPECT_EQ(contexts.jacobian_updates(KinematicContext::REFERENCE), 0u);
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ik_singularity/manipulability_atlas.hpp"
+
+using ik_singularity::ManipulabilityAtlas;
+using ik_singularity::ManipulabilityAtlasCell;
+using ik_singularity::ManipulabilityAtlasHeader;
+
+namespace
+{
+const std::string PATH = "test_manipulability_atlas.bin";
+
+// Joint 0 over [-1, 1] in 5 points, joint 1 periodic over [-pi, pi) in 8 points, joint 2 not sampled
+ManipulabilityAtlasHeader make_header()
+{
+  ManipulabilityAtlasHeader header = {};
+  std::memcpy(header.magic, ik_singularity::MANIPULABILITY_ATLAS_MAGIC, sizeof(header.magic));
+  header.version = ik_singularity::MANIPULABILITY_ATLAS_VERSION;
+  header.num_joints = 3;
+  header.counts[0] = 5;
+  header.counts[1] = 8;
+  header.counts[2] = 1;
+  header.periodic[1] = 1;
+  header.min_positions[0] = -1.0;
+  header.max_positions[0] = 1.0;
+  header.min_positions[1] = -M_PI;
+  header.max_positions[1] = M_PI;
+  return header;
+}
+
+// Inverse condition linear in joint 0, the grid index of joint 1 as manipulability
+std::vector<ManipulabilityAtlasCell> make_cells(const ManipulabilityAtlasHeader & header)
+{
+  std::vector<ManipulabilityAtlasCell> cells;
+  for (auto i = 0u; i < header.counts[0]; ++i) {
+    for (auto k = 0u; k < header.counts[1]; ++k) {
+      const double q0 = ik_singularity::manipulability_atlas_position(header, 0, i);
+      cells.push_back({static_cast<float>(k), static_cast<float>(0.5 + 0.25 * q0)});
+    }
+  }
+  return cells;
+}
+
+class ManipulabilityAtlasTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    const auto header = make_header();
+    std::string error;
+    ASSERT_TRUE(ik_singularity::write_manipulability_atlas(PATH, header, make_cells(header), error)) << error;
+    ASSERT_TRUE(atlas_.open(PATH, error)) << error;
+  }
+
+  void TearDown() override
+  {
+    atlas_.close();
+    std::remove(PATH.c_str());
+  }
+
+  ManipulabilityAtlas atlas_;
+};
+}  // namespace
+
+TEST(ManipulabilityAtlasGridTest, places_grid_points)
+{
+  const auto header = make_header();
+  EXPECT_EQ(ik_singularity::manipulability_atlas_cells(header), 40u);
+  EXPECT_DOUBLE_EQ(ik_singularity::manipulability_atlas_position(header, 0, 0), -1.0);
+  EXPECT_DOUBLE_EQ(ik_singularity::manipulability_atlas_position(header, 0, 4), 1.0);
+  // Periodic joints do not repeat the end of the range
+  EXPECT_DOUBLE_EQ(ik_singularity::manipulability_atlas_position(header, 1, 4), 0.0);
+  EXPECT_DOUBLE_EQ(ik_singularity::manipulability_atlas_position(header, 1, 7), 0.75 * M_PI);
+  EXPECT_DOUBLE_EQ(ik_singularity::manipulability_atlas_position(header, 2, 0), 0.0);
+}
+
+TEST_F(ManipulabilityAtlasTest, interpolates_with_gradient)
+{
+  ASSERT_EQ(atlas_.num_joints(), 3u);
+  const double positions[3] = {0.3, 0.25 * M_PI + 0.1, 42.0};
+  double gradient[3];
+  const auto sample = atlas_.lookup(positions, gradient);
+  EXPECT_NEAR(sample.inverse_condition, 0.5 + 0.25 * 0.3, 1e-6);
+  EXPECT_NEAR(sample.condition(), 1.0 / (0.5 + 0.25 * 0.3), 1e-5);
+  // pi / 4 is grid point 5 of joint 1
+  EXPECT_NEAR(sample.manipulability, 5.0 + 0.1 / (M_PI / 4.0), 1e-6);
+  EXPECT_NEAR(gradient[0], 0.25, 1e-6);
+  EXPECT_NEAR(gradient[1], 0.0, 1e-6);
+  EXPECT_EQ(gradient[2], 0.0);
+}
+
+TEST_F(ManipulabilityAtlasTest, wraps_periodic_and_clamps_bounded_joints)
+{
+  // Halfway between the last grid point of joint 1 and the first one, one turn further
+  const double wrapped[3] = {0.0, 0.875 * M_PI + 2.0 * M_PI, 0.0};
+  EXPECT_NEAR(atlas_.lookup(wrapped).manipulability, 3.5, 1e-6);
+
+  const double beyond[3] = {2.0, 0.0, 0.0};
+  double gradient[3];
+  const auto sample = atlas_.lookup(beyond, gradient);
+  EXPECT_NEAR(sample.inverse_condition, 0.75, 1e-6);
+  EXPECT_EQ(gradient[0], 0.0);
+}
+
+TEST(ManipulabilityAtlasFileTest, rejects_invalid_files)
+{
+  ManipulabilityAtlas atlas;
+  std::string error;
+  EXPECT_FALSE(atlas.open("does_not_exist.bin", error));
+
+  auto header = make_header();
+  const auto cells = make_cells(header);
+  EXPECT_FALSE(ik_singularity::write_manipulability_atlas(PATH, header, {cells.begin(), cells.end() - 1}, error));
+
+  // Valid header, truncated cells
+  {
+    std::ofstream file(PATH, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(cells.data()), sizeof(ManipulabilityAtlasCell));
+  }
+  EXPECT_FALSE(atlas.open(PATH, error));
+  EXPECT_FALSE(atlas.is_open());
+
+  header.magic[0] = 'X';
+  ASSERT_TRUE(ik_singularity::write_manipulability_atlas(PATH, header, cells, error)) << error;
+  EXPECT_FALSE(atlas.open(PATH, error));
+  std::remove(PATH.c_str());
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cmath>
+#include <vector>
+
+#include "eigen3/Eigen/Geometry"
+#include "eigen3/Eigen/SVD"
+#include "ik_singularity/null_space_objectives.hpp"
+
+namespace
+{
+// Standard DH parameters (a, alpha, d) of a 7-DOF arm
+const double DH[7][3] = {
+  {0.0, -M_PI / 2, 0.333}, {0.0, M_PI / 2, 0.0}, {0.0825, M_PI / 2, 0.316}, {-0.0825, -M_PI / 2, 0.0},
+  {0.0, M_PI / 2, 0.384}, {0.088, M_PI / 2, 0.0}, {0.0, 0.0, 0.107}};
+const std::vector<double> POSITIONS = {0.1, -0.4, 0.3, -1.8, 0.2, 1.5, 0.6};
+
+// Geometric Jacobian of the tip in the base frame, linear rows first
+Eigen::MatrixXd jacobian(const std::vector<double> & q)
+{
+  std::vector<Eigen::Isometry3d> frames(1, Eigen::Isometry3d::Identity());
+  for (auto i = 0ul; i < 7; ++i) {
+    Eigen::Isometry3d link = Eigen::Isometry3d::Identity();
+    link.rotate(Eigen::AngleAxisd(q[i], Eigen::Vector3d::UnitZ()));
+    link.translate(Eigen::Vector3d(0.0, 0.0, DH[i][2]));
+    link.translate(Eigen::Vector3d(DH[i][0], 0.0, 0.0));
+    link.rotate(Eigen::AngleAxisd(DH[i][1], Eigen::Vector3d::UnitX()));
+    frames.push_back(frames.back() * link);
+  }
+  Eigen::MatrixXd j(6, 7);
+  for (auto i = 0; i < 7; ++i) {
+    const Eigen::Vector3d axis = frames[i].rotation().col(2);
+    j.block<3, 1>(0, i) = axis.cross(frames.back().translation() - frames[i].translation());
+    j.block<3, 1>(3, i) = axis;
+  }
+  return j;
+}
+
+double log_manipulability(const std::vector<double> & q)
+{
+  const auto j = jacobian(q);
+  return 0.5 * std::log((j * j.transpose()).determinant());
+}
+}  // namespace
+
+TEST(NullSpaceObjectivesTest, manipulability_gradient_matches_finite_differences)
+{
+  const auto j = jacobian(POSITIONS);
+  const Eigen::MatrixXd inverse = j.completeOrthogonalDecomposition().pseudoInverse();
+  Eigen::VectorXd gradient(7);
+  ik_singularity::log_manipulability_gradient(j, inverse, gradient);
+  for (auto k = 0; k < 7; ++k) {
+    auto above = POSITIONS;
+    auto below = POSITIONS;
+    above[k] += 1e-6;
+    below[k] -= 1e-6;
+    EXPECT_NEAR(gradient(k), (log_manipulability(above) - log_manipulability(below)) / 2e-6, 1e-5) << "joint " << k;
+  }
+}
+
+TEST(NullSpaceObjectivesTest, projection_does_not_move_the_tip)
+{
+  const auto j = jacobian(POSITIONS);
+  const Eigen::JacobiSVD<Eigen::MatrixXd> svd(j, Eigen::ComputeThinU | Eigen::ComputeThinV);
+  Eigen::VectorXd motion = Eigen::VectorXd::LinSpaced(7, -0.3, 0.3);
+  Eigen::VectorXd coefficients(6);
+  ik_singularity::project_onto_null_space(svd.matrixV(), motion, coefficients);
+  EXPECT_GT(motion.norm(), 1e-3);
+  EXPECT_LT((j * motion).norm(), 1e-12);
+
+  const Eigen::VectorXd projected = motion;
+  ik_singularity::project_onto_null_space(svd.matrixV(), motion, coefficients);
+  EXPECT_TRUE(motion.isApprox(projected));
+}
+
+TEST(NullSpaceObjectivesTest, centers_joints_and_approaches_posture)
+{
+  ik_singularity::NullSpaceObjectives objectives;
+  // Joint 1 has no position limits
+  objectives.configure({-1.0, -10.0}, {3.0, 10.0}, {0.5, -0.5}, {2.0, 0.0, 0.0});
+  Eigen::VectorXd motion(2);
+  const Eigen::MatrixXd unused;
+  objectives.motion({2.0, 4.0}, unused, unused, motion);
+  EXPECT_DOUBLE_EQ(motion(0), -2.0 * (2.0 - 1.0) / 16.0);
+  EXPECT_EQ(motion(1), 0.0);
+
+  objectives.configure({-1.0, -10.0}, {3.0, 10.0}, {0.5, -0.5}, {0.0, 0.0, 0.1});
+  objectives.motion({2.0, 4.0}, unused, unused, motion);
+  EXPECT_DOUBLE_EQ(motion(0), -0.15);
+  EXPECT_DOUBLE_EQ(motion(1), -0.45);
+}
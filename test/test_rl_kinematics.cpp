@@ -0,0 +1,178 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+#include "rl_differential_ik_plugin/rl_kinematics.hpp"
+
+using ik_eigen_interface::CartesianQuantity;
+
+namespace
+{
+const std::vector<double> NOMINAL_JOINT_POSITIONS = {0.0, -1.57, 1.57, -1.57, -1.57, 0.0};
+// Upper position limit of the elbow of the UR5e
+constexpr size_t ELBOW = 2;
+constexpr double ELBOW_MAX_POSITION = M_PI;
+// Joints of the redundant arm in chain order, and a configuration away from its singularities
+const std::vector<std::string> ARM7_JOINTS = {
+  "joint_a1", "joint_a2", "joint_a3", "joint_a4", "joint_a5", "joint_a6", "joint_a7"};
+const std::vector<double> ARM7_JOINT_POSITIONS = {0.3, 0.6, -0.2, -1.2, 0.4, 0.9, 0.1};
+
+std::string read_file(const std::string & path)
+{
+  std::ifstream file(path);
+  std::stringstream content;
+  content << file.rdbuf();
+  return content.str();
+}
+}  // namespace
+
+class RLKinematicsTest : public ::testing::Test
+{
+public:
+  static void TearDownTestCase()
+  {
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  void SetUp() override
+  {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+    identity_transform_.header.frame_id = "base_link";
+    identity_transform_.transform.rotation.w = 1.0;
+  }
+
+  // The plugin on \p urdf_path in \p joint_positions, without singularity scaling so that deltas are exact
+  bool initialize(
+    const std::string & urdf_path, const std::vector<double> & joint_positions,
+    std::vector<rclcpp::Parameter> overrides)
+  {
+    overrides.emplace_back("robot_description", read_file(urdf_path));
+    overrides.emplace_back("IK.singularity.enable", false);
+    node_ = std::make_shared<rclcpp_lifecycle::LifecycleNode>(
+      "test_rl_kinematics", rclcpp::NodeOptions().parameter_overrides(overrides));
+    ik_ = std::make_unique<rl_differential_ik_plugin::RLKinematics>();
+    if (!ik_->initialize(node_, "ur_manipulator")) {
+      return false;
+    }
+    trajectory_msgs::msg::JointTrajectoryPoint joint_state;
+    joint_state.positions = joint_positions;
+    return ik_->update_robot_state(joint_state);
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::unique_ptr<rl_differential_ik_plugin::RLKinematics> ik_;
+  geometry_msgs::msg::TransformStamped identity_transform_;
+};
+
+TEST_F(RLKinematicsTest, qp_bounds_joint_deltas_relative_to_the_origin)
+{
+  ASSERT_TRUE(initialize(ADMITTANCE_BENCHMARK_URDF, NOMINAL_JOINT_POSITIONS, {{"IK.qp.enable", true}}));
+
+  // A Cartesian delta that lifts the elbow, which is far from its limits in the robot state
+  Eigen::VectorXd elbow_delta = Eigen::VectorXd::Zero(6);
+  elbow_delta(ELBOW) = 0.01;
+  Eigen::VectorXd delta_x(6);
+  ASSERT_TRUE(ik_->convert_joint_deltas_to_cartesian_deltas(elbow_delta, identity_transform_, delta_x));
+  Eigen::VectorXd unbounded(6);
+  ASSERT_TRUE(ik_->convert_cartesian_to_joint(delta_x, CartesianQuantity::MOTION, identity_transform_, unbounded));
+  EXPECT_NEAR(unbounded(ELBOW), 0.01, 1e-4);
+
+  // Added to positions with the elbow 2 mrad below its limit, e.g. a reference plus an admittance offset
+  Eigen::VectorXd origin = Eigen::Map<const Eigen::VectorXd>(NOMINAL_JOINT_POSITIONS.data(), 6);
+  origin(ELBOW) = ELBOW_MAX_POSITION - 0.002;
+  ik_->set_joint_delta_origin(origin);
+  Eigen::VectorXd bounded(6);
+  ASSERT_TRUE(ik_->convert_cartesian_to_joint(delta_x, CartesianQuantity::MOTION, identity_transform_, bounded));
+  EXPECT_LE(bounded(ELBOW), 0.002 + 1e-9);
+  EXPECT_GT(bounded(ELBOW), 0.001);
+
+  // The origin holds for that motion only
+  Eigen::VectorXd next(6);
+  ASSERT_TRUE(ik_->convert_cartesian_to_joint(delta_x, CartesianQuantity::MOTION, identity_transform_, next));
+  EXPECT_TRUE(next.isApprox(unbounded, 1e-6));
+}
+
+TEST_F(RLKinematicsTest, controls_the_joints_of_the_controller)
+{
+  ASSERT_TRUE(initialize(ARM7_URDF, ARM7_JOINT_POSITIONS, {{"joints", ARM7_JOINTS}}));
+  Eigen::VectorXd delta_theta = Eigen::VectorXd::Constant(7, 0.01);
+  Eigen::VectorXd delta_x(6);
+  EXPECT_TRUE(ik_->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x));
+
+  // Without the parameter all joints of the model
+  ASSERT_TRUE(initialize(ARM7_URDF, ARM7_JOINT_POSITIONS, {}));
+  EXPECT_TRUE(ik_->convert_joint_deltas_to_cartesian_deltas(delta_theta, identity_transform_, delta_x));
+
+  auto reordered = ARM7_JOINTS;
+  std::swap(reordered[0], reordered[1]);
+  EXPECT_FALSE(initialize(ARM7_URDF, ARM7_JOINT_POSITIONS, {{"joints", reordered}}));
+  EXPECT_FALSE(
+    initialize(ARM7_URDF, ARM7_JOINT_POSITIONS, {{"joints", std::vector<std::string>{"joint_a1", "joint_a8"}}}));
+}
+
+TEST_F(RLKinematicsTest, null_space_motion_does_not_move_the_tip_of_a_redundant_arm)
+{
+  ASSERT_TRUE(initialize(ARM7_URDF, ARM7_JOINT_POSITIONS, {
+    {"joints", ARM7_JOINTS},
+    {"IK.null_space.enable", true},
+    {"IK.null_space.posture_gain", 0.1},
+    {"IK.null_space.posture", std::vector<double>(7, 0.0)},
+  }));
+
+  // Without a Cartesian motion only the self-motion towards the posture is left
+  const Eigen::VectorXd no_motion = Eigen::VectorXd::Zero(6);
+  Eigen::VectorXd self_motion(7);
+  ASSERT_TRUE(ik_->convert_cartesian_to_joint(no_motion, CartesianQuantity::MOTION, identity_transform_, self_motion));
+  EXPECT_GT(self_motion.norm(), 1e-4);
+  Eigen::VectorXd tip_motion(6);
+  ASSERT_TRUE(ik_->convert_joint_deltas_to_cartesian_deltas(self_motion, identity_transform_, tip_motion));
+  EXPECT_LT(tip_motion.norm(), 1e-9);
+
+  // Accelerations do not get it
+  Eigen::VectorXd acceleration(7);
+  ASSERT_TRUE(
+    ik_->convert_cartesian_to_joint(no_motion, CartesianQuantity::ACCELERATION, identity_transform_, acceleration));
+  EXPECT_EQ(acceleration.norm(), 0.0);
+}
+
+TEST_F(RLKinematicsTest, no_null_space_motion_without_redundancy)
+{
+  ASSERT_TRUE(initialize(ADMITTANCE_BENCHMARK_URDF, NOMINAL_JOINT_POSITIONS, {
+    {"IK.null_space.enable", true},
+    {"IK.null_space.posture_gain", 0.1},
+    {"IK.null_space.posture", std::vector<double>(6, 0.0)},
+  }));
+  const Eigen::VectorXd no_motion = Eigen::VectorXd::Zero(6);
+  Eigen::VectorXd self_motion(6);
+  ASSERT_TRUE(ik_->convert_cartesian_to_joint(no_motion, CartesianQuantity::MOTION, identity_transform_, self_motion));
+  EXPECT_LT(self_motion.norm(), 1e-12);
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "admittance_controller/admittance_rule.hpp"
+#include "admittance_controller/flight_recorder.hpp"
+#include "admittance_controller/rule_replay.hpp"
+#include "mock_ik_plugin.hpp"
+#include "rclcpp/rclcpp.hpp"
+#include "rclcpp_lifecycle/lifecycle_node.hpp"
+
+using admittance_controller::CycleRecord;
+using admittance_controller::FlightLogCompression;
+using admittance_controller::FlightLogReader;
+using admittance_controller::FlightLogWriter;
+using admittance_controller::RuleReplayOptions;
+using admittance_controller::RuleReplayResult;
+
+class RuleReplayTest : public ::testing::Test
+{
+public:
+  static void TearDownTestCase()
+  {
+    if (rclcpp::ok()) {
+      rclcpp::shutdown();
+    }
+  }
+
+protected:
+  void SetUp() override
+  {
+    if (!rclcpp::ok()) {
+      rclcpp::init(0, nullptr);
+    }
+    node_ = std::make_shared<rclcpp_lifecycle::LifecycleNode>("test_rule_replay");
+  }
+
+  void TearDown() override
+  {
+    for (const auto & path : paths_) {
+      std::remove(path.c_str());
+    }
+  }
+
+  // A rule in the state the controller leaves it in after activation. The sensor frame is the control frame,
+  // so no transforms are needed.
+  std::unique_ptr<admittance_controller::AdmittanceRule> make_rule()
+  {
+    auto rule = std::make_unique<admittance_controller::AdmittanceRule>();
+    rule->parameters_.ik_base_frame_ = "base_link";
+    rule->parameters_.control_frame_ = "tool0";
+    rule->parameters_.sensor_frame_ = "tool0";
+    rule->parameters_.open_loop_control_ = false;
+    rule->parameters_.selected_axes_.fill(true);
+    rule->parameters_.mass_ = {3.0, 3.0, 3.0, 0.05, 0.05, 0.05};
+    rule->parameters_.stiffness_ = {50.0, 50.0, 50.0, 1.0, 1.0, 1.0};
+    rule->parameters_.damping_ratio_.fill(1.0);
+    rule->parameters_.convert_damping_ratio_to_damping();
+    EXPECT_EQ(
+      rule->configure(node_, std::make_unique<admittance_controller_test::MockIKPlugin>()),
+      controller_interface::return_type::OK);
+    rule->reset();
+    return rule;
+  }
+
+  // Cycles as the controller records them: inputs of a push against a moving reference and the rule outputs
+  std::vector<CycleRecord> record_session(size_t num_cycles)
+  {
+    auto rule = make_rule();
+    admittance_controller::RuleReplay recorder(*rule);
+    std::vector<CycleRecord> records(num_cycles);
+    for (auto i = 0u; i < num_cycles; ++i) {
+      const double t = i * 1e-3;
+      CycleRecord input{};
+      input.stamp_nanosec = 1000000000ll + i * 1000000ll;
+      input.cycle_index = i;
+      input.period_nanosec = 1000000;
+      input.period = 1e-3;
+      input.num_joints = 6;
+      input.wrench_raw = {2.0 * std::sin(3.0 * t), 0.0, -10.0 * std::sin(t), 0.0, 0.05, 0.0};
+      for (auto j = 0u; j < 6; ++j) {
+        input.joint_reference_positions[j] = 0.1 * j + 0.2 * std::sin(t + j);
+        input.joint_reference_velocities[j] = 0.2 * std::cos(t + j);
+        input.joint_actual_positions[j] = 0.1 * j + 0.2 * std::sin(t - 0.01 + j);
+        input.joint_actual_velocities[j] = 0.2 * std::cos(t - 0.01 + j);
+      }
+      recorder.step(input, records[i]);
+    }
+    return records;
+  }
+
+  std::string write_log(const std::string & name, const std::vector<CycleRecord> & records)
+  {
+    const std::string path = "test_rule_replay_" + name + ".bin";
+    paths_.push_back(path);
+    FlightLogWriter writer;
+    EXPECT_TRUE(writer.open(path, FlightLogCompression::XOR_DELTA));
+    for (size_t i = 0; i < records.size(); i += 300) {
+      EXPECT_TRUE(writer.write_chunk(records.data() + i, std::min<size_t>(300, records.size() - i)));
+    }
+    EXPECT_TRUE(writer.close());
+    return path;
+  }
+
+  RuleReplayResult replay(
+    const std::string & input_path, const std::string & golden_path, const RuleReplayOptions & options,
+    FlightLogWriter * output = nullptr)
+  {
+    FlightLogReader input;
+    FlightLogReader golden;
+    EXPECT_TRUE(input.open(input_path)) << input.error();
+    EXPECT_TRUE(golden.open(golden_path)) << golden.error();
+    auto rule = make_rule();
+    RuleReplayResult result;
+    admittance_controller::replay_flight_log(*rule, input, golden, options, output, result);
+    return result;
+  }
+
+  std::shared_ptr<rclcpp_lifecycle::LifecycleNode> node_;
+  std::vector<std::string> paths_;
+};
+
+TEST_F(RuleReplayTest, replay_is_bit_exact)
+{
+  const auto path = write_log("session", record_session(2000));
+
+  RuleReplayOptions options;
+  options.bit_exact = true;
+  const auto result = replay(path, path, options);
+  EXPECT_TRUE(result.ok()) << result.error;
+  EXPECT_EQ(result.cycles, 2000u);
+  EXPECT_EQ(result.mismatched_cycles, 0u);
+  EXPECT_EQ(result.max_abs_error, 0.0);
+  EXPECT_NEAR(result.recorded_duration, 2.0, 1e-9);
+}
+
+TEST_F(RuleReplayTest, reports_changed_outputs)
+{
+  auto records = record_session(1000);
+  const auto input_path = write_log("input", records);
+  records[500].joint_desired_positions[2] += 1e-7;
+  records[700].admittance_velocity[0] = std::nextafter(records[700].admittance_velocity[0], 1.0);
+  const auto golden_path = write_log("golden", records);
+
+  RuleReplayOptions options;
+  options.bit_exact = true;
+  auto result = replay(input_path, golden_path, options);
+  EXPECT_TRUE(result.error.empty()) << result.error;
+  EXPECT_EQ(result.cycles, 1000u);
+  EXPECT_EQ(result.mismatched_cycles, 2u);
+  ASSERT_EQ(result.mismatches.size(), 2u);
+  EXPECT_EQ(result.mismatches[0].cycle_index, 500);
+  EXPECT_EQ(result.mismatches[0].field, "joint_desired_positions");
+  EXPECT_EQ(result.mismatches[0].index, 2u);
+  EXPECT_EQ(result.mismatches[1].cycle_index, 700);
+  EXPECT_EQ(result.mismatches[1].field, "admittance_velocity");
+  EXPECT_NEAR(result.max_abs_error, 1e-7, 1e-12);
+
+  // The one-ulp difference is within the tolerance, the other one is not
+  options.bit_exact = false;
+  options.tolerance = 1e-9;
+  result = replay(input_path, golden_path, options);
+  EXPECT_EQ(result.mismatched_cycles, 1u);
+  options.tolerance = 1e-6;
+  result = replay(input_path, golden_path, options);
+  EXPECT_TRUE(result.ok());
+}
+
+TEST_F(RuleReplayTest, stops_at_dropped_records)
+{
+  auto records = record_session(1000);
+  records.erase(records.begin() + 400);
+  const auto path = write_log("dropped", records);
+
+  RuleReplayOptions options;
+  options.bit_exact = true;
+  const auto result = replay(path, path, options);
+  EXPECT_FALSE(result.ok());
+  EXPECT_EQ(result.cycles, 400u);
+  EXPECT_EQ(result.mismatched_cycles, 0u);
+  EXPECT_THAT(result.error, ::testing::HasSubstr("from cycle 399 to cycle 401"));
+}
+
+TEST_F(RuleReplayTest, writes_replayed_log)
+{
+  const auto input_path = write_log("input", record_session(1500));
+  const std::string output_path = "test_rule_replay_output.bin";
+  paths_.push_back(output_path);
+
+  FlightLogWriter writer;
+  ASSERT_TRUE(writer.open(output_path, FlightLogCompression::NONE));
+  RuleReplayOptions options;
+  options.bit_exact = true;
+  EXPECT_TRUE(replay(input_path, input_path, options, &writer).ok());
+  ASSERT_TRUE(writer.close());
+  EXPECT_EQ(writer.num_records(), 1500u);
+
+  // The replayed log is a valid golden log for the recording
+  const auto result = replay(input_path, output_path, options);
+  EXPECT_TRUE(result.ok()) << result.error;
+  EXPECT_EQ(result.cycles, 1500u);
+}
@@ -0,0 +1,140 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <limits>
+
+#include "ik_singularity/singularity_velocity_scaling.hpp"
+
+using ik_singularity::SingularityThresholds;
+using ik_singularity::SingularityVelocityScaling;
+using Vector6d = SingularityVelocityScaling::Vector6d;
+
+namespace
+{
+const Vector6d U = (Vector6d() << 0.0, 0.0, 1.0, 0.0, 0.0, 0.0).finished();
+const Vector6d ALONG_U = 0.01 * U;
+}  // namespace
+
+TEST(SingularityThresholdsTest, requires_increasing_thresholds)
+{
+  EXPECT_TRUE(SingularityThresholds().valid());
+  EXPECT_FALSE((SingularityThresholds{80.0, 20.0, 120.0}.valid()));
+  EXPECT_FALSE((SingularityThresholds{20.0, 120.0, 80.0}.valid()));
+  EXPECT_FALSE((SingularityThresholds{0.0, 80.0, 120.0}.valid()));
+}
+
+TEST(SingularityVelocityScalingTest, full_speed_when_well_conditioned_and_stop_at_hard_limit)
+{
+  SingularityVelocityScaling scaling;
+  EXPECT_EQ(scaling.update(ALONG_U, U, 10.0), 1.0);
+  EXPECT_EQ(scaling.update(-ALONG_U, U, 10.0), 1.0);
+
+  scaling.reset();
+  EXPECT_EQ(scaling.update(-ALONG_U, U, 130.0), 0.0);
+  scaling.reset();
+  EXPECT_EQ(scaling.update(ALONG_U, U, std::numeric_limits<double>::infinity()), 0.0);
+  scaling.reset();
+  EXPECT_EQ(scaling.update(ALONG_U, U, std::numeric_limits<double>::quiet_NaN()), 0.0);
+}
+
+TEST(SingularityVelocityScalingTest, ramps_down_faster_towards_the_singularity)
+{
+  // Without history the singular vector is taken as pointing towards the singularity
+  SingularityVelocityScaling scaling;
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, U, 50.0), 0.5);
+  scaling.reset();
+  EXPECT_DOUBLE_EQ(scaling.update(-ALONG_U, U, 50.0), 0.7);
+  scaling.reset();
+  EXPECT_EQ(scaling.update(ALONG_U, U, 90.0), 0.0);
+}
+
+TEST(SingularityVelocityScalingTest, orients_direction_from_condition_change)
+{
+  SingularityVelocityScaling scaling;
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, U, 30.0), 1.0 - 10.0 / 60.0);
+  // Moving along U lowered the condition number, so U points away from the singularity
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, U, 25.0), 1.0 - 5.0 / 100.0);
+  EXPECT_TRUE(scaling.toward_singularity().isApprox(-U));
+  EXPECT_EQ(scaling.condition(), 25.0);
+}
+
+TEST(SingularityVelocityScalingTest, keeps_sign_of_singular_vector_continuous)
+{
+  SingularityVelocityScaling scaling;
+  scaling.update(ALONG_U, U, 30.0);
+  // The decomposition flipped the vector, and the motion along U raised the condition number
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, -U, 35.0), 1.0 - 15.0 / 60.0);
+  EXPECT_TRUE(scaling.toward_singularity().isApprox(U));
+}
+
+TEST(SingularityVelocityScalingTest, acceleration_and_wrench_do_not_change_direction_history)
+{
+  // Per cycle the rule converts velocity, acceleration and wrench; only the velocity is a motion
+  SingularityVelocityScaling scaling;
+  SingularityVelocityScaling velocity_only;
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, U, 30.0), velocity_only.update(ALONG_U, U, 30.0));
+  // Decelerating away from the singularity, with the vector flipped by the decomposition
+  EXPECT_DOUBLE_EQ(scaling.scale_along(-ALONG_U, -U, 30.0), 1.0 - 10.0 / 100.0);
+  EXPECT_DOUBLE_EQ(scaling.scale_along(ALONG_U, -U, 30.0), 1.0 - 10.0 / 60.0);
+  EXPECT_TRUE(scaling.toward_singularity().isApprox(U));
+
+  // The velocity along U raised the condition number, so U still points towards the singularity
+  EXPECT_DOUBLE_EQ(scaling.update(ALONG_U, U, 35.0), 1.0 - 15.0 / 60.0);
+  EXPECT_DOUBLE_EQ(velocity_only.update(ALONG_U, U, 35.0), 1.0 - 15.0 / 60.0);
+  EXPECT_TRUE(scaling.toward_singularity().isApprox(velocity_only.toward_singularity()));
+  EXPECT_TRUE(scaling.toward_singularity().isApprox(U));
+}
+
+TEST(SingularityVelocityScalingTest, scales_known_direction_without_history)
+{
+  const SingularityVelocityScaling scaling;
+  EXPECT_DOUBLE_EQ(scaling.scale(50.0, true), 0.5);
+  EXPECT_DOUBLE_EQ(scaling.scale(50.0, false), 0.7);
+  EXPECT_EQ(scaling.scale(10.0, true), 1.0);
+  EXPECT_EQ(scaling.scale(120.0, false), 0.0);
+}
+
+TEST(SingularityDampingTest, damps_only_below_threshold)
+{
+  EXPECT_EQ(ik_singularity::damping_for_measure(0.2, 0.1, 0.05), 0.0);
+  EXPECT_EQ(ik_singularity::damping_for_measure(0.1, 0.1, 0.05), 0.0);
+  EXPECT_DOUBLE_EQ(ik_singularity::damping_for_measure(0.05, 0.1, 0.05), 0.0125);
+  EXPECT_DOUBLE_EQ(ik_singularity::damping_for_measure(0.0, 0.1, 0.05), 0.05);
+  EXPECT_DOUBLE_EQ(ik_singularity::damping_for_measure(std::numeric_limits<double>::quiet_NaN(), 0.1, 0.05), 0.05);
+}
+
+TEST(SingularityDampingTest, schedules_damping_from_singular_values)
+{
+  ik_singularity::DampingSchedule schedule;
+  EXPECT_TRUE(schedule.valid());
+  const Eigen::Vector3d well_conditioned(2.0, 1.0, 0.5);
+  const Eigen::Vector3d near_singular(2.0, 1.0, 0.025);
+  EXPECT_EQ(schedule.damping_for_singular_values(well_conditioned), 0.0);
+  EXPECT_DOUBLE_EQ(schedule.damping_for_singular_values(near_singular), 0.0025);
+
+  schedule.measure = ik_singularity::DampingMeasure::MANIPULABILITY;
+  schedule.min_damping = 0.001;
+  schedule.threshold = 0.1;
+  EXPECT_DOUBLE_EQ(schedule.damping_for_singular_values(well_conditioned), 0.001);
+  EXPECT_DOUBLE_EQ(schedule.damping_for_singular_values(near_singular), 0.001 + 0.0025);
+
+  schedule.measure = ik_singularity::DampingMeasure::CONSTANT;
+  EXPECT_DOUBLE_EQ(schedule.damping_for_singular_values(near_singular), 0.001);
+  schedule.min_damping = 0.0;
+  EXPECT_FALSE(schedule.valid());
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "admittance_controller/snapshot_buffer.hpp"
+
+using admittance_controller::SnapshotBuffer;
+
+namespace
+{
+struct Gains
+{
+  uint64_t version;
+  std::array<double, 24> values;
+};
+
+Gains make_gains(uint64_t version)
+{
+  Gains gains;
+  gains.version = version;
+  gains.values.fill(static_cast<double>(version));
+  return gains;
+}
+}  // namespace
+
+TEST(SnapshotBufferTest, default_until_first_write)
+{
+  SnapshotBuffer<Gains> buffer;
+  EXPECT_EQ(buffer.read().version, 0u);
+  EXPECT_EQ(buffer.read().values[23], 0.0);
+  EXPECT_EQ(buffer.published(), 0u);
+}
+
+TEST(SnapshotBufferTest, reader_gets_latest_snapshot)
+{
+  SnapshotBuffer<Gains> buffer;
+  buffer.write(make_gains(1));
+  EXPECT_EQ(buffer.read().version, 1u);
+  EXPECT_EQ(buffer.read().version, 1u);
+
+  buffer.write(make_gains(2));
+  buffer.write(make_gains(3));
+  buffer.write(make_gains(4));
+  EXPECT_EQ(buffer.read().version, 4u);
+  EXPECT_EQ(buffer.published(), 4u);
+}
+
+TEST(SnapshotBufferTest, snapshot_in_use_is_not_overwritten)
+{
+  SnapshotBuffer<Gains> buffer;
+  buffer.write(make_gains(1));
+  const Gains & in_use = buffer.read();
+  for (uint64_t version = 2; version < 10; ++version) {
+    buffer.write(make_gains(version));
+    EXPECT_EQ(in_use.version, 1u);
+    EXPECT_EQ(in_use.values[0], 1.0);
+  }
+  EXPECT_EQ(buffer.read().version, 9u);
+}
+
+TEST(SnapshotBufferTest, concurrent_reader_sees_complete_snapshots)
+{
+  SnapshotBuffer<Gains> buffer;
+  static constexpr uint64_t NUM_WRITES = 200000;
+  std::atomic<bool> done{false};
+
+  std::thread writer([&]() {
+      for (uint64_t version = 1; version <= NUM_WRITES; ++version) {
+        buffer.write(make_gains(version));
+      }
+      done = true;
+    });
+
+  uint64_t last_version = 0;
+  bool torn = false;
+  bool went_back = false;
+  while (!done || last_version != NUM_WRITES) {
+    const Gains & gains = buffer.read();
+    for (const auto value : gains.values) {
+      torn |= value != static_cast<double>(gains.version);
+    }
+    went_back |= gains.version < last_version;
+    last_version = gains.version;
+  }
+  writer.join();
+
+  EXPECT_FALSE(torn);
+  EXPECT_FALSE(went_back);
+  EXPECT_EQ(last_version, NUM_WRITES);
+}
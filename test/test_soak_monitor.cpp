@@ -0,0 +1,120 @@
+// Copyright (c) 2022, PickNik, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+/// \author: Paul Gesel
+
+#include <gmock/gmock.h>
+
+#include "soak_monitor.hpp"
+
+using admittance_controller_test::SoakLimits;
+using admittance_controller_test::SoakMonitor;
+using admittance_controller_test::SoakWindow;
+
+namespace
+{
+SoakWindow steady_window(size_t index)
+{
+  SoakWindow window;
+  window.cycles = (index + 1) * 1000000ull;
+  window.sim_time = (index + 1) * 1000.0;
+  window.rss_bytes = 50u * 1024 * 1024;
+  window.allocations_per_cycle = 12.0;
+  window.p50_us = 20.0;
+  window.p99_us = 30.0;
+  window.p999_us = 40.0;
+  window.max_us = 80.0;
+  window.max_joint_offset = 0.01;
+  return window;
+}
+}  // namespace
+
+TEST(SoakMonitorTest, steady_run_passes)
+{
+  SoakMonitor monitor(SoakLimits{});
+  for (size_t i = 0; i < 20; ++i) {
+    monitor.add_window(steady_window(i));
+  }
+  EXPECT_TRUE(monitor.evaluate());
+  EXPECT_TRUE(monitor.failures().empty());
+}
+
+TEST(SoakMonitorTest, warmup_is_ignored)
+{
+  SoakMonitor monitor(SoakLimits{});
+  for (size_t i = 0; i < 20; ++i) {
+    auto window = steady_window(i);
+    if (i < 2) {
+      window.rss_bytes = 10u * 1024 * 1024;
+      window.p999_us = 5.0;
+    }
+    monitor.add_window(window);
+  }
+  EXPECT_TRUE(monitor.evaluate());
+}
+
+TEST(SoakMonitorTest, fails_on_memory_growth)
+{
+  SoakMonitor monitor(SoakLimits{});
+  for (size_t i = 0; i < 20; ++i) {
+    auto window = steady_window(i);
+    window.rss_bytes += i * 1024 * 1024;
+    monitor.add_window(window);
+  }
+  EXPECT_FALSE(monitor.evaluate());
+  ASSERT_EQ(monitor.failures().size(), 1u);
+  EXPECT_THAT(monitor.failures()[0], ::testing::HasSubstr("RSS grew by 17.0 MiB"));
+}
+
+TEST(SoakMonitorTest, fails_on_latency_drift_but_not_on_single_spikes)
+{
+  SoakMonitor spikes(SoakLimits{});
+  SoakMonitor drift(SoakLimits{});
+  for (size_t i = 0; i < 20; ++i) {
+    auto window = steady_window(i);
+    window.p999_us = i % 5 == 4 ? 400.0 : 40.0;
+    spikes.add_window(window);
+
+    window = steady_window(i);
+    window.p999_us = 40.0 + 5.0 * i;
+    drift.add_window(window);
+  }
+  EXPECT_TRUE(spikes.evaluate());
+  EXPECT_FALSE(drift.evaluate());
+  ASSERT_EQ(drift.failures().size(), 1u);
+  EXPECT_THAT(drift.failures()[0], ::testing::HasSubstr("p99.9 latency drifted"));
+}
+
+TEST(SoakMonitorTest, optional_allocation_and_integrator_limits)
+{
+  SoakLimits limits;
+  limits.max_allocations_per_cycle = 10.0;
+  limits.max_integrator = 0.005;
+  SoakMonitor monitor(limits);
+  for (size_t i = 0; i < 10; ++i) {
+    monitor.add_window(steady_window(i));
+  }
+  EXPECT_FALSE(monitor.evaluate());
+  ASSERT_EQ(monitor.failures().size(), 2u);
+  EXPECT_THAT(monitor.failures()[0], ::testing::HasSubstr("allocations per cycle"));
+  EXPECT_THAT(monitor.failures()[1], ::testing::HasSubstr("integrators"));
+}
+
+TEST(SoakMonitorTest, needs_windows_after_warmup)
+{
+  SoakMonitor monitor(SoakLimits{});
+  monitor.add_window(steady_window(0));
+  monitor.add_window(steady_window(1));
+  EXPECT_FALSE(monitor.evaluate());
+}